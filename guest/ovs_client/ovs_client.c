@@ -159,11 +159,10 @@ int main(int argc, char *argv[])
 		 * The host app will be in charge to periodically check this ring and
 		 * free all the buffers in there. Check example below.
 		 *
-		 * A similar issue may be found in case we needed to allocate buffers
-		 * in the guest. This can be avoided if we added an "alloc" queue
-		 * where the guest could retrieve packets from. The host app will
-		 * be periodically allocating mbufs and adding them to this queue.
-		 * Add this new queue the same way the free_q queue is added.
+		 * Likewise, a guest that needs to build new packets must not call
+		 * rte_pktmbuf_alloc. Instead it should dequeue ready-to-use mbufs
+		 * from the client's alloc queue (ovs_vport_client_lookup_alloc_q),
+		 * which the host keeps topped up.
 		 */
 		if (ret == -ENOBUFS)
 			enqueue_mbufs_to_be_freed(free_q, pkts, pkts_count);
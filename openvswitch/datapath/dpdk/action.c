@@ -90,10 +90,18 @@ action_execute(const struct action *actions, struct rte_mbuf *mbuf)
 			/* need to clone only if multiple OUTPUT case */
 			if (multiple_outputs) {
 				mb = rte_pktmbuf_clone(mbuf, (struct rte_mempool *)mp);
-				if (mb)
+				if (mb) {
 					action_output(&actions[i].data.output, mb);
-				else
+				} else {
+					uint32_t port = actions[i].data.output.port;
+
 					RTE_LOG(ERR, APP, "Failed to clone pktmbuf\n");
+					stats_vswitch_nombuf_increment(INC_BY_1);
+					stats_vswitch_tx_drop_increment(INC_BY_1);
+					if (port < MAX_VPORTS)
+						stats_vport_drop_increment(port,
+						        STATS_DROP_NOMBUF, INC_BY_1);
+				}
 			}
 			else {
 				action_output(&actions[i].data.output, mbuf);
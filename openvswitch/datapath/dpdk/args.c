@@ -51,6 +51,10 @@
 #include "kni.h"
 #include "veth.h"
 #include "vhost.h"
+#include "datapath.h"
+#include "flow.h"
+#include "sched.h"
+#include "stats.h"
 
 #define PORT_OFFSET 0x10
 #define RTE_LOGTYPE_APP RTE_LOGTYPE_USER1
@@ -91,11 +95,13 @@ usage(void)
 {
 	printf(
 	    "%s [EAL options] -- -p PORTMASK -n NUM_CLIENTS [-k NUM_KNI] [-v NUM_VETH]\n"
+	    "    [-h NUM_VHOST] [-m NUM_MEMNIC]\n"
 	    " -p PORTMASK: hexadecimal bitmask of ports to use\n"
 	    " -n NUM_CLIENTS: number of client processes to use\n"
 	    " -k NUM_KNI: number of kni ports to use\n"
 	    " -v NUM_VETH: number of host kni (veth) ports to use\n"
 		" -h NUM_VHOST: number of vhost (devices) ports to use\n"
+		" -m NUM_MEMNIC: number of memnic (shared descriptor ring) ports to use\n"
 		" --vswitchd COREMASK\n"
 		"   CPU ID of the core used to display statistics and communicate with the vswitch daemon\n"
 		" --config (port,queue,lcore)[,(port,queue,lcore]\n"
@@ -113,7 +119,45 @@ usage(void)
 		"   Set the number of retries when sending packets to a vhost device\n"
 		" --vhost_retry_wait WAIT_TIME_US\n"
 		"   Wait time in useconds when retrying to send packets to a vhost device\n"
-	    , progname);
+		" --upcall_rate RATE\n"
+		"   Maximum number of flow misses per second sent to the vswitch daemon for each port.\n"
+		"   Set to 0 for no limit (default)\n"
+		" --upcall_pending_max COUNT\n"
+		"   Maximum number of packets of a flow sent to the vswitch daemon before the flow\n"
+		"   is installed. Set to 0 for no limit (default %u)\n"
+		" --idle_sleep TIME_US\n"
+		"   Maximum time in useconds the vswitchd core sleeps waiting for the vswitch daemon\n"
+		"   when idle. Only used if the core does not switch packets. Set to 0 to busy poll (default)\n"
+		" --rss_hash\n"
+		"   Use the RSS hash computed by the NICs for flow table lookups of physical port traffic\n"
+		" --flow_table_size COUNT\n"
+		"   Maximum number of flows, a power of two (default %u)\n"
+		" --flow_bucket_entries COUNT\n"
+		"   Number of flows in each flow table hash bucket, a power of two up to %u (default %u)\n"
+		" --flow_table_socket SOCKET\n"
+		"   NUMA socket to allocate the flow table on (default: socket of most switching cores)\n"
+		" --mbufs_per_port COUNT\n"
+		"   Number of mbufs allocated for each physical port (default %u)\n"
+		" --mbufs_per_vport COUNT\n"
+		"   Number of mbufs allocated for each client, KNI, vEth and vHost port (default %u)\n"
+		" --jumbo_ports PORTMASK\n"
+		"   Hexadecimal bitmask of physical ports which receive frames of up to %u bytes\n"
+		" --tx_flush (port,time_us)[,(port,time_us)]\n"
+		"   Maximum time in useconds packets wait to fill a burst before being sent on\n"
+		"   each port (default %u)\n"
+		" --rebalance_interval TIME_MS\n"
+		"   Interval in mseconds at which vports are moved from busy to idle switching cores.\n"
+		"   Set to 0 to never move vports (default)\n"
+		" --latency_sample RATE\n"
+		"   Time one in RATE received packets through the switch for each output port.\n"
+		"   Set to 0 to time no packets (default)\n"
+		" --stats_export_interval TIME_MS\n"
+		"   Interval in mseconds at which statistics are exported to shared memory for\n"
+		"   monitoring tools. Set to 0 to export nothing (default %u)\n"
+	    , progname, UPCALL_PENDING_MAX_DEFAULT, FLOW_TABLE_SIZE_DEFAULT,
+	    FLOW_TABLE_BUCKET_ENTRIES_MAX, FLOW_TABLE_BUCKET_ENTRIES_DEFAULT,
+	    MBUFS_PER_PORT_DEFAULT, MBUFS_PER_VPORT_DEFAULT, JUMBO_FRAME_MAX_SIZE,
+	    PORT_FLUSH_PERIOD_US, STATS_EXPORT_INTERVAL_DEFAULT);
 }
 
 /**
@@ -153,6 +197,29 @@ parse_portmask(uint8_t max_ports, const char *portmask)
 	return 0;
 }
 
+/*
+ * Parse the hexadecimal mask of physical ports which receive jumbo frames
+ */
+static int
+parse_jumbo_portmask(const char *portmask)
+{
+	char *end = NULL;
+	unsigned long long pm;
+
+	if (portmask == NULL || *portmask == '\0')
+		return -1;
+
+	pm = strtoull(portmask, &end, 16);
+	if (end == NULL || *end != '\0')
+		return -1;
+	/* a shift by the width of the type is undefined */
+	if (RTE_MAX_ETHPORTS < 64 && (pm >> (RTE_MAX_ETHPORTS % 64)) != 0)
+		return -1;
+
+	jumbo_portmask = pm;
+	return 0;
+}
+
 /**
  * Take the number of clients parameter passed to the app
  * and convert to a number to store in the num_clients variable
@@ -246,6 +313,53 @@ parse_config(const char *q_arg)
 	return 0;
 }
 
+/*
+ * Parse the TX burst deadline of each physical port given as
+ * (port,time_us)[,(port,time_us)]
+ */
+static int
+parse_tx_flush(const char *q_arg)
+{
+	char s[256];
+	const char *p, *p0 = q_arg;
+	char *end;
+	enum fieldnames {
+		FLD_PORT = 0,
+		FLD_TIME,
+		_NUM_FLD
+	};
+	unsigned long int_fld[_NUM_FLD];
+	char *str_fld[_NUM_FLD];
+	int i;
+	unsigned size;
+
+	while ((p = strchr(p0,'(')) != NULL) {
+		++p;
+		if((p0 = strchr(p,')')) == NULL)
+			return -1;
+
+		size = p0 - p;
+		if(size >= sizeof(s))
+			return -1;
+
+		rte_snprintf(s, sizeof(s), "%.*s", size, p);
+		if (rte_strsplit(s, sizeof(s), str_fld, _NUM_FLD, ',') != _NUM_FLD)
+			return -1;
+		for (i = 0; i < _NUM_FLD; i++) {
+			errno = 0;
+			int_fld[i] = strtoul(str_fld[i], &end, 0);
+			if (errno != 0 || end == str_fld[i] || *end != '\0')
+				return -1;
+		}
+		if (int_fld[FLD_PORT] >= MAX_PHYPORTS ||
+		    int_fld[FLD_TIME] > UINT32_MAX)
+			return -1;
+
+		port_tx_flush_us[int_fld[FLD_PORT]] = (uint32_t)int_fld[FLD_TIME];
+	}
+
+	return 0;
+}
 
 /**
  * The application specific arguments follow the DPDK-specific
@@ -267,15 +381,29 @@ parse_app_args(uint8_t max_ports, int argc, char *argv[])
 			{VHOST_CHAR_DEV_IDX, 1, 0, 0},
 			{VHOST_RETRY_COUNT, 1, 0, 0},
 			{VHOST_RETRY_WAIT, 1, 0, 0},
+			{PARAM_UPCALL_RATE, 1, 0, 0},
+			{PARAM_UPCALL_PENDING, 1, 0, 0},
+			{PARAM_IDLE_SLEEP, 1, 0, 0},
+			{PARAM_RSS_HASH, 0, 0, 0},
+			{PARAM_FLOW_TABLE_SIZE, 1, 0, 0},
+			{PARAM_FLOW_BUCKET_ENTRIES, 1, 0, 0},
+			{PARAM_FLOW_TABLE_SOCKET, 1, 0, 0},
+			{PARAM_MBUFS_PER_PORT, 1, 0, 0},
+			{PARAM_MBUFS_PER_VPORT, 1, 0, 0},
+			{PARAM_JUMBO_PORTS, 1, 0, 0},
+			{PARAM_TX_FLUSH, 1, 0, 0},
+			{PARAM_REBALANCE_INTERVAL, 1, 0, 0},
+			{PARAM_LATENCY_SAMPLE, 1, 0, 0},
+			{PARAM_STATS_EXPORT_INTERVAL, 1, 0, 0},
 			{NULL, 0, 0, 0}
 	};
 
 	progname = argv[0];
 
 	/* Initialize counters to "not used" */
-	num_clients = num_kni = num_veth = num_vhost = 0;
+	num_clients = num_kni = num_veth = num_vhost = num_memnic = 0;
 
-	while ((opt = getopt_long(argc, argvopt, "n:p:k:v:h:", lgopts,
+	while ((opt = getopt_long(argc, argvopt, "n:p:k:v:h:m:", lgopts,
 		&option_index)) != EOF) {
 		switch (opt) {
 			case 'p':  /* Physical ports */
@@ -316,6 +444,14 @@ parse_app_args(uint8_t max_ports, int argc, char *argv[])
 				}
 				num_vhost = (uint8_t)temp;
 				break;
+			case 'm':  /* memnic ports */
+				temp = parse_num_clients(optarg);
+				if (temp <= 0) {
+					usage();
+					return -1;
+				}
+				num_memnic = (uint8_t)temp;
+				break;
 			case 0:
 				if (!strcmp(lgopts[option_index].name, PARAM_CONFIG)) {
 					ret = parse_config(optarg);
@@ -323,20 +459,20 @@ parse_app_args(uint8_t max_ports, int argc, char *argv[])
 						printf("invalid config\n");
 					}
 				}
-				if (strncmp(lgopts[option_index].name, PARAM_STATS, 5) == 0) {
+				if (!strcmp(lgopts[option_index].name, PARAM_STATS)) {
 					stats_display_interval = atoi(optarg);
-				} else if (strncmp(lgopts[option_index].name, PARAM_VSWITCHD, 8) == 0) {
+				} else if (!strcmp(lgopts[option_index].name, PARAM_VSWITCHD)) {
 					vswitchd_core = atoi(optarg);
-				} else if (strncmp(lgopts[option_index].name, PARAM_CSC, 16) == 0) {
+				} else if (!strcmp(lgopts[option_index].name, PARAM_CSC)) {
 					client_switching_core = atoi(optarg);
-				} else if (strncmp(lgopts[option_index].name, VHOST_CHAR_DEV_NAME, 18) == 0) {
+				} else if (!strcmp(lgopts[option_index].name, VHOST_CHAR_DEV_NAME)) {
 					 temp = us_vhost_parse_basename(optarg);
 					 if (temp < 0) {
 						 printf ("Invalid argument for character device basename\n");
 						 usage();
 						 return -1;
 					 }
-				} else if (strncmp(lgopts[option_index].name, VHOST_CHAR_DEV_IDX, 15) == 0) {
+				} else if (!strcmp(lgopts[option_index].name, VHOST_CHAR_DEV_IDX)) {
 					temp = atoi(optarg);
 					if (temp < 0) {
 						printf("Invalid argument for character device index\n");	
@@ -344,7 +480,7 @@ parse_app_args(uint8_t max_ports, int argc, char *argv[])
 						return -1;
 					}
 					dev_index = (uint32_t)temp;
-				} else if (strncmp(lgopts[option_index].name, VHOST_RETRY_COUNT, 17) == 0) {
+				} else if (!strcmp(lgopts[option_index].name, VHOST_RETRY_COUNT)) {
 					temp = atoi(optarg);
 					if (temp < 0) {
 						printf("Invalid argument for retry count\n");	
@@ -352,7 +488,7 @@ parse_app_args(uint8_t max_ports, int argc, char *argv[])
 						return -1;
 					}
 					burst_tx_retry_num = (uint32_t)temp;
-				} else if (strncmp(lgopts[option_index].name, VHOST_RETRY_WAIT, 16) == 0) {
+				} else if (!strcmp(lgopts[option_index].name, VHOST_RETRY_WAIT)) {
 					temp = atoi(optarg);
 					if (temp < 0) {
 						printf("Invalid argument for retry wait time\n");	
@@ -360,6 +496,110 @@ parse_app_args(uint8_t max_ports, int argc, char *argv[])
 						return -1;
 					}
 					burst_tx_delay_time = (uint32_t)temp;
+				} else if (!strcmp(lgopts[option_index].name, PARAM_UPCALL_RATE)) {
+					temp = atoi(optarg);
+					if (temp < 0) {
+						printf("Invalid argument for upcall rate\n");
+						usage();
+						return -1;
+					}
+					upcall_rate = (unsigned)temp;
+				} else if (!strcmp(lgopts[option_index].name, PARAM_UPCALL_PENDING)) {
+					temp = atoi(optarg);
+					if (temp < 0) {
+						printf("Invalid argument for upcall pending max\n");
+						usage();
+						return -1;
+					}
+					upcall_pending_max = (unsigned)temp;
+				} else if (!strcmp(lgopts[option_index].name, PARAM_IDLE_SLEEP)) {
+					temp = atoi(optarg);
+					if (temp < 0) {
+						printf("Invalid argument for idle sleep time\n");
+						usage();
+						return -1;
+					}
+					idle_sleep_us = (unsigned)temp;
+				} else if (!strcmp(lgopts[option_index].name, PARAM_RSS_HASH)) {
+					use_rss_hash = true;
+				} else if (!strcmp(lgopts[option_index].name, PARAM_FLOW_TABLE_SIZE)) {
+					temp = atoi(optarg);
+					if (temp < 2 * FLOW_TABLE_BUCKET_ENTRIES_MAX ||
+					    !rte_is_power_of_2((uint32_t)temp)) {
+						printf("Invalid argument for flow table size\n");
+						usage();
+						return -1;
+					}
+					flow_table_size = (uint32_t)temp;
+				} else if (!strcmp(lgopts[option_index].name, PARAM_FLOW_BUCKET_ENTRIES)) {
+					temp = atoi(optarg);
+					if (temp <= 0 || temp > FLOW_TABLE_BUCKET_ENTRIES_MAX ||
+					    !rte_is_power_of_2((uint32_t)temp)) {
+						printf("Invalid argument for flow bucket entries\n");
+						usage();
+						return -1;
+					}
+					flow_table_bucket_entries = (uint32_t)temp;
+				} else if (!strcmp(lgopts[option_index].name, PARAM_FLOW_TABLE_SOCKET)) {
+					temp = atoi(optarg);
+					if (temp < 0 || temp >= RTE_MAX_NUMA_NODES) {
+						printf("Invalid argument for flow table socket\n");
+						usage();
+						return -1;
+					}
+					flow_table_socket = temp;
+				} else if (!strcmp(lgopts[option_index].name, PARAM_MBUFS_PER_PORT)) {
+					temp = atoi(optarg);
+					if (temp <= 0) {
+						printf("Invalid argument for mbufs per port\n");
+						usage();
+						return -1;
+					}
+					mbufs_per_port = (unsigned)temp;
+				} else if (!strcmp(lgopts[option_index].name, PARAM_MBUFS_PER_VPORT)) {
+					temp = atoi(optarg);
+					if (temp <= 0) {
+						printf("Invalid argument for mbufs per vport\n");
+						usage();
+						return -1;
+					}
+					mbufs_per_vport = (unsigned)temp;
+				} else if (!strcmp(lgopts[option_index].name, PARAM_JUMBO_PORTS)) {
+					if (parse_jumbo_portmask(optarg) != 0) {
+						printf("Invalid argument for jumbo ports\n");
+						usage();
+						return -1;
+					}
+				} else if (!strcmp(lgopts[option_index].name, PARAM_TX_FLUSH)) {
+					if (parse_tx_flush(optarg) != 0) {
+						printf("Invalid argument for tx flush\n");
+						usage();
+						return -1;
+					}
+				} else if (!strcmp(lgopts[option_index].name, PARAM_REBALANCE_INTERVAL)) {
+					temp = atoi(optarg);
+					if (temp < 0) {
+						printf("Invalid argument for rebalance interval\n");
+						usage();
+						return -1;
+					}
+					rebalance_interval_ms = (unsigned)temp;
+				} else if (!strcmp(lgopts[option_index].name, PARAM_LATENCY_SAMPLE)) {
+					temp = atoi(optarg);
+					if (temp < 0) {
+						printf("Invalid argument for latency sample rate\n");
+						usage();
+						return -1;
+					}
+					latency_sample_rate = (unsigned)temp;
+				} else if (!strcmp(lgopts[option_index].name, PARAM_STATS_EXPORT_INTERVAL)) {
+					temp = atoi(optarg);
+					if (temp < 0) {
+						printf("Invalid argument for stats export interval\n");
+						usage();
+						return -1;
+					}
+					stats_export_interval_ms = (unsigned)temp;
 				}
 				break;
 			default:
@@ -393,6 +633,12 @@ parse_app_args(uint8_t max_ports, int argc, char *argv[])
 		return -1;
 	}
 
+	if (num_memnic > MAX_MEMNIC_PORTS) {
+		printf ("Number of memnic ports is invalid\n");
+		usage();
+		return -1;
+	}
+
 	return 0;
 }
 
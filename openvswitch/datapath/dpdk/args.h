@@ -45,6 +45,20 @@
 #define VHOST_CHAR_DEV_IDX "vhost_dev_index"
 #define VHOST_RETRY_COUNT "vhost_retry_count"
 #define VHOST_RETRY_WAIT "vhost_retry_wait"
+#define PARAM_UPCALL_RATE "upcall_rate"
+#define PARAM_UPCALL_PENDING "upcall_pending_max"
+#define PARAM_IDLE_SLEEP "idle_sleep"
+#define PARAM_RSS_HASH "rss_hash"
+#define PARAM_FLOW_TABLE_SIZE "flow_table_size"
+#define PARAM_FLOW_BUCKET_ENTRIES "flow_bucket_entries"
+#define PARAM_FLOW_TABLE_SOCKET "flow_table_socket"
+#define PARAM_MBUFS_PER_PORT "mbufs_per_port"
+#define PARAM_MBUFS_PER_VPORT "mbufs_per_vport"
+#define PARAM_JUMBO_PORTS "jumbo_ports"
+#define PARAM_TX_FLUSH "tx_flush"
+#define PARAM_REBALANCE_INTERVAL "rebalance_interval"
+#define PARAM_LATENCY_SAMPLE "latency_sample"
+#define PARAM_STATS_EXPORT_INTERVAL "stats_export_interval"
 #define PARAM_CSC "client_switching_core"
 #define PARAM_KSC "kni_switching_core"
 
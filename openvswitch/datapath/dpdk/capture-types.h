@@ -0,0 +1,148 @@
+/*
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2010-2014 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __CAPTURE_TYPES_H_
+#define __CAPTURE_TYPES_H_
+
+#include <stdint.h>
+
+#include <rte_memory.h>
+
+#include "vport-types.h"
+
+/*
+ * Shared memory layout of the packet capture tap.
+ *
+ * The datapath reserves MZ_CAPTURE and two rings at startup. The free ring
+ * holds pointers to the unused records in 'records'. When a packet of the
+ * captured vport passes the filter and is sampled, a switching core takes a
+ * record from the free ring, copies up to CAPTURE_SNAPLEN bytes of the
+ * packet into it and puts it on the capture ring. The capture tool takes
+ * records off the capture ring and returns them to the free ring once it
+ * has written them out. A packet is not captured, and the core's 'dropped'
+ * is counted, if no record is free.
+ *
+ * The tool configures the tap by filling in the fields between 'heartbeat'
+ * and 'filter' and then incrementing 'generation'. The vswitchd core
+ * applies a new generation once no switching core can still be using the
+ * previous filter, then sets 'status' and copies 'generation' to 'applied'.
+ * Only one tool may drive the tap at a time, and it must clear 'enabled'
+ * and increment 'generation' when it is done.
+ *
+ * While capturing, the tool must store the TSC in 'heartbeat' at least every
+ * CAPTURE_LEASE_MS. Should it stop doing so, e.g. because it was killed, the
+ * vswitchd core switches the tap off and sets 'status' to
+ * CAPTURE_STATUS_EXPIRED.
+ */
+#define MZ_CAPTURE				"OVS_capture"
+#define CAPTURE_RING_NAME		"OVS_capture_ring"
+#define CAPTURE_FREE_RING_NAME	"OVS_capture_free"
+#define CAPTURE_MAGIC			0x50414354	/* "TCAP" */
+#define CAPTURE_VERSION			2
+#define CAPTURE_RING_SIZE		1024		/* Power of two */
+#define CAPTURE_NUM_RECORDS		(CAPTURE_RING_SIZE - 1)
+#define CAPTURE_SNAPLEN			1536
+#define CAPTURE_MAX_LCORES		128
+#define CAPTURE_LEASE_MS		1000
+
+/* Values of 'status' */
+#define CAPTURE_STATUS_OK			0
+#define CAPTURE_STATUS_NO_VPORT		-1	/* 'vport_name' does not exist */
+#define CAPTURE_STATUS_EXPIRED		-2	/* 'heartbeat' was not refreshed */
+
+/* Which packets of the captured vport are mirrored */
+#define CAPTURE_DIR_IN			0x1	/* received by the switch from the vport */
+#define CAPTURE_DIR_OUT			0x2	/* sent by the switch to the vport */
+
+/* Flow key fields compared by a filter, in host byte order */
+#define CAPTURE_MATCH_ETHER_TYPE	0x01
+#define CAPTURE_MATCH_VLAN_ID		0x02
+#define CAPTURE_MATCH_IP_PROTO		0x04
+#define CAPTURE_MATCH_IP_SRC		0x08	/* under 'ip_src_mask' */
+#define CAPTURE_MATCH_IP_DST		0x10	/* under 'ip_dst_mask' */
+#define CAPTURE_MATCH_TP_SRC		0x20
+#define CAPTURE_MATCH_TP_DST		0x40
+
+/* A packet passes if all fields in 'match' equal those of its flow key */
+struct capture_filter {
+	uint32_t match;			/* CAPTURE_MATCH_* */
+	uint16_t ether_type;
+	uint16_t vlan_id;
+	uint32_t ip_src;		/* IPv4 or ARP addresses */
+	uint32_t ip_src_mask;
+	uint32_t ip_dst;
+	uint32_t ip_dst_mask;
+	uint16_t tp_src;		/* TCP/UDP port or ICMP type */
+	uint16_t tp_dst;		/* TCP/UDP port or ICMP code */
+	uint8_t ip_proto;
+};
+
+struct capture_record {
+	uint64_t tsc;			/* when the packet was captured */
+	uint32_t vportid;
+	uint32_t dir;			/* CAPTURE_DIR_IN or CAPTURE_DIR_OUT */
+	uint32_t len;			/* length of the packet */
+	uint32_t caplen;		/* bytes of it in 'data' */
+	uint8_t data[CAPTURE_SNAPLEN];
+} __rte_cache_aligned;
+
+/* Counters of one lcore, only written by that lcore */
+struct capture_lcore {
+	uint64_t captured;
+	uint64_t dropped;		/* no free record */
+} __rte_cache_aligned;
+
+struct capture_area {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t tsc_hz;
+
+	/* Written by the capture tool */
+	volatile uint32_t generation;
+	volatile uint64_t heartbeat;	/* TSC, see CAPTURE_LEASE_MS */
+	uint32_t enabled;
+	char vport_name[VPORT_INFO_NAMESZ];
+	uint32_t dir;			/* CAPTURE_DIR_* */
+	uint32_t sample_rate;	/* capture one in this many packets, 0 or 1 for all */
+	struct capture_filter filter;
+
+	/* Written by the datapath */
+	volatile uint32_t applied;	/* last generation applied */
+	volatile int32_t status;	/* CAPTURE_STATUS_* */
+	struct capture_lcore lcores[CAPTURE_MAX_LCORES];
+
+	struct capture_record records[CAPTURE_NUM_RECORDS] __rte_cache_aligned;
+};
+
+#endif /* __CAPTURE_TYPES_H_ */
@@ -0,0 +1,298 @@
+/*
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2010-2014 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <string.h>
+
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_memcpy.h>
+#include <rte_memzone.h>
+#include <rte_ring.h>
+
+#include "capture.h"
+#include "capture-types.h"
+#include "vport.h"
+
+#define RTE_LOGTYPE_APP RTE_LOGTYPE_USER1
+#define NO_FLAGS 0
+
+/* Packets left until the next one an lcore captures */
+struct capture_sampler {
+	unsigned count;
+} __rte_cache_aligned;
+
+volatile unsigned capture_in_vport = MAX_VPORTS;
+volatile unsigned capture_out_vport = MAX_VPORTS;
+
+static struct capture_area *capture_area = NULL;
+static struct rte_ring *capture_ring = NULL;
+static struct rte_ring *capture_free_ring = NULL;
+/* Configuration applied by capture_update() */
+static struct capture_filter capture_filter;
+static unsigned capture_sample_rate;
+static struct capture_sampler capture_samplers[RTE_MAX_LCORE];
+/* TSC cycles the tool's heartbeat may be behind before the tap stops */
+static uint64_t capture_lease;
+
+/*
+ * Reserve the memzone and rings shared with the capture tool, see
+ * capture-types.h, and put all records on the free ring.
+ */
+void
+capture_init(void)
+{
+	const struct rte_memzone *mz = NULL;
+	unsigned i = 0;
+
+	RTE_BUILD_BUG_ON(RTE_MAX_LCORE > CAPTURE_MAX_LCORES);
+
+	mz = rte_memzone_reserve(MZ_CAPTURE, sizeof(struct capture_area),
+	                         rte_socket_id(), NO_FLAGS);
+	if (mz == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot reserve memory zone for packet capture\n");
+	capture_area = mz->addr;
+	memset(capture_area, 0, sizeof(struct capture_area));
+
+	capture_area->magic = CAPTURE_MAGIC;
+	capture_area->version = CAPTURE_VERSION;
+	capture_area->tsc_hz = rte_get_tsc_hz();
+	capture_lease = rte_get_tsc_hz() / MS_PER_S * CAPTURE_LEASE_MS;
+
+	capture_ring = rte_ring_create(CAPTURE_RING_NAME, CAPTURE_RING_SIZE,
+	                               rte_socket_id(), NO_FLAGS);
+	capture_free_ring = rte_ring_create(CAPTURE_FREE_RING_NAME,
+	                                    CAPTURE_RING_SIZE, rte_socket_id(),
+	                                    NO_FLAGS);
+	if (capture_ring == NULL || capture_free_ring == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot create packet capture rings\n");
+
+	for (i = 0; i < CAPTURE_NUM_RECORDS; i++)
+		rte_ring_mp_enqueue(capture_free_ring, &capture_area->records[i]);
+
+	capture_in_vport = MAX_VPORTS;
+	capture_out_vport = MAX_VPORTS;
+}
+
+/*
+ * Switch the tap off if the capture tool has not refreshed its heartbeat
+ * within its lease, e.g. because it was killed. As in capture_update(),
+ * the switching cores are quiesced, so that the tap being off always means
+ * no core still uses the filter.
+ */
+static void
+capture_check_lease(void)
+{
+	int64_t age = 0;
+
+	if (capture_in_vport == MAX_VPORTS && capture_out_vport == MAX_VPORTS)
+		return;
+
+	/* The tool may have read the TSC after this core */
+	age = (int64_t)(rte_rdtsc() - capture_area->heartbeat);
+	if (age <= (int64_t)capture_lease)
+		return;
+
+	RTE_LOG(WARNING, APP, "Capture tool stopped responding, stopping "
+	        "capture of vport '%s'\n", capture_area->vport_name);
+	capture_in_vport = MAX_VPORTS;
+	capture_out_vport = MAX_VPORTS;
+	rte_wmb();
+	vport_quiesce();
+	capture_area->status = CAPTURE_STATUS_EXPIRED;
+}
+
+/*
+ * Apply a configuration written by the capture tool, if there is a new
+ * one, or stop capturing if the tool's lease has expired. The tap is
+ * switched off, and every switching core has finished with the old filter,
+ * before the new one is copied. Only the vswitchd core may call this.
+ */
+void
+capture_update(void)
+{
+	uint32_t generation = 0;
+	uint32_t vportid = MAX_VPORTS;
+
+	if (capture_area == NULL)
+		return;
+	if (capture_area->applied == capture_area->generation) {
+		capture_check_lease();
+		return;
+	}
+
+	generation = capture_area->generation;
+	rte_rmb();
+
+	if (capture_in_vport != MAX_VPORTS || capture_out_vport != MAX_VPORTS) {
+		capture_in_vport = MAX_VPORTS;
+		capture_out_vport = MAX_VPORTS;
+		rte_wmb();
+		vport_quiesce();
+	}
+
+	capture_area->status = CAPTURE_STATUS_OK;
+	if (capture_area->enabled) {
+		capture_area->vport_name[VPORT_INFO_NAMESZ - 1] = '\0';
+		vportid = vport_name_to_portid(capture_area->vport_name);
+		if (vportid >= MAX_VPORTS) {
+			RTE_LOG(WARNING, APP, "Cannot capture unknown vport '%s'\n",
+			        capture_area->vport_name);
+			capture_area->status = CAPTURE_STATUS_NO_VPORT;
+		} else {
+			capture_filter = capture_area->filter;
+			capture_sample_rate = capture_area->sample_rate;
+			memset(capture_samplers, 0, sizeof(capture_samplers));
+			rte_wmb();
+
+			if (capture_area->dir & CAPTURE_DIR_IN)
+				capture_in_vport = vportid;
+			if (capture_area->dir & CAPTURE_DIR_OUT)
+				capture_out_vport = vportid;
+		}
+	}
+
+	rte_wmb();
+	capture_area->applied = generation;
+}
+
+static inline int
+capture_filter_match(const struct capture_filter *f,
+                     const struct flow_key *key)
+{
+	if ((f->match & CAPTURE_MATCH_ETHER_TYPE) &&
+	    key->ether_type != f->ether_type)
+		return 0;
+	if ((f->match & CAPTURE_MATCH_VLAN_ID) && key->vlan_id != f->vlan_id)
+		return 0;
+	if ((f->match & CAPTURE_MATCH_IP_PROTO) && key->ip_proto != f->ip_proto)
+		return 0;
+	if ((f->match & CAPTURE_MATCH_IP_SRC) &&
+	    (key->ip_src & f->ip_src_mask) != (f->ip_src & f->ip_src_mask))
+		return 0;
+	if ((f->match & CAPTURE_MATCH_IP_DST) &&
+	    (key->ip_dst & f->ip_dst_mask) != (f->ip_dst & f->ip_dst_mask))
+		return 0;
+	if ((f->match & CAPTURE_MATCH_TP_SRC) && key->tran_src_port != f->tp_src)
+		return 0;
+	if ((f->match & CAPTURE_MATCH_TP_DST) && key->tran_dst_port != f->tp_dst)
+		return 0;
+
+	return 1;
+}
+
+/* Whether the next packet that passed the filter on this lcore is taken */
+static inline int
+capture_sample(void)
+{
+	struct capture_sampler *sampler = &capture_samplers[rte_lcore_id()];
+
+	if (capture_sample_rate <= 1)
+		return 1;
+	if (++sampler->count < capture_sample_rate)
+		return 0;
+	sampler->count = 0;
+
+	return 1;
+}
+
+/* Copy 'pkt' into a free record and hand it to the capture tool */
+static void
+capture_mbuf(unsigned vportid, uint32_t dir, const struct rte_mbuf *pkt)
+{
+	struct capture_lcore *counters = &capture_area->lcores[rte_lcore_id()];
+	struct capture_record *rec = NULL;
+	const struct rte_mbuf *seg = NULL;
+	unsigned len = 0, n = 0;
+
+	if (rte_ring_mc_dequeue(capture_free_ring, (void **)&rec) != 0) {
+		counters->dropped++;
+		return;
+	}
+
+	rec->tsc = rte_rdtsc();
+	rec->vportid = vportid;
+	rec->dir = dir;
+	rec->len = rte_pktmbuf_pkt_len(pkt);
+	for (seg = pkt; seg != NULL && len < CAPTURE_SNAPLEN; seg = seg->pkt.next) {
+		n = RTE_MIN((unsigned)rte_pktmbuf_data_len(seg),
+		            CAPTURE_SNAPLEN - len);
+		rte_memcpy(rec->data + len, rte_pktmbuf_mtod(seg, void *), n);
+		len += n;
+	}
+	rec->caplen = len;
+
+	if (rte_ring_mp_enqueue(capture_ring, rec) != 0) {
+		rte_ring_mp_enqueue(capture_free_ring, rec);
+		counters->dropped++;
+		return;
+	}
+	counters->captured++;
+}
+
+/*
+ * Capture the packets of a burst received from 'vportid' that pass the
+ * filter on their already extracted 'keys'.
+ */
+void
+capture_in_burst(unsigned vportid, struct rte_mbuf **bufs,
+                 const struct flow_key *keys, unsigned count)
+{
+	unsigned i = 0;
+
+	for (i = 0; i < count; i++)
+		if (capture_filter_match(&capture_filter, &keys[i]) &&
+		    capture_sample())
+			capture_mbuf(vportid, CAPTURE_DIR_IN, bufs[i]);
+}
+
+/*
+ * Capture a packet being sent to 'vportid' if it passes the filter. Its
+ * flow key is only extracted when the filter needs it.
+ */
+void
+capture_out_packet(unsigned vportid, struct rte_mbuf *buf)
+{
+	struct flow_key key = {0};
+	uint16_t l4_offset = 0;
+
+	if (capture_filter.match != 0) {
+		flow_key_extract(buf, vportid, &key, &l4_offset);
+		if (!capture_filter_match(&capture_filter, &key))
+			return;
+	}
+
+	if (capture_sample())
+		capture_mbuf(vportid, CAPTURE_DIR_OUT, buf);
+}
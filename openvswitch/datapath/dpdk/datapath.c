@@ -35,12 +35,16 @@
 #include <stdint.h>
 #include <rte_memcpy.h>
 #include <rte_ring.h>
+#include <rte_atomic.h>
 #include <rte_cycles.h>
+#include <rte_string_fns.h>
 
 #include <stdbool.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/ioctl.h>
+#include <poll.h>
+#include <time.h>
 
 #include "vport.h"
 #include "datapath.h"
@@ -51,11 +55,15 @@
 
 #define RTE_LOGTYPE_APP RTE_LOGTYPE_USER1
 #define NO_FLAGS               0
-#define SOCKET0                0
 #define PKT_BURST_SIZE         32u
 #define VSWITCHD_RINGSIZE      2048
 #define VSWITCHD_ALLOC_THRESHOLD   (VSWITCHD_RINGSIZE/4)
-#define VSWITCHD_PACKET_RING_NAME  "MProc_Vswitchd_Packet_Ring"
+#define VSWITCHD_PACKET_RING_NAME  "MProc_Vswitchd_Packet_Ring_%u"
+#define VSWITCHD_PACKET_RINGS      4   /* Must be a power of two */
+#define UPCALL_PENDING_ENTRIES     4096   /* Must be a power of two */
+#define UPCALL_PENDING_TIMEOUT_MS  100
+#define UPCALL_BUCKET_DEPTH_MS     10
+#define DPIF_SIGNAL_INTERVAL_US    10
 #define VSWITCHD_REPLY_RING_NAME   "MProc_Vswitchd_Reply_Ring"
 #define VSWITCHD_MESSAGE_RING_NAME "MProc_Vswitchd_Message_Ring"
 #define VSWITCHD_FREE_RING_NAME    "MProc_Vswitchd_Free_Ring"
@@ -72,14 +80,16 @@
 #define FLAG_CREATE            0x400
 #define FLAG_APPEND            0x800
 
+#define DP_CMD_FAMILY          0xD
 #define VPORT_CMD_FAMILY       0xE
 #define FLOW_CMD_FAMILY        0xF
 #define PACKET_CMD_FAMILY      0x1F
 
 #define DPIF_SOCKNAME "\0dpif-dpdk"
+#define DATAPATH_SOCKNAME "\0ovdk-datapath"
 
-/* ring to send packets to vswitchd */
-static struct rte_ring *vswitchd_packet_ring = NULL;
+/* rings to send packets to vswitchd, selected by flow key hash */
+static struct rte_ring *vswitchd_packet_ring[VSWITCHD_PACKET_RINGS] = {NULL};
 /* ring to receive messages from vswitchd */
 static struct rte_ring *vswitchd_message_ring = NULL;
 /* ring to send reply messages to vswitchd */
@@ -90,9 +100,63 @@ static struct rte_ring *vswitchd_free_ring = NULL;
 /* Holds newly allocated packets */
 static struct rte_ring *vswitchd_alloc_ring = NULL;
 
+/*
+ * Per-lcore staging area for upcalls. Misses are batched here so that each
+ * packet ring is written with a single burst enqueue rather than one
+ * multi-producer enqueue per packet.
+ */
+struct upcall_cache {
+	struct rte_mbuf *cache[PKT_BURST_SIZE];
+	unsigned count;
+} __rte_cache_aligned;
+
+static struct upcall_cache upcall_cache[RTE_MAX_LCORE][VSWITCHD_PACKET_RINGS];
+
+/*
+ * Misses already sent to vswitchd for a flow, indexed by flow key hash.
+ * Once 'upcall_pending_max' misses are outstanding for a flow, further
+ * packets are dropped until the flow is installed or the entry times out.
+ * Flows that share an entry are counted together until it times out, so
+ * that they can't reset each other's count. Entries are shared by all
+ * lcores without locking; a lost update only lets an extra miss through or
+ * drops one early.
+ */
+struct upcall_pending {
+	uint32_t hash;   /* Flow key hash of the first miss since 'tsc' */
+	uint32_t count;  /* Misses sent since 'tsc', 0 if unused */
+	uint64_t tsc;    /* Time the first miss was sent */
+};
+
+static struct upcall_pending upcall_pending[UPCALL_PENDING_ENTRIES];
+
+/*
+ * Per-lcore, per-vport token buckets limiting the rate of misses sent to
+ * vswitchd. Tokens are scaled by the TSC frequency so that refilling needs
+ * no division.
+ */
+struct upcall_bucket {
+	uint64_t tokens;
+	uint64_t tsc;    /* Time of last refill */
+};
+
+struct upcall_buckets {
+	struct upcall_bucket vport[MAX_VPORTS];
+} __rte_cache_aligned;
+
+static struct upcall_buckets upcall_buckets[RTE_MAX_LCORE];
+
+static uint64_t upcall_pending_timeout = 0;
+static uint64_t tsc_hz = 0;
+
+unsigned upcall_pending_max = UPCALL_PENDING_MAX_DEFAULT;
+unsigned upcall_rate = 0;
+unsigned idle_sleep_us = 0;
+
 static void send_reply_to_vswitchd(struct dpdk_message *reply);
+static void flush_upcall_cache(unsigned ringid);
 
 static void handle_vswitchd_cmd(struct rte_mbuf *mbuf);
+static void handle_dp_cmd(struct dpdk_dp_message *request);
 static void handle_vport_cmd(struct dpdk_vport_message *request);
 static void handle_flow_cmd(struct dpdk_flow_message *request);
 static void handle_packet_cmd(struct dpdk_packet_message *request,
@@ -105,6 +169,115 @@ static void flow_cmd_del(struct dpdk_flow_message *request);
 static void flow_cmd_dump(struct dpdk_flow_message *request);
 
 static int dpif_socket = -1;
+/* vswitchd signals this socket when it has queued messages */
+static int datapath_socket = -1;
+
+/*
+ * Set by the switching cores when vswitchd needs to be woken up. The
+ * vswitchd core sends the signal, so no syscalls are made on the
+ * forwarding path.
+ */
+static volatile int dpif_signal_pending = 0;
+static uint64_t dpif_signal_interval = 0;
+
+/*
+ * Set while the vswitchd core sleeps under --idle_sleep. It can't send the
+ * pending signal then, so the switching core that sets it wakes the
+ * vswitchd core instead.
+ */
+static rte_atomic32_t vswitchd_core_sleeping = RTE_ATOMIC32_INIT(0);
+
+/*
+ * Returns true if another miss for the flow with hash 'hash' may be sent to
+ * vswitchd at TSC 'now'.
+ */
+static inline bool
+upcall_pending_admit(uint32_t hash, uint64_t now)
+{
+	struct upcall_pending *entry = NULL;
+
+	if (upcall_pending_max == 0)
+		return true;
+
+	entry = &upcall_pending[hash & (UPCALL_PENDING_ENTRIES - 1)];
+
+	if (entry->count == 0 || now - entry->tsc > upcall_pending_timeout) {
+		entry->hash = hash;
+		entry->tsc = now;
+		entry->count = 1;
+		return true;
+	}
+
+	if (entry->count >= upcall_pending_max)
+		return false;
+
+	entry->count++;
+	return true;
+}
+
+/*
+ * Forget any misses sent for 'key', e.g. because its flow has been
+ * installed or removed.
+ */
+static void
+upcall_pending_clear(const struct flow_key *key)
+{
+	uint32_t hash = flow_key_hash(key);
+	struct upcall_pending *entry = NULL;
+
+	entry = &upcall_pending[hash & (UPCALL_PENDING_ENTRIES - 1)];
+	if (entry->hash == hash)
+		entry->count = 0;
+}
+
+/*
+ * Returns true if a miss received on 'vportid' at TSC 'now' is within this
+ * lcore's upcall rate limit for that vport.
+ */
+static inline bool
+upcall_bucket_admit(uint32_t vportid, uint64_t now)
+{
+	struct upcall_bucket *bucket = NULL;
+	uint64_t depth = 0;
+	uint64_t elapsed = 0;
+
+	if (upcall_rate == 0 || vportid >= MAX_VPORTS)
+		return true;
+
+	bucket = &upcall_buckets[rte_lcore_id()].vport[vportid];
+	depth = tsc_hz * UPCALL_BUCKET_DEPTH_MS / 1000 * upcall_rate;
+	if (depth < tsc_hz)
+		depth = tsc_hz;  /* Always allow at least one upcall */
+
+	elapsed = now - bucket->tsc;
+	if (elapsed > tsc_hz)
+		elapsed = tsc_hz;  /* Avoid overflow after long idle periods */
+	bucket->tsc = now;
+
+	bucket->tokens += elapsed * upcall_rate;
+	if (bucket->tokens > depth)
+		bucket->tokens = depth;
+
+	if (bucket->tokens < tsc_hz)
+		return false;
+
+	bucket->tokens -= tsc_hz;
+	return true;
+}
+
+/*
+ * Drop 'mbuf' instead of sending it to vswitchd, counting it against
+ * 'reason'.
+ */
+static inline void
+upcall_drop(struct rte_mbuf *mbuf, enum stats_drop_reason reason)
+{
+	rte_pktmbuf_free(mbuf);
+	stats_vswitch_tx_drop_increment(INC_BY_1);
+	stats_vswitch_lost_increment(INC_BY_1);
+	stats_vport_tx_drop_increment(VSWITCHD, INC_BY_1);
+	stats_vport_drop_increment(VSWITCHD, reason, INC_BY_1);
+}
 
 static void send_signal_to_dpif(void)
 {
@@ -121,15 +294,60 @@ static void send_signal_to_dpif(void)
 		(struct sockaddr *)&addr, sizeof(addr));
 }
 
+/*
+ * Wake the vswitchd core from wait_for_request_from_vswitchd(), as vswitchd
+ * does when it queues a message.
+ */
+static void send_signal_to_datapath(void)
+{
+	static struct sockaddr_un addr;
+	int n;
+
+	if (!addr.sun_family) {
+		addr.sun_family = AF_UNIX;
+		memcpy(addr.sun_path, DATAPATH_SOCKNAME, sizeof(DATAPATH_SOCKNAME));
+	}
+
+	/* don't care about error */
+	sendto(dpif_socket, &n, sizeof(n), 0,
+		(struct sockaddr *)&addr, sizeof(addr));
+}
+
 /*
  * Function sends unmatched packets to vswitchd.
+ *
+ * The packet is staged in this lcore's cache for the packet ring selected by
+ * the flow key hash, so that all packets of a flow land on the same ring.
+ * The cache is written to the ring when full, or by
+ * flush_packets_to_vswitchd().
+ *
+ * Misses are subject to the per-flow pending limit and the per-vport rate
+ * limit; packets over either limit are dropped.
+ *
+ * 'hash' is the flow table hash of 'info->key'.
  */
 inline void __attribute__((always_inline))
-send_packet_to_vswitchd(struct rte_mbuf *mbuf, struct dpdk_upcall *info)
+send_packet_to_vswitchd(struct rte_mbuf *mbuf, struct dpdk_upcall *info,
+                        uint32_t hash)
 {
-	int rslt = 0;
-	int cnt = 0;
+	struct upcall_cache *per_ring_cache = NULL;
 	void *mbuf_ptr = NULL;
+	unsigned ringid = 0;
+	uint64_t now = 0;
+
+	if (info->cmd == PACKET_CMD_MISS) {
+		/* Not curr_tsc, which stands still while the vswitchd core
+		 * sleeps under --idle_sleep */
+		now = rte_rdtsc();
+		if (!upcall_pending_admit(hash, now)) {
+			upcall_drop(mbuf, STATS_DROP_UPCALL_PENDING);
+			return;
+		}
+		if (!upcall_bucket_admit(info->key.in_port, now)) {
+			upcall_drop(mbuf, STATS_DROP_UPCALL_LIMIT);
+			return;
+		}
+	}
 
 	/* send one packet, delete information about segments */
 	rte_pktmbuf_pkt_len(mbuf) = rte_pktmbuf_data_len(mbuf);
@@ -140,38 +358,119 @@ send_packet_to_vswitchd(struct rte_mbuf *mbuf, struct dpdk_upcall *info)
 	if (unlikely(mbuf_ptr == NULL)) {
 		RTE_LOG(ERR, APP, "Error : Cannot prepend upcall info "
 		        ": %s : %d", __FUNCTION__, __LINE__);
-		rte_pktmbuf_free(mbuf);
-		stats_vswitch_tx_drop_increment(INC_BY_1);
-		stats_vport_tx_drop_increment(VSWITCHD, INC_BY_1);
+		upcall_drop(mbuf, STATS_DROP_NO_HEADROOM);
+		stats_vport_tx_error_increment(VSWITCHD, INC_BY_1);
 		return;
 	}
 
 	rte_memcpy(mbuf_ptr, info, sizeof(*info));
 
-	cnt = rte_ring_count(vswitchd_packet_ring);
+	ringid = hash & (VSWITCHD_PACKET_RINGS - 1);
+	per_ring_cache = &upcall_cache[rte_lcore_id()][ringid];
 
-	/* send the packet and the upcall info to the daemon */
-	rslt = rte_ring_mp_enqueue(vswitchd_packet_ring, mbuf);
-	if (rslt < 0) {
-		if (rslt == -ENOBUFS) {
-			rte_pktmbuf_free(mbuf);
-			stats_vswitch_tx_drop_increment(INC_BY_1);
-			stats_vport_tx_drop_increment(VSWITCHD, INC_BY_1);
-			return;
-		} else {
-			stats_vport_overrun_increment(VSWITCHD, INC_BY_1);
+	per_ring_cache->cache[per_ring_cache->count++] = mbuf;
+	if (per_ring_cache->count == PKT_BURST_SIZE)
+		flush_upcall_cache(ringid);
+}
+
+/*
+ * Flush any upcalls in this lcore's cache for packet ring 'ringid'.
+ */
+static inline void
+flush_upcall_cache(unsigned ringid)
+{
+	struct upcall_cache *per_ring_cache = NULL;
+	struct rte_ring *ring = vswitchd_packet_ring[ringid];
+	unsigned tx_count = 0, i = 0;
+	unsigned cnt = 0;
+	uint64_t bytes = 0;
+
+	per_ring_cache = &upcall_cache[rte_lcore_id()][ringid];
+
+	cnt = rte_ring_count(ring);
+
+	/* Count the packets, not the upcall info prepended to them */
+	for (i = 0; i < per_ring_cache->count; i++)
+		bytes += rte_pktmbuf_pkt_len(per_ring_cache->cache[i]) -
+		         sizeof(struct dpdk_upcall);
+
+	/* send the packets and the upcall info to the daemon */
+	tx_count = rte_ring_mp_enqueue_burst(ring,
+			(void **)per_ring_cache->cache, per_ring_cache->count);
+
+	if (unlikely(tx_count < per_ring_cache->count)) {
+		unsigned dropped = per_ring_cache->count - tx_count;
+		for (i = tx_count; i < per_ring_cache->count; i++) {
+			bytes -= rte_pktmbuf_pkt_len(per_ring_cache->cache[i]) -
+			         sizeof(struct dpdk_upcall);
+			rte_pktmbuf_free(per_ring_cache->cache[i]);
 		}
+
+		stats_vswitch_tx_drop_increment(dropped);
+		stats_vswitch_lost_increment(dropped);
+		stats_vport_tx_drop_increment(VSWITCHD, dropped);
+		stats_vport_drop_increment(VSWITCHD, STATS_DROP_UPCALL_FULL,
+		                           dropped);
 	}
 
-	stats_vport_tx_increment(VSWITCHD, INC_BY_1);
+	stats_vport_tx_increment(VSWITCHD, tx_count);
+	stats_vport_tx_bytes_increment(VSWITCHD, bytes);
+
+	per_ring_cache->count = 0;
 
 	/*
 	 * cnt == 0 means vswitchd is in poll_block, and needed to wake up.
-	 * However, current rte_ring_count == 0 means, queued packet has
-	 * been processed in vswitchd, then no signaling is needed.
+	 * However, current rte_ring_count == 0 means, queued packets have
+	 * been processed in vswitchd, then no signaling is needed. The signal
+	 * itself is sent later by the vswitchd core, which is woken first if
+	 * it is sleeping. Only one switching core wakes it.
 	 */
-	if (cnt == 0 && rte_ring_count(vswitchd_packet_ring) > 0)
-		send_signal_to_dpif();
+	if (tx_count && cnt == 0 && rte_ring_count(ring) > 0 &&
+	    !dpif_signal_pending) {
+		dpif_signal_pending = 1;
+		rte_mb();
+		if (rte_atomic32_cmpset(
+		        (volatile uint32_t *)&vswitchd_core_sleeping.cnt, 1, 0))
+			send_signal_to_datapath();
+	}
+}
+
+/*
+ * Wake up vswitchd if any switching core has queued packets for it since
+ * the last signal. Signals are coalesced and sent at most once every
+ * DPIF_SIGNAL_INTERVAL_US.
+ *
+ * This must only be called by the vswitchd core.
+ */
+void
+send_pending_signal_to_dpif(void)
+{
+	static uint64_t next_signal_tsc = 0;
+
+	if (likely(!dpif_signal_pending) || curr_tsc < next_signal_tsc)
+		return;
+
+	dpif_signal_pending = 0;
+	next_signal_tsc = curr_tsc + dpif_signal_interval;
+	send_signal_to_dpif();
+}
+
+/*
+ * This function must be called periodically to ensure that no upcalls get
+ * stuck in the upcall cache.
+ *
+ * This must be called by each core that calls send_packet_to_vswitchd()
+ */
+void
+flush_packets_to_vswitchd(void)
+{
+	unsigned lcore_id = rte_lcore_id();
+	unsigned ringid = 0;
+
+	for (ringid = 0; ringid < VSWITCHD_PACKET_RINGS; ringid++) {
+		if (upcall_cache[lcore_id][ringid].count)
+			flush_upcall_cache(ringid);
+	}
 }
 
 /*
@@ -210,9 +509,56 @@ handle_request_from_vswitchd(void)
 		}
 		if (j)
 			rte_ring_sp_enqueue_bulk(vswitchd_alloc_ring, (void**) buf, j);
+		/* pool is exhausted, try again on the next call */
+		if (j < PKT_BURST_SIZE) {
+			stats_vswitch_nombuf_increment(INC_BY_1);
+			break;
+		}
 	}
 }
 
+/*
+ * Sleep for up to 'timeout_us' waiting for vswitchd to queue a message, to
+ * take or return mbufs, or for a switching core to queue an upcall.
+ *
+ * Returns immediately if there is already work for the vswitchd core. Any
+ * signals received are consumed.
+ */
+void
+wait_for_request_from_vswitchd(unsigned timeout_us)
+{
+	struct pollfd pfd = {0};
+	struct timespec timeout = {0};
+	int n = 0;
+
+	/*
+	 * Publish that this core is going to sleep before the last check, so
+	 * that a switching core either sees it and wakes this core, or set
+	 * 'dpif_signal_pending' early enough to be seen here.
+	 */
+	rte_atomic32_set(&vswitchd_core_sleeping, 1);
+	rte_mb();
+
+	if (rte_ring_count(vswitchd_message_ring) ||
+	    rte_ring_count(vswitchd_free_ring) ||
+	    dpif_signal_pending) {
+		rte_atomic32_set(&vswitchd_core_sleeping, 0);
+		return;
+	}
+
+	pfd.fd = datapath_socket;
+	pfd.events = POLLIN;
+	timeout.tv_sec = timeout_us / US_PER_S;
+	timeout.tv_nsec = (timeout_us % US_PER_S) * 1000;
+
+	ppoll(&pfd, 1, &timeout, NULL);
+	rte_atomic32_set(&vswitchd_core_sleeping, 0);
+
+	/* don't care about the contents, just drain the socket */
+	while (recv(datapath_socket, &n, sizeof(n), 0) > 0)
+		;
+}
+
 /*
  * Send a reply message to vswitchd.
  */
@@ -229,8 +575,10 @@ send_reply_to_vswitchd(struct dpdk_message *reply)
 	if (!mbuf) {
 		RTE_LOG(WARNING, APP, "Error : Unable to allocate an mbuf "
 		        ": %s : %d", __FUNCTION__, __LINE__);
+		stats_vswitch_nombuf_increment(INC_BY_1);
 		stats_vswitch_tx_drop_increment(INC_BY_1);
 		stats_vport_rx_drop_increment(VSWITCHD, INC_BY_1);
+		stats_vport_drop_increment(VSWITCHD, STATS_DROP_NOMBUF, INC_BY_1);
 		return;
 	}
 
@@ -245,6 +593,8 @@ send_reply_to_vswitchd(struct dpdk_message *reply)
 			rte_pktmbuf_free(mbuf);
 			stats_vswitch_tx_drop_increment(INC_BY_1);
 			stats_vport_rx_drop_increment(VSWITCHD, INC_BY_1);
+			stats_vport_drop_increment(VSWITCHD, STATS_DROP_RING_FULL,
+			                           INC_BY_1);
 		} else {
 			stats_vport_overrun_increment(VSWITCHD, INC_BY_1);
 			stats_vport_rx_increment(VSWITCHD, INC_BY_1);
@@ -272,13 +622,14 @@ handle_unknown_cmd(void)
  *
  * This handles a request from the datapath to add a new port. The request can
  * contain a port number, a port name, or both. If a port number is not
- * available, the datapath attempts to get a free port within the port type's
- * range.
+ * given, or is outside the port type's range, the datapath attempts to get a
+ * free port within that range. The vport and its rings, fifos and shared
+ * memory are then created.
  *
  * 0 is returned to the daemon and the 'request->port_no' field updated if the
- * port number - generated or given - is available. If a port is not
- * available - because it's in use or non-existent - 'EBUSY' or 'ENODEV' is
- * returned respectively.
+ * port was created. If the port number is in use 'EBUSY' is returned, if no
+ * port of the type can be created 'ENODEV', and otherwise the error from
+ * creating it.
  */
 static void
 vport_cmd_new(struct dpdk_vport_message *request)
@@ -287,6 +638,7 @@ vport_cmd_new(struct dpdk_vport_message *request)
 	uint32_t port_no;
 	char *port_name;
 	uint8_t port_type;
+	int retval = 0;
 
 	port_type = request->type;
 	port_name = request->port_name;
@@ -298,35 +650,25 @@ vport_cmd_new(struct dpdk_vport_message *request)
 
 	/* Haven't requested a given port_number or one supplied is invalid, so get
 	 * one in range */
-	if (!vport_exists(port_no) || !vport_id_is_valid(port_no, port_type))
+	if (!vport_id_is_valid(port_no, port_type))
 		port_no = vport_next_available_index(port_type);
 
 	/* Bridge ports do not exist on the datapath - we should not
 	 * add one to the datapaths list of ports
 	 */
-	if (vport_exists(port_no) && port_type != VPORT_TYPE_BRIDGE) {
-		if (!vport_is_enabled(port_no)) {
-			vport_enable(port_no);
-
-			/* Haven't requested a given port_name, so use default one */
-			if (port_name == NULL)
-				port_name = vport_get_name(port_no);
-			else
-				vport_set_name(port_no, port_name);
-
-			/* We don't need to "set type", as the port's position in the 'vport_info'
-			 * array implicitly defines the type. This will change if the structure
-			 * of this array changes. */
-
+	if (port_type == VPORT_TYPE_BRIDGE || port_no >= MAX_VPORTS) {
+		reply.type = ENODEV;
+	} else if (vport_exists(port_no)) {
+		reply.type = EBUSY;
+	} else {
+		retval = vport_create(port_no, port_type, port_name);
+		if (retval == 0) {
 			/* Populate 'reply' */
 			request->port_no = port_no;
-			strncpy(request->port_name, port_name, MAX_VPORT_NAME_SIZE);
-			reply.type = 0;
-		} else {
-			reply.type = EBUSY;
+			strncpy(request->port_name, vport_get_name(port_no),
+			        MAX_VPORT_NAME_SIZE);
 		}
-	} else {
-		reply.type = ENODEV;
+		reply.type = -retval;
 	}
 
 	reply.vport_msg = *request;
@@ -347,17 +689,26 @@ vport_cmd_del(struct dpdk_vport_message *request)
 	struct dpdk_message reply = {0};
 	uint16_t port_no = request->port_no;
 
-	if (vport_exists(port_no) && vport_is_enabled(port_no)) {
-		vport_disable(port_no);
-		reply.type = 0;
-	} else {
-		reply.type = ENODEV;  /* from a high-level, the device doesn't exist */
-	}
+	/* from a high-level, a disabled device doesn't exist */
+	reply.type = -vport_destroy(port_no);
 
 	reply.vport_msg = *request;
 	send_reply_to_vswitchd(&reply);
 }
 
+/*
+ * Fill in the latency histogram of the vport in 'request'.
+ */
+static void
+vport_latency_get(struct dpdk_vport_message *request)
+{
+	unsigned bucket = 0;
+
+	for (bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++)
+		request->latency[bucket] =
+		        stats_vport_latency_get(request->port_no, bucket);
+}
+
 /*
  * Get current stats for a single vport, and send result to vswitchd.
  */
@@ -376,6 +727,7 @@ vport_cmd_get(struct dpdk_vport_message *request)
 	if (vport_exists(port_no) && vport_is_enabled(port_no)) {
 		request->stats = stats_vport_get(request->port_no);
 		request->type = vport_get_type(request->port_no);
+		vport_latency_get(request);
 
 		strncpy(request->port_name, vport_get_name(request->port_no),
 		        MAX_VPORT_NAME_SIZE);
@@ -406,13 +758,10 @@ vport_cmd_dump(struct dpdk_vport_message *request)
 	else
 		request->port_no += 1;
 
-	/* Skip all ports without the 'enabled' flag. This particular approach is
-	 * necessary due to the current design of the datapath. Ports are currently
-	 * declared and initialised at startup, rather than being allocated and
-	 * initialised "on the fly". We need to check for 'vport_is_enabled' rather
-	 * than 'vport_exists', to prevent vswitchd seeing ports that have not been
-	 * explicitly added via 'ovs-vsctl'. If this were not done the vswitchd
-	 * would spot the "alien" ports and try to remove them, causing issues. */
+	/* Skip all ports without the 'enabled' flag. Ports are only created
+	 * when added via 'ovs-vsctl', but vport 0 exists from startup for
+	 * vswitchd and must not be reported, or vswitchd would spot the "alien"
+	 * port and try to remove it. */
 	for ( ; request->port_no < MAX_VPORTS && !vport_is_enabled(request->port_no)\
 		      ; request->port_no++)
 		;
@@ -420,6 +769,7 @@ vport_cmd_dump(struct dpdk_vport_message *request)
 	if (request->port_no < MAX_VPORTS) {
 		request->stats = stats_vport_get(request->port_no);
 		request->type = vport_get_type(request->port_no);
+		vport_latency_get(request);
 		reply.type = 0;
 	} else {
 		reply.type = EOF;  /* "Exit case" for state machine */
@@ -430,6 +780,39 @@ vport_cmd_dump(struct dpdk_vport_message *request)
 	send_reply_to_vswitchd(&reply);
 }
 
+/*
+ * Get datapath-wide statistics, and send result to vswitchd.
+ */
+static void
+dp_cmd_get(struct dpdk_dp_message *request)
+{
+	struct dpdk_message reply = {0};
+
+	request->stats.n_hit = stats_vswitch_hit_get();
+	request->stats.n_missed = stats_vswitch_miss_get();
+	request->stats.n_lost = stats_vswitch_lost_get();
+	request->stats.n_flows = flow_table_count();
+	reply.type = 0;
+
+	reply.dp_msg = *request;
+	send_reply_to_vswitchd(&reply);
+}
+
+/*
+ * Parse 'datapath message' from vswitchd and send to appropriate handler.
+ */
+static void
+handle_dp_cmd(struct dpdk_dp_message *request)
+{
+	switch (request->cmd) {
+	case DP_CMD_GET:
+		dp_cmd_get(request);
+		break;
+	default:
+		handle_unknown_cmd();
+	}
+}
+
 /*
  * Parse 'vport message' from vswitchd and send to appropriate handler.
  */
@@ -469,6 +852,7 @@ flow_cmd_new(struct dpdk_flow_message *request)
 	if (pos < 0) {
 		if (request->flags & FLAG_CREATE) {
 			flow_table_add_flow(&request->key, request->actions);
+			upcall_pending_clear(&request->key);
 			reply.type = 0;
 		} else {
 			reply.type = ENOENT;
@@ -508,6 +892,7 @@ flow_cmd_del(struct dpdk_flow_message *request)
 
 	if (!memcmp(&request->key, &empty, sizeof(request->key))) {
 		flow_table_del_all();
+		memset(upcall_pending, 0, sizeof(upcall_pending));
 		reply.type = 0;
 	} else {
 		pos = flow_table_lookup(&request->key);
@@ -518,6 +903,7 @@ flow_cmd_del(struct dpdk_flow_message *request)
 			flow_table_get_flow(&request->key,
 			               NULL, &request->stats);
 			flow_table_del_flow(&request->key);
+			upcall_pending_clear(&request->key);
 			reply.type = 0;
 		}
 	}
@@ -618,6 +1004,8 @@ handle_flow_cmd(struct dpdk_flow_message *request)
 static void
 handle_packet_cmd(struct dpdk_packet_message *request, struct rte_mbuf *pkt)
 {
+	/* packets from the daemon were never stamped on receipt */
+	pkt->pkt.hash.rss = 0;
 	action_execute(request->actions, pkt);
 }
 
@@ -632,6 +1020,10 @@ handle_vswitchd_cmd(struct rte_mbuf *mbuf)
 	request = rte_pktmbuf_mtod(mbuf, struct dpdk_message *);
 
 	switch (request->type) {
+	case DP_CMD_FAMILY:
+		handle_dp_cmd(&request->dp_msg);
+		rte_pktmbuf_free(mbuf);
+		break;
 	case VPORT_CMD_FAMILY:
 		handle_vport_cmd(&request->vport_msg);
 		rte_pktmbuf_free(mbuf);
@@ -656,31 +1048,44 @@ handle_vswitchd_cmd(struct rte_mbuf *mbuf)
 void
 datapath_init(void)
 {
+	char ring_name[RTE_RING_NAMESIZE] = {0};
+	struct sockaddr_un addr = {0};
+	unsigned ring_socket = rte_lcore_to_socket_id(vswitchd_core);
+	unsigned ringid = 0;
 	int one = 1;
 
-	vswitchd_packet_ring = rte_ring_create(VSWITCHD_PACKET_RING_NAME,
-			         VSWITCHD_RINGSIZE, SOCKET0, NO_FLAGS);
-	if (vswitchd_packet_ring == NULL)
-		rte_exit(EXIT_FAILURE, "Cannot create packet ring for vswitchd");
+	tsc_hz = rte_get_tsc_hz();
+	upcall_pending_timeout = tsc_hz * UPCALL_PENDING_TIMEOUT_MS / 1000;
+	dpif_signal_interval = tsc_hz * DPIF_SIGNAL_INTERVAL_US / US_PER_S;
+
+	for (ringid = 0; ringid < VSWITCHD_PACKET_RINGS; ringid++) {
+		rte_snprintf(ring_name, sizeof(ring_name),
+		             VSWITCHD_PACKET_RING_NAME, ringid);
+		vswitchd_packet_ring[ringid] = rte_ring_create(ring_name,
+		                 VSWITCHD_RINGSIZE, ring_socket, NO_FLAGS);
+		if (vswitchd_packet_ring[ringid] == NULL)
+			rte_exit(EXIT_FAILURE, "Cannot create packet ring %u for "
+			         "vswitchd", ringid);
+	}
 
 	vswitchd_reply_ring = rte_ring_create(VSWITCHD_REPLY_RING_NAME,
-			         VSWITCHD_RINGSIZE, SOCKET0, NO_FLAGS);
+			         VSWITCHD_RINGSIZE, ring_socket, NO_FLAGS);
 	if (vswitchd_reply_ring == NULL)
 		rte_exit(EXIT_FAILURE, "Cannot create reply ring for vswitchd");
 
 	vswitchd_message_ring = rte_ring_create(VSWITCHD_MESSAGE_RING_NAME,
-			         VSWITCHD_RINGSIZE, SOCKET0, NO_FLAGS);
+			         VSWITCHD_RINGSIZE, ring_socket, NO_FLAGS);
 	if (vswitchd_message_ring == NULL)
 		rte_exit(EXIT_FAILURE, "Cannot create message ring for vswitchd");
 
 	vswitchd_free_ring = rte_ring_create(VSWITCHD_FREE_RING_NAME,
-	         VSWITCHD_RINGSIZE, SOCKET0, NO_FLAGS);
+	         VSWITCHD_RINGSIZE, ring_socket, NO_FLAGS);
 
 	if (vswitchd_free_ring == NULL)
 			rte_exit(EXIT_FAILURE, "Cannot create free ring for vswitchd");
 
 	vswitchd_alloc_ring = rte_ring_create(VSWITCHD_ALLOC_RING_NAME,
-	         VSWITCHD_RINGSIZE, SOCKET0, NO_FLAGS);
+	         VSWITCHD_RINGSIZE, ring_socket, NO_FLAGS);
 
 	if (vswitchd_alloc_ring == NULL)
 			rte_exit(EXIT_FAILURE, "Cannot create alloc ring for vswitchd");
@@ -691,4 +1096,16 @@ datapath_init(void)
 
 	if (ioctl(dpif_socket, FIONBIO, &one) < 0)
 		rte_exit(EXIT_FAILURE, "Cannot make socket non-blocking");
+
+	datapath_socket = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (datapath_socket < 0)
+		rte_exit(EXIT_FAILURE, "Cannot create socket");
+
+	if (ioctl(datapath_socket, FIONBIO, &one) < 0)
+		rte_exit(EXIT_FAILURE, "Cannot make socket non-blocking");
+
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, DATAPATH_SOCKNAME, sizeof(DATAPATH_SOCKNAME));
+	if (bind(datapath_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		rte_exit(EXIT_FAILURE, "Cannot bind datapath socket");
 }
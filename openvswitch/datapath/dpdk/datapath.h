@@ -40,8 +40,21 @@
 #include "flow.h"
 #include "ovdk_datapath_messages.h"
 
+#define UPCALL_PENDING_MAX_DEFAULT 4
+
+/* Misses sent per flow while its upcall is outstanding, 0 for no limit */
+extern unsigned upcall_pending_max;
+/* Misses sent per second per vport, 0 for no limit */
+extern unsigned upcall_rate;
+/* Time the idle vswitchd core sleeps waiting for requests, 0 to busy poll */
+extern unsigned idle_sleep_us;
+
 void handle_request_from_vswitchd(void);
-void send_packet_to_vswitchd(struct rte_mbuf *mbuf, struct dpdk_upcall *info);
+void wait_for_request_from_vswitchd(unsigned timeout_us);
+void send_packet_to_vswitchd(struct rte_mbuf *mbuf, struct dpdk_upcall *info,
+                             uint32_t hash);
+void flush_packets_to_vswitchd(void);
+void send_pending_signal_to_dpif(void);
 void datapath_init(void);
 
 #endif /* __DATAPATH_H_ */
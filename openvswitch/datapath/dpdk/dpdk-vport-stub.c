@@ -39,6 +39,17 @@
 
 struct rte_mbuf *buf_array[MAX_VPORTS][MAX_BUFS] = {NULL};
 
+/* Settings of the modules left out of the unit tests, set by args.c */
+uint32_t burst_tx_delay_time = 0;
+uint32_t burst_tx_retry_num = 0;
+uint32_t port_tx_flush_us[MAX_PHYPORTS] = {0};
+char dev_basename[MAX_BASENAME_SZ] = "vhost-net";
+uint32_t dev_index = 0;
+unsigned mbufs_per_port = 0;
+unsigned mbufs_per_vport = 0;
+uint64_t jumbo_portmask = 0;
+unsigned rebalance_interval_ms = 0;
+
 int buf_tail[MAX_VPORTS] = {0};
 int buf_head[MAX_VPORTS] = {0};
 
@@ -100,6 +111,23 @@ vport_fini(void)
 	return;
 }
 
+int
+vport_create(unsigned vportid, enum vport_type type, const char *name)
+{
+	return 0;
+}
+
+int
+vport_destroy(unsigned vportid)
+{
+	return 0;
+}
+
+void
+vport_quiesce(void)
+{
+}
+
 void
 vport_set_name(unsigned vportid, const char *fmt, ...)
 {
@@ -153,3 +181,9 @@ void
 vport_disable(unsigned vportid)
 {
 }
+
+unsigned
+vport_queues_export(struct stats_export_queue *queues, unsigned max)
+{
+	return 0;
+}
@@ -32,8 +32,11 @@
  *
  */
 
+#include <errno.h>
+
 #include <rte_fbk_hash.h>
 #include <rte_memzone.h>
+#include <rte_malloc.h>
 #include <rte_hash.h>
 #include <rte_cpuflags.h>
 #include <rte_tcp.h>
@@ -50,14 +53,21 @@
 #include <rte_jhash.h>
 #endif
 
+#ifdef RTE_MACHINE_CPUFLAG_SSSE3
+#include <tmmintrin.h>
+/* Shuffle index that zeroes the destination byte */
+#define ZERO_BYTE           ((char)0x80)
+#endif
+
 #include <linux/openvswitch.h>
 
 #include "flow.h"
 #include "action.h"
 #include "datapath.h"
+#include "stats.h"
 
 #define CHECK_POS(pos) do {\
-                             if ((pos) >= MAX_FLOWS || (pos) < 0) return -1; \
+                             if ((pos) >= (int)flow_table_size || (pos) < 0) return -1; \
                           } while (0)
 
 #define CHECK_NULL(ptr)   do { \
@@ -66,13 +76,23 @@
 
 #define RTE_LOGTYPE_APP RTE_LOGTYPE_USER1
 #define NO_FLAGS             0
-#define HASH_NAME           "flow_table"
-#define HASH_BUCKETS        4
-#define SOCKET0             0
 #define VLAN_ID_MASK        0xFFF
 #define VLAN_PRIO_SHIFT     13
 #define TCP_FLAG_MASK       0x3F
+#define IPV6_LABEL_MASK     0xFFFFF
+#define IPV6_TCLASS_SHIFT   20
+#define IPV6_TCLASS_MASK    0xFF
+#define IPV6_FRAG_OFF_MASK  0xFFF8
+#define ICMPV6_HDR_LEN      4
+#define ICMPV6_ND_SOLICIT   135
+#define ICMPV6_ND_ADVERT    136
+#define ND_OPT_SOURCE_LINKADDR 1
+#define ND_OPT_TARGET_LINKADDR 2
+#define ND_OPT_LEN_UNIT     8
+#define ARP_HRD_ETHER       1
 #define MZ_FLOW_TABLE       "MProc_flow_table"
+#define FLOW_INDEX_SEARCH_MAX 512
+#define FLOW_INDEX_ALT_MULT 0x9e3779b1
 
 /* IP and Ethernet printing formats and arguments */
 #define ETH_FMT "%02"PRIx8":%02"PRIx8":%02"PRIx8":%02"PRIx8":%02"PRIx8":%02"PRIx8
@@ -80,11 +100,6 @@
 #define IP_FMT "%"PRIu8".%"PRIu8".%"PRIu8".%"PRIu8
 #define IP_ARGS(ip) ((ip >> 24) & 0xFF), ((ip >> 16) & 0xFF), ((ip >> 8) & 0xFF), (ip & 0xFF)
 
-#define TCP_HDR_FROM_PKT(pkt) (struct tcp_hdr*)\
-	(rte_pktmbuf_mtod(pkt, unsigned char *) + \
-			sizeof(struct ether_hdr) + \
-			sizeof(struct ipv4_hdr))
-
 struct flow_table_entry {
 	rte_rwlock_t lock;   /* Lock to allow multiple readers and one writer */
 	struct flow_key key;     /* Flow key. */
@@ -93,60 +108,488 @@ struct flow_table_entry {
 	struct action actions[MAX_ACTIONS];    /* Type of action */
 };
 
-/* Parameters used for hash table */
-static struct rte_hash_parameters hash_table_params = {
-	.name               = HASH_NAME,
-	.entries            = MAX_FLOWS,
-	.bucket_entries     = HASH_BUCKETS,
-	.key_len            = sizeof(struct flow_key),
-	.hash_func          = rte_jhash,
-	.hash_func_init_val = 0,
-	.socket_id          = SOCKET0,
+uint32_t flow_table_size = FLOW_TABLE_SIZE_DEFAULT;
+uint32_t flow_table_bucket_entries = FLOW_TABLE_BUCKET_ENTRIES_DEFAULT;
+int flow_table_socket = SOCKET_ID_ANY;
+
+/* Hash function used for the flow table */
+static rte_hash_function flow_hash_func = rte_jhash;
+static uint32_t flow_hash_init_val = 0;
+
+/*
+ * Toeplitz key programmed into the NICs when RSS hashing is enabled, so the
+ * flow table can compute the same hash in software.
+ */
+const uint8_t flow_rss_key[FLOW_RSS_KEY_LEN] = {
+	0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+	0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+	0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+	0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+	0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
 };
 
+/* Largest Toeplitz input: IPv6 addresses and ports */
+#define FLOW_RSS_INPUT_MAX  36
+
+bool use_rss_hash = false;
+/* Toeplitz hash contribution of each byte value at each input position */
+static uint32_t rss_table[FLOW_RSS_INPUT_MAX][UINT8_MAX + 1];
+/* Hash used for keys which the NIC does not hash */
+static rte_hash_function flow_key_default_hash = rte_jhash;
+
 static struct flow_table_entry *flow_table = NULL;
-static struct rte_hash *handle = NULL;
+/* Number of flows in the table, only updated by the vswitchd core */
+static uint32_t flow_count = 0;
+/*
+ * Number of flows indexed by the overflow hash, only updated by the vswitchd
+ * core. With RSS hashing, IP flows that differ only outside the addresses
+ * and ports share a hash, and so at most two buckets; flows that do not fit
+ * in them are indexed by a hash of the whole key instead.
+ */
+static volatile uint32_t flow_overflow_count = 0;
+
+/*
+ * Flow table index, a bucketized cuckoo hash of flow table positions. A key
+ * may be in one of two buckets: the first is chosen by its hash, the second
+ * is derived from the first and the hash, so that an entry can be moved to
+ * its other bucket without the key. When both buckets of a new key are full,
+ * entries are displaced along the shortest path found to a free slot, which
+ * keeps adds succeeding at well above 90% occupancy.
+ *
+ * Only the vswitchd core modifies the index. Entries are copied before their
+ * old slot is cleared, but a lookup racing a displacement can still miss, in
+ * which case the packet is handled as any other miss.
+ */
+struct flow_index_slot {
+	uint32_t sig;            /* Flow key hash */
+	volatile int32_t pos;    /* Flow table position, -1 if unused */
+};
+
+/* Node of the breadth first search for a displacement path */
+struct flow_index_node {
+	uint32_t bucket;
+	int parent;              /* Node the entry is moved from, -1 for none */
+	unsigned slot;           /* Slot of the entry in the parent's bucket */
+};
+
+static struct flow_index_slot *flow_index = NULL;
+static uint32_t flow_index_bucket_mask = 0;
+static struct flow_index_node flow_index_search[FLOW_INDEX_SEARCH_MAX];
+/* Stack of unused flow table positions */
+static int32_t *flow_free_pos = NULL;
+static uint32_t flow_free_count = 0;
+
+/*
+ * Per-lcore direct mapped cache of recently matched flows, indexed by the
+ * flow key hash. Entries are only valid for the flow table generation they
+ * were added in, which is increased whenever flows are deleted, so that
+ * stale positions are dropped without touching every lcore's cache. Adding
+ * or modifying a flow does not invalidate it, as only hits are cached.
+ */
+#define MICROFLOW_CACHE_SIZE  2048
+#define MICROFLOW_CACHE_MASK  (MICROFLOW_CACHE_SIZE - 1)
+
+struct microflow_entry {
+	uint32_t hash;
+	uint32_t generation;
+	int32_t pos;
+};
+
+static struct microflow_entry
+	microflow_cache[RTE_MAX_LCORE][MICROFLOW_CACHE_SIZE] __rte_cache_aligned;
+/* Generation 0 is never valid, so zeroed cache entries are never used */
+static volatile uint32_t flow_table_generation = 1;
 
 static uint64_t ovs_flow_used_time(uint64_t flow_tsc);
 static int copy_entry_from_table(int pos, struct flow_key *key,
             struct action *actions, struct flow_stats *stats);
-static int flow_table_update_stats(int pos, const struct rte_mbuf *pkt);
+static int flow_table_update_stats(int pos, const struct rte_mbuf *pkt,
+                                   uint16_t l4_offset);
+static int flow_table_clear_stats(int pos);
+static void flow_index_reset(void);
+static uint32_t flow_key_rss_hash(const void *data, uint32_t data_len,
+                                  uint32_t init_val);
+
+/*
+ * Return the 32 bits of the RSS key starting at bit 'bit'
+ */
+static uint32_t
+rss_key_window(unsigned bit)
+{
+	const uint8_t *k = &flow_rss_key[bit / 8];
+	uint64_t window = (uint64_t)k[0] << 32 | (uint64_t)k[1] << 24 |
+	                  k[2] << 16 | k[3] << 8 | k[4];
+
+	return (uint32_t)(window >> (8 - bit % 8));
+}
+
+/*
+ * Precompute the Toeplitz hash of every byte value at every input position,
+ * so that hashing an input is one table lookup per byte.
+ */
+static void
+flow_rss_init(void)
+{
+	unsigned pos = 0, val = 0, bit = 0;
+
+	for (pos = 0; pos < FLOW_RSS_INPUT_MAX; pos++) {
+		for (val = 0; val <= UINT8_MAX; val++) {
+			rss_table[pos][val] = 0;
+			for (bit = 0; bit < 8; bit++)
+				if (val & (0x80 >> bit))
+					rss_table[pos][val] ^= rss_key_window(pos * 8 + bit);
+		}
+	}
+}
 
 /* Initialize the flow table  */
 void
 flow_table_init(void)
 {
-	unsigned flow_table_size = sizeof(struct flow_table_entry) * MAX_FLOWS;
+	size_t table_size = sizeof(struct flow_table_entry) * flow_table_size;
 	const struct rte_memzone *mz = NULL;
-	int pos = 0;
+	int socket = flow_table_socket;
+	uint32_t pos = 0;
+
+	if (!rte_is_power_of_2(flow_table_size) ||
+	    !rte_is_power_of_2(flow_table_bucket_entries) ||
+	    flow_table_bucket_entries > FLOW_TABLE_BUCKET_ENTRIES_MAX ||
+	    flow_table_size < 2 * flow_table_bucket_entries)
+		rte_exit(EXIT_FAILURE, "Invalid flow table size %u with %u "
+		         "entries per bucket\n", flow_table_size,
+		         flow_table_bucket_entries);
+	if (socket == SOCKET_ID_ANY)
+		socket = rte_socket_id();
+
 	/* set up array for flow table data */
-	mz = rte_memzone_reserve(MZ_FLOW_TABLE, flow_table_size,
-	                         rte_socket_id(), NO_FLAGS);
+	mz = rte_memzone_reserve(MZ_FLOW_TABLE, table_size, socket, NO_FLAGS);
 	if (mz == NULL)
 		rte_exit(EXIT_FAILURE, "Cannot reserve memory zone for flow"
 		                       "table \n");
-	memset(mz->addr, 0, flow_table_size);
+	memset(mz->addr, 0, table_size);
 	flow_table = mz->addr;
-	for (pos = 0; pos < MAX_FLOWS; pos++) {
+	for (pos = 0; pos < flow_table_size; pos++) {
 		rte_rwlock_init(&flow_table[pos].lock);
 	}
 
+	flow_index = rte_malloc_socket("flow_index",
+	                               sizeof(*flow_index) * flow_table_size,
+	                               CACHE_LINE_SIZE, socket);
+	flow_free_pos = rte_malloc_socket("flow_free_pos",
+	                                  sizeof(*flow_free_pos) * flow_table_size,
+	                                  0, socket);
+	if (flow_index == NULL || flow_free_pos == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot allocate flow table index\n");
+	flow_index_bucket_mask = flow_table_size / flow_table_bucket_entries - 1;
+	flow_index_reset();
+
+	RTE_LOG(INFO, APP, "Flow table of %u flows, %u per bucket, on socket "
+	        "%d\n", flow_table_size, flow_table_bucket_entries, socket);
+
 #ifdef RTE_MACHINE_CPUFLAG_SSE4_2
-	hash_table_params.hash_func = rte_hash_crc;
+	flow_hash_func = rte_hash_crc;
 	/* Check if hardware-accelerated hashing supported */
 	if (!rte_cpu_get_flag_enabled(RTE_CPUFLAG_SSE4_2)) {
 		RTE_LOG(WARNING, HASH, "CRC32 instruction requires SSE4.2, "
 		              "which is not supported on this system. "
 		              "Falling back to software hash.\n");
-		hash_table_params.hash_func = rte_jhash;
+		flow_hash_func = rte_jhash;
 	}
 	RTE_LOG(WARNING, HASH, "Enabling CRC32 instruction for hashing\n");
 #endif /* This check does not compile if SSE4_2 is not enabled for build */
 
-	handle = rte_hash_create(&hash_table_params);
-	if (handle == NULL) {
-		rte_exit(EXIT_FAILURE, "Failed to create hash table\n");
+	if (use_rss_hash) {
+		RTE_LOG(INFO, HASH, "Using NIC RSS hash for flow table lookups\n");
+		flow_rss_init();
+		flow_key_default_hash = flow_hash_func;
+		flow_hash_func = flow_key_rss_hash;
 	}
+
+	flow_count = 0;
+}
+
+/*
+ * Hash 'key' using the same function as the flow table.
+ */
+inline uint32_t __attribute__((always_inline))
+flow_key_hash(const struct flow_key *key)
+{
+#ifdef RTE_MACHINE_CPUFLAG_SSE4_2
+	/* Call directly so the fixed length CRC loop is unrolled */
+	if (likely(flow_hash_func == rte_hash_crc))
+		return rte_hash_crc(key, FLOW_KEY_HASH_LEN, flow_hash_init_val);
+#endif
+	return flow_hash_func(key, FLOW_KEY_HASH_LEN, flow_hash_init_val);
+}
+
+/*
+ * Flow table hash function used when RSS hashing is enabled. IP keys are
+ * hashed the same way as the NIC does with FLOW_RSS_HF; ports are only
+ * included for unfragmented TCP and UDP. Any other key uses the default
+ * hash function.
+ */
+static uint32_t
+flow_key_rss_hash(const void *data, uint32_t data_len, uint32_t init_val)
+{
+	const struct flow_key *key = data;
+	uint8_t input[FLOW_RSS_INPUT_MAX];
+	uint32_t addrs[2];
+	uint16_t ports[2];
+	uint32_t hash = 0;
+	unsigned len = 0;
+	unsigned i = 0;
+
+	if (key->ether_type == ETHER_TYPE_IPv4) {
+		addrs[0] = rte_cpu_to_be_32(key->ip_src);
+		addrs[1] = rte_cpu_to_be_32(key->ip_dst);
+		memcpy(input, addrs, sizeof(addrs));
+		len = sizeof(addrs);
+	} else if (key->ether_type == ETHER_TYPE_IPv6) {
+		memcpy(input, key->ipv6_src, sizeof(key->ipv6_src));
+		memcpy(input + sizeof(key->ipv6_src), key->ipv6_dst,
+		       sizeof(key->ipv6_dst));
+		len = sizeof(key->ipv6_src) + sizeof(key->ipv6_dst);
+	} else {
+		return flow_key_default_hash(data, data_len, init_val);
+	}
+
+	if ((key->ip_proto == IPPROTO_TCP || key->ip_proto == IPPROTO_UDP) &&
+	    key->ip_frag == OVS_FRAG_TYPE_NONE) {
+		ports[0] = rte_cpu_to_be_16(key->tran_src_port);
+		ports[1] = rte_cpu_to_be_16(key->tran_dst_port);
+		memcpy(input + len, ports, sizeof(ports));
+		len += sizeof(ports);
+	}
+
+	for (i = 0; i < len; i++)
+		hash ^= rss_table[i][input[i]];
+
+	return hash;
+}
+
+/*
+ * Return the first slot of flow table index bucket 'bucket'
+ */
+static inline struct flow_index_slot * __attribute__((always_inline))
+flow_index_bucket(uint32_t bucket)
+{
+	return &flow_index[bucket * flow_table_bucket_entries];
+}
+
+/*
+ * Return the other bucket of a key with hash 'sig' which is in 'bucket'.
+ * The lowest bit is always flipped, so the two buckets differ.
+ */
+static inline uint32_t __attribute__((always_inline))
+flow_index_alt_bucket(uint32_t bucket, uint32_t sig)
+{
+	return (bucket ^ (rte_bswap32(sig * FLOW_INDEX_ALT_MULT) | 1)) &
+	       flow_index_bucket_mask;
+}
+
+static inline int __attribute__((always_inline))
+flow_index_bucket_lookup(uint32_t bucket, const struct flow_key *key,
+                         uint32_t sig)
+{
+	const struct flow_index_slot *slot = flow_index_bucket(bucket);
+	unsigned i = 0;
+	int32_t pos = 0;
+
+	for (i = 0; i < flow_table_bucket_entries; i++) {
+		if (slot[i].sig != sig)
+			continue;
+		pos = slot[i].pos;
+		if (pos >= 0 && !memcmp(&flow_table[pos].key, key, sizeof(*key)))
+			return pos;
+	}
+
+	return -ENOENT;
+}
+
+/*
+ * Return the flow table position of 'key', which hashes to 'sig'
+ */
+static inline int __attribute__((always_inline))
+flow_index_lookup(const struct flow_key *key, uint32_t sig)
+{
+	uint32_t bucket = sig & flow_index_bucket_mask;
+	int pos = flow_index_bucket_lookup(bucket, key, sig);
+
+	if (pos < 0)
+		pos = flow_index_bucket_lookup(flow_index_alt_bucket(bucket, sig),
+		                               key, sig);
+	return pos;
+}
+
+/*
+ * Return the hash a flow is indexed with when it does not fit in the
+ * buckets of its RSS hash.
+ */
+static inline uint32_t __attribute__((always_inline))
+flow_key_overflow_hash(const struct flow_key *key)
+{
+	return flow_key_default_hash(key, FLOW_KEY_HASH_LEN, flow_hash_init_val);
+}
+
+/*
+ * Return the flow table position of 'key', trying the overflow hash if it
+ * is not indexed by its own hash. 'sig' is set to the hash it was found with.
+ */
+static int
+flow_index_find(const struct flow_key *key, uint32_t *sig)
+{
+	int pos = 0;
+
+	*sig = flow_key_hash(key);
+	pos = flow_index_lookup(key, *sig);
+	if (pos < 0 && flow_overflow_count) {
+		*sig = flow_key_overflow_hash(key);
+		pos = flow_index_lookup(key, *sig);
+	}
+
+	return pos;
+}
+
+/*
+ * Return true if 'bucket' is on the search path ending at node 'node'
+ */
+static bool
+flow_index_on_path(int node, uint32_t bucket)
+{
+	for (; node >= 0; node = flow_index_search[node].parent)
+		if (flow_index_search[node].bucket == bucket)
+			return true;
+
+	return false;
+}
+
+/*
+ * Add flow table position 'pos' to the index with hash 'sig'. If both
+ * buckets are full, search breadth first for the shortest chain of entries
+ * that can each move to their other bucket, ending in a bucket with a free
+ * slot, and move them starting from the end of the chain.
+ */
+static int
+flow_index_add(uint32_t sig, int32_t pos)
+{
+	struct flow_index_node *node = flow_index_search;
+	struct flow_index_slot *from = NULL;
+	struct flow_index_slot *to = NULL;
+	unsigned head = 0, tail = 0, i = 0;
+	uint32_t bucket = 0;
+	int slot = -1;
+
+	node[0].bucket = sig & flow_index_bucket_mask;
+	node[0].parent = -1;
+	node[1].bucket = flow_index_alt_bucket(node[0].bucket, sig);
+	node[1].parent = -1;
+	tail = 2;
+
+	for (head = 0; head < tail; head++) {
+		to = flow_index_bucket(node[head].bucket);
+		for (i = 0; i < flow_table_bucket_entries; i++) {
+			if (to[i].pos < 0) {
+				slot = i;
+				break;
+			}
+		}
+		if (slot >= 0)
+			break;
+
+		for (i = 0; i < flow_table_bucket_entries &&
+		            tail < FLOW_INDEX_SEARCH_MAX; i++) {
+			bucket = flow_index_alt_bucket(node[head].bucket, to[i].sig);
+			/* A path must not pass through a bucket twice */
+			if (flow_index_on_path(head, bucket))
+				continue;
+			node[tail].bucket = bucket;
+			node[tail].parent = head;
+			node[tail].slot = i;
+			tail++;
+		}
+	}
+	if (slot < 0)
+		return -ENOSPC;
+
+	/* Move each entry on the path into the slot freed before it */
+	for (; node[head].parent >= 0; head = node[head].parent) {
+		from = &flow_index_bucket(node[node[head].parent].bucket)[node[head].slot];
+		to = &flow_index_bucket(node[head].bucket)[slot];
+		to->sig = from->sig;
+		rte_wmb();
+		to->pos = from->pos;
+		rte_wmb();
+		from->pos = -1;
+		slot = node[head].slot;
+	}
+
+	to = &flow_index_bucket(node[head].bucket)[slot];
+	to->sig = sig;
+	rte_wmb();
+	to->pos = pos;
+
+	return 0;
+}
+
+/*
+ * Remove flow table position 'pos', which hashes to 'sig', from the index
+ */
+static void
+flow_index_del(uint32_t sig, int32_t pos)
+{
+	uint32_t bucket = sig & flow_index_bucket_mask;
+	struct flow_index_slot *slot = NULL;
+	unsigned i = 0, j = 0;
+
+	for (j = 0; j < 2; j++) {
+		slot = flow_index_bucket(bucket);
+		for (i = 0; i < flow_table_bucket_entries; i++) {
+			if (slot[i].pos == pos) {
+				slot[i].pos = -1;
+				return;
+			}
+		}
+		bucket = flow_index_alt_bucket(bucket, sig);
+	}
+}
+
+/*
+ * Empty the flow table index and mark every flow table position unused
+ */
+static void
+flow_index_reset(void)
+{
+	uint32_t pos = 0;
+
+	for (pos = 0; pos < flow_table_size; pos++)
+		flow_index[pos].pos = -1;
+
+	/* Lowest positions are used first */
+	flow_free_count = 0;
+	for (pos = flow_table_size; pos > 0; pos--)
+		flow_free_pos[flow_free_count++] = pos - 1;
+}
+
+/*
+ * Clear the flow table entry at 'pos'
+ */
+static void
+flow_table_clear_entry(int pos)
+{
+	/* As we are writing to the table, acquire write lock */
+	rte_rwlock_write_lock(&flow_table[pos].lock);
+
+	memset((void *)&flow_table[pos].key, 0,
+	       sizeof(flow_table[pos].key));
+	memset((void *)&flow_table[pos].actions, 0,
+	       sizeof(flow_table[pos].actions));
+	flow_table[pos].enabled = false;
+
+	/* release lock as table has been written */
+	rte_rwlock_write_unlock(&flow_table[pos].lock);
+
+	/* dont care about locking stats */
+	flow_table_clear_stats(pos);
 }
 
 /*
@@ -169,18 +612,21 @@ flow_table_clear_stats(int pos)
 int
 flow_table_add_flow(const struct flow_key *key, const struct action *actions)
 {
+	uint32_t hash = 0;
 	int pos = 0;
 	CHECK_NULL(key);
 	CHECK_NULL(actions);
 
-	pos = flow_table_lookup(key);
+	pos = flow_index_find(key, &hash);
 	/* already exists */
 	if (pos >= 0) {
 		return -1;
 	}
+	hash = flow_key_hash(key);
 
-	pos = rte_hash_add_key(handle, key);
-	CHECK_POS(pos);
+	if (flow_free_count == 0)
+		return -1;
+	pos = flow_free_pos[--flow_free_count];
 
 	/* As we are writing to the table, acquire write lock */
 	rte_rwlock_write_lock(&flow_table[pos].lock);
@@ -195,6 +641,19 @@ flow_table_add_flow(const struct flow_key *key, const struct action *actions)
 
 	/* dont care about locking stats */
 	flow_table_clear_stats(pos);
+
+	/* only make the flow visible once it has been written */
+	if (flow_index_add(hash, pos) < 0) {
+		if (!use_rss_hash || flow_key_overflow_hash(key) == hash ||
+		    flow_index_add(flow_key_overflow_hash(key), pos) < 0) {
+			flow_table_clear_entry(pos);
+			flow_free_pos[flow_free_count++] = pos;
+			return -1;
+		}
+		flow_overflow_count++;
+	}
+
+	flow_count++;
 	return pos;
 }
 
@@ -300,7 +759,7 @@ int flow_table_get_next_flow(const struct flow_key *key,
 	CHECK_POS(pos);
 	pos++;
 
-	for (; pos < MAX_FLOWS; pos++) {
+	for (; pos < (int)flow_table_size; pos++) {
 		/* dont lock as only writer should call this */
 		ret = copy_entry_from_table(pos, next_key, actions, stats);
 		if (ret == pos) {
@@ -308,7 +767,7 @@ int flow_table_get_next_flow(const struct flow_key *key,
 		}
 	}
 
-	if (pos == MAX_FLOWS)
+	if (pos == (int)flow_table_size)
 		ret = -1;
 
 	return ret;
@@ -325,7 +784,7 @@ int flow_table_get_first_flow(struct flow_key *first_key, struct action *actions
 	int pos = 0;
 	int ret = -1;
 
-	for (pos = 0; pos < MAX_FLOWS; pos++) {
+	for (pos = 0; pos < (int)flow_table_size; pos++) {
 		/* dont lock as only writer should call this */
 		ret = copy_entry_from_table(pos, first_key, actions, stats);
 		if (ret == pos) {
@@ -333,7 +792,7 @@ int flow_table_get_first_flow(struct flow_key *first_key, struct action *actions
 		}
 	}
 
-	if (pos == MAX_FLOWS)
+	if (pos == (int)flow_table_size)
 		return -1;
 
 	return ret;
@@ -345,25 +804,20 @@ int flow_table_get_first_flow(struct flow_key *first_key, struct action *actions
 int
 flow_table_del_flow(const struct flow_key *key)
 {
+	uint32_t hash = 0;
 	int pos = 0;
 	CHECK_NULL(key);
-	pos = rte_hash_del_key(handle, key);
+	pos = flow_index_find(key, &hash);
 	CHECK_POS(pos);
 
-	/* As we are writing to the table, acquire write lock */
-	rte_rwlock_write_lock(&flow_table[pos].lock);
-
-	memset((void *)&flow_table[pos].key, 0,
-	       sizeof(flow_table[pos].key));
-	memset((void *)&flow_table[pos].actions, 0,
-	       sizeof(flow_table[pos].actions));
-	flow_table[pos].enabled = false;
-
-	/* release lock as table has been written */
-	rte_rwlock_write_unlock(&flow_table[pos].lock);
-
-	/* dont care about locking stats */
-	flow_table_clear_stats(pos);
+	/* remove the flow from the index before clearing it */
+	flow_index_del(hash, pos);
+	if (hash != flow_key_hash(key))
+		flow_overflow_count--;
+	flow_table_clear_entry(pos);
+	flow_free_pos[flow_free_count++] = pos;
+	flow_count--;
+	flow_table_generation++;
 	return pos;
 }
 
@@ -373,39 +827,51 @@ flow_table_del_flow(const struct flow_key *key)
 void
 flow_table_del_all(void)
 {
-	int pos = 0;
-	struct flow_key *key = NULL;
-
-	for (pos = 0; pos < MAX_FLOWS; pos++) {
-		key = &(flow_table[pos].key);
-		flow_table_clear_stats(pos);
-		rte_hash_del_key(handle, key);
-
-		/* As we are writing to the table, acquire write lock */
-		rte_rwlock_write_lock(&flow_table[pos].lock);
+	uint32_t pos = 0;
 
-		memset(key, 0, sizeof(struct flow_key));
-		memset((void *)&flow_table[pos].actions, 0,
-		       sizeof(flow_table[pos].actions));
-		flow_table[pos].enabled = false;
+	flow_index_reset();
+	for (pos = 0; pos < flow_table_size; pos++)
+		flow_table_clear_entry(pos);
 
-		/* release lock as table has been written */
-		rte_rwlock_write_unlock(&flow_table[pos].lock);
+	flow_count = 0;
+	flow_overflow_count = 0;
+	flow_table_generation++;
+}
 
-	}
+/*
+ * Return the number of flows in the flow table
+ */
+uint32_t
+flow_table_count(void)
+{
+	return flow_count;
+}
 
+/*
+ * Return the number of flows indexed by the overflow hash
+ */
+uint32_t
+flow_table_overflow_count(void)
+{
+	return flow_overflow_count;
 }
 
 /*
- * Use 'pkt' to update stats at entry 'key' in flow_table
+ * Use 'pkt' to update stats at entry 'key' in flow_table. 'l4_offset' is
+ * where flow_key_parse() found the L4 header of 'pkt', or 0.
  */
 static inline int __attribute__((always_inline))
-flow_table_update_stats(int pos, const struct rte_mbuf *pkt)
+flow_table_update_stats(int pos, const struct rte_mbuf *pkt,
+                        uint16_t l4_offset)
 {
-	if (flow_table[pos].key.ether_type == ETHER_TYPE_IPv4 &&
-	    flow_table[pos].key.ip_proto == IPPROTO_TCP) {
-		struct tcp_hdr *tcp_hdr = TCP_HDR_FROM_PKT(pkt);
-		flow_table[pos].stats.tcp_flags |= tcp_hdr->tcp_flags & TCP_FLAG_MASK;
+	const struct tcp_hdr *tcp_hdr = NULL;
+
+	if (flow_table[pos].key.ip_proto == IPPROTO_TCP && l4_offset != 0) {
+		if (l4_offset + sizeof(struct tcp_hdr) <= rte_pktmbuf_data_len(pkt)) {
+			tcp_hdr = (const struct tcp_hdr *)
+			          (rte_pktmbuf_mtod(pkt, const unsigned char *) + l4_offset);
+			flow_table[pos].stats.tcp_flags |= tcp_hdr->tcp_flags & TCP_FLAG_MASK;
+		}
 	}
 
 	flow_table[pos].stats.used = curr_tsc;
@@ -433,20 +899,252 @@ struct icmp_hdr {
 	uint8_t icmp_data[0];
 };
 
+/* ARP header for Ethernet/IPv4 */
+struct arp_hdr {
+	uint16_t arp_hrd;
+	uint16_t arp_pro;
+	uint8_t arp_hln;
+	uint8_t arp_pln;
+	uint16_t arp_op;
+	struct ether_addr arp_sha;
+	uint32_t arp_spa;
+	struct ether_addr arp_tha;
+	uint32_t arp_tpa;
+} __attribute__((__packed__));
+
+/* IPv6 extension header, common part */
+struct ipv6_ext_hdr {
+	uint8_t next_header;
+	uint8_t len;
+};
+
+struct ipv6_frag_hdr {
+	uint8_t next_header;
+	uint8_t reserved;
+	uint16_t frag_off;
+	uint32_t ident;
+};
+
+/* IPv6 neighbor solicitation/advertisement, following the ICMPv6 header */
+struct nd_msg {
+	uint32_t reserved;
+	uint8_t target[16];
+	uint8_t options[0];
+};
+
+struct nd_opt_hdr {
+	uint8_t type;
+	uint8_t len;    /* In units of 8 bytes */
+};
+
 /*
- * Extract 13 tuple from pkt as key
+ * Copy the big endian source and destination ports at 'l4' to 'key',
+ * swapping both with one 32 bit load and store.
  */
-inline void __attribute__((always_inline))
-flow_key_extract(const struct rte_mbuf *pkt, uint8_t in_port,
-                 struct flow_key *key)
+static inline void __attribute__((always_inline))
+flow_key_set_ports(struct flow_key *key, const void *l4)
+{
+	uint32_t ports = *(const uint32_t *)l4;
+
+	ports = ((ports & 0x00FF00FF) << 8) | ((ports >> 8) & 0x00FF00FF);
+	*(uint32_t *)&key->tran_src_port = ports;
+}
+
+/*
+ * Extract TCP, UDP or ICMP ports from 'pkt_data' into 'key', where
+ * 'key->ip_proto' has already been set.
+ */
+static inline void __attribute__((always_inline))
+flow_key_extract_l4(unsigned char *pkt_data, const unsigned char *pkt_end,
+                    struct flow_key *key)
+{
+	struct icmp_hdr *icmp = NULL;
+	struct nd_msg *nd = NULL;
+	struct nd_opt_hdr *opt = NULL;
+	unsigned opt_len = 0;
+
+	/* Every L4 header parsed below starts with at least 4 bytes */
+	if (pkt_data + sizeof(uint32_t) > pkt_end)
+		return;
+
+	switch (key->ip_proto) {
+		case IPPROTO_TCP:
+		case IPPROTO_UDP:
+			/* Both start with the source and destination ports */
+			flow_key_set_ports(key, pkt_data);
+			break;
+		case IPPROTO_ICMP:
+			icmp = (struct icmp_hdr *)pkt_data;
+
+			key->tran_dst_port = icmp->icmp_code;
+			key->tran_src_port = icmp->icmp_type;
+			break;
+		case IPPROTO_ICMPV6:
+			icmp = (struct icmp_hdr *)pkt_data;
+			pkt_data += ICMPV6_HDR_LEN;
+
+			key->tran_dst_port = icmp->icmp_code;
+			key->tran_src_port = icmp->icmp_type;
+
+			if (icmp->icmp_code != 0 ||
+			    (icmp->icmp_type != ICMPV6_ND_SOLICIT &&
+			     icmp->icmp_type != ICMPV6_ND_ADVERT) ||
+			    pkt_data + sizeof(struct nd_msg) > pkt_end)
+				break;
+
+			nd = (struct nd_msg *)pkt_data;
+			pkt_data = nd->options;
+			memcpy(key->nd_target, nd->target, sizeof(key->nd_target));
+
+			/* Same rules as vswitchd: a malformed or repeated option
+			 * invalidates all neighbor discovery fields */
+			while (pkt_data + ND_OPT_LEN_UNIT <= pkt_end) {
+				opt = (struct nd_opt_hdr *)pkt_data;
+				opt_len = opt->len * ND_OPT_LEN_UNIT;
+				if (opt_len == 0 || pkt_data + opt_len > pkt_end)
+					goto invalid_nd;
+
+				if (opt->type == ND_OPT_SOURCE_LINKADDR &&
+				    opt_len == ND_OPT_LEN_UNIT) {
+					if (!is_zero_ether_addr(&key->nd_sll))
+						goto invalid_nd;
+					ether_addr_copy((struct ether_addr *)(opt + 1),
+					                &key->nd_sll);
+				} else if (opt->type == ND_OPT_TARGET_LINKADDR &&
+				           opt_len == ND_OPT_LEN_UNIT) {
+					if (!is_zero_ether_addr(&key->nd_tll))
+						goto invalid_nd;
+					ether_addr_copy((struct ether_addr *)(opt + 1),
+					                &key->nd_tll);
+				}
+				pkt_data += opt_len;
+			}
+			break;
+invalid_nd:
+			memset(key->nd_target, 0, sizeof(key->nd_target));
+			memset(&key->nd_sll, 0, sizeof(key->nd_sll));
+			memset(&key->nd_tll, 0, sizeof(key->nd_tll));
+			break;
+		default:
+			key->tran_dst_port = 0;
+			key->tran_src_port = 0;
+	}
+}
+
+/*
+ * Extract IPv6 header fields from 'pkt_data' into 'key', walking any
+ * extension headers the same way vswitchd does. Returns a pointer to the
+ * upper layer header, or NULL if it should not be parsed.
+ */
+static inline unsigned char * __attribute__((always_inline))
+flow_key_extract_ipv6(unsigned char *pkt_data, const unsigned char *pkt_end,
+                      struct flow_key *key)
+{
+	struct ipv6_hdr *ipv6_hdr = (struct ipv6_hdr *)pkt_data;
+	struct ipv6_ext_hdr *ext_hdr = NULL;
+	struct ipv6_frag_hdr *frag_hdr = NULL;
+	uint32_t vtc_flow = 0;
+	uint8_t next_header = 0;
+
+	pkt_data += sizeof(struct ipv6_hdr);
+
+	vtc_flow = rte_be_to_cpu_32(ipv6_hdr->vtc_flow);
+	memcpy(key->ipv6_src, ipv6_hdr->src_addr, sizeof(key->ipv6_src));
+	memcpy(key->ipv6_dst, ipv6_hdr->dst_addr, sizeof(key->ipv6_dst));
+	key->ipv6_label = vtc_flow & IPV6_LABEL_MASK;
+	key->ip_tos = (vtc_flow >> IPV6_TCLASS_SHIFT) & IPV6_TCLASS_MASK;
+	key->ip_ttl = ipv6_hdr->hop_limits;
+	key->ip_frag = OVS_FRAG_TYPE_NONE;
+
+	next_header = ipv6_hdr->proto;
+	for (;;) {
+		if (pkt_data + sizeof(struct ipv6_ext_hdr) > pkt_end)
+			break;
+
+		if (next_header == IPPROTO_HOPOPTS ||
+		    next_header == IPPROTO_ROUTING ||
+		    next_header == IPPROTO_DSTOPTS) {
+			ext_hdr = (struct ipv6_ext_hdr *)pkt_data;
+			next_header = ext_hdr->next_header;
+			pkt_data += (ext_hdr->len + 1) * 8;
+		} else if (next_header == IPPROTO_AH) {
+			ext_hdr = (struct ipv6_ext_hdr *)pkt_data;
+			next_header = ext_hdr->next_header;
+			pkt_data += (ext_hdr->len + 2) * 4;
+		} else if (next_header == IPPROTO_FRAGMENT) {
+			if (pkt_data + sizeof(struct ipv6_frag_hdr) > pkt_end)
+				break;
+			frag_hdr = (struct ipv6_frag_hdr *)pkt_data;
+			next_header = frag_hdr->next_header;
+			pkt_data += sizeof(struct ipv6_frag_hdr);
+
+			if (frag_hdr->frag_off == 0)
+				continue;
+			if (frag_hdr->frag_off & rte_cpu_to_be_16(IPV6_FRAG_OFF_MASK)) {
+				key->ip_frag = OVS_FRAG_TYPE_LATER;
+				key->ip_proto = IPPROTO_FRAGMENT;
+				return NULL;
+			}
+			key->ip_frag = OVS_FRAG_TYPE_FIRST;
+		} else {
+			break;
+		}
+	}
+	key->ip_proto = next_header;
+
+	/* An extension header claimed to run past the end of the packet */
+	if (pkt_data > pkt_end)
+		return NULL;
+
+	return pkt_data;
+}
+
+/*
+ * Copy the Ethernet addresses and type at 'pkt_data' to 'key'.
+ */
+static inline void __attribute__((always_inline))
+flow_key_extract_l2(const unsigned char *pkt_data, struct flow_key *key)
+{
+#ifdef RTE_MACHINE_CPUFLAG_SSSE3
+	/*
+	 * Load the 14 byte header and shuffle it into place in one go: the
+	 * addresses are copied, the type is byte swapped and the VLAN fields
+	 * that follow it in the key are zeroed. This reads 2 bytes past the
+	 * header, which are always within the mbuf.
+	 */
+	const __m128i shuf = _mm_set_epi8(ZERO_BYTE, ZERO_BYTE, 12, 13, 11, 10, 9, 8,
+	                                  7, 6, 5, 4, 3, 2, 1, 0);
+	__m128i hdr = _mm_loadu_si128((const __m128i *)pkt_data);
+
+	RTE_BUILD_BUG_ON(offsetof(struct flow_key, ether_src) !=
+	                 offsetof(struct flow_key, ether_dst) + ETHER_ADDR_LEN);
+	RTE_BUILD_BUG_ON(offsetof(struct flow_key, ether_type) !=
+	                 offsetof(struct flow_key, ether_dst) + 2 * ETHER_ADDR_LEN);
+	_mm_storeu_si128((__m128i *)&key->ether_dst, _mm_shuffle_epi8(hdr, shuf));
+#else
+	const struct ether_hdr *ether_hdr = (const struct ether_hdr *)pkt_data;
+
+	key->ether_dst = ether_hdr->d_addr;
+	key->ether_src = ether_hdr->s_addr;
+	key->ether_type = rte_be_to_cpu_16(ether_hdr->ether_type);
+#endif
+}
+
+/*
+ * Parse 'pkt' into 'key'. 'key' must be zeroed by the caller.
+ *
+ * Returns the offset of the L4 header in 'pkt', for reading its TCP flags
+ * later, or 0 if parsing did not reach it.
+ */
+static inline uint16_t __attribute__((always_inline))
+flow_key_parse(struct rte_mbuf *pkt, uint8_t in_port, struct flow_key *key)
 {
-	struct ether_hdr *ether_hdr = NULL;
 	struct vlan_hdr *vlan_hdr = NULL;
 	struct ipv4_hdr *ipv4_hdr = NULL;
-	struct tcp_hdr *tcp = NULL;
-	struct udp_hdr *udp = NULL;
-	struct icmp_hdr *icmp = NULL;
+	struct arp_hdr *arp_hdr = NULL;
 	unsigned char *pkt_data = NULL;
+	const unsigned char *pkt_start = NULL;
+	const unsigned char *pkt_end = NULL;
 	uint16_t vlan_tci = 0;
 	uint16_t be_offset = 0;
 
@@ -454,13 +1152,11 @@ flow_key_extract(const struct rte_mbuf *pkt, uint8_t in_port,
 
 	/* Assume ethernet packet and get packet data */
 	pkt_data = rte_pktmbuf_mtod(pkt, unsigned char *);
-	ether_hdr = (struct ether_hdr *)pkt_data;
+	pkt_start = pkt_data;
+	pkt_end = pkt_data + rte_pktmbuf_data_len(pkt);
+	flow_key_extract_l2(pkt_data, key);
 	pkt_data += sizeof(struct ether_hdr);
 
-	key->ether_dst = ether_hdr->d_addr;
-	key->ether_src = ether_hdr->s_addr;
-	key->ether_type = rte_be_to_cpu_16(ether_hdr->ether_type);
-
 	if (key->ether_type == ETHER_TYPE_VLAN) {
 		vlan_hdr = (struct vlan_hdr *)pkt_data;
 		pkt_data += sizeof(struct vlan_hdr);
@@ -472,7 +1168,11 @@ flow_key_extract(const struct rte_mbuf *pkt, uint8_t in_port,
 		key->ether_type = rte_be_to_cpu_16(vlan_hdr->eth_proto);
 	}
 
-	if (key->ether_type == ETHER_TYPE_IPv4) {
+
+	switch (key->ether_type) {
+	case ETHER_TYPE_IPv4:
+		if (pkt_data + sizeof(struct ipv4_hdr) > pkt_end)
+			break;
 		ipv4_hdr = (struct ipv4_hdr *)pkt_data;
 		pkt_data += sizeof(struct ipv4_hdr);
 
@@ -485,40 +1185,62 @@ flow_key_extract(const struct rte_mbuf *pkt, uint8_t in_port,
 		be_offset = ipv4_hdr->fragment_offset;
 		if (be_offset & rte_be_to_cpu_16(IPV4_HDR_OFFSET_MASK)) {
 			key->ip_frag = OVS_FRAG_TYPE_LATER;
-			return;
+			return 0;
 		}
 		if (be_offset & rte_be_to_cpu_16(IPV4_HDR_MF_FLAG))
 			key->ip_frag = OVS_FRAG_TYPE_FIRST;
 		else
 			key->ip_frag = OVS_FRAG_TYPE_NONE;
-	}
-
-	switch (key->ip_proto) {
-		case IPPROTO_TCP:
-			tcp = (struct tcp_hdr *)pkt_data;
-			pkt_data += sizeof(struct tcp_hdr);
 
-			key->tran_dst_port = rte_be_to_cpu_16(tcp->dst_port);
-			key->tran_src_port = rte_be_to_cpu_16(tcp->src_port);
+		flow_key_extract_l4(pkt_data, pkt_end, key);
+		return pkt_data - pkt_start;
+	case ETHER_TYPE_IPv6:
+		if (pkt_data + sizeof(struct ipv6_hdr) > pkt_end)
 			break;
-		case IPPROTO_UDP:
-			udp = (struct udp_hdr *)pkt_data;
-			pkt_data += sizeof(struct udp_hdr);
-
-			key->tran_dst_port = rte_be_to_cpu_16(udp->dst_port);
-			key->tran_src_port = rte_be_to_cpu_16(udp->src_port);
+		pkt_data = flow_key_extract_ipv6(pkt_data, pkt_end, key);
+		if (pkt_data == NULL)
 			break;
-		case IPPROTO_ICMP:
-			icmp = (struct icmp_hdr *)pkt_data;
-			pkt_data += sizeof(struct icmp_hdr);
-
-			key->tran_dst_port = icmp->icmp_code;
-			key->tran_src_port = icmp->icmp_type;
+		flow_key_extract_l4(pkt_data, pkt_end, key);
+		return pkt_data - pkt_start;
+	case ETHER_TYPE_ARP:
+		arp_hdr = (struct arp_hdr *)pkt_data;
+		if (pkt_data + sizeof(struct arp_hdr) > pkt_end ||
+		    arp_hdr->arp_hrd != rte_cpu_to_be_16(ARP_HRD_ETHER) ||
+		    arp_hdr->arp_pro != rte_cpu_to_be_16(ETHER_TYPE_IPv4) ||
+		    arp_hdr->arp_hln != ETHER_ADDR_LEN ||
+		    arp_hdr->arp_pln != sizeof(uint32_t))
 			break;
-		default:
-			key->tran_dst_port = 0;
-			key->tran_src_port = 0;
+
+		/* vswitchd only keeps the low 8 bits of the opcode */
+		if (rte_be_to_cpu_16(arp_hdr->arp_op) <= UINT8_MAX)
+			key->ip_proto = rte_be_to_cpu_16(arp_hdr->arp_op);
+		key->ip_src = rte_be_to_cpu_32(arp_hdr->arp_spa);
+		key->ip_dst = rte_be_to_cpu_32(arp_hdr->arp_tpa);
+		key->arp_sha = arp_hdr->arp_sha;
+		key->arp_tha = arp_hdr->arp_tha;
+		break;
+	default:
+		break;
 	}
+
+	return 0;
+}
+
+/*
+ * Extract flow key from pkt. 'key' must be zeroed by the caller.
+ * 'l4_offset' is set to where the L4 header was found, or 0, to be passed
+ * to switch_packet() along with 'key'.
+ *
+ * Returns the flow table hash of 'key', computed while the key is still
+ * hot, to be passed to switch_packet().
+ */
+inline uint32_t __attribute__((always_inline))
+flow_key_extract(struct rte_mbuf *pkt, uint8_t in_port,
+                 struct flow_key *key, uint16_t *l4_offset)
+{
+	*l4_offset = flow_key_parse(pkt, in_port, key);
+
+	return flow_key_hash(key);
 }
 
 
@@ -528,7 +1250,9 @@ flow_key_extract(const struct rte_mbuf *pkt, uint8_t in_port,
 inline
 int flow_table_lookup(const struct flow_key *key)
 {
-	return rte_hash_lookup(handle, key);
+	uint32_t hash = 0;
+
+	return flow_index_find(key, &hash);
 }
 
 /*
@@ -557,30 +1281,153 @@ ovs_flow_used_time(uint64_t flow_tsc)
 }
 
 /*
- * This function takes a packet and routes it as per the flow table.
+ * As flow_key_extract(), but return the RSS hash computed by the NIC if it
+ * covers the key. Only for packets received directly from a NIC.
+ *
+ * The NIC sets the IPv4/IPv6 header flags for packets it parsed as such, and
+ * does not hash IPv6 extension headers as FLOW_RSS_HF is set.
  */
-inline void __attribute__((always_inline))
-switch_packet(struct rte_mbuf *pkt, struct flow_key *key)
+inline uint32_t __attribute__((always_inline))
+flow_key_extract_rss(struct rte_mbuf *pkt, uint8_t in_port,
+                     struct flow_key *key, uint16_t *l4_offset)
 {
-	int pos;
+	*l4_offset = flow_key_parse(pkt, in_port, key);
 
-	pos = flow_table_lookup(key);
+	if (likely(pkt->ol_flags & PKT_RX_RSS_HASH) &&
+	    (pkt->ol_flags & (PKT_RX_IPV4_HDR | PKT_RX_IPV6_HDR)))
+		return pkt->pkt.hash.rss;
 
-	if (likely(pos >= 0)) {
-		rte_rwlock_read_lock(&flow_table[pos].lock);
-		if (flow_table[pos].enabled) {
-			struct action *actions;
-			actions = &flow_table[pos].actions[0];
-			action_execute(actions, pkt);
-			flow_table_update_stats(pos, pkt);
-			rte_rwlock_read_unlock(&flow_table[pos].lock);
-			return;
+	return flow_key_hash(key);
+}
+
+/*
+ * Find the flow table entry for 'key', which hashes to 'hash'. If the
+ * entry was found with a different hash, 'hash' is updated.
+ */
+static inline int __attribute__((always_inline))
+flow_table_lookup_with_hash(const struct flow_key *key, uint32_t *hash)
+{
+	uint32_t sw_hash = 0;
+	int pos;
+
+	pos = flow_index_lookup(key, *hash);
+	if (unlikely(pos < 0) && use_rss_hash) {
+		/*
+		 * Flows are added with the software hash. Should the NIC have
+		 * hashed the packet differently, e.g. a fragment, look it up again.
+		 */
+		sw_hash = flow_key_hash(key);
+		if (sw_hash != *hash) {
+			*hash = sw_hash;
+			pos = flow_index_lookup(key, sw_hash);
 		}
+		/* Should it share its hash with too many other flows */
+		if (unlikely(pos < 0) && flow_overflow_count)
+			pos = flow_index_lookup(key, flow_key_overflow_hash(key));
+	}
+
+	return pos;
+}
+
+/*
+ * Execute the actions of the flow at 'pos' on 'pkt' if it is still in use
+ * and still has 'key'. Returns false if not.
+ */
+static inline bool __attribute__((always_inline))
+flow_table_execute(int pos, const struct flow_key *key, struct rte_mbuf *pkt,
+                   uint16_t l4_offset)
+{
+	rte_rwlock_read_lock(&flow_table[pos].lock);
+	if (likely(flow_table[pos].enabled) &&
+	    !memcmp(&flow_table[pos].key, key, sizeof(*key))) {
+		/* Before the actions, which may modify or send the packet */
+		flow_table_update_stats(pos, pkt, l4_offset);
+		action_execute(flow_table[pos].actions, pkt);
 		rte_rwlock_read_unlock(&flow_table[pos].lock);
+		stats_vswitch_hit_increment(INC_BY_1);
+		return true;
+	}
+	rte_rwlock_read_unlock(&flow_table[pos].lock);
+
+	return false;
+}
+
+/*
+ * Find the flow table entry that a packet with 'key' should match. 'hash'
+ * must be the value returned by flow_key_extract() or
+ * flow_key_extract_rss() for 'key'.
+ *
+ * The lcore's microflow cache is checked first. A cache entry only records
+ * where a packet with the same hash last matched, so the result is only a
+ * candidate, which switch_packet_execute() checks. 'cached' is set if it
+ * came from the microflow cache.
+ */
+inline int __attribute__((always_inline))
+switch_packet_lookup(const struct flow_key *key, uint32_t hash, bool *cached)
+{
+	struct microflow_entry *mf = NULL;
+	uint32_t lookup_hash = hash;
+
+	mf = &microflow_cache[rte_lcore_id()][hash & MICROFLOW_CACHE_MASK];
+	*cached = mf->hash == hash && mf->generation == flow_table_generation;
+	if (*cached)
+		return mf->pos;
+
+	return flow_table_lookup_with_hash(key, &lookup_hash);
+}
+
+/*
+ * Route 'pkt' with the actions of the flow at 'pos', found for 'key' and
+ * 'hash' by switch_packet_lookup(), or send it to the daemon if no flow
+ * matches. 'l4_offset' is as set by flow_key_extract().
+ */
+inline void __attribute__((always_inline))
+switch_packet_execute(struct rte_mbuf *pkt, struct flow_key *key,
+                      uint16_t l4_offset, uint32_t hash, int pos, bool cached)
+{
+	struct microflow_entry *mf = NULL;
+	uint32_t generation = flow_table_generation;
+	uint32_t lookup_hash = hash;
+
+	if (cached) {
+		if (flow_table_execute(pos, key, pkt, l4_offset))
+			return;
+		/* the cache entry is stale, so look the flow up */
+		pos = flow_table_lookup_with_hash(key, &lookup_hash);
+	}
+
+	/* the index is read unlocked, so check the key again */
+	mf = &microflow_cache[rte_lcore_id()][hash & MICROFLOW_CACHE_MASK];
+	if (likely(pos >= 0) && flow_table_execute(pos, key, pkt, l4_offset)) {
+		mf->hash = hash;
+		mf->generation = generation;
+		mf->pos = pos;
+		return;
 	}
+
 	struct dpdk_upcall info;
 	/* flow table miss, send unmatched packet to the daemon */
+	stats_vswitch_miss_increment(INC_BY_1);
 	info.cmd = PACKET_CMD_MISS;
 	info.key = *key;
-	send_packet_to_vswitchd(pkt, &info);
+	/* flows are added with the software hash */
+	if (use_rss_hash)
+		lookup_hash = flow_key_hash(key);
+	send_packet_to_vswitchd(pkt, &info, lookup_hash);
+}
+
+/*
+ * This function takes a packet and routes it as per the flow table.
+ * 'hash' must be the value returned by flow_key_extract() or
+ * flow_key_extract_rss() for 'key', and 'l4_offset' the offset it set.
+ */
+inline void __attribute__((always_inline))
+switch_packet(struct rte_mbuf *pkt, struct flow_key *key, uint16_t l4_offset,
+              uint32_t hash)
+{
+	bool cached = false;
+	int pos;
+
+	pos = switch_packet_lookup(key, hash, &cached);
+	switch_packet_execute(pkt, key, l4_offset, hash, pos, cached);
 }
@@ -37,13 +37,36 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <rte_mbuf.h>
 #include <rte_ether.h>
+#include <rte_ethdev.h>
 
 #include "action.h"
 
-/* Maximum number of flow table entries */
-#define MAX_FLOWS              (1 << 16)
+/* Default flow table geometry */
+#define FLOW_TABLE_SIZE_DEFAULT           (1 << 16)
+#define FLOW_TABLE_BUCKET_ENTRIES_DEFAULT 4
+#define FLOW_TABLE_BUCKET_ENTRIES_MAX     16
+
+/* Toeplitz key length and hash types used when RSS hashing is enabled */
+#define FLOW_RSS_KEY_LEN       40
+#define FLOW_RSS_HF            (ETH_RSS_IPV4 | ETH_RSS_IPV4_TCP | \
+                                ETH_RSS_IPV4_UDP | ETH_RSS_IPV6 | \
+                                ETH_RSS_IPV6_TCP | ETH_RSS_IPV6_UDP)
+
+/* Use the RSS hash computed by the NIC as the flow table hash */
+extern bool use_rss_hash;
+extern const uint8_t flow_rss_key[FLOW_RSS_KEY_LEN];
+
+/*
+ * Flow table capacity, entries per hash bucket and NUMA socket, set before
+ * flow_table_init(). Both counts must be powers of two. SOCKET_ID_ANY places
+ * the table on the socket of the core that initializes it.
+ */
+extern uint32_t flow_table_size;
+extern uint32_t flow_table_bucket_entries;
+extern int flow_table_socket;
 
 /* Measured CPU frequency. Needed to translate tsk to ms. */
 uint64_t cpu_freq;
@@ -53,23 +76,51 @@ uint64_t cpu_freq;
  */
 volatile uint64_t curr_tsc;
 
+/*
+ * Exact match flow key.
+ *
+ * Only the first FLOW_KEY_HASH_LEN bytes are hashed. Protocol specific
+ * fields share a union so that an IPv6 key fits in 64 bytes. The IPv6
+ * neighbor discovery fields follow the hashed portion and are only compared
+ * on lookup; they are zero for any other packet.
+ *
+ * A double tagged frame is keyed on its outer tag with the inner TPID as
+ * 'ether_type', which is how vswitchd represents it.
+ */
 struct flow_key {
 	uint32_t in_port;
 	struct ether_addr ether_dst;
 	struct ether_addr ether_src;
 	uint16_t ether_type;
-	uint16_t vlan_id;
-	uint8_t vlan_prio;
-	uint32_t ip_src;
-	uint32_t ip_dst;
-	uint8_t ip_proto;
-	uint8_t ip_tos;
-	uint8_t ip_ttl;
+	uint16_t vlan_id:12;
+	uint16_t vlan_prio:4;
+	uint8_t ip_proto;   /* IP protocol, IPv6 next header or ARP opcode */
+	uint8_t ip_tos;     /* IPv4 TOS or IPv6 traffic class */
+	uint8_t ip_ttl;     /* IPv4 TTL or IPv6 hop limit */
 	uint8_t ip_frag;
 	uint16_t tran_src_port;
 	uint16_t tran_dst_port;
+	union {
+		struct {
+			uint32_t ip_src;    /* IPv4 or ARP sender address */
+			uint32_t ip_dst;    /* IPv4 or ARP target address */
+			struct ether_addr arp_sha;
+			struct ether_addr arp_tha;
+		};
+		struct {
+			uint8_t ipv6_src[16];
+			uint8_t ipv6_dst[16];
+			uint32_t ipv6_label;
+		};
+	};
+	/* Not hashed, see above */
+	uint8_t nd_target[16];
+	struct ether_addr nd_sll;
+	struct ether_addr nd_tll;
 } __attribute__((__packed__));
 
+#define FLOW_KEY_HASH_LEN (offsetof(struct flow_key, nd_target))
+
 struct flow_stats {
 	uint64_t packet_count;	/* Number of packets matched. */
 	uint64_t byte_count;	/* Number of bytes matched. */
@@ -79,10 +130,15 @@ struct flow_stats {
 
 void flow_table_init(void);
 int flow_table_lookup(const struct flow_key *key);
-void flow_key_extract(const struct rte_mbuf *pkt, uint8_t in_port,
-                      struct flow_key *key);
+uint32_t flow_key_hash(const struct flow_key *key);
+uint32_t flow_key_extract(struct rte_mbuf *pkt, uint8_t in_port,
+                          struct flow_key *key, uint16_t *l4_offset);
+uint32_t flow_key_extract_rss(struct rte_mbuf *pkt, uint8_t in_port,
+                              struct flow_key *key, uint16_t *l4_offset);
 int flow_table_del_flow(const struct flow_key *key);
 void flow_table_del_all(void);
+uint32_t flow_table_count(void);
+uint32_t flow_table_overflow_count(void);
 int flow_table_add_flow(const struct flow_key *key, const struct action *action);
 int flow_table_mod_flow(const struct flow_key *key, const struct action *action,
                         bool clear_stats);
@@ -93,7 +149,13 @@ int flow_table_get_first_flow(struct flow_key *first_key,
 int flow_table_get_next_flow(const struct flow_key *key,
              struct flow_key *next_key, struct action *action,
              struct flow_stats *stats);
-void switch_packet(struct rte_mbuf *pkt, struct flow_key *key);
+int switch_packet_lookup(const struct flow_key *key, uint32_t hash,
+                         bool *cached);
+void switch_packet_execute(struct rte_mbuf *pkt, struct flow_key *key,
+                           uint16_t l4_offset, uint32_t hash, int pos,
+                           bool cached);
+void switch_packet(struct rte_mbuf *pkt, struct flow_key *key,
+                   uint16_t l4_offset, uint32_t hash);
 
 #endif /* __FLOW_H_ */
 
@@ -47,17 +47,14 @@
 #include "vport.h"
 #include "datapath.h"
 #include "stats.h"
+#include "sched.h"
+#include "capture.h"
 
 #define RTE_LOGTYPE_APP RTE_LOGTYPE_USER1
 #define NO_FLAGS 0
 
-/* These are used to dimension the overall size of the mbuf mempool. They
- * are arbitrary values that have been determined by tuning */
-#define MBUFS_PER_CLIENT  3072
-#define MBUFS_PER_PORT    3072
-#define MBUFS_PER_KNI     3072
-#define MBUFS_PER_VETH    3072
-#define MBUFS_PER_VHOST   3072
+/* Mbufs for the vswitch daemon, the per port and vport numbers are set with
+ * mbufs_per_port and mbufs_per_vport */
 #define MBUFS_PER_DAEMON  2048
 
 #define MBUF_CACHE_SIZE 128
@@ -65,32 +62,173 @@
 #define MAX_PACKET_SIZE 1520
 #define MBUF_SIZE (MAX_PACKET_SIZE + MBUF_OVERHEAD + \
 		RTE_MAX(sizeof(struct dpdk_message),sizeof(struct dpdk_upcall)))
+#define JUMBO_MBUF_SIZE (JUMBO_FRAME_MAX_SIZE + MBUF_OVERHEAD + \
+		RTE_MAX(sizeof(struct dpdk_message),sizeof(struct dpdk_upcall)))
+#define SOCKET_POOL_NAME "MProc_pktmbuf_pool_s%u"
+#define JUMBO_POOL_NAME "MProc_pktmbuf_pool_jumbo_s%u"
+
+unsigned mbufs_per_port = MBUFS_PER_PORT_DEFAULT;
+unsigned mbufs_per_vport = MBUFS_PER_VPORT_DEFAULT;
+uint64_t jumbo_portmask = 0;
+
+/*
+ * Return the NUMA socket of physical port 'port_id'. Ports with no known
+ * socket are treated as being on socket 0.
+ */
+unsigned
+port_socket_id(uint8_t port_id)
+{
+	struct rte_eth_dev_info dev_info = {0};
+
+	rte_eth_dev_info_get(port_id, &dev_info);
+	if (dev_info.pci_dev == NULL || dev_info.pci_dev->numa_node < 0)
+		return 0;
+
+	return (unsigned)dev_info.pci_dev->numa_node;
+}
+
+/*
+ * Return the mbuf pool that physical ports on 'socket' receive into
+ */
+struct rte_mempool *
+pktmbuf_pool_get(unsigned socket)
+{
+	if (socket < RTE_MAX_NUMA_NODES && socket_pktmbuf_pool[socket] != NULL)
+		return socket_pktmbuf_pool[socket];
+
+	return pktmbuf_pool;
+}
+
+/*
+ * Return true if physical port 'port_id' receives jumbo frames
+ */
+bool
+port_is_jumbo(uint8_t port_id)
+{
+	return port_id < 64 && (jumbo_portmask & (1ULL << port_id)) != 0;
+}
+
+/*
+ * Return the mbuf pool that physical port 'port_id' receives into
+ */
+struct rte_mempool *
+port_pktmbuf_pool(uint8_t port_id)
+{
+	unsigned socket = port_socket_id(port_id);
+
+	if (port_is_jumbo(port_id))
+		return jumbo_pktmbuf_pool[socket];
+
+	return pktmbuf_pool_get(socket);
+}
+
+/*
+ * Choose the socket that most packet switching cores are on, preferring the
+ * client switching core's socket. Shared structures are placed there.
+ */
+static void
+init_switching_socket(void)
+{
+	unsigned cores[RTE_MAX_NUMA_NODES] = {0};
+	unsigned socket = 0;
+	unsigned i = 0;
+
+	switching_socket = rte_lcore_to_socket_id(client_switching_core);
+	cores[switching_socket]++;
+	for (i = 0; i < nb_cfg_params; i++)
+		if (cfg_params[i].lcore_id != client_switching_core)
+			cores[rte_lcore_to_socket_id(cfg_params[i].lcore_id)]++;
+
+	for (socket = 0; socket < RTE_MAX_NUMA_NODES; socket++)
+		if (cores[socket] > cores[switching_socket])
+			switching_socket = socket;
+
+	RTE_LOG(INFO, APP, "Switching socket is %u\n", switching_socket);
+}
+
+static struct rte_mempool *
+create_mbuf_pool(const char *name, unsigned num_mbufs, unsigned mbuf_size,
+                 unsigned socket)
+{
+	/* don't pass single-producer/single-consumer flags to mbuf create as it
+	 * seems faster to use a cache instead */
+	printf("Creating mbuf pool '%s' [%u mbufs of %u bytes] on socket %u ...\n",
+			name, num_mbufs, mbuf_size, socket);
+	return rte_mempool_create(name, num_mbufs,
+			mbuf_size, MBUF_CACHE_SIZE,
+			sizeof(struct rte_pktmbuf_pool_private), rte_pktmbuf_pool_init,
+			NULL, rte_pktmbuf_init, NULL, socket, NO_FLAGS);
+}
 
 /**
- * Initialise the mbuf pool
+ * Initialise the mbuf pools
+ *
+ * The pool shared with clients, KNI and vEth devices is placed on the
+ * switching socket. Guests and the KNI kernel module can only address
+ * mbufs in that pool, so physical ports on other sockets only get a pool
+ * of their own, and jumbo frame ports can only be used, if none of those
+ * devices are configured. Jumbo frame ports receive into a pool of large
+ * mbufs on their socket, so that a frame is never chained.
  */
 static int
 init_mbuf_pools(void)
 {
-	const unsigned num_mbufs = (num_clients * MBUFS_PER_CLIENT)
-			+ (port_cfg.num_phy_ports * MBUFS_PER_PORT)
-			+ (num_kni * MBUFS_PER_KNI)
-			+ (num_veth * MBUFS_PER_VETH)
-			+ (num_vhost * MBUFS_PER_VHOST)
-			+ MBUFS_PER_DAEMON;
+	unsigned socket_ports[RTE_MAX_NUMA_NODES] = {0};
+	unsigned jumbo_ports[RTE_MAX_NUMA_NODES] = {0};
+	char pool_name[RTE_MEMPOOL_NAMESIZE] = {0};
+	bool shared_only = num_clients > CLIENT1 || num_kni || num_veth;
+	unsigned num_phy_mbufs = 0;
+	unsigned num_mbufs = 0;
+	unsigned socket = 0;
+	unsigned i = 0;
 
 	/* make sure the upcall does not the exceed mbuf headroom */
 	if (sizeof(struct dpdk_upcall) >= RTE_PKTMBUF_HEADROOM)
 		rte_panic("Upcall exceed mbuf headroom\n");
 
-	/* don't pass single-producer/single-consumer flags to mbuf create as it
-	 * seems faster to use a cache instead */
-	printf("Creating mbuf pool '%s' [%u mbufs] ...\n",
-			PKTMBUF_POOL_NAME, num_mbufs);
-	pktmbuf_pool = rte_mempool_create(PKTMBUF_POOL_NAME, num_mbufs,
-			MBUF_SIZE, MBUF_CACHE_SIZE,
-			sizeof(struct rte_pktmbuf_pool_private), rte_pktmbuf_pool_init,
-			NULL, rte_pktmbuf_init, NULL, SOCKET0, NO_FLAGS );
+	for (i = 0; i < port_cfg.num_phy_ports; i++) {
+		socket = port_socket_id(port_cfg.id[i]);
+		if (port_is_jumbo(port_cfg.id[i]))
+			jumbo_ports[socket]++;
+		else if (shared_only || socket == switching_socket)
+			num_phy_mbufs += mbufs_per_port;
+		else
+			socket_ports[socket]++;
+	}
+
+	for (socket = 0; socket < RTE_MAX_NUMA_NODES; socket++) {
+		if (jumbo_ports[socket] != 0) {
+			if (shared_only) {
+				RTE_LOG(ERR, APP, "Jumbo frame ports cannot be used with "
+				        "client, KNI or vEth ports\n");
+				return -1;
+			}
+			rte_snprintf(pool_name, sizeof(pool_name), JUMBO_POOL_NAME,
+			             socket);
+			jumbo_pktmbuf_pool[socket] = create_mbuf_pool(pool_name,
+			             jumbo_ports[socket] * mbufs_per_port,
+			             JUMBO_MBUF_SIZE, socket);
+			if (jumbo_pktmbuf_pool[socket] == NULL)
+				return -1;
+		}
+		if (socket_ports[socket] != 0) {
+			rte_snprintf(pool_name, sizeof(pool_name), SOCKET_POOL_NAME,
+			             socket);
+			socket_pktmbuf_pool[socket] = create_mbuf_pool(pool_name,
+			             socket_ports[socket] * mbufs_per_port,
+			             MBUF_SIZE, socket);
+			if (socket_pktmbuf_pool[socket] == NULL)
+				return -1;
+		}
+	}
+
+	num_mbufs = num_phy_mbufs
+			+ (num_clients + num_kni + num_veth + num_vhost + num_memnic)
+			  * mbufs_per_vport
+			+ MBUFS_PER_DAEMON;
+
+	pktmbuf_pool = create_mbuf_pool(PKTMBUF_POOL_NAME, num_mbufs, MBUF_SIZE,
+	                                switching_socket);
 
 	return (pktmbuf_pool == NULL); /* 0  on success */
 }
@@ -128,15 +266,22 @@ init(int argc, char *argv[])
 	if (retval != 0)
 		return -1;
 
+	init_switching_socket();
+
 	/* initialise mbuf pools */
 	retval = init_mbuf_pools();
 	if (retval != 0)
 		rte_exit(EXIT_FAILURE, "Cannot create needed mbuf pools\n");
 
+	/* look up flows on the socket of the cores switching packets */
+	if (flow_table_socket == SOCKET_ID_ANY)
+		flow_table_socket = switching_socket;
 	flow_table_init();
 	datapath_init();
+	sched_init();
 	vport_init();
 	stats_init();
+	capture_init();
 	if (num_vhost)
 		vhost_init();
 
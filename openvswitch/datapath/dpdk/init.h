@@ -36,18 +36,42 @@
 #ifndef _INIT_H_
 #define _INIT_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MBUFS_PER_PORT_DEFAULT  3072
+#define MBUFS_PER_VPORT_DEFAULT 3072
+/* Largest frame received on a jumbo frame port, including the CRC */
+#define JUMBO_FRAME_MAX_SIZE    9018
+
 /* The mbuf pool for packet rx */
 struct rte_mempool *pktmbuf_pool;
+/* Pools for physical ports on other sockets, NULL if they use pktmbuf_pool */
+struct rte_mempool *socket_pktmbuf_pool[RTE_MAX_NUMA_NODES];
+/* Pools for jumbo frame ports on each socket */
+struct rte_mempool *jumbo_pktmbuf_pool[RTE_MAX_NUMA_NODES];
+/* Number of mbufs for each physical port, and each other vport */
+extern unsigned mbufs_per_port;
+extern unsigned mbufs_per_vport;
+/* Physical ports which receive jumbo frames */
+extern uint64_t jumbo_portmask;
 uint32_t num_clients;
 uint32_t num_kni;
 uint32_t num_veth;
 uint32_t num_vhost;
+uint32_t num_memnic;
 unsigned num_sockets;
 
 unsigned stats_display_interval;
 unsigned vswitchd_core;
 unsigned client_switching_core;
+/* Socket of most switching cores, where shared rings and tables are placed */
+unsigned switching_socket;
 
 int init(int argc, char *argv[]);
+unsigned port_socket_id(uint8_t port_id);
+struct rte_mempool *pktmbuf_pool_get(unsigned socket);
+bool port_is_jumbo(uint8_t port_id);
+struct rte_mempool *port_pktmbuf_pool(uint8_t port_id);
 
 #endif /* ifndef _INIT_H_ */
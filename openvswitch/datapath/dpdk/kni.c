@@ -60,13 +60,29 @@
 #define FAIL_ON_MEMZONE_NULL(mz) \
 	do { \
 		if ((mz) == NULL) \
-		{ rte_exit(EXIT_FAILURE, "FIFO initialisation failed.\n"); } \
+		{ RTE_LOG(ERR, APP, "FIFO initialisation failed.\n"); return -1; } \
 	}while(0)
 
 static void kni_fifo_init(struct rte_kni_fifo *fifo, unsigned size);
+static const struct rte_memzone *kni_memzone_reserve(const char *name);
 static int create_kni_fifos(struct rte_kni *kni_dev,
 		struct vport_kni_fifo_names *fifo_names, uint8_t kni_port_id);
 
+/**
+ * Look up a fifo memzone left by an earlier attempt, or reserve it.
+ */
+static const struct rte_memzone *
+kni_memzone_reserve(const char *name)
+{
+	const struct rte_memzone *mz = NULL;
+
+	mz = rte_memzone_lookup(name);
+	if (mz == NULL)
+		mz = rte_memzone_reserve(name, KNI_FIFO_SIZE, SOCKET_ID_ANY, 0);
+
+	return mz;
+}
+
 /**
  * Create memzones and fifos for a KNI port.
  */
@@ -80,7 +96,7 @@ create_kni_fifos(struct rte_kni *kni_dev,
 
 	/* TX RING */
 	rte_snprintf(obj_name, OBJNAMSIZ, OVS_KNI_QUEUE_TX, kni_port_id);
-	mz = rte_memzone_reserve(obj_name, KNI_FIFO_SIZE, SOCKET_ID_ANY, 0);
+	mz = kni_memzone_reserve(obj_name);
 	FAIL_ON_MEMZONE_NULL(mz);
 	kni_dev->tx_q = mz->addr;
 	kni_fifo_init(kni_dev->tx_q, KNI_FIFO_COUNT_MAX);
@@ -88,7 +104,7 @@ create_kni_fifos(struct rte_kni *kni_dev,
 
 	/* RX RING */
 	rte_snprintf(obj_name, OBJNAMSIZ, OVS_KNI_QUEUE_RX, kni_port_id);
-	mz = rte_memzone_reserve(obj_name, KNI_FIFO_SIZE, SOCKET_ID_ANY, 0);
+	mz = kni_memzone_reserve(obj_name);
 	FAIL_ON_MEMZONE_NULL(mz);
 	kni_dev->rx_q = mz->addr;
 	kni_fifo_init(kni_dev->rx_q, KNI_FIFO_COUNT_MAX);
@@ -96,7 +112,7 @@ create_kni_fifos(struct rte_kni *kni_dev,
 
 	/* ALLOC RING */
 	rte_snprintf(obj_name, OBJNAMSIZ, OVS_KNI_QUEUE_ALLOC, kni_port_id);
-	mz = rte_memzone_reserve(obj_name, KNI_FIFO_SIZE, SOCKET_ID_ANY, 0);
+	mz = kni_memzone_reserve(obj_name);
 	FAIL_ON_MEMZONE_NULL(mz);
 	kni_dev->alloc_q = mz->addr;
 	kni_fifo_init(kni_dev->alloc_q, KNI_FIFO_COUNT_MAX);
@@ -104,7 +120,7 @@ create_kni_fifos(struct rte_kni *kni_dev,
 
 	/* FREE RING */
 	rte_snprintf(obj_name, OBJNAMSIZ, OVS_KNI_QUEUE_FREE, kni_port_id);
-	mz = rte_memzone_reserve(obj_name, KNI_FIFO_SIZE, SOCKET_ID_ANY, 0);
+	mz = kni_memzone_reserve(obj_name);
 	FAIL_ON_MEMZONE_NULL(mz);
 	kni_dev->free_q = mz->addr;
 	kni_fifo_init(kni_dev->free_q, KNI_FIFO_COUNT_MAX);
@@ -112,7 +128,7 @@ create_kni_fifos(struct rte_kni *kni_dev,
 
 	/* Request RING */
 	rte_snprintf(obj_name, OBJNAMSIZ, OVS_KNI_QUEUE_REQ, kni_port_id);
-	mz = rte_memzone_reserve(obj_name, KNI_FIFO_SIZE, SOCKET_ID_ANY, 0);
+	mz = kni_memzone_reserve(obj_name);
 	FAIL_ON_MEMZONE_NULL(mz);
 	kni_dev->req_q = mz->addr;
 	kni_fifo_init(kni_dev->req_q, KNI_FIFO_COUNT_MAX);
@@ -120,7 +136,7 @@ create_kni_fifos(struct rte_kni *kni_dev,
 
 	/* Response RING */
 	rte_snprintf(obj_name, OBJNAMSIZ, OVS_KNI_QUEUE_RESP, kni_port_id);
-	mz = rte_memzone_reserve(obj_name, KNI_FIFO_SIZE, SOCKET_ID_ANY, 0);
+	mz = kni_memzone_reserve(obj_name);
 	FAIL_ON_MEMZONE_NULL(mz);
 	kni_dev->resp_q = mz->addr;
 	kni_fifo_init(kni_dev->resp_q, KNI_FIFO_COUNT_MAX);
@@ -128,7 +144,7 @@ create_kni_fifos(struct rte_kni *kni_dev,
 
 	/* Req/Resp sync mem area */
 	rte_snprintf(obj_name, OBJNAMSIZ, OVS_KNI_QUEUE_SYNC, kni_port_id);
-	mz = rte_memzone_reserve(obj_name, KNI_FIFO_SIZE, SOCKET_ID_ANY, 0);
+	mz = kni_memzone_reserve(obj_name);
 	FAIL_ON_MEMZONE_NULL(mz);
 	kni_dev->sync_addr= mz->addr;
 	kni_fifo_init(kni_dev->sync_addr, KNI_FIFO_COUNT_MAX);
@@ -153,22 +169,17 @@ kni_fifo_init(struct rte_kni_fifo *fifo, unsigned size)
 	fifo->elem_size = sizeof(void *);
 }
 
-rte_spinlock_t rte_kni_locks[MAX_KNI_PORTS];
-
-void
-init_kni(void)
+int
+kni_port_init(uint8_t port_id, struct vport_kni_fifo_names *fifo_names)
 {
-	uint8_t port_id = 0;
-	struct vport_kni_fifo_names kni_names;
-
-	memset(rte_kni_list, 0, sizeof(rte_kni_list));
-
-	/* Create the rte_kni fifos for each KNI port */
-	for (port_id = 0; port_id < num_kni; port_id++) {
-		RTE_LOG(INFO, APP, "Initialising KNI port '%s'\n",
-				vport_get_name(KNI0 + port_id));
-		create_kni_fifos(&rte_kni_list[port_id], &kni_names, port_id);
-		vport_set_kni_fifo_names(KNI0 + port_id, &kni_names);
-		rte_spinlock_init(&rte_kni_locks[port_id]);
-	}
+	struct rte_kni *kni = &rte_kni_list[port_id];
+
+	/* A KNI port that was deleted keeps its fifos, and any mbufs the
+	 * kernel still holds in them, for when it is added again. sync_addr
+	 * is set last, so it is only non-NULL once every fifo exists. */
+	if (kni->sync_addr != NULL)
+		return 0;
+
+	RTE_LOG(INFO, APP, "Initialising KNI port %u\n", port_id);
+	return create_kni_fifos(kni, fifo_names, port_id);
 }
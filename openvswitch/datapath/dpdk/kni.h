@@ -40,7 +40,6 @@
 
 #include <rte_kni.h>
 #include <exec-env/rte_kni_common.h>
-#include <rte_spinlock.h>
 
 #include "kni-types.h"
 
@@ -49,12 +48,14 @@
                                 sizeof(struct rte_kni_fifo))
 
 struct rte_kni rte_kni_list[MAX_KNI_PORTS];
-extern rte_spinlock_t rte_kni_locks[MAX_KNI_PORTS];
 
-/* Reserves memory for MAX_KNI_PORTS number of KNI ports and initialises
- * the fifos
+struct vport_kni_fifo_names;
+
+/* Reserves memory for KNI port 'port_id', initialises its fifos and
+ * stores their names in 'fifo_names'. Does nothing if the port was already
+ * initialised. Returns 0 on success, -1 if memory can't be reserved.
  */
-void
-init_kni(void);
+int
+kni_port_init(uint8_t port_id, struct vport_kni_fifo_names *fifo_names);
 
 #endif
@@ -0,0 +1 @@
+../capture-types.h
\ No newline at end of file
@@ -42,6 +42,7 @@
 #include <rte_string_fns.h>
 
 #include "vport-types.h"
+#include "stats-types.h"
 #include "ovs-vport.h"
 
 #define RTE_LOGTYPE_APP RTE_LOGTYPE_USER1
@@ -54,12 +55,22 @@
 	(kni.type == VPORT_TYPE_KNI							\
 	&& !strncmp(kni.name, kni_name, sizeof(kni.name)))
 
+#define memnic_vport_name_equal_to(memnic, memnic_name)	\
+	(memnic.type == VPORT_TYPE_MEMNIC					\
+	&& !strncmp(memnic.name, memnic_name, sizeof(memnic.name)))
+
 #define ASSERT_VPORTS_NOT_NULL() assert(vports != NULL)
 
+/* Attempts at copying a stats snapshot while the datapath rewrites it */
+#define STATS_SNAPSHOT_RETRIES 1000
+
 /* Global references to vports structure and its memzone */
 static struct vport_info *vports = NULL;
 static const struct rte_memzone* vports_mz = NULL;
 
+/* Statistics exported by the datapath */
+static const struct stats_export *stats_exp = NULL;
+
 static inline struct vport_client *
 get_client_vport_by_name(const char *port_name)
 {
@@ -100,6 +111,26 @@ get_kni_vport_by_name(const char *port_name)
 	return kni;
 }
 
+static inline struct vport_memnic *
+get_memnic_vport_by_name(const char *port_name)
+{
+	int i = 0;
+	struct vport_memnic *memnic = NULL;
+
+	if ((ovs_vport_is_vport_name_valid(port_name)) < 0)
+		return NULL;
+
+	for (i = 0; i < MAX_VPORTS; i++) {
+		if (memnic_vport_name_equal_to(vports[i], port_name)) {
+			memnic = &vports[i].memnic;
+			break;
+		}
+	}
+	if (memnic == NULL)
+		RTE_LOG(ERR, APP, "Cannot find MEMNIC vport '%s'\n", port_name);
+	return memnic;
+}
+
 static inline struct rte_ring *
 ring_lookup(const char *ring_name)
 {
@@ -173,6 +204,22 @@ ovs_vport_is_vport_kni(const char *port_name)
 	return -1;
 }
 
+int
+ovs_vport_is_vport_memnic(const char *port_name)
+{
+	int i = 0;
+
+	ASSERT_VPORTS_NOT_NULL();
+
+	if ((ovs_vport_is_vport_name_valid(port_name)) < 0)
+		return -1;
+
+	for (i = 0; i < MAX_VPORTS; i++)
+		if (memnic_vport_name_equal_to(vports[i], port_name))
+			return 0;
+	return -1;
+}
+
 struct rte_ring *
 ovs_vport_client_lookup_rx_q(const char *port_name)
 {
@@ -218,6 +265,21 @@ ovs_vport_client_lookup_free_q(const char *port_name)
 	return ring;
 }
 
+struct rte_ring *
+ovs_vport_client_lookup_alloc_q(const char *port_name)
+{
+	struct vport_client *client = NULL;
+	struct rte_ring *ring = NULL;
+
+	ASSERT_VPORTS_NOT_NULL();
+
+	client = get_client_vport_by_name(port_name);
+	if (client != NULL)
+		ring = ring_lookup(client->ring_names.alloc);
+
+	return ring;
+}
+
 const struct rte_memzone *
 ovs_vport_kni_lookup_tx_fifo(const char *port_name)
 {
@@ -322,6 +384,21 @@ ovs_vport_kni_lookup_sync_fifo(const char *port_name)
 	return mz;
 }
 
+const struct rte_memzone *
+ovs_vport_memnic_lookup_memzone(const char *port_name)
+{
+	struct vport_memnic *memnic = NULL;
+	const struct rte_memzone *mz = NULL;
+
+	ASSERT_VPORTS_NOT_NULL();
+
+	memnic = get_memnic_vport_by_name(port_name);
+	if (memnic != NULL)
+		mz = memzone_lookup(memnic->mz_name);
+
+	return mz;
+}
+
 struct rte_mempool *
 ovs_vport_host_lookup_packet_mempool(void)
 {
@@ -345,3 +422,47 @@ ovs_vport_is_vport_name_valid(const char *port_name)
 {
 	return vport_is_valid_name(port_name);
 }
+
+const struct rte_memzone *
+ovs_vport_lookup_stats_export(void)
+{
+	const struct rte_memzone *mz = NULL;
+	const struct stats_export *exp = NULL;
+
+	mz = memzone_lookup(MZ_STATS_EXPORT);
+	if (mz == NULL)
+		return NULL;
+
+	exp = mz->addr;
+	/* The layout has arrays of structures, so only the exact version
+	 * this was built with can be read */
+	if (exp->magic != STATS_EXPORT_MAGIC ||
+	    exp->version != STATS_EXPORT_VERSION ||
+	    exp->size != sizeof(struct stats_export)) {
+		RTE_LOG(ERR, APP, "Unsupported stats export layout, version %u "
+		        "instead of %u\n", exp->version, STATS_EXPORT_VERSION);
+		return NULL;
+	}
+
+	stats_exp = exp;
+	return mz;
+}
+
+int
+ovs_vport_stats_snapshot(struct stats_export *snapshot)
+{
+	uint32_t seq = 0;
+	int i = 0;
+
+	assert(stats_exp != NULL);
+
+	for (i = 0; i < STATS_SNAPSHOT_RETRIES; i++) {
+		seq = stats_export_read_begin(stats_exp);
+		memcpy(snapshot, (const void *)stats_exp, sizeof(*snapshot));
+		if (!stats_export_read_retry(stats_exp, seq))
+			return 0;
+	}
+
+	RTE_LOG(ERR, APP, "Cannot get a consistent stats snapshot\n");
+	return -1;
+}
@@ -63,6 +63,15 @@ int ovs_vport_is_vport_client(const char *port_name);
  */
 int ovs_vport_is_vport_kni(const char *port_name);
 
+/**
+ * Check if port_name is a valid MEMNIC port name
+ *
+ * Returns 0 in case port_name is a valid and existent MEMNIC port name.
+ * Otherwise returns -1.
+ * ovs_vport_lookup_vport() must have been called before.
+ */
+int ovs_vport_is_vport_memnic(const char *port_name);
+
 /**
  * Lookup the RX queue of vport client named port_name.
  *
@@ -90,6 +99,15 @@ struct rte_ring *ovs_vport_client_lookup_tx_q(const char *port_name);
  */
 struct rte_ring *ovs_vport_client_lookup_free_q(const char *port_name);
 
+/**
+ * Lookup the ALLOC queue of vport client named port_name.
+ *
+ * Returns the ALLOC rte_ring of vport client named port_name in case this
+ * is valid. Otherwise returns NULL.
+ * ovs_vport_lookup_vport() must have been called before.
+ */
+struct rte_ring *ovs_vport_client_lookup_alloc_q(const char *port_name);
+
 /**
  * Lookup the TX queue of vport KNI named port_name.
  *
@@ -153,6 +171,15 @@ const struct rte_memzone *ovs_vport_kni_lookup_req_fifo(const char *port_name);
  */
 const struct rte_memzone *ovs_vport_kni_lookup_sync_fifo(const char *port_name);
 
+/**
+ * Lookup the shared memory of vport MEMNIC named port_name.
+ *
+ * Returns the rte_memzone holding the struct memnic_area of vport MEMNIC
+ * named port_name in case this is valid. Otherwise returns NULL.
+ * ovs_vport_lookup_vport() must have been called before.
+ */
+const struct rte_memzone *ovs_vport_memnic_lookup_memzone(const char *port_name);
+
 /**
  * Lookup the packet mempool.
  *
@@ -182,4 +209,26 @@ const struct rte_memzone *ovs_vport_guest_lookup_packet_mempools_memzone(void);
  */
 int ovs_vport_is_vport_name_valid(const char *port_name);
 
+struct stats_export;
+
+/**
+ * Lookup the memzone the datapath exports its statistics in.
+ *
+ * Does a rte_memzone_lookup(MZ_STATS_EXPORT) and checks that its layout,
+ * described in stats-types.h, is one this library understands. Needs to be
+ * called before ovs_vport_stats_snapshot(). In case of error returns NULL.
+ */
+const struct rte_memzone *ovs_vport_lookup_stats_export(void);
+
+/**
+ * Copy a consistent snapshot of the exported statistics.
+ *
+ * Copies the statistics into 'snapshot', retrying while the datapath is
+ * updating them. The memzone is only read, so this can be polled as often
+ * as needed without slowing down the datapath. Returns 0 on success or -1
+ * if no consistent copy could be made.
+ * ovs_vport_lookup_stats_export() must have been called before.
+ */
+int ovs_vport_stats_snapshot(struct stats_export *snapshot);
+
 #endif  /* __OVS_VPORT_H_ */
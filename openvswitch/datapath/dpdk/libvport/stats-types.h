@@ -0,0 +1 @@
+../stats-types.h
\ No newline at end of file
@@ -47,9 +47,12 @@
 #include "main.h"
 #include "vport.h"
 #include "stats.h"
+#include "stats-types.h"
 #include "flow.h"
 #include "datapath.h"
 #include "action.h"
+#include "sched.h"
+#include "capture.h"
 
 #define RTE_LOGTYPE_APP RTE_LOGTYPE_USER1
 #define NUM_BYTES_MAC_ADDR  6
@@ -112,22 +115,28 @@ get_printable_mac_addr(uint8_t port)
 static void
 stats_display(void)
 {
-	unsigned i = 0;
+	unsigned i = 0, j = 0;
+	char label[16];
 	/* ANSI escape sequences for terminal display.
 	 * 27 = ESC, 2J = Clear screen */
 	const char clr[] = {27, '[', '2', 'J', '\0'};
 	/* H = Home position for cursor*/
 	const char topLeft[] = {27, '[', '1', ';', '1', 'H','\0'};
+	struct rte_eth_stats eth_stats = {0};
 	uint64_t overruns = 0;
+	uint64_t rx_nombuf = 0;
 
 	/* Clear screen and move to top left */
 	printf("%s%s", clr, topLeft);
 
 	printf("Physical Ports\n");
 	printf("-----\n");
-	for (i = 0; i < ports->num_phy_ports; i++)
+	for (i = 0; i < ports->num_phy_ports; i++) {
 		printf("Port %u: '%s'\t", ports->id[i],
 				get_printable_mac_addr(ports->id[i]));
+		rte_eth_stats_get(ports->id[i], &eth_stats);
+		rx_nombuf += eth_stats.rx_nombuf;
+	}
 	printf("\n\n");
 
 	printf("\nVport Statistics\n"
@@ -149,13 +158,208 @@ stats_display(void)
 	}
 	printf("=============   ============  ============  ============  ============\n");
 
+	printf("\nVport Bytes and Errors\n"
+		     "=============   ============  ============  ============  ============\n"
+		     "Interface       rx_bytes      tx_bytes      rx_errors     tx_errors   \n"
+		     "-------------   ------------  ------------  ------------  ------------\n");
+	for (i = 0; i < MAX_VPORTS; i++) {
+		const char *name = vport_get_name(i);
+		if (name == NULL || *name == 0)
+			continue;
+		printf("%-*.*s ", 13, 13, name);
+		printf("%13"PRIu64" %13"PRIu64" %13"PRIu64" %13"PRIu64"\n",
+		       stats_vport_rx_bytes_get(i),
+		       stats_vport_tx_bytes_get(i),
+		       stats_vport_rx_error_get(i),
+		       stats_vport_tx_error_get(i));
+	}
+	printf("=============   ============  ============  ============  ============\n");
+
+	/* Only vports that dropped packets are listed */
+	printf("\nVport Drops by Reason\n"
+		     "=============   ========  ========  ========  ========  ========  ========  ========  ========  ========\n"
+		     "Interface       ringfull  nombuf    vhostful  novport   upcallfl  upcallrl  toobig    upcallpd  noheadrm\n"
+		     "-------------   --------  --------  --------  --------  --------  --------  --------  --------  --------\n");
+	for (i = 0; i < MAX_VPORTS; i++) {
+		const char *name = vport_get_name(i);
+		uint64_t drops[STATS_DROP_MAX] = {0};
+		uint64_t total = 0;
+
+		if (name == NULL || *name == 0)
+			continue;
+		for (j = 0; j < STATS_DROP_MAX; j++)
+			total += drops[j] = stats_vport_drop_get(i, j);
+		if (total == 0)
+			continue;
+		printf("%-*.*s ", 13, 13, name);
+		for (j = 0; j < STATS_DROP_MAX; j++)
+			printf(" %9"PRIu64, drops[j]);
+		printf("\n");
+	}
+	printf("=============   ========  ========  ========  ========  ========  ========  ========  ========  ========\n");
+
+	printf("\nClient Mbuf Recycling\n"
+		     "=============   ============  ============  ============\n"
+		     "Interface       recycled      backlog       max_backlog \n"
+		     "-------------   ------------  ------------  ------------\n");
+	for (i = 0; i < MAX_VPORTS; i++) {
+		const char *name = vport_get_name(i);
+		if (name == NULL || *name == 0 ||
+		    vport_get_type(i) != VPORT_TYPE_CLIENT)
+			continue;
+		printf("%-*.*s ", 13, 13, name);
+		printf("%13"PRIu64" %13"PRIu64" %13"PRIu64"\n",
+		       stats_vport_recycled_get(i),
+		       stats_vport_recycle_backlog_get(i),
+		       stats_vport_recycle_backlog_max_get(i));
+	}
+	printf("=============   ============  ============  ============\n");
+
+	printf("\nPhysical Port TX Bursts by Wait (us)\n");
+	printf("%-13s ", "Interface");
+	for (j = 0; j < STATS_TX_LATENCY_BUCKETS; j++) {
+		if (j == STATS_TX_LATENCY_BUCKETS - 1)
+			rte_snprintf(label, sizeof(label), ">=%u", 1u << (j - 1));
+		else
+			rte_snprintf(label, sizeof(label), "<%u", 1u << j);
+		printf(" %8s", label);
+	}
+	printf("\n");
+	for (i = 0; i < MAX_VPORTS; i++) {
+		const char *name = vport_get_name(i);
+		if (name == NULL || *name == 0 ||
+		    vport_get_type(i) != VPORT_TYPE_PHY)
+			continue;
+		printf("%-*.*s ", 13, 13, name);
+		for (j = 0; j < STATS_TX_LATENCY_BUCKETS; j++)
+			printf(" %8"PRIu64, stats_vport_tx_latency_get(i, j));
+		printf("\n");
+	}
+
+	if (latency_sample_rate) {
+		printf("\nSampled Packet Latency by Output Port (us)\n");
+		printf("%-13s ", "Interface");
+		for (j = 0; j < STATS_LATENCY_BUCKETS; j++) {
+			if (j == STATS_LATENCY_BUCKETS - 1)
+				rte_snprintf(label, sizeof(label), ">=%u",
+				             1u << (j - 1));
+			else
+				rte_snprintf(label, sizeof(label), "<%u", 1u << j);
+			printf(" %8s", label);
+		}
+		printf("\n");
+		for (i = 0; i < MAX_VPORTS; i++) {
+			const char *name = vport_get_name(i);
+			if (name == NULL || *name == 0)
+				continue;
+			printf("%-*.*s ", 13, 13, name);
+			for (j = 0; j < STATS_LATENCY_BUCKETS; j++)
+				printf(" %8"PRIu64, stats_vport_latency_get(i, j));
+			printf("\n");
+		}
+	}
+
+	printf("\nVport Scheduling\n"
+		     "=============   ======  ============  ============\n"
+		     "Interface       lcore   rx_packets    cycles/pkt  \n"
+		     "-------------   ------  ------------  ------------\n");
+	for (i = 0; i < MAX_VPORTS; i++) {
+		const struct sched_vport *sv = &sched_vports[i];
+		const char *name = vport_get_name(i);
+		if (name == NULL || *name == 0 || !vport_is_enabled(i))
+			continue;
+		printf("%-*.*s ", 13, 13, name);
+		printf("%7u %13"PRIu64" %13"PRIu64"\n", sv->lcore, sv->packets,
+		       sv->packets ? sv->cycles / sv->packets : 0);
+	}
+	printf("=============   ======  ============  ============\n");
+	RTE_LCORE_FOREACH(j) {
+		const struct sched_lcore *sl = &sched_lcores[j];
+		if (!sl->switching)
+			continue;
+		printf("\n Switching lcore %2u busy %3"PRIu64"%%", j,
+		       sl->total_cycles ? sl->busy_cycles * 100 / sl->total_cycles
+		                        : 0);
+	}
+	printf("\n");
+
+	printf("\nLcore Cycles (%%)\n"
+	       "lcore     rx  lookup  action      tx    idle  busy loops\n"
+	       "=====  =====  ======  ======  ======  ======  ==========\n");
+	RTE_LCORE_FOREACH(j) {
+		uint64_t total = 0, loops = 0;
+
+		if (!sched_lcores[j].switching)
+			continue;
+		for (i = 0; i < STATS_CYCLES_MAX; i++)
+			total += stats_lcore_cycles_get(j, i);
+		loops = stats_lcore_loops_get(j);
+		printf("%5u", j);
+		for (i = 0; i < STATS_CYCLES_MAX; i++)
+			printf("  %6"PRIu64, total ?
+			       stats_lcore_cycles_get(j, i) * 100 / total : 0);
+		printf("  %10"PRIu64"\n", loops ?
+		       stats_lcore_busy_loops_get(j) * 100 / loops : 0);
+	}
+	printf("=====  =====  ======  ======  ======  ======  ==========\n");
+
 	printf("\n Switch rx dropped %lu\n", stats_vswitch_rx_drop_get());
 	printf("\n Switch tx dropped %lu\n", stats_vswitch_tx_drop_get());
+	printf("\n Flow table hit    %lu\n", stats_vswitch_hit_get());
+	printf("\n Flow table missed %lu\n", stats_vswitch_miss_get());
+	printf("\n Upcalls lost      %lu\n", stats_vswitch_lost_get());
 	printf("\n Queue overruns    %lu\n",  overruns);
+	printf("\n Mbuf alloc failed %lu\n", stats_vswitch_nombuf_get());
+	printf("\n Port rx no mbuf   %lu\n", rx_nombuf);
 	printf("\n Mempool count     %9u\n", rte_mempool_count(pktmbuf_pool));
+	for (i = 0; i < RTE_MAX_NUMA_NODES; i++) {
+		if (socket_pktmbuf_pool[i] != NULL)
+			printf("\n Socket %u mempool count       %9u\n", i,
+			       rte_mempool_count(socket_pktmbuf_pool[i]));
+		if (jumbo_pktmbuf_pool[i] != NULL)
+			printf("\n Socket %u jumbo mempool count %9u\n", i,
+			       rte_mempool_count(jumbo_pktmbuf_pool[i]));
+	}
 	printf("\n");
 }
 
+/*
+ * Flush the packets this core has buffered for each vport
+ */
+static inline void __attribute__((always_inline))
+flush_vport_caches(void)
+{
+	flush_clients();
+	flush_ports();
+	flush_vhost_devs();
+	flush_memnic_ports();
+	flush_kni_ports();
+	flush_packets_to_vswitchd();
+}
+
+/*
+ * Publish a snapshot of the statistics if one is due, with the lcore
+ * polling each vport added to what stats.c gathers.
+ */
+static void
+export_stats(void)
+{
+	struct stats_export *exp = NULL;
+	unsigned vportid = 0, lcore = 0;
+
+	exp = stats_export_begin(curr_tsc);
+	if (exp == NULL)
+		return;
+
+	for (vportid = 0; vportid < MAX_VPORTS; vportid++)
+		if (exp->vports[vportid].type != VPORT_TYPE_DISABLED)
+			exp->vports[vportid].lcore = sched_vports[vportid].lcore;
+	RTE_LCORE_FOREACH(lcore)
+		exp->lcores[lcore].switching = sched_lcores[lcore].switching;
+
+	stats_export_end(exp);
+}
+
 static inline void
 do_vswitchd(void)
 {
@@ -163,13 +367,13 @@ do_vswitchd(void)
 	static uint64_t next_tsc = 0;
 	uint64_t curr_tsc_local;
 
-	/* handle any packets from vswitchd */
-	handle_request_from_vswitchd();
-
 	/* 
 	 * curr_tsc is accessed by all cores but is updated here for each loop
 	 * which causes cacheline contention. By setting a defined update
 	 * period for curr_tsc of 1us this contention is removed.
+	 *
+	 * It is updated first, as it will have stood still if this core
+	 * has just woken up from an idle sleep.
 	 */
 	curr_tsc_local = rte_rdtsc();
 	if (curr_tsc_local >= next_tsc) {
@@ -177,6 +381,12 @@ do_vswitchd(void)
 		next_tsc = curr_tsc_local + tsc_update_period;
 	}
 
+	/* handle any packets from vswitchd */
+	handle_request_from_vswitchd();
+
+	/* wake up vswitchd if packets have been queued for it */
+	send_pending_signal_to_dpif();
+
 	/* display stats every 'stats' sec */
 	if ((curr_tsc - last_stats_display_tsc) / cpu_freq >= stats_display_interval
 	              && stats_display_interval != 0)
@@ -184,13 +394,23 @@ do_vswitchd(void)
 		last_stats_display_tsc = curr_tsc;
 		stats_display();
 	}
-	flush_clients();
-	flush_ports();
-	flush_vhost_devs();
+
+	/* move vports from busy to idle switching cores */
+	sched_rebalance();
+
+	/* snapshot the stats for monitoring agents */
+	export_stats();
+
+	/* start, change or stop the capture tap as asked by the capture tool */
+	capture_update();
+
+	flush_vport_caches();
 }
 
 static inline void __attribute__((always_inline))
-do_switch_packets(unsigned vportid, struct rte_mbuf **bufs, int rx_count)
+do_switch_packets(unsigned vportid, struct rte_mbuf **bufs, int rx_count,
+                  bool hw_hash, uint64_t rx_tsc, uint64_t *lookup_cycles,
+                  uint64_t *action_cycles)
 {
 	int j;
 	/* 
@@ -198,97 +418,120 @@ do_switch_packets(unsigned vportid, struct rte_mbuf **bufs, int rx_count)
 	 * loading the full key in to cache at once later.
 	 */
 	struct flow_key key[PKT_BURST_SIZE] = {{0}};
+	uint16_t l4_offset[PKT_BURST_SIZE];
+	uint32_t hash[PKT_BURST_SIZE];
+	int pos[PKT_BURST_SIZE];
+	bool cached[PKT_BURST_SIZE];
+	uint64_t start_tsc = 0, lookup_tsc = 0;
+
+	start_tsc = rte_rdtsc();
 
 	/* Prefetch first packets */
 	for (j = 0; j < PREFETCH_OFFSET && j < rx_count; j++)
 		rte_prefetch0(rte_pktmbuf_mtod(bufs[j], void *));
 
-	/* Prefetch new packets and forward already prefetched packets */
-	for (j = 0; j < (rx_count - PREFETCH_OFFSET); j++) {
-		flow_key_extract(bufs[j], vportid, &key[j]);
-		rte_prefetch0(rte_pktmbuf_mtod(bufs[j + PREFETCH_OFFSET], void *));
-		switch_packet(bufs[j], &key[j]);
+	/*
+	 * Look the whole burst up before running any actions, so each phase
+	 * is timed once per burst rather than once per packet.
+	 */
+	for (j = 0; j < rx_count; j++) {
+		hash[j] = hw_hash ?
+		          flow_key_extract_rss(bufs[j], vportid, &key[j],
+		                               &l4_offset[j]) :
+		          flow_key_extract(bufs[j], vportid, &key[j], &l4_offset[j]);
+		if (j + PREFETCH_OFFSET < rx_count)
+			rte_prefetch0(rte_pktmbuf_mtod(bufs[j + PREFETCH_OFFSET],
+			                               void *));
+		pos[j] = switch_packet_lookup(&key[j], hash[j], &cached[j]);
 	}
 
-	/* Forward remaining prefetched packets */
-	for (; j < rx_count; j++) {
-		flow_key_extract(bufs[j], vportid, &key[j]);
-		switch_packet(bufs[j], &key[j]);
-	}
+	lookup_tsc = rte_rdtsc();
+
+	/* The RSS hash has been used, so it can hold the receive time */
+	if (latency_sample_rate)
+		stats_latency_stamp(bufs, rx_count, rx_tsc);
+
+	/* Mirror the burst if this vport is being captured */
+	if (unlikely(vportid == capture_in_vport))
+		capture_in_burst(vportid, bufs, key, rx_count);
+
+	for (j = 0; j < rx_count; j++)
+		switch_packet_execute(bufs[j], &key[j], l4_offset[j], hash[j],
+		                      pos[j], cached[j]);
+
+	*lookup_cycles += lookup_tsc - start_tsc;
+	*action_cycles += rte_rdtsc() - lookup_tsc;
 }
 
+/*
+ * Receive and switch a burst from each vport the scheduler gave this core,
+ * timing the polls that receive packets so that vports can be rebalanced
+ * between cores. Where the cycles go is also recorded for the core as a
+ * whole: receiving, looking up, running actions, transmitting and polling
+ * vports that had nothing to receive.
+ */
 static inline void __attribute__((always_inline))
-do_client_switching(void)
+do_switching(unsigned lcore, bool client_switching)
 {
-	static unsigned client = CLIENT1;
-	static unsigned kni_vportid = KNI0;
-	static unsigned veth_vportid = VETH0;
-	static unsigned vhost_vportid = VHOST0;
+	struct sched_lcore *sl = &sched_lcores[lcore];
+	unsigned count = sl->vports.count;
+	uint64_t start_tsc = 0, prev_tsc = 0, tsc = 0, rx_tsc = 0;
+	uint64_t cycles[STATS_CYCLES_MAX] = {0};
+	uint32_t vportid = 0;
 	int rx_count = 0;
+	int rx_total = 0;
+	bool phy = false;
+	unsigned i = 0;
 	struct rte_mbuf *bufs[PKT_BURST_SIZE];
 
-	/* Client ports */
-
-	rx_count = receive_from_vport(client, &bufs[0]);
-	do_switch_packets(client, bufs, rx_count);
-
-
-	/* move to next client and dont handle client 0*/
-	if (++client == num_clients) {
-		client = 1;
-	}
-
-	/* KNI ports */
-	if (num_kni) {
-		rx_count = receive_from_vport(kni_vportid, &bufs[0]);
-		do_switch_packets(kni_vportid, bufs, rx_count);
-
-		/* move to next kni port */
-		if (++kni_vportid == (unsigned)KNI0 + num_kni) {
-			kni_vportid = KNI0;
+	start_tsc = prev_tsc = rte_rdtsc();
+
+	for (i = 0; i < count; i++) {
+		vportid = sl->vports.ids[i];
+		phy = vportid >= PHYPORT0 && vportid < PHYPORT0 + MAX_PHYPORTS;
+
+		rx_count = receive_from_vport(vportid, &bufs[0]);
+		rx_tsc = rte_rdtsc();
+		if (rx_count)
+			cycles[STATS_CYCLES_RX] += rx_tsc - prev_tsc;
+		else
+			cycles[STATS_CYCLES_IDLE] += rx_tsc - prev_tsc;
+		rx_total += rx_count;
+
+		/* Only packets straight from a NIC carry a usable RSS hash */
+		if (rx_count)
+			do_switch_packets(vportid, bufs, rx_count,
+			                  phy && use_rss_hash, rx_tsc,
+			                  &cycles[STATS_CYCLES_LOOKUP],
+			                  &cycles[STATS_CYCLES_ACTION]);
+
+		if (phy) {
+			tsc = rte_rdtsc();
+			flush_vport_caches();
+			flush_nic_tx_ring(vportid);
+			cycles[STATS_CYCLES_TX] += rte_rdtsc() - tsc;
 		}
-	}
 
-	/* vETH Devices */
-	if (unlikely(num_veth)) {  /* vEth devices are optional */
-		rx_count = receive_from_vport(veth_vportid, &bufs[0]);
-		do_switch_packets(veth_vportid, bufs, rx_count);
-
-		/* move to next veth port */
-		if (++veth_vportid == (unsigned)VETH0 + num_veth) {
-			veth_vportid = VETH0;
-		}
+		tsc = rte_rdtsc();
+		if (rx_count)
+			sched_vport_account(lcore, vportid, rx_count,
+			                    tsc - prev_tsc);
+		prev_tsc = tsc;
 	}
 
-	/* Vhost Devices */
-	if (num_vhost) {
-		rx_count = receive_from_vport(vhost_vportid, &bufs[0]);
-		do_switch_packets(vhost_vportid, bufs, rx_count);
+	if (client_switching)
+		recycle_clients();
+	flush_vport_caches();
+	if (client_switching)
+		flush_kni_tx_rings();
 
-		/* move to next vhost port */
-		if (++vhost_vportid == (unsigned)VHOST0 + num_vhost) { 
-			vhost_vportid = VHOST0;
-		}
-	}
+	tsc = rte_rdtsc();
+	cycles[STATS_CYCLES_TX] += tsc - prev_tsc;
+	sl->total_cycles += tsc - start_tsc;
 
-	flush_clients();
-	flush_ports();
-	flush_vhost_devs();
-}
-
-static inline void __attribute__((always_inline))
-do_port_switching(unsigned vportid)
-{
-	int rx_count = 0;
-	struct rte_mbuf *bufs[PKT_BURST_SIZE];
-
-	rx_count = receive_from_vport(vportid, &bufs[0]);
-	do_switch_packets(vportid, bufs, rx_count);
-
-	flush_clients();
-	flush_ports();
-	flush_vhost_devs();
-	flush_nic_tx_ring(vportid);
+	for (i = 0; i < STATS_CYCLES_MAX; i++)
+		stats_lcore_cycles_increment(i, cycles[i]);
+	stats_lcore_loop_increment(rx_total > 0);
 }
 
 /* Get CPU frequency */
@@ -309,6 +552,26 @@ measure_cpu_frequency(void)
 	cpu_freq *= 1000000;
 }
 
+/*
+ * Maximum time the vswitchd core may sleep when idle. curr_tsc, the stats
+ * export and the rebalancing all only advance while this core is awake, so
+ * the sleep is capped at the shortest of their periods.
+ */
+static unsigned
+idle_sleep_timeout_us(void)
+{
+	unsigned timeout_us = idle_sleep_us;
+
+	if (stats_export_interval_ms &&
+	    timeout_us > stats_export_interval_ms * 1000)
+		timeout_us = stats_export_interval_ms * 1000;
+	if (rebalance_interval_ms &&
+	    timeout_us > rebalance_interval_ms * 1000)
+		timeout_us = rebalance_interval_ms * 1000;
+
+	return timeout_us;
+}
+
 /* Main function used by the processing threads.
  * Prints out some configuration details for the thread and then begins
  * performing packet RX and TX.
@@ -320,8 +583,9 @@ lcore_main(void *arg __rte_unused)
 	const unsigned id = rte_lcore_id();
 	unsigned nr_vswitchd = 0;
 	unsigned nr_client_switching = 0;
-	unsigned nr_port_switching = 0;
-	unsigned portid_map[MAX_PHYPORTS] = {0};
+	unsigned nr_switching = 0;
+	unsigned idle_vswitchd = 0;
+	unsigned idle_timeout_us = 0;
 
 	/* vswitchd core is used for print_stat and receive_from_vswitchd */
 	if (id == vswitchd_core) {
@@ -346,10 +610,27 @@ lcore_main(void *arg __rte_unused)
 	for (i = 0; i < nb_cfg_params; i++) {
 		if (id == cfg_params[i].lcore_id) {
 			RTE_LOG(INFO, APP, "Port core is %d.\n", id);
-			portid_map[nr_port_switching++] = cfg_params[i].port_id;
+			break;
 		}
 	}
 
+	/* The vports each switching core polls are set by the scheduler */
+	if (sched_lcores[id].switching)
+		nr_switching = RUN_ON_THIS_THREAD;
+
+	if (nr_vswitchd && idle_sleep_us) {
+		if (nr_switching)
+			RTE_LOG(WARNING, APP, "vswitchd core %d also switches "
+			        "packets, idle sleep disabled\n", id);
+		else
+			idle_vswitchd = RUN_ON_THIS_THREAD;
+
+		idle_timeout_us = idle_sleep_timeout_us();
+		if (idle_timeout_us < idle_sleep_us)
+			RTE_LOG(INFO, APP, "vswitchd core idle sleep limited to "
+			        "%u us\n", idle_timeout_us);
+	}
+
 	for (;;) {
 		/*
 		 * This to to ensure that a vhost device can be safely removed.
@@ -362,10 +643,15 @@ lcore_main(void *arg __rte_unused)
 
 		if (nr_vswitchd)
 			do_vswitchd();
-		if (nr_client_switching)
-			do_client_switching();
-		for (i = 0; i < nr_port_switching; i++)
-			do_port_switching(portid_map[i]);
+		if (nr_switching)
+			do_switching(id, nr_client_switching);
+
+		/*
+		 * A vswitchd core with no switching work may sleep until
+		 * vswitchd queues a request, rather than spin.
+		 */
+		if (idle_vswitchd)
+			wait_for_request_from_vswitchd(idle_timeout_us);
 	}
 
 	return 0;
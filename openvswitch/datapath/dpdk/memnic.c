@@ -0,0 +1,230 @@
+/*
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2010-2014 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <string.h>
+
+#include <rte_log.h>
+#include <rte_mbuf.h>
+#include <rte_memcpy.h>
+#include <rte_memzone.h>
+#include <rte_spinlock.h>
+
+#include "memnic.h"
+#include "stats.h"
+#include "vport.h"
+
+#define RTE_LOGTYPE_APP        RTE_LOGTYPE_USER1
+
+#define MEMNIC_RING_MASK       (MEMNIC_RING_SIZE - 1)
+
+/*
+ * Host side state of a MEMNIC port. The indices are private copies of the
+ * shared ones, so that the shared cache lines are only read when the
+ * private view shows the ring as full or empty.
+ */
+struct memnic_port {
+	struct memnic_area *area;
+	rte_spinlock_t tx_lock;      /* Serialises cores sending to the guest */
+	uint32_t to_guest_head;      /* Next 'to_guest' slot to fill */
+	uint32_t to_guest_tail;      /* Last 'to_guest.tail' read */
+	uint32_t from_guest_tail;    /* Next 'from_guest' slot to drain */
+	uint32_t from_guest_head;    /* Last 'from_guest.head' read */
+} __rte_cache_aligned;
+
+static struct memnic_port memnic_ports[MAX_MEMNIC_PORTS];
+
+struct memnic_area *
+memnic_port_init(unsigned index, const char *mz_name, int socket)
+{
+	const struct rte_memzone *mz = NULL;
+	struct memnic_area *area = NULL;
+	struct memnic_port *port = &memnic_ports[index];
+
+	/* Memzones can't be freed, so a deleted port's area is reused */
+	mz = rte_memzone_lookup(mz_name);
+	if (mz == NULL)
+		mz = rte_memzone_reserve(mz_name, sizeof(*area), socket, 0);
+	if (mz == NULL) {
+		RTE_LOG(ERR, APP, "Cannot reserve memzone '%s' for MEMNIC "
+		        "port %u\n", mz_name, index);
+		return NULL;
+	}
+
+	area = mz->addr;
+	memset(area, 0, sizeof(*area));
+	area->ring_size = MEMNIC_RING_SIZE;
+	area->buf_size = MEMNIC_BUF_SIZE;
+	area->version = MEMNIC_VERSION;
+	rte_wmb();
+	area->magic = MEMNIC_MAGIC;
+
+	memset(port, 0, sizeof(*port));
+	port->area = area;
+	rte_spinlock_init(&port->tx_lock);
+
+	return area;
+}
+
+unsigned
+memnic_tx_burst(unsigned index, struct rte_mbuf **bufs, unsigned count,
+                uint64_t *bytes, unsigned *too_big)
+{
+	struct memnic_port *port = &memnic_ports[index];
+	struct memnic_ring *ring = &port->area->to_guest;
+	struct memnic_desc *desc = NULL;
+	uint32_t head = 0, tail = 0, slot = 0, len = 0;
+	unsigned free_slots = 0, sent = 0, i = 0;
+
+	*bytes = 0;
+	*too_big = 0;
+
+	rte_spinlock_lock(&port->tx_lock);
+
+	head = port->to_guest_head;
+	free_slots = MEMNIC_RING_SIZE - (head - port->to_guest_tail);
+	if (free_slots < count) {
+		tail = ring->tail;
+		/* A tail outside the ring can only come from a broken guest, so
+		 * leave every descriptor to it rather than overwrite its own */
+		if (unlikely(head - tail > MEMNIC_RING_SIZE)) {
+			free_slots = 0;
+		} else {
+			port->to_guest_tail = tail;
+			free_slots = MEMNIC_RING_SIZE - (head - tail);
+		}
+	}
+	if (count > free_slots)
+		count = free_slots;
+
+	for (i = 0; i < count; i++) {
+		len = rte_pktmbuf_data_len(bufs[i]);
+		/* Only single segment frames that fit a buffer can be sent */
+		if (unlikely(len > MEMNIC_BUF_SIZE ||
+		             len != rte_pktmbuf_pkt_len(bufs[i]))) {
+			(*too_big)++;
+			continue;
+		}
+
+		slot = head & MEMNIC_RING_MASK;
+		rte_memcpy(port->area->bufs[slot],
+		           rte_pktmbuf_mtod(bufs[i], void *), len);
+		desc = &ring->desc[slot];
+		desc->offset = slot * MEMNIC_BUF_SIZE;
+		desc->len = (uint16_t)len;
+		head++;
+		sent++;
+		*bytes += len;
+	}
+
+	if (sent) {
+		/* Descriptors and data must be visible before the new head */
+		rte_wmb();
+		ring->head = head;
+		port->to_guest_head = head;
+	}
+
+	rte_spinlock_unlock(&port->tx_lock);
+
+	return sent;
+}
+
+unsigned
+memnic_rx_burst(unsigned index, struct rte_mempool *mp,
+                struct rte_mbuf **bufs, unsigned count)
+{
+	struct memnic_port *port = &memnic_ports[index];
+	struct memnic_ring *ring = &port->area->from_guest;
+	struct memnic_desc desc = {0};
+	struct rte_mbuf *mbuf = NULL;
+	uint32_t tail = port->from_guest_tail;
+	unsigned avail = 0, rx_count = 0, i = 0;
+	char *data = NULL;
+
+	avail = port->from_guest_head - tail;
+	if (avail == 0) {
+		port->from_guest_head = ring->head;
+		/* Read the head before the descriptors it publishes */
+		rte_rmb();
+		avail = port->from_guest_head - tail;
+		/* A head outside the ring can only come from a broken guest */
+		if (unlikely(avail > MEMNIC_RING_SIZE)) {
+			port->from_guest_head = tail;
+			return 0;
+		}
+	}
+	if (count > avail)
+		count = avail;
+
+	for (i = 0; i < count; i++) {
+		desc = ring->desc[tail & MEMNIC_RING_MASK];
+
+		if (unlikely(desc.len == 0 || desc.len > MEMNIC_BUF_SIZE ||
+		             desc.offset > sizeof(port->area->bufs) - desc.len)) {
+			stats_vport_tx_drop_increment(MEMNIC0 + index, INC_BY_1);
+			stats_vport_tx_error_increment(MEMNIC0 + index, INC_BY_1);
+			tail++;
+			continue;
+		}
+
+		mbuf = rte_pktmbuf_alloc(mp);
+		if (unlikely(mbuf == NULL)) {
+			/* Leave the rest in the ring until mbufs are available */
+			stats_vswitch_nombuf_increment(INC_BY_1);
+			break;
+		}
+
+		data = rte_pktmbuf_append(mbuf, desc.len);
+		if (unlikely(data == NULL)) {
+			rte_pktmbuf_free(mbuf);
+			stats_vport_tx_drop_increment(MEMNIC0 + index, INC_BY_1);
+			stats_vport_tx_error_increment(MEMNIC0 + index, INC_BY_1);
+			tail++;
+			continue;
+		}
+		rte_memcpy(data, (uint8_t *)port->area->bufs + desc.offset, desc.len);
+
+		bufs[rx_count++] = mbuf;
+		tail++;
+	}
+
+	if (tail != port->from_guest_tail) {
+		/* The guest may reuse the buffers once the tail moves on */
+		rte_compiler_barrier();
+		ring->tail = tail;
+		port->from_guest_tail = tail;
+	}
+
+	return rx_count;
+}
@@ -0,0 +1,70 @@
+/*
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2010-2014 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef __MEMNIC_H_
+#define __MEMNIC_H_
+
+#define MAX_MEMNIC_PORTS       16
+
+struct rte_mbuf;
+struct rte_mempool;
+struct memnic_area;
+
+/* Reserves, or reuses, and initialises the shared memory of MEMNIC port
+ * 'index' in memzone 'mz_name' on 'socket'. Returns NULL on failure.
+ */
+struct memnic_area *
+memnic_port_init(unsigned index, const char *mz_name, int socket);
+
+/* Copies up to 'count' packets from 'bufs' to the guest of MEMNIC port
+ * 'index'. May be called from any core. Returns the number of packets
+ * sent, with their length in 'bytes'; 'too_big' is set to the number of
+ * packets skipped as they do not fit in one buffer. The other unsent
+ * packets did not fit in the ring. The caller still owns, and must free,
+ * all mbufs.
+ */
+unsigned
+memnic_tx_burst(unsigned index, struct rte_mbuf **bufs, unsigned count,
+                uint64_t *bytes, unsigned *too_big);
+
+/* Copies up to 'count' packets sent by the guest of MEMNIC port 'index'
+ * into mbufs allocated from 'mp'. Must only be called from one core.
+ * Returns the number of mbufs stored in 'bufs'.
+ */
+unsigned
+memnic_rx_burst(unsigned index, struct rte_mempool *mp,
+                struct rte_mbuf **bufs, unsigned count);
+
+#endif /* __MEMNIC_H_ */
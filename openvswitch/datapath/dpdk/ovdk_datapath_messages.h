@@ -39,6 +39,22 @@
 #include "flow.h"
 #include "stats.h"
 
+/* Datapath-wide statistics. */
+struct dpdk_dp_stats {
+	uint64_t n_hit;              /* Number of flow table matches. */
+	uint64_t n_missed;           /* Number of flow table misses. */
+	uint64_t n_lost;             /* Number of misses not sent to vswitchd. */
+	uint64_t n_flows;            /* Number of flows present. */
+};
+
+/* A 'datapath' message between vswitchd <-> datapath. */
+struct dpdk_dp_message {
+	uint32_t id;                 /* Thread ID of sending thread */
+	uint8_t cmd;                 /* Command to execute on datapath. */
+	uint32_t flags;              /* Additional flags, if any, or null. */
+	struct dpdk_dp_stats stats;  /* Current statistics for the datapath. */
+};
+
 /* A 'vport managment' message between vswitchd <-> datapath.  */
 struct dpdk_vport_message {
 	uint32_t id;                 /* Thread ID of sending thread */
@@ -49,6 +65,8 @@ struct dpdk_vport_message {
 	enum vport_type type;        /* Type of the vport */
 	char reserved[16];           /* Padding - currently reserved for future use */
 	struct port_stats stats;     /* Current statistics for the given vport. */
+	uint64_t latency[STATS_LATENCY_BUCKETS];  /* Sampled packets sent to the
+	                                vport, by latency, see --latency_sample */
 };
 
 struct dpdk_flow_message {
@@ -69,6 +87,7 @@ struct dpdk_packet_message {
 struct dpdk_message {
 	int16_t type;              /* Message type, if a request, or return code */
 	union {                    /* Actual message */
+		struct dpdk_dp_message dp_msg;
 		struct dpdk_vport_message vport_msg;
 		struct dpdk_flow_message flow_msg;
 		struct dpdk_packet_message packet_msg;
@@ -81,6 +100,13 @@ struct dpdk_upcall {
 	struct flow_key key; /* Extracted flow key for the packet. */
 };
 
+enum dp_cmd {
+	DP_CMD_UNSPEC,
+	DP_CMD_NEW,            /* Unused, matches OVS_DP_CMD_NEW. */
+	DP_CMD_DEL,            /* Unused, matches OVS_DP_CMD_DEL. */
+	DP_CMD_GET             /* Get datapath statistics. */
+};
+
 enum vport_cmd {
 	VPORT_CMD_UNSPEC,
 	VPORT_CMD_NEW,         /* Add new vport. */
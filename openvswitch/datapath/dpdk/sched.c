@@ -0,0 +1,259 @@
+/*
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2010-2014 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+
+#include <rte_atomic.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+
+#include "sched.h"
+#include "args.h"
+#include "vport.h"
+
+#define RTE_LOGTYPE_APP RTE_LOGTYPE_USER1
+/* Difference in load, per mille, between lcores before a vport is moved */
+#define SCHED_IMBALANCE_MIN 200
+
+struct sched_lcore sched_lcores[RTE_MAX_LCORE];
+struct sched_vport sched_vports[MAX_VPORTS];
+/* Interval in mseconds between rebalancing vports, 0 to never rebalance */
+unsigned rebalance_interval_ms = 0;
+
+/* Counters as seen at the last rebalance */
+static uint64_t rebalance_period;
+static uint64_t last_rebalance_tsc;
+static uint64_t lcore_busy_last[RTE_MAX_LCORE];
+static uint64_t lcore_total_last[RTE_MAX_LCORE];
+static uint64_t vport_cycles_last[MAX_VPORTS];
+
+/*
+ * The client switching core and the cores given in --config poll vports.
+ */
+void
+sched_init(void)
+{
+	unsigned i = 0;
+
+	sched_lcores[client_switching_core].switching = true;
+	for (i = 0; i < nb_cfg_params; i++)
+		sched_lcores[cfg_params[i].lcore_id].switching = true;
+
+	rebalance_period = (rte_get_tsc_hz() + MS_PER_S - 1) / MS_PER_S *
+	                   rebalance_interval_ms;
+	last_rebalance_tsc = rte_rdtsc();
+}
+
+/*
+ * Give a newly created vport to an lcore to poll. A physical port goes to
+ * the first core given for it in --config, and any other vport to the
+ * client switching core. KNI and vEth ports stay there, as that core also
+ * passes their packets to the kernel.
+ */
+void
+sched_vport_add(unsigned vportid)
+{
+	struct sched_vport *sv = &sched_vports[vportid];
+	enum vport_type type = vport_get_type(vportid);
+	unsigned lcore = client_switching_core;
+	unsigned i = 0;
+
+	if (type == VPORT_TYPE_PHY) {
+		for (i = 0; i < nb_cfg_params; i++) {
+			if (cfg_params[i].port_id == vportid) {
+				lcore = cfg_params[i].lcore_id;
+				break;
+			}
+		}
+	}
+
+	sv->lcore = lcore;
+	sv->movable = type != VPORT_TYPE_KNI && type != VPORT_TYPE_VETH;
+	sv->cycles = 0;
+	sv->packets = 0;
+	vport_cycles_last[vportid] = 0;
+	vport_list_add(&sched_lcores[lcore].vports, vportid);
+}
+
+/*
+ * Stop polling a vport that is being deleted. Its lcore may still poll it
+ * until the next vport_quiesce().
+ */
+void
+sched_vport_del(unsigned vportid)
+{
+	vport_list_del(&sched_lcores[sched_vports[vportid].lcore].vports,
+	               vportid);
+}
+
+/*
+ * Wait for 'lcore' to start a new loop, so that it has finished with
+ * anything it has been told to stop polling.
+ */
+static void
+sched_quiesce_lcore(unsigned lcore)
+{
+	if (lcore == rte_lcore_id())
+		return;
+
+	dev_removal_flag[lcore] = REQUEST_DEV_REMOVAL;
+	while (dev_removal_flag[lcore] != ACK_DEV_REMOVAL)
+		rte_pause();
+}
+
+/*
+ * Move the polling of 'vportid' to 'lcore'.
+ *
+ * The vport is taken off its old lcore's list, and only listed on 'lcore'
+ * once the old lcore has finished its loop. A vport is therefore never
+ * polled by two lcores, and the old lcore has passed on all the packets it
+ * received from the vport, and, for a physical port, sent all the packets
+ * it took from the port's TX queue, before the new lcore starts.
+ *
+ * Returns 0 on success, else a negative errno value.
+ */
+int
+sched_vport_move(unsigned vportid, unsigned lcore)
+{
+	struct sched_vport *sv = NULL;
+	unsigned from = 0;
+
+	if (!vport_is_enabled(vportid))
+		return -ENODEV;
+	if (lcore >= RTE_MAX_LCORE || !sched_lcores[lcore].switching)
+		return -EINVAL;
+
+	sv = &sched_vports[vportid];
+	if (!sv->movable)
+		return -EPERM;
+
+	from = sv->lcore;
+	if (from == lcore)
+		return 0;
+
+	vport_list_del(&sched_lcores[from].vports, vportid);
+	sched_quiesce_lcore(from);
+	sv->lcore = lcore;
+	vport_list_add(&sched_lcores[lcore].vports, vportid);
+
+	RTE_LOG(INFO, APP, "Moved vport %u from lcore %u to lcore %u\n",
+	        vportid, from, lcore);
+
+	return 0;
+}
+
+/*
+ * Every 'rebalance_interval_ms', find the busiest and least busy switching
+ * lcores over the interval. If their load differs by SCHED_IMBALANCE_MIN
+ * or more, move the vport of the busiest lcore whose load comes closest to
+ * halving the difference, as long as moving it narrows the difference.
+ * Only one vport is moved each interval, so that the load can be measured
+ * again before another is moved.
+ *
+ * This must be called periodically by the vswitchd core.
+ */
+void
+sched_rebalance(void)
+{
+	unsigned load[RTE_MAX_LCORE] = {0};
+	uint64_t total[RTE_MAX_LCORE] = {0};
+	uint64_t now = rte_rdtsc();
+	uint64_t cost[MAX_VPORTS];
+	const struct vport_list *list = NULL;
+	struct sched_lcore *sl = NULL;
+	unsigned hi = RTE_MAX_LCORE, lo = RTE_MAX_LCORE;
+	unsigned gap = 0, vport_load = 0, diff = 0, best_diff = UINT_MAX;
+	unsigned lcore = 0, vportid = 0, best = MAX_VPORTS, i = 0;
+	uint64_t busy = 0, cycles = 0;
+
+	if (rebalance_period == 0 ||
+	    now - last_rebalance_tsc < rebalance_period)
+		return;
+	last_rebalance_tsc = now;
+
+	RTE_LCORE_FOREACH(lcore) {
+		sl = &sched_lcores[lcore];
+		if (!sl->switching)
+			continue;
+
+		busy = sl->busy_cycles;
+		cycles = sl->total_cycles;
+		total[lcore] = cycles - lcore_total_last[lcore];
+		if (total[lcore])
+			load[lcore] = (busy - lcore_busy_last[lcore]) * 1000 /
+			              total[lcore];
+		lcore_busy_last[lcore] = busy;
+		lcore_total_last[lcore] = cycles;
+
+		if (hi == RTE_MAX_LCORE || load[lcore] > load[hi])
+			hi = lcore;
+		if (lo == RTE_MAX_LCORE || load[lcore] < load[lo])
+			lo = lcore;
+	}
+
+	for (vportid = 0; vportid < MAX_VPORTS; vportid++) {
+		cycles = sched_vports[vportid].cycles;
+		cost[vportid] = cycles - vport_cycles_last[vportid];
+		vport_cycles_last[vportid] = cycles;
+	}
+
+	if (hi == lo || total[hi] == 0)
+		return;
+	gap = load[hi] - load[lo];
+	if (gap < SCHED_IMBALANCE_MIN)
+		return;
+
+	list = &sched_lcores[hi].vports;
+	for (i = 0; i < list->count; i++) {
+		vportid = list->ids[i];
+		if (!sched_vports[vportid].movable)
+			continue;
+
+		vport_load = cost[vportid] * 1000 / total[hi];
+		if (vport_load == 0 || vport_load >= gap)
+			continue;
+
+		diff = abs((int)gap - 2 * (int)vport_load);
+		if (diff < best_diff) {
+			best_diff = diff;
+			best = vportid;
+		}
+	}
+
+	if (best != MAX_VPORTS)
+		sched_vport_move(best, lo);
+}
@@ -0,0 +1,88 @@
+/*
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2010-2014 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef __SCHED_H_
+#define __SCHED_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <rte_lcore.h>
+
+#include "vport.h"
+
+/*
+ * Vports polled by one switching lcore, and how busy polling them keeps
+ * it. The list is only changed by the vswitchd core, and the counters are
+ * only written by the lcore itself.
+ */
+struct sched_lcore {
+	struct vport_list vports;
+	volatile uint64_t busy_cycles;   /* cycles of polls that received packets */
+	volatile uint64_t total_cycles;  /* cycles spent switching */
+	bool switching;                  /* whether the lcore polls vports */
+} __rte_cache_aligned;
+
+/*
+ * Cost of polling one vport. The counters are only written by the lcore
+ * polling the vport.
+ */
+struct sched_vport {
+	volatile uint64_t cycles;   /* cycles of polls that received packets */
+	volatile uint64_t packets;  /* packets received by those polls */
+	unsigned lcore;             /* lcore polling the vport */
+	bool movable;               /* whether it may move to another lcore */
+} __rte_cache_aligned;
+
+extern struct sched_lcore sched_lcores[RTE_MAX_LCORE];
+extern struct sched_vport sched_vports[MAX_VPORTS];
+extern unsigned rebalance_interval_ms;
+
+void sched_init(void);
+void sched_vport_add(unsigned vportid);
+void sched_vport_del(unsigned vportid);
+int sched_vport_move(unsigned vportid, unsigned lcore);
+void sched_rebalance(void);
+
+/* Charge a poll of 'vportid' by 'lcore' which received 'packets' */
+static inline void __attribute__((always_inline))
+sched_vport_account(unsigned lcore, unsigned vportid, unsigned packets,
+                    uint64_t cycles)
+{
+	sched_vports[vportid].cycles += cycles;
+	sched_vports[vportid].packets += packets;
+	sched_lcores[lcore].busy_cycles += cycles;
+}
+
+#endif /* __SCHED_H_ */
@@ -0,0 +1,183 @@
+/*
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2010-2014 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __STATS_TYPES_H_
+#define __STATS_TYPES_H_
+
+#include <stdint.h>
+
+#include <rte_atomic.h>
+#include <rte_memory.h>
+
+#include "vport-types.h"
+
+/*
+ * Shared memory layout of the statistics exported for monitoring agents.
+ *
+ * The vswitchd core gathers the datapath counters into the MZ_STATS_EXPORT
+ * memzone every --stats_export_interval mseconds. Other processes attach
+ * to the memzone read-only and never write to it, so polling it costs the
+ * switching cores nothing.
+ *
+ * 'seq' is a sequence lock: it is odd while a snapshot is being written
+ * and is incremented again once it is complete. Readers copy the area
+ * between two reads of 'seq' and retry if it was odd or has changed, see
+ * stats_export_read_begin() and stats_export_read_retry().
+ *
+ * Readers must check 'magic', 'version' and 'size' before using anything
+ * else, and only accept the version they were built for: 'lcores',
+ * 'vports' and 'queues' are arrays, so any change to a structure moves
+ * every later element. The version is bumped on every layout change. All
+ * counters are totals since the datapath started or was last cleared.
+ */
+#define MZ_STATS_EXPORT			"OVS_stats_export"
+#define STATS_EXPORT_MAGIC		0x54535644	/* "DVST" */
+#define STATS_EXPORT_VERSION	3
+#define STATS_EXPORT_MAX_LCORES	128
+#define STATS_EXPORT_MAX_QUEUES	512
+#define STATS_EXPORT_DROP_REASONS	9	/* enum stats_drop_reason */
+#define STATS_EXPORT_CYCLES_TYPES	5	/* enum stats_cycles_type */
+#define STATS_EXPORT_LATENCY_BUCKETS	11	/* last bucket is >= 512us */
+
+/* Counters of one vport, indexed by vport id; unused ids have type 0 */
+struct stats_export_vport {
+	char name[VPORT_INFO_NAMESZ];
+	uint32_t type;			/* enum vport_type */
+	uint32_t lcore;			/* lcore polling the vport */
+	uint64_t rx;
+	uint64_t tx;
+	uint64_t rx_bytes;
+	uint64_t tx_bytes;
+	uint64_t rx_drop;
+	uint64_t tx_drop;
+	uint64_t rx_error;
+	uint64_t tx_error;
+	uint64_t overrun;
+	uint64_t drops[STATS_EXPORT_DROP_REASONS];
+	/* sampled packets sent to the vport, by latency (1us << bucket) */
+	uint64_t latency[STATS_EXPORT_LATENCY_BUCKETS];
+};
+
+/* Counters of one lcore, indexed by lcore id */
+struct stats_export_lcore {
+	uint32_t enabled;		/* lcore is used by the datapath */
+	uint32_t switching;		/* lcore polls vports */
+	uint64_t cycles[STATS_EXPORT_CYCLES_TYPES];
+	uint64_t loops;
+	uint64_t busy_loops;
+	uint64_t hit;
+	uint64_t miss;
+	uint64_t lost;
+	uint64_t nombuf;
+	uint64_t rx_drop;
+	uint64_t tx_drop;
+};
+
+struct stats_export_flow_table {
+	uint64_t flows;			/* flows installed */
+	uint64_t size;			/* maximum number of flows */
+	uint64_t hit;
+	uint64_t miss;
+	uint64_t lost;
+	uint64_t overflow;		/* flows indexed by the overflow hash */
+};
+
+enum stats_export_queue_type {
+	STATS_EXPORT_QUEUE_TX,		/* packets waiting for the vport */
+	STATS_EXPORT_QUEUE_RX,		/* packets waiting for the switch */
+	STATS_EXPORT_QUEUE_FREE,	/* mbufs returned by a client */
+	STATS_EXPORT_QUEUE_ALLOC,	/* mbufs offered to a client */
+};
+
+/* Depth of one ring or fifo between the switch and a vport */
+struct stats_export_queue {
+	uint32_t vportid;
+	uint32_t type;			/* enum stats_export_queue_type */
+	uint32_t count;			/* entries queued */
+	uint32_t size;			/* capacity */
+};
+
+struct stats_export {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;			/* sizeof(struct stats_export) */
+	volatile uint32_t seq;
+	uint64_t tsc_hz;
+	uint64_t tsc;			/* when the snapshot was taken */
+	uint32_t interval_ms;	/* time between snapshots */
+	uint32_t num_queues;	/* entries of 'queues' in use */
+	struct stats_export_flow_table flow_table;
+	struct stats_export_lcore lcores[STATS_EXPORT_MAX_LCORES] __rte_cache_aligned;
+	struct stats_export_vport vports[MAX_VPORTS] __rte_cache_aligned;
+	struct stats_export_queue queues[STATS_EXPORT_MAX_QUEUES] __rte_cache_aligned;
+};
+
+/* Mark the start of a snapshot; only the vswitchd core writes */
+static inline void
+stats_export_write_begin(struct stats_export *exp)
+{
+	exp->seq++;
+	rte_wmb();
+}
+
+/* Publish a snapshot started with stats_export_write_begin() */
+static inline void
+stats_export_write_end(struct stats_export *exp)
+{
+	rte_wmb();
+	exp->seq++;
+}
+
+/* Wait for a complete snapshot and return its sequence number */
+static inline uint32_t
+stats_export_read_begin(const struct stats_export *exp)
+{
+	uint32_t seq = 0;
+
+	while ((seq = exp->seq) & 1)
+		;
+	rte_rmb();
+
+	return seq;
+}
+
+/* Whether what was read since stats_export_read_begin() may be torn */
+static inline int
+stats_export_read_retry(const struct stats_export *exp, uint32_t seq)
+{
+	rte_rmb();
+	return exp->seq != seq;
+}
+
+#endif /* __STATS_TYPES_H_ */
@@ -33,11 +33,18 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <rte_common.h>
 #include <rte_ether.h>
 #include <rte_memzone.h>
+#include <rte_cycles.h>
+#include <rte_mbuf.h>
+#include <rte_string_fns.h>
 
 #include "stats.h"
+#include "stats-types.h"
 #include "init.h"
+#include "flow.h"
 #include "vport.h" /* for MAX_VPORTS */
 
 #define NO_FLAGS            0
@@ -56,6 +63,18 @@ struct vport_lcore_statistics {
 	volatile uint64_t rx_drop;
 	volatile uint64_t tx_drop;
 	volatile uint64_t overrun;
+	volatile uint64_t rx_bytes;
+	volatile uint64_t tx_bytes;
+	volatile uint64_t rx_error;
+	volatile uint64_t tx_error;
+	volatile uint64_t drops[STATS_DROP_MAX];  /* rx and tx drops by reason */
+	volatile uint64_t recycled;          /* mbufs returned via free_q */
+	volatile uint64_t recycle_backlog;   /* free_q depth at last recycle */
+	volatile uint64_t recycle_backlog_max;
+	/* bursts sent to a physical port, by wait of their first packet */
+	volatile uint64_t tx_latency[STATS_TX_LATENCY_BUCKETS];
+	/* sampled packets sent to the vport, by time since they were received */
+	volatile uint64_t latency[STATS_LATENCY_BUCKETS];
 } __rte_cache_aligned;
 
 struct vport_statistics {
@@ -65,14 +84,35 @@ struct vport_statistics {
 struct vswitch_lcore_statistics {
 	uint64_t tx_drop;
 	uint64_t rx_drop;
+	uint64_t hit;     /* Packets that matched a flow */
+	uint64_t miss;    /* Packets that did not match a flow */
+	uint64_t lost;    /* Misses that could not be sent to vswitchd */
+	uint64_t nombuf;  /* Failed mbuf allocations */
+	/* TSC cycles spent by a switching core, by phase */
+	uint64_t cycles[STATS_CYCLES_MAX];
+	uint64_t loops;       /* Passes over the core's vports */
+	uint64_t busy_loops;  /* Passes that received packets */
 } __rte_cache_aligned;
 
 struct vswitch_statistics {
 	struct vswitch_lcore_statistics stats[RTE_MAX_LCORE];
 };
 
+/* Packets left until the next one an lcore stamps */
+struct latency_sampler {
+	unsigned count;
+} __rte_cache_aligned;
+
 static struct vport_statistics *vport_stats[MAX_VPORTS] = {NULL};
 static struct vswitch_statistics *vswitch_stats = NULL;
+static struct latency_sampler latency_samplers[RTE_MAX_LCORE];
+static uint64_t stats_cycles_per_us = 1;
+static struct stats_export *stats_exp = NULL;
+static uint64_t export_period;
+static uint64_t last_export_tsc;
+
+unsigned latency_sample_rate = 0;
+unsigned stats_export_interval_ms = STATS_EXPORT_INTERVAL_DEFAULT;
 
 void
 stats_clear(void)
@@ -92,6 +132,14 @@ stats_vswitch_clear(void)
 	for (i = 0; i < RTE_MAX_LCORE; i++) {
 		vswitch_stats->stats[i].rx_drop = 0;
 		vswitch_stats->stats[i].tx_drop = 0;
+		vswitch_stats->stats[i].hit = 0;
+		vswitch_stats->stats[i].miss = 0;
+		vswitch_stats->stats[i].lost = 0;
+		vswitch_stats->stats[i].nombuf = 0;
+		memset(vswitch_stats->stats[i].cycles, 0,
+		       sizeof(vswitch_stats->stats[i].cycles));
+		vswitch_stats->stats[i].loops = 0;
+		vswitch_stats->stats[i].busy_loops = 0;
 	}
 }
 
@@ -111,6 +159,16 @@ stats_vport_clear(unsigned vportid)
 		s->tx = 0;
 		s->tx_drop = 0;
 		s->overrun = 0;
+		s->rx_bytes = 0;
+		s->tx_bytes = 0;
+		s->rx_error = 0;
+		s->tx_error = 0;
+		memset((void *)s->drops, 0, sizeof(s->drops));
+		s->recycled = 0;
+		s->recycle_backlog = 0;
+		s->recycle_backlog_max = 0;
+		memset((void *)s->tx_latency, 0, sizeof(s->tx_latency));
+		memset((void *)s->latency, 0, sizeof(s->latency));
 	}
 }
 
@@ -147,6 +205,43 @@ void stats_vport_overrun_increment(unsigned vportid, int inc)
 {
 }
 
+void stats_vport_rx_bytes_increment(unsigned vportid, uint64_t bytes)
+{
+}
+
+void stats_vport_tx_bytes_increment(unsigned vportid, uint64_t bytes)
+{
+}
+
+void stats_vport_rx_error_increment(unsigned vportid, int inc)
+{
+}
+
+void stats_vport_tx_error_increment(unsigned vportid, int inc)
+{
+}
+
+void stats_vport_drop_increment(unsigned vportid,
+                                enum stats_drop_reason reason, int inc)
+{
+}
+
+void stats_vport_recycled_increment(unsigned vportid, int inc)
+{
+}
+
+void stats_vport_recycle_backlog_update(unsigned vportid, unsigned backlog)
+{
+}
+
+void stats_vport_tx_latency_record(unsigned vportid, uint64_t us)
+{
+}
+
+void stats_vport_latency_record(unsigned vportid, uint64_t us)
+{
+}
+
 void stats_vswitch_rx_drop_increment(int inc)
 {
 }
@@ -155,6 +250,30 @@ void stats_vswitch_tx_drop_increment(int inc)
 {
 }
 
+void stats_vswitch_hit_increment(int inc)
+{
+}
+
+void stats_vswitch_miss_increment(int inc)
+{
+}
+
+void stats_vswitch_lost_increment(int inc)
+{
+}
+
+void stats_vswitch_nombuf_increment(int inc)
+{
+}
+
+void stats_lcore_cycles_increment(enum stats_cycles_type type, uint64_t cycles)
+{
+}
+
+void stats_lcore_loop_increment(bool busy)
+{
+}
+
 #else /* STATS_DISABLE */
 inline void stats_vport_rx_increment(unsigned vportid, int inc)
 {
@@ -181,6 +300,75 @@ inline void stats_vport_overrun_increment(unsigned vportid, int inc)
 	vport_stats[vportid]->stats[rte_lcore_id()].overrun += inc;
 }
 
+inline void stats_vport_rx_bytes_increment(unsigned vportid, uint64_t bytes)
+{
+	vport_stats[vportid]->stats[rte_lcore_id()].rx_bytes += bytes;
+}
+
+inline void stats_vport_tx_bytes_increment(unsigned vportid, uint64_t bytes)
+{
+	vport_stats[vportid]->stats[rte_lcore_id()].tx_bytes += bytes;
+}
+
+inline void stats_vport_rx_error_increment(unsigned vportid, int inc)
+{
+	vport_stats[vportid]->stats[rte_lcore_id()].rx_error += inc;
+}
+
+inline void stats_vport_tx_error_increment(unsigned vportid, int inc)
+{
+	vport_stats[vportid]->stats[rte_lcore_id()].tx_error += inc;
+}
+
+inline void stats_vport_drop_increment(unsigned vportid,
+                                       enum stats_drop_reason reason, int inc)
+{
+	vport_stats[vportid]->stats[rte_lcore_id()].drops[reason] += inc;
+}
+
+inline void stats_vport_recycled_increment(unsigned vportid, int inc)
+{
+	vport_stats[vportid]->stats[rte_lcore_id()].recycled += inc;
+}
+
+inline void stats_vport_recycle_backlog_update(unsigned vportid,
+                                               unsigned backlog)
+{
+	struct vport_lcore_statistics *s =
+	        &vport_stats[vportid]->stats[rte_lcore_id()];
+
+	s->recycle_backlog = backlog;
+	if (backlog > s->recycle_backlog_max)
+		s->recycle_backlog_max = backlog;
+}
+
+/*
+ * Bucket 0 counts times under 1us, bucket i times under 2^i us, and the
+ * last bucket all longer times.
+ */
+static inline unsigned
+latency_bucket(uint64_t us, unsigned num_buckets)
+{
+	if (us == 0)
+		return 0;
+
+	return RTE_MIN(64 - __builtin_clzll(us), num_buckets - 1);
+}
+
+inline void stats_vport_tx_latency_record(unsigned vportid, uint64_t us)
+{
+	unsigned bucket = latency_bucket(us, STATS_TX_LATENCY_BUCKETS);
+
+	vport_stats[vportid]->stats[rte_lcore_id()].tx_latency[bucket]++;
+}
+
+inline void stats_vport_latency_record(unsigned vportid, uint64_t us)
+{
+	unsigned bucket = latency_bucket(us, STATS_LATENCY_BUCKETS);
+
+	vport_stats[vportid]->stats[rte_lcore_id()].latency[bucket]++;
+}
+
 inline void stats_vswitch_rx_drop_increment(int inc)
 {
 	vswitch_stats->stats[rte_lcore_id()].rx_drop += inc;
@@ -191,6 +379,39 @@ inline void stats_vswitch_tx_drop_increment(int inc)
 	vswitch_stats->stats[rte_lcore_id()].tx_drop += inc;
 }
 
+inline void stats_vswitch_hit_increment(int inc)
+{
+	vswitch_stats->stats[rte_lcore_id()].hit += inc;
+}
+
+inline void stats_vswitch_miss_increment(int inc)
+{
+	vswitch_stats->stats[rte_lcore_id()].miss += inc;
+}
+
+inline void stats_vswitch_lost_increment(int inc)
+{
+	vswitch_stats->stats[rte_lcore_id()].lost += inc;
+}
+
+inline void stats_vswitch_nombuf_increment(int inc)
+{
+	vswitch_stats->stats[rte_lcore_id()].nombuf += inc;
+}
+
+inline void stats_lcore_cycles_increment(enum stats_cycles_type type,
+                                         uint64_t cycles)
+{
+	vswitch_stats->stats[rte_lcore_id()].cycles[type] += cycles;
+}
+
+inline void stats_lcore_loop_increment(bool busy)
+{
+	vswitch_stats->stats[rte_lcore_id()].loops++;
+	if (busy)
+		vswitch_stats->stats[rte_lcore_id()].busy_loops++;
+}
+
 #endif /* STATS_DISABLE */
 
 inline uint64_t stats_vport_rx_get(unsigned vportid)
@@ -248,6 +469,170 @@ inline uint64_t stats_vport_overrun_get(unsigned vportid)
 	return overrun;
 }
 
+inline uint64_t stats_vport_rx_bytes_get(unsigned vportid)
+{
+	uint64_t rx_bytes;
+	int i;
+
+	for (rx_bytes = 0, i = 0; i < RTE_MAX_LCORE; i++)
+		rx_bytes += vport_stats[vportid]->stats[i].rx_bytes;
+
+	return rx_bytes;
+}
+
+inline uint64_t stats_vport_tx_bytes_get(unsigned vportid)
+{
+	uint64_t tx_bytes;
+	int i;
+
+	for (tx_bytes = 0, i = 0; i < RTE_MAX_LCORE; i++)
+		tx_bytes += vport_stats[vportid]->stats[i].tx_bytes;
+
+	return tx_bytes;
+}
+
+inline uint64_t stats_vport_rx_error_get(unsigned vportid)
+{
+	uint64_t rx_error;
+	int i;
+
+	for (rx_error = 0, i = 0; i < RTE_MAX_LCORE; i++)
+		rx_error += vport_stats[vportid]->stats[i].rx_error;
+
+	return rx_error;
+}
+
+inline uint64_t stats_vport_tx_error_get(unsigned vportid)
+{
+	uint64_t tx_error;
+	int i;
+
+	for (tx_error = 0, i = 0; i < RTE_MAX_LCORE; i++)
+		tx_error += vport_stats[vportid]->stats[i].tx_error;
+
+	return tx_error;
+}
+
+inline uint64_t stats_vport_drop_get(unsigned vportid,
+                                     enum stats_drop_reason reason)
+{
+	uint64_t drops;
+	int i;
+
+	for (drops = 0, i = 0; i < RTE_MAX_LCORE; i++)
+		drops += vport_stats[vportid]->stats[i].drops[reason];
+
+	return drops;
+}
+
+inline uint64_t stats_vport_recycled_get(unsigned vportid)
+{
+	uint64_t recycled;
+	int i;
+
+	for (recycled = 0, i = 0; i < RTE_MAX_LCORE; i++)
+		recycled += vport_stats[vportid]->stats[i].recycled;
+
+	return recycled;
+}
+
+/*
+ * Only one core recycles a given client, so the backlog gauges are the
+ * largest value reported by any core.
+ */
+inline uint64_t stats_vport_recycle_backlog_get(unsigned vportid)
+{
+	uint64_t backlog = 0;
+	int i;
+
+	for (i = 0; i < RTE_MAX_LCORE; i++)
+		backlog = RTE_MAX(backlog,
+		                  vport_stats[vportid]->stats[i].recycle_backlog);
+
+	return backlog;
+}
+
+inline uint64_t stats_vport_recycle_backlog_max_get(unsigned vportid)
+{
+	uint64_t backlog_max = 0;
+	int i;
+
+	for (i = 0; i < RTE_MAX_LCORE; i++)
+		backlog_max = RTE_MAX(backlog_max,
+		                  vport_stats[vportid]->stats[i].recycle_backlog_max);
+
+	return backlog_max;
+}
+
+inline uint64_t stats_vport_tx_latency_get(unsigned vportid, unsigned bucket)
+{
+	uint64_t count;
+	int i;
+
+	for (count = 0, i = 0; i < RTE_MAX_LCORE; i++)
+		count += vport_stats[vportid]->stats[i].tx_latency[bucket];
+
+	return count;
+}
+
+inline uint64_t stats_vport_latency_get(unsigned vportid, unsigned bucket)
+{
+	uint64_t count;
+	int i;
+
+	for (count = 0, i = 0; i < RTE_MAX_LCORE; i++)
+		count += vport_stats[vportid]->stats[i].latency[bucket];
+
+	return count;
+}
+
+/*
+ * Stamp one in 'latency_sample_rate' of a burst received at 'rx_tsc' with
+ * the low bits of the TSC, and clear the stamp of the others. Stamps are
+ * kept in the RSS hash field, which is not used once the packets have been
+ * looked up, and are never zero. The RSS hash flag is cleared, so that the
+ * stamp is not taken for a hash if the packet is looked up again.
+ */
+void
+stats_latency_stamp(struct rte_mbuf **bufs, unsigned count, uint64_t rx_tsc)
+{
+	struct latency_sampler *sampler = &latency_samplers[rte_lcore_id()];
+	unsigned i = 0;
+
+	for (i = 0; i < count; i++) {
+		bufs[i]->ol_flags &= ~PKT_RX_RSS_HASH;
+		if (++sampler->count >= latency_sample_rate) {
+			sampler->count = 0;
+			bufs[i]->pkt.hash.rss = (uint32_t)rx_tsc | 1;
+		} else {
+			bufs[i]->pkt.hash.rss = 0;
+		}
+	}
+}
+
+/*
+ * Record how long the stamped packets in 'bufs' have been in the switch,
+ * as they are handed to 'vportid'. The stamps wrap after 2^32 cycles,
+ * which is far longer than a packet stays queued.
+ */
+void
+stats_vport_latency_sample(unsigned vportid, struct rte_mbuf **bufs,
+                           unsigned count)
+{
+	uint32_t now = (uint32_t)rte_rdtsc();
+	uint32_t stamp = 0, cycles = 0;
+	unsigned i = 0;
+
+	for (i = 0; i < count; i++) {
+		stamp = bufs[i]->pkt.hash.rss;
+		if (stamp == 0)
+			continue;
+		/* the stamp's low bit is set, so it can be a cycle ahead */
+		cycles = (int32_t)(now - stamp) > 0 ? now - stamp : 0;
+		stats_vport_latency_record(vportid, cycles / stats_cycles_per_us);
+	}
+}
+
 inline struct port_stats stats_vport_get(unsigned vportid)
 {
        struct port_stats stats = {0};
@@ -256,6 +641,10 @@ inline struct port_stats stats_vport_get(unsigned vportid)
        stats.tx = stats_vport_tx_get(vportid);
        stats.rx_drop = stats_vport_rx_drop_get(vportid);
        stats.tx_drop = stats_vport_tx_drop_get(vportid);
+       stats.rx_bytes = stats_vport_rx_bytes_get(vportid);
+       stats.tx_bytes = stats_vport_tx_bytes_get(vportid);
+       stats.rx_error = stats_vport_rx_error_get(vportid);
+       stats.tx_error = stats_vport_tx_error_get(vportid);
 
        return stats;
 }
@@ -282,6 +671,190 @@ inline uint64_t stats_vswitch_tx_drop_get(void)
 	return tx_drop;
 }
 
+inline uint64_t stats_vswitch_hit_get(void)
+{
+	uint64_t hit;
+	int i;
+
+	for (hit = 0, i = 0; i < RTE_MAX_LCORE; i++)
+		hit += vswitch_stats->stats[i].hit;
+
+	return hit;
+}
+
+inline uint64_t stats_vswitch_miss_get(void)
+{
+	uint64_t miss;
+	int i;
+
+	for (miss = 0, i = 0; i < RTE_MAX_LCORE; i++)
+		miss += vswitch_stats->stats[i].miss;
+
+	return miss;
+}
+
+inline uint64_t stats_vswitch_lost_get(void)
+{
+	uint64_t lost;
+	int i;
+
+	for (lost = 0, i = 0; i < RTE_MAX_LCORE; i++)
+		lost += vswitch_stats->stats[i].lost;
+
+	return lost;
+}
+
+inline uint64_t stats_vswitch_nombuf_get(void)
+{
+	uint64_t nombuf;
+	int i;
+
+	for (nombuf = 0, i = 0; i < RTE_MAX_LCORE; i++)
+		nombuf += vswitch_stats->stats[i].nombuf;
+
+	return nombuf;
+}
+
+inline uint64_t stats_lcore_cycles_get(unsigned lcore,
+                                       enum stats_cycles_type type)
+{
+	return vswitch_stats->stats[lcore].cycles[type];
+}
+
+inline uint64_t stats_lcore_loops_get(unsigned lcore)
+{
+	return vswitch_stats->stats[lcore].loops;
+}
+
+inline uint64_t stats_lcore_busy_loops_get(unsigned lcore)
+{
+	return vswitch_stats->stats[lcore].busy_loops;
+}
+
+/*
+ * Reserve the memzone snapshots of the statistics are exported in, see
+ * stats-types.h for its layout.
+ */
+static void
+stats_export_init(void)
+{
+	const struct rte_memzone *mz = NULL;
+
+	RTE_BUILD_BUG_ON(RTE_MAX_LCORE > STATS_EXPORT_MAX_LCORES);
+	RTE_BUILD_BUG_ON(STATS_DROP_MAX != STATS_EXPORT_DROP_REASONS);
+	RTE_BUILD_BUG_ON(STATS_CYCLES_MAX != STATS_EXPORT_CYCLES_TYPES);
+	RTE_BUILD_BUG_ON(STATS_LATENCY_BUCKETS != STATS_EXPORT_LATENCY_BUCKETS);
+
+	mz = rte_memzone_reserve(MZ_STATS_EXPORT, sizeof(struct stats_export),
+	                         rte_socket_id(), NO_FLAGS);
+	if (mz == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot reserve memory zone for exported statistics\n");
+	memset(mz->addr, 0, sizeof(struct stats_export));
+
+	stats_exp = mz->addr;
+	stats_exp->magic = STATS_EXPORT_MAGIC;
+	stats_exp->version = STATS_EXPORT_VERSION;
+	stats_exp->size = sizeof(struct stats_export);
+	stats_exp->tsc_hz = rte_get_tsc_hz();
+	stats_exp->interval_ms = stats_export_interval_ms;
+
+	export_period = (rte_get_tsc_hz() + MS_PER_S - 1) / MS_PER_S *
+	                stats_export_interval_ms;
+	last_export_tsc = 0;
+}
+
+static void
+stats_export_vport(unsigned vportid, struct stats_export_vport *ev)
+{
+	unsigned i = 0;
+
+	if (!vport_exists(vportid)) {
+		memset(ev, 0, sizeof(*ev));
+		return;
+	}
+
+	rte_snprintf(ev->name, sizeof(ev->name), "%s", vport_get_name(vportid));
+	ev->type = vport_get_type(vportid);
+	ev->rx = stats_vport_rx_get(vportid);
+	ev->tx = stats_vport_tx_get(vportid);
+	ev->rx_bytes = stats_vport_rx_bytes_get(vportid);
+	ev->tx_bytes = stats_vport_tx_bytes_get(vportid);
+	ev->rx_drop = stats_vport_rx_drop_get(vportid);
+	ev->tx_drop = stats_vport_tx_drop_get(vportid);
+	ev->rx_error = stats_vport_rx_error_get(vportid);
+	ev->tx_error = stats_vport_tx_error_get(vportid);
+	ev->overrun = stats_vport_overrun_get(vportid);
+	for (i = 0; i < STATS_DROP_MAX; i++)
+		ev->drops[i] = stats_vport_drop_get(vportid, i);
+	for (i = 0; i < STATS_LATENCY_BUCKETS; i++)
+		ev->latency[i] = stats_vport_latency_get(vportid, i);
+}
+
+static void
+stats_export_lcore(unsigned lcore, struct stats_export_lcore *el)
+{
+	const struct vswitch_lcore_statistics *s = &vswitch_stats->stats[lcore];
+	unsigned i = 0;
+
+	el->enabled = 1;
+	for (i = 0; i < STATS_CYCLES_MAX; i++)
+		el->cycles[i] = s->cycles[i];
+	el->loops = s->loops;
+	el->busy_loops = s->busy_loops;
+	el->hit = s->hit;
+	el->miss = s->miss;
+	el->lost = s->lost;
+	el->nombuf = s->nombuf;
+	el->rx_drop = s->rx_drop;
+	el->tx_drop = s->tx_drop;
+}
+
+/*
+ * Start a snapshot of the statistics if one is due at 'now', and return
+ * the area it is written in, or NULL. The caller may fill in what stats.c
+ * does not know about before publishing it with stats_export_end().
+ * Only the vswitchd core may call this.
+ */
+struct stats_export *
+stats_export_begin(uint64_t now)
+{
+	struct stats_export_flow_table *ft = NULL;
+	unsigned vportid = 0, lcore = 0;
+
+	if (stats_exp == NULL || export_period == 0 ||
+	    now - last_export_tsc < export_period)
+		return NULL;
+	last_export_tsc = now;
+
+	stats_export_write_begin(stats_exp);
+
+	stats_exp->tsc = now;
+	for (vportid = 0; vportid < MAX_VPORTS; vportid++)
+		stats_export_vport(vportid, &stats_exp->vports[vportid]);
+	RTE_LCORE_FOREACH(lcore)
+		stats_export_lcore(lcore, &stats_exp->lcores[lcore]);
+
+	ft = &stats_exp->flow_table;
+	ft->flows = flow_table_count();
+	ft->size = flow_table_size;
+	ft->hit = stats_vswitch_hit_get();
+	ft->miss = stats_vswitch_miss_get();
+	ft->lost = stats_vswitch_lost_get();
+	ft->overflow = flow_table_overflow_count();
+
+	stats_exp->num_queues = vport_queues_export(stats_exp->queues,
+	                                            STATS_EXPORT_MAX_QUEUES);
+
+	return stats_exp;
+}
+
+/* Publish the snapshot started by stats_export_begin() */
+void
+stats_export_end(struct stats_export *exp)
+{
+	stats_export_write_end(exp);
+}
+
 void
 stats_init(void)
 {
@@ -300,6 +873,8 @@ stats_init(void)
 
 	vswitch_stats = (void *)((char *)mz->addr +
 				MAX_VPORTS * sizeof(struct vport_statistics));
-}
 
+	stats_cycles_per_us = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S;
 
+	stats_export_init();
+}
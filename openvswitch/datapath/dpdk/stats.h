@@ -39,6 +39,43 @@
 
 #define INC_BY_1  1
 #define VSWITCHD 0
+/* Buckets of the physical port TX wait histogram, the last >= 512us */
+#define STATS_TX_LATENCY_BUCKETS 11
+/* Buckets of the sampled packet latency histogram, the last >= 512us */
+#define STATS_LATENCY_BUCKETS 11
+/* Default time between snapshots of the exported statistics */
+#define STATS_EXPORT_INTERVAL_DEFAULT 100
+
+/* Why a packet sent to or received from a vport was dropped */
+enum stats_drop_reason {
+	STATS_DROP_RING_FULL,      /* ring, fifo or NIC queue full */
+	STATS_DROP_NOMBUF,         /* mbuf allocation failed */
+	STATS_DROP_VHOST_FULL,     /* vHost virtqueue full */
+	STATS_DROP_INVALID_VPORT,  /* vport deleted or not connected */
+	STATS_DROP_UPCALL_FULL,    /* vswitchd packet ring full */
+	STATS_DROP_UPCALL_LIMIT,   /* flow miss over the vport's upcall rate */
+	STATS_DROP_TOO_BIG,        /* frame does not fit the vport's buffers */
+	STATS_DROP_UPCALL_PENDING, /* too many misses pending for the flow */
+	STATS_DROP_NO_HEADROOM,    /* no room for the upcall header */
+	STATS_DROP_MAX
+};
+
+/* Stamp one in this many received packets, or none if zero */
+extern unsigned latency_sample_rate;
+/* Time in mseconds between exported snapshots, or zero for none */
+extern unsigned stats_export_interval_ms;
+
+struct stats_export;
+
+/* Phases of a switching core's loop that its cycles are split between */
+enum stats_cycles_type {
+	STATS_CYCLES_RX,      /* receiving packets */
+	STATS_CYCLES_LOOKUP,  /* extracting keys and finding flows */
+	STATS_CYCLES_ACTION,  /* running flow actions */
+	STATS_CYCLES_TX,      /* flushing caches and transmit queues */
+	STATS_CYCLES_IDLE,    /* polling vports with nothing to receive */
+	STATS_CYCLES_MAX
+};
 
 void stats_init(void);
 void stats_fini(void);
@@ -51,11 +88,35 @@ void stats_vport_rx_drop_increment(unsigned vportid, int inc);
 void stats_vport_tx_increment(unsigned vportid, int inc);
 void stats_vport_tx_drop_increment(unsigned vportid, int inc);
 void stats_vport_overrun_increment(unsigned vportid, int inc);
+void stats_vport_rx_bytes_increment(unsigned vportid, uint64_t bytes);
+void stats_vport_tx_bytes_increment(unsigned vportid, uint64_t bytes);
+void stats_vport_rx_error_increment(unsigned vportid, int inc);
+void stats_vport_tx_error_increment(unsigned vportid, int inc);
+void stats_vport_drop_increment(unsigned vportid,
+                                enum stats_drop_reason reason, int inc);
 uint64_t stats_vport_rx_get(unsigned vportid);
 uint64_t stats_vport_rx_drop_get(unsigned vportid);
 uint64_t stats_vport_tx_get(unsigned vportid);
 uint64_t stats_vport_tx_drop_get(unsigned vportid);
 uint64_t stats_vport_overrun_get(unsigned vportid);
+uint64_t stats_vport_rx_bytes_get(unsigned vportid);
+uint64_t stats_vport_tx_bytes_get(unsigned vportid);
+uint64_t stats_vport_rx_error_get(unsigned vportid);
+uint64_t stats_vport_tx_error_get(unsigned vportid);
+uint64_t stats_vport_drop_get(unsigned vportid, enum stats_drop_reason reason);
+void stats_vport_recycled_increment(unsigned vportid, int inc);
+void stats_vport_recycle_backlog_update(unsigned vportid, unsigned backlog);
+uint64_t stats_vport_recycled_get(unsigned vportid);
+uint64_t stats_vport_recycle_backlog_get(unsigned vportid);
+uint64_t stats_vport_recycle_backlog_max_get(unsigned vportid);
+void stats_vport_tx_latency_record(unsigned vportid, uint64_t us);
+uint64_t stats_vport_tx_latency_get(unsigned vportid, unsigned bucket);
+void stats_vport_latency_record(unsigned vportid, uint64_t us);
+uint64_t stats_vport_latency_get(unsigned vportid, unsigned bucket);
+void stats_latency_stamp(struct rte_mbuf **bufs, unsigned count,
+                         uint64_t rx_tsc);
+void stats_vport_latency_sample(unsigned vportid, struct rte_mbuf **bufs,
+                                unsigned count);
 struct port_stats stats_vport_get(unsigned vportid);
 
 
@@ -64,6 +125,22 @@ void stats_vswitch_rx_drop_increment(int inc);
 uint64_t stats_vswitch_rx_drop_get(void);
 void stats_vswitch_tx_drop_increment(int inc);
 uint64_t stats_vswitch_tx_drop_get(void);
+void stats_vswitch_hit_increment(int inc);
+uint64_t stats_vswitch_hit_get(void);
+void stats_vswitch_miss_increment(int inc);
+uint64_t stats_vswitch_miss_get(void);
+void stats_vswitch_lost_increment(int inc);
+uint64_t stats_vswitch_lost_get(void);
+void stats_vswitch_nombuf_increment(int inc);
+uint64_t stats_vswitch_nombuf_get(void);
+void stats_lcore_cycles_increment(enum stats_cycles_type type, uint64_t cycles);
+void stats_lcore_loop_increment(bool busy);
+uint64_t stats_lcore_cycles_get(unsigned lcore, enum stats_cycles_type type);
+uint64_t stats_lcore_loops_get(unsigned lcore);
+uint64_t stats_lcore_busy_loops_get(unsigned lcore);
+
+struct stats_export *stats_export_begin(uint64_t now);
+void stats_export_end(struct stats_export *exp);
 
 
 #endif /* __STATS_H_ */
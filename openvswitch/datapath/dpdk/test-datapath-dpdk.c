@@ -33,18 +33,38 @@
  */
 
 #include <rte_mbuf.h>
+#include <rte_cycles.h>
+#include <rte_byteorder.h>
 #include <rte_ip.h>
+#include <rte_tcp.h>
 #include <rte_ether.h>
-
+#include <rte_memzone.h>
+#include <rte_ring.h>
+#include <rte_launch.h>
+#include <rte_lcore.h>
+#include <rte_string_fns.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
 #include <string.h>
 #include <limits.h>
+#include <getopt.h>
+#include <unistd.h>
 #include <linux/openvswitch.h>
 
 #include "action.h"
+#include "datapath.h"
 #include "stats.h"
+#include "stats-types.h"
+#include "capture.h"
+#include "capture-types.h"
 #include "flow.h"
 #include "vport.h"
 #include "ut.h"
+#include "args.h"
+#include "init.h"
 
 #include <assert.h>
 
@@ -523,6 +543,34 @@ test_flow_table_del_flow(int argc, char *argv[])
 	assert(ret < 0);
 }
 
+/* Try to count flows as they are added and deleted, which should succeed */
+static void
+test_flow_table_count(int argc, char *argv[])
+{
+	struct flow_key key1 = {1};
+	struct flow_key key2 = {2};
+	struct action action_multiple[MAX_ACTIONS] = {0};
+
+	flow_table_init();
+	assert(flow_table_count() == 0);
+
+	action_output_build(&action_multiple[0], 1);
+	action_null_build(&action_multiple[1]);
+	flow_table_add_flow(&key1, action_multiple);
+	flow_table_add_flow(&key2, action_multiple);
+	assert(flow_table_count() == 2);
+	/* duplicates are not counted */
+	flow_table_add_flow(&key1, action_multiple);
+	assert(flow_table_count() == 2);
+	flow_table_del_flow(&key1);
+	assert(flow_table_count() == 1);
+	/* non-existent flows are not counted */
+	flow_table_del_flow(&key1);
+	assert(flow_table_count() == 1);
+	flow_table_del_all();
+	assert(flow_table_count() == 0);
+}
+
 /* Try to delete all flows, which should succeed */
 static void
 test_flow_table_del_all(int argc, char *argv[])
@@ -676,6 +724,625 @@ test_flow_table_get_next_flow(int argc, char *argv[])
 
 }
 
+/* Switch packets of a flow that is replaced between packets, which should
+ * send each packet to the current flow's output port */
+static void
+test_switch_packet__microflow_cache(int argc, char *argv[])
+{
+	struct flow_key key1 = {1};
+	struct action action_multiple[MAX_ACTIONS] = {0};
+	struct rte_mbuf buf_multiple[3];
+	struct rte_mbuf *buf_p_multiple[3];
+	uint32_t hash = 0;
+	int count = 0;
+
+	stats_init();
+	stats_vswitch_clear();
+	vport_init();
+	flow_table_init();
+	hash = flow_key_hash(&key1);
+
+	action_output_build(&action_multiple[0], 3);
+	action_null_build(&action_multiple[1]);
+	assert(flow_table_add_flow(&key1, action_multiple) >= 0);
+	/* second packet is matched from the cache */
+	switch_packet(&buf_multiple[0], &key1, 0, hash);
+	switch_packet(&buf_multiple[1], &key1, 0, hash);
+	count = receive_from_vport(3, buf_p_multiple);
+	assert(count == 2);
+
+	/* cached entry must not be used once the flow is deleted */
+	assert(flow_table_del_flow(&key1) >= 0);
+	action_output_build(&action_multiple[0], 4);
+	assert(flow_table_add_flow(&key1, action_multiple) >= 0);
+	switch_packet(&buf_multiple[2], &key1, 0, hash);
+	count = receive_from_vport(4, buf_p_multiple);
+	assert(count == 1);
+	assert(buf_p_multiple[0] == &buf_multiple[2]);
+	assert(stats_vswitch_hit_get() == 3);
+}
+
+#define FLOW_KEY_TEST_PKTS  1024
+
+/* Build an empty packet of 'len' bytes for flow key extraction */
+static struct rte_mbuf *
+flow_key_test_pkt(uint16_t len)
+{
+	static struct rte_mempool *pktmbuf_pool = NULL;
+	struct rte_mbuf *buf = NULL;
+
+	if (pktmbuf_pool == NULL)
+		pktmbuf_pool = rte_mempool_create("MProc_pktmbuf_pool",
+		                FLOW_KEY_TEST_PKTS, /* num mbufs */
+		                2048 + sizeof(struct rte_mbuf) + 128, /*pktmbuf size */
+		                32, /*cache size */
+		                sizeof(struct rte_pktmbuf_pool_private),
+		                rte_pktmbuf_pool_init,
+		                NULL, rte_pktmbuf_init, NULL, 0, 0);
+	assert(pktmbuf_pool != NULL);
+
+	buf = rte_pktmbuf_alloc(pktmbuf_pool);
+	assert(buf != NULL);
+	memset(rte_pktmbuf_mtod(buf, void *), 0, len);
+	buf->pkt.data_len = len;
+	buf->pkt.pkt_len = len;
+
+	return buf;
+}
+
+/* Extract the key of an IPv6 TCP packet, which should succeed */
+static void
+test_flow_key_extract__ipv6(int argc, char *argv[])
+{
+	struct flow_key key = {0};
+	struct rte_mbuf *buf = NULL;
+	struct ether_hdr *eth = NULL;
+	struct ipv6_hdr *ipv6 = NULL;
+	struct tcp_hdr *tcp = NULL;
+	uint8_t zero[16] = {0};
+	uint16_t l4_offset = 0;
+	uint32_t hash = 0;
+
+	buf = flow_key_test_pkt(sizeof(*eth) + sizeof(*ipv6) + sizeof(*tcp));
+	eth = rte_pktmbuf_mtod(buf, struct ether_hdr *);
+	ipv6 = (struct ipv6_hdr *)(eth + 1);
+	tcp = (struct tcp_hdr *)(ipv6 + 1);
+
+	eth->ether_type = rte_cpu_to_be_16(ETHER_TYPE_IPv6);
+	ipv6->vtc_flow = rte_cpu_to_be_32(6 << 28 | 0x2E << 20 | 0x12345);
+	ipv6->proto = IPPROTO_TCP;
+	ipv6->hop_limits = 64;
+	ipv6->src_addr[0] = 0xFE;
+	ipv6->src_addr[15] = 1;
+	ipv6->dst_addr[0] = 0xFE;
+	ipv6->dst_addr[15] = 2;
+	tcp->src_port = rte_cpu_to_be_16(1234);
+	tcp->dst_port = rte_cpu_to_be_16(80);
+
+	hash = flow_key_extract(buf, 3, &key, &l4_offset);
+	assert(hash == flow_key_hash(&key));
+	assert(l4_offset == sizeof(*eth) + sizeof(*ipv6));
+	assert(key.in_port == 3);
+	assert(key.ether_type == ETHER_TYPE_IPv6);
+	assert(memcmp(key.ipv6_src, ipv6->src_addr, sizeof(key.ipv6_src)) == 0);
+	assert(memcmp(key.ipv6_dst, ipv6->dst_addr, sizeof(key.ipv6_dst)) == 0);
+	assert(key.ipv6_label == 0x12345);
+	assert(key.ip_tos == 0x2E);
+	assert(key.ip_ttl == 64);
+	assert(key.ip_proto == IPPROTO_TCP);
+	assert(key.tran_src_port == 1234);
+	assert(key.tran_dst_port == 80);
+	assert(memcmp(key.nd_target, zero, sizeof(key.nd_target)) == 0);
+
+	rte_pktmbuf_free(buf);
+}
+
+/* Extract the key of an IPv6 packet whose hop-by-hop options header claims
+ * to run past the end of the packet, which should leave L4 unparsed */
+static void
+test_flow_key_extract__ipv6_truncated_ext_hdr(int argc, char *argv[])
+{
+	struct flow_key key = {0};
+	struct rte_mbuf *buf = NULL;
+	struct ether_hdr *eth = NULL;
+	struct ipv6_hdr *ipv6 = NULL;
+	uint8_t *ext = NULL;
+	uint16_t l4_offset = 0;
+
+	buf = flow_key_test_pkt(sizeof(*eth) + sizeof(*ipv6) + 8);
+	eth = rte_pktmbuf_mtod(buf, struct ether_hdr *);
+	ipv6 = (struct ipv6_hdr *)(eth + 1);
+	ext = (uint8_t *)(ipv6 + 1);
+
+	eth->ether_type = rte_cpu_to_be_16(ETHER_TYPE_IPv6);
+	ipv6->vtc_flow = rte_cpu_to_be_32(6 << 28);
+	ipv6->proto = 0;                             /* Hop-by-hop options */
+	ext[0] = IPPROTO_TCP;
+	ext[1] = 255;                                /* 2 KB long */
+	/* What a TCP header would be read as if the length was trusted */
+	memset(ext + 2, 0xFF, 6);
+
+	flow_key_extract(buf, 3, &key, &l4_offset);
+	assert(l4_offset == 0);
+	assert(key.ether_type == ETHER_TYPE_IPv6);
+	assert(key.ip_proto == IPPROTO_TCP);
+	assert(key.tran_src_port == 0);
+	assert(key.tran_dst_port == 0);
+
+	rte_pktmbuf_free(buf);
+}
+
+/* Switch a VLAN tagged TCP packet, which should record its TCP flags in the
+ * flow's stats and leave the mbuf's TX offload header lengths alone */
+static void
+test_switch_packet__tcp_flags(int argc, char *argv[])
+{
+	struct flow_key key = {0};
+	struct flow_stats stats = {0};
+	struct action action_multiple[MAX_ACTIONS] = {0};
+	struct rte_mbuf *buf = NULL;
+	struct rte_mbuf *buf_p_multiple[1];
+	struct ether_hdr *eth = NULL;
+	struct vlan_hdr *vlan = NULL;
+	struct ipv4_hdr *ipv4 = NULL;
+	struct tcp_hdr *tcp = NULL;
+	uint16_t l4_offset = 0;
+	uint32_t hash = 0;
+
+	stats_init();
+	vport_init();
+	flow_table_init();
+
+	buf = flow_key_test_pkt(sizeof(*eth) + sizeof(*vlan) + sizeof(*ipv4) +
+	                        sizeof(*tcp));
+	eth = rte_pktmbuf_mtod(buf, struct ether_hdr *);
+	vlan = (struct vlan_hdr *)(eth + 1);
+	ipv4 = (struct ipv4_hdr *)(vlan + 1);
+	tcp = (struct tcp_hdr *)(ipv4 + 1);
+
+	eth->ether_type = rte_cpu_to_be_16(ETHER_TYPE_VLAN);
+	vlan->vlan_tci = rte_cpu_to_be_16(10);
+	vlan->eth_proto = rte_cpu_to_be_16(ETHER_TYPE_IPv4);
+	ipv4->version_ihl = 0x45;
+	ipv4->next_proto_id = IPPROTO_TCP;
+	ipv4->src_addr = rte_cpu_to_be_32(IPv4(10, 0, 0, 1));
+	ipv4->dst_addr = rte_cpu_to_be_32(IPv4(10, 0, 0, 2));
+	tcp->src_port = rte_cpu_to_be_16(1234);
+	tcp->dst_port = rte_cpu_to_be_16(80);
+	tcp->tcp_flags = 0x12;                       /* SYN and ACK */
+	buf->pkt.vlan_macip.f.l2_len = 7;
+	buf->pkt.vlan_macip.f.l3_len = 33;
+
+	hash = flow_key_extract(buf, 3, &key, &l4_offset);
+	assert(l4_offset == sizeof(*eth) + sizeof(*vlan) + sizeof(*ipv4));
+	action_output_build(&action_multiple[0], 4);
+	action_null_build(&action_multiple[1]);
+	assert(flow_table_add_flow(&key, action_multiple) >= 0);
+
+	switch_packet(buf, &key, l4_offset, hash);
+	assert(receive_from_vport(4, buf_p_multiple) == 1);
+	assert(flow_table_get_flow(&key, NULL, &stats) >= 0);
+	assert(stats.packet_count == 1);
+	assert(stats.tcp_flags == 0x12);
+	assert(buf_p_multiple[0]->pkt.vlan_macip.f.l2_len == 7);
+	assert(buf_p_multiple[0]->pkt.vlan_macip.f.l3_len == 33);
+
+	rte_pktmbuf_free(buf_p_multiple[0]);
+}
+
+/* Extract the key of an ARP request, which should succeed */
+static void
+test_flow_key_extract__arp(int argc, char *argv[])
+{
+	struct flow_key key = {0};
+	struct rte_mbuf *buf = NULL;
+	struct ether_hdr *eth = NULL;
+	uint16_t *arp = NULL;
+	uint8_t *arp_addrs = NULL;
+	struct ether_addr sha = {{0x00, 0x01, 0x02, 0x03, 0x04, 0x05}};
+	uint16_t l4_offset = 0;
+
+	buf = flow_key_test_pkt(sizeof(*eth) + 28);
+	eth = rte_pktmbuf_mtod(buf, struct ether_hdr *);
+	arp = (uint16_t *)(eth + 1);
+	arp_addrs = (uint8_t *)(arp + 4);
+
+	eth->ether_type = rte_cpu_to_be_16(ETHER_TYPE_ARP);
+	arp[0] = rte_cpu_to_be_16(1);                /* Ethernet */
+	arp[1] = rte_cpu_to_be_16(ETHER_TYPE_IPv4);
+	arp[2] = rte_cpu_to_be_16(6 << 8 | 4);       /* Address lengths */
+	arp[3] = rte_cpu_to_be_16(1);                /* Request */
+	memcpy(arp_addrs, &sha, sizeof(sha));
+	*(uint32_t *)(arp_addrs + 6) = rte_cpu_to_be_32(IPv4(10, 0, 0, 1));
+	*(uint32_t *)(arp_addrs + 16) = rte_cpu_to_be_32(IPv4(10, 0, 0, 2));
+
+	flow_key_extract(buf, 3, &key, &l4_offset);
+	assert(l4_offset == 0);
+	assert(key.ether_type == ETHER_TYPE_ARP);
+	assert(key.ip_proto == 1);
+	assert(key.ip_src == IPv4(10, 0, 0, 1));
+	assert(key.ip_dst == IPv4(10, 0, 0, 2));
+	assert(is_same_ether_addr(&key.arp_sha, &sha));
+	assert(is_zero_ether_addr(&key.arp_tha));
+	assert(key.tran_src_port == 0);
+	assert(key.tran_dst_port == 0);
+
+	rte_pktmbuf_free(buf);
+}
+
+/* Try to add and look up flows which only differ in their neighbor discovery
+ * target, which should find each flow */
+static void
+test_flow_table_lookup__nd_target(int argc, char *argv[])
+{
+	struct flow_key key1 = {1};
+	struct flow_key key2 = {1};
+	struct action action_multiple[MAX_ACTIONS] = {0};
+	int pos1 = 0;
+	int ret = 0;
+
+	flow_table_init();
+
+	key1.nd_target[15] = 1;
+	key2.nd_target[15] = 2;
+	action_output_build(&action_multiple[0], 1);
+	action_null_build(&action_multiple[1]);
+	pos1 = flow_table_add_flow(&key1, action_multiple);
+	assert(pos1 >= 0);
+	ret = flow_table_lookup(&key2);
+	assert(ret < 0);
+	ret = flow_table_add_flow(&key2, action_multiple);
+	assert(ret >= 0 && ret != pos1);
+	assert(flow_table_lookup(&key2) == ret);
+	/* deleting one flow must not remove the other */
+	ret = flow_table_del_flow(&key2);
+	assert(ret >= 0);
+	assert(flow_table_lookup(&key1) == pos1);
+	ret = flow_table_lookup(&key2);
+	assert(ret < 0);
+}
+
+#define OCCUPANCY_TABLE_SIZE  4096
+#define OCCUPANCY_FLOWS       (OCCUPANCY_TABLE_SIZE * 92 / 100)
+
+/* Try to fill a small flow table to 92% of its size, delete half of the
+ * flows and add them again, which should succeed and find every flow */
+static void
+test_flow_table_add_flow__occupancy(int argc, char *argv[])
+{
+	struct flow_key key = {0};
+	struct action action_multiple[MAX_ACTIONS] = {0};
+	int ret = 0;
+	int i = 0;
+
+	flow_table_size = OCCUPANCY_TABLE_SIZE;
+	flow_table_init();
+
+	action_output_build(&action_multiple[0], 1);
+	action_null_build(&action_multiple[1]);
+	for (i = 0; i < OCCUPANCY_FLOWS; i++) {
+		key.ip_src = i;
+		ret = flow_table_add_flow(&key, action_multiple);
+		assert(ret >= 0);
+	}
+	assert(flow_table_count() == OCCUPANCY_FLOWS);
+
+	for (i = 0; i < OCCUPANCY_FLOWS; i += 2) {
+		key.ip_src = i;
+		ret = flow_table_del_flow(&key);
+		assert(ret >= 0);
+	}
+	for (i = 0; i < OCCUPANCY_FLOWS; i += 2) {
+		key.ip_src = i;
+		ret = flow_table_add_flow(&key, action_multiple);
+		assert(ret >= 0);
+	}
+
+	for (i = 0; i < OCCUPANCY_FLOWS; i++) {
+		key.ip_src = i;
+		ret = flow_table_lookup(&key);
+		assert(ret >= 0 && ret < OCCUPANCY_TABLE_SIZE);
+	}
+	key.ip_src = OCCUPANCY_FLOWS;
+	ret = flow_table_lookup(&key);
+	assert(ret < 0);
+}
+
+#define SAME_HASH_FLOWS  16
+
+/* Add IPv4 flows that only differ in their input port while RSS hashing is
+ * used, which all share one hash, more than its two buckets hold. Every
+ * flow should be added and found, the extra ones by their overflow hash */
+static void
+test_flow_table_add_flow__same_rss_hash(int argc, char *argv[])
+{
+	struct flow_key key = {0};
+	struct action action_multiple[MAX_ACTIONS] = {0};
+	struct rte_mbuf buf = {0};
+	struct rte_mbuf *buf_p_multiple[1];
+	uint32_t overflow = SAME_HASH_FLOWS - 2 * flow_table_bucket_entries;
+	int pos[SAME_HASH_FLOWS];
+	int i = 0;
+
+	use_rss_hash = true;
+	stats_init();
+	vport_init();
+	flow_table_init();
+
+	key.ether_type = ETHER_TYPE_IPv4;
+	key.ip_proto = IPPROTO_ICMP;
+	key.ip_src = IPv4(10, 0, 0, 1);
+	key.ip_dst = IPv4(10, 0, 0, 2);
+	action_output_build(&action_multiple[0], 4);
+	action_null_build(&action_multiple[1]);
+	for (i = 0; i < SAME_HASH_FLOWS; i++) {
+		key.in_port = i;
+		pos[i] = flow_table_add_flow(&key, action_multiple);
+		assert(pos[i] >= 0);
+	}
+	assert(flow_table_count() == SAME_HASH_FLOWS);
+	assert(flow_table_overflow_count() == overflow);
+
+	for (i = 0; i < SAME_HASH_FLOWS; i++) {
+		key.in_port = i;
+		assert(flow_table_lookup(&key) == pos[i]);
+	}
+
+	/* the last flow is only found by its overflow hash */
+	key.in_port = SAME_HASH_FLOWS - 1;
+	switch_packet(&buf, &key, 0, flow_key_hash(&key));
+	assert(receive_from_vport(4, buf_p_multiple) == 1);
+	assert(stats_vswitch_hit_get() == 1);
+
+	assert(flow_table_del_flow(&key) == pos[SAME_HASH_FLOWS - 1]);
+	assert(flow_table_lookup(&key) < 0);
+	assert(flow_table_overflow_count() == overflow - 1);
+	flow_table_del_all();
+	assert(flow_table_overflow_count() == 0);
+}
+
+#define PCAP_MAGIC          0xa1b2c3d4
+#define PCAP_MAGIC_NSEC     0xa1b23c4d
+#define BENCH_MAX_PKTS      FLOW_KEY_TEST_PKTS
+#define BENCH_MAX_PKT_LEN   2048  /* data room of the test mbufs */
+#define BENCH_ITERATIONS    10000
+
+struct pcap_file_hdr {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+struct pcap_rec_hdr {
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t incl_len;
+	uint32_t orig_len;
+};
+
+/*
+ * Not a test: report the cycles per packet taken to extract and hash flow
+ * keys for the first packets of an Ethernet pcap file, e.g.
+ *
+ *   test-datapath -c 1 -n 4 -- flow_key_extract_benchmark trace.pcap
+ *
+ * Packets longer than an mbuf's data room are truncated.
+ */
+static void
+bench_flow_key_extract(int argc, char *argv[])
+{
+	struct rte_mbuf *bufs[BENCH_MAX_PKTS] = {NULL};
+	struct flow_key key = {0};
+	struct pcap_file_hdr file_hdr = {0};
+	struct pcap_rec_hdr rec_hdr = {0};
+	unsigned iterations = BENCH_ITERATIONS;
+	unsigned n_pkts = 0;
+	unsigned i = 0, j = 0;
+	uint16_t l4_offset = 0;
+	uint32_t hash = 0;
+	uint32_t len = 0, copy_len = 0;
+	uint64_t start = 0, cycles = 0;
+	bool swapped = false;
+	FILE *pcap = NULL;
+
+	if (argc > 2)
+		iterations = strtoul(argv[2], NULL, 0);
+
+	pcap = fopen(argv[1], "r");
+	if (pcap == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot open '%s'\n", argv[1]);
+	if (fread(&file_hdr, sizeof(file_hdr), 1, pcap) != 1)
+		rte_exit(EXIT_FAILURE, "Cannot read the pcap file header\n");
+	swapped = file_hdr.magic == rte_bswap32(PCAP_MAGIC) ||
+	          file_hdr.magic == rte_bswap32(PCAP_MAGIC_NSEC);
+	if (!swapped && file_hdr.magic != PCAP_MAGIC &&
+	    file_hdr.magic != PCAP_MAGIC_NSEC)
+		rte_exit(EXIT_FAILURE, "'%s' is not a pcap file\n", argv[1]);
+
+	flow_table_init();
+
+	while (n_pkts < BENCH_MAX_PKTS &&
+	       fread(&rec_hdr, sizeof(rec_hdr), 1, pcap) == 1) {
+		len = swapped ? rte_bswap32(rec_hdr.incl_len) : rec_hdr.incl_len;
+		copy_len = RTE_MIN(len, (uint32_t)BENCH_MAX_PKT_LEN);
+
+		bufs[n_pkts] = flow_key_test_pkt(copy_len);
+		if (fread(rte_pktmbuf_mtod(bufs[n_pkts], void *), 1, copy_len,
+		          pcap) != copy_len ||
+		    fseek(pcap, len - copy_len, SEEK_CUR) != 0) {
+			/* A truncated last record */
+			rte_pktmbuf_free(bufs[n_pkts]);
+			break;
+		}
+		n_pkts++;
+	}
+	fclose(pcap);
+	if (n_pkts == 0)
+		rte_exit(EXIT_FAILURE, "No packets in '%s'\n", argv[1]);
+
+	for (i = 0; i < iterations; i++) {
+		start = rte_rdtsc();
+		for (j = 0; j < n_pkts; j++) {
+			memset(&key, 0, sizeof(key));
+			hash += flow_key_extract(bufs[j], 1, &key, &l4_offset);
+		}
+		cycles += rte_rdtsc() - start;
+	}
+
+	printf("%u packets, %u iterations: %"PRIu64" cycles per packet "
+	       "(hash sum %"PRIx32")\n", n_pkts, iterations,
+	       cycles / ((uint64_t)n_pkts * iterations), hash);
+
+	for (j = 0; j < n_pkts; j++)
+		rte_pktmbuf_free(bufs[j]);
+}
+
+/* Send packets to a memnic port, loop them back as the guest would and
+ * receive them again, which should return the same packets and drop a
+ * descriptor that points outside the shared buffers */
+static void
+test_memnic_tx_rx(int argc, char *argv[])
+{
+	struct rte_mempool *pktmbuf_pool;
+	struct memnic_area *area = NULL;
+	struct rte_mbuf *bufs[PKT_BURST_SIZE] = {NULL};
+	struct rte_mbuf *rx_bufs[PKT_BURST_SIZE] = {NULL};
+	uint32_t slot = 0;
+	uint64_t bytes = 0;
+	unsigned too_big = 0;
+	unsigned i = 0;
+	char *data = NULL;
+
+	pktmbuf_pool = rte_mempool_create("MProc_pktmbuf_pool",
+                    20, /* num mbufs */
+                    2048 + sizeof(struct rte_mbuf) + 128, /*pktmbuf size */
+                    32, /*cache size */
+                    sizeof(struct rte_pktmbuf_pool_private),
+                    rte_pktmbuf_pool_init,
+                    NULL, rte_pktmbuf_init, NULL, 0, 0);
+
+	stats_init();
+	stats_vport_clear_all();
+
+	area = memnic_port_init(0, "test_memnic", SOCKET_ID_ANY);
+	assert(area->magic == MEMNIC_MAGIC);
+	assert(area->ring_size == MEMNIC_RING_SIZE);
+
+	for (i = 0; i < 3; i++) {
+		bufs[i] = rte_pktmbuf_alloc(pktmbuf_pool);
+		data = rte_pktmbuf_append(bufs[i], 60 + i);
+		memset(data, i + 1, 60 + i);
+	}
+
+	assert(memnic_tx_burst(0, bufs, 3, &bytes, &too_big) == 3);
+	assert(bytes == 60 + 61 + 62);
+	assert(too_big == 0);
+	assert(area->to_guest.head == 3);
+	for (i = 0; i < 3; i++) {
+		assert(area->to_guest.desc[i].len == 60 + i);
+		data = (char *)area->bufs + area->to_guest.desc[i].offset;
+		assert(data[0] == (char)(i + 1) && data[59 + i] == (char)(i + 1));
+		rte_pktmbuf_free(bufs[i]);
+	}
+
+	/* Loop the packets back, as the guest, followed by a bad descriptor */
+	for (slot = area->to_guest.tail; slot != area->to_guest.head; slot++)
+		area->from_guest.desc[slot] = area->to_guest.desc[slot];
+	area->to_guest.tail = slot;
+	area->from_guest.desc[slot].offset = sizeof(area->bufs);
+	area->from_guest.desc[slot].len = 60;
+	area->from_guest.head = slot + 1;
+
+	assert(memnic_rx_burst(0, pktmbuf_pool, rx_bufs, PKT_BURST_SIZE) == 3);
+	assert(area->from_guest.tail == 4);
+	assert(stats_vport_tx_drop_get(MEMNIC0) == 1);
+	assert(stats_vport_tx_error_get(MEMNIC0) == 1);
+	for (i = 0; i < 3; i++) {
+		assert(rte_pktmbuf_pkt_len(rx_bufs[i]) == 60 + i);
+		data = rte_pktmbuf_mtod(rx_bufs[i], char *);
+		assert(data[0] == (char)(i + 1) && data[59] == (char)(i + 1));
+		rte_pktmbuf_free(rx_bufs[i]);
+	}
+
+	/* Nothing more to receive */
+	assert(memnic_rx_burst(0, pktmbuf_pool, rx_bufs, PKT_BURST_SIZE) == 0);
+
+	/* A frame that does not fit one buffer is skipped, not the rest */
+	for (i = 0; i < 3; i++) {
+		bufs[i] = rte_pktmbuf_alloc(pktmbuf_pool);
+		rte_pktmbuf_append(bufs[i], 60);
+	}
+	rte_pktmbuf_pkt_len(bufs[1]) = MEMNIC_BUF_SIZE + 1;
+	assert(memnic_tx_burst(0, bufs, 3, &bytes, &too_big) == 2);
+	assert(bytes == 2 * 60);
+	assert(too_big == 1);
+	for (i = 0; i < 3; i++)
+		rte_pktmbuf_free(bufs[i]);
+}
+
+/* Fill a memnic port's ring and have the guest write a tail ahead of the
+ * head, or too far behind it, which should send nothing rather than
+ * overwrite descriptors the guest still owns */
+static void
+test_memnic_tx__corrupt_tail(int argc, char *argv[])
+{
+	struct rte_mempool *pktmbuf_pool;
+	struct memnic_area *area = NULL;
+	struct rte_mbuf *bufs[PKT_BURST_SIZE] = {NULL};
+	uint64_t bytes = 0;
+	unsigned too_big = 0;
+	unsigned i = 0;
+
+	pktmbuf_pool = rte_mempool_create("MProc_pktmbuf_pool",
+                    2 * PKT_BURST_SIZE, /* num mbufs */
+                    2048 + sizeof(struct rte_mbuf) + 128, /*pktmbuf size */
+                    32, /*cache size */
+                    sizeof(struct rte_pktmbuf_pool_private),
+                    rte_pktmbuf_pool_init,
+                    NULL, rte_pktmbuf_init, NULL, 0, 0);
+
+	stats_init();
+	area = memnic_port_init(0, "test_memnic", SOCKET_ID_ANY);
+
+	for (i = 0; i < PKT_BURST_SIZE; i++) {
+		bufs[i] = rte_pktmbuf_alloc(pktmbuf_pool);
+		rte_pktmbuf_append(bufs[i], 60);
+	}
+
+	for (i = 0; i < MEMNIC_RING_SIZE / PKT_BURST_SIZE; i++)
+		assert(memnic_tx_burst(0, bufs, PKT_BURST_SIZE, &bytes,
+		                       &too_big) == PKT_BURST_SIZE);
+	assert(area->to_guest.head == MEMNIC_RING_SIZE);
+	/* What the guest may have left in a descriptor it owns */
+	area->to_guest.desc[0].len = 1234;
+
+	/* a tail ahead of the head */
+	area->to_guest.tail = MEMNIC_RING_SIZE + 10;
+	assert(memnic_tx_burst(0, bufs, PKT_BURST_SIZE, &bytes, &too_big) == 0);
+	assert(area->to_guest.head == MEMNIC_RING_SIZE);
+	assert(area->to_guest.desc[0].len == 1234);
+
+	/* a tail more than a ring behind the head */
+	area->to_guest.tail = (uint32_t)-1;
+	assert(memnic_tx_burst(0, bufs, PKT_BURST_SIZE, &bytes, &too_big) == 0);
+	assert(area->to_guest.head == MEMNIC_RING_SIZE);
+	assert(area->to_guest.desc[0].len == 1234);
+
+	/* sending resumes once the guest frees a burst */
+	area->to_guest.tail = PKT_BURST_SIZE;
+	assert(memnic_tx_burst(0, bufs, PKT_BURST_SIZE, &bytes,
+	                       &too_big) == PKT_BURST_SIZE);
+	assert(area->to_guest.head == MEMNIC_RING_SIZE + PKT_BURST_SIZE);
+	assert(area->to_guest.desc[0].len == 60);
+
+	for (i = 0; i < PKT_BURST_SIZE; i++)
+		rte_pktmbuf_free(bufs[i]);
+}
+
 /* Try to increment stats for all vport counters, which should
  * succeed */
 static void
@@ -692,11 +1359,29 @@ test_stats_vport_xxx_increment(int argc, char *argv[])
 		stats_vport_tx_increment(vportid, 23);
 		stats_vport_tx_drop_increment(vportid, 23);
 		stats_vport_overrun_increment(vportid, 23);
+		stats_vport_recycled_increment(vportid, 23);
+		stats_vport_recycle_backlog_update(vportid, 23);
+		stats_vport_tx_latency_record(vportid, 23);
+		stats_vport_rx_bytes_increment(vportid, 23);
+		stats_vport_tx_bytes_increment(vportid, 23);
+		stats_vport_rx_error_increment(vportid, 23);
+		stats_vport_tx_error_increment(vportid, 23);
+		stats_vport_drop_increment(vportid, STATS_DROP_RING_FULL, 23);
+		stats_vport_drop_increment(vportid, STATS_DROP_UPCALL_LIMIT, 23);
 		stats_vport_rx_increment(vportid, 19);
 		stats_vport_rx_drop_increment(vportid, 19);
 		stats_vport_tx_increment(vportid, 19);
 		stats_vport_tx_drop_increment(vportid, 19);
 		stats_vport_overrun_increment(vportid, 19);
+		stats_vport_recycled_increment(vportid, 19);
+		stats_vport_recycle_backlog_update(vportid, 19);
+		stats_vport_tx_latency_record(vportid, 19);
+		stats_vport_rx_bytes_increment(vportid, 19);
+		stats_vport_tx_bytes_increment(vportid, 19);
+		stats_vport_rx_error_increment(vportid, 19);
+		stats_vport_tx_error_increment(vportid, 19);
+		stats_vport_drop_increment(vportid, STATS_DROP_RING_FULL, 19);
+		stats_vport_drop_increment(vportid, STATS_DROP_UPCALL_LIMIT, 19);
 	}
 }
 
@@ -716,11 +1401,29 @@ test_stats_vport_xxx_get(int argc, char *argv[])
 		stats_vport_tx_increment(vportid, 23);
 		stats_vport_tx_drop_increment(vportid, 23);
 		stats_vport_overrun_increment(vportid, 23);
+		stats_vport_recycled_increment(vportid, 23);
+		stats_vport_recycle_backlog_update(vportid, 23);
+		stats_vport_tx_latency_record(vportid, 23);
+		stats_vport_rx_bytes_increment(vportid, 23);
+		stats_vport_tx_bytes_increment(vportid, 23);
+		stats_vport_rx_error_increment(vportid, 23);
+		stats_vport_tx_error_increment(vportid, 23);
+		stats_vport_drop_increment(vportid, STATS_DROP_RING_FULL, 23);
+		stats_vport_drop_increment(vportid, STATS_DROP_UPCALL_LIMIT, 23);
 		stats_vport_rx_increment(vportid, 19);
 		stats_vport_rx_drop_increment(vportid, 19);
 		stats_vport_tx_increment(vportid, 19);
 		stats_vport_tx_drop_increment(vportid, 19);
 		stats_vport_overrun_increment(vportid, 19);
+		stats_vport_recycled_increment(vportid, 19);
+		stats_vport_recycle_backlog_update(vportid, 19);
+		stats_vport_tx_latency_record(vportid, 19);
+		stats_vport_rx_bytes_increment(vportid, 19);
+		stats_vport_tx_bytes_increment(vportid, 19);
+		stats_vport_rx_error_increment(vportid, 19);
+		stats_vport_tx_error_increment(vportid, 19);
+		stats_vport_drop_increment(vportid, STATS_DROP_RING_FULL, 19);
+		stats_vport_drop_increment(vportid, STATS_DROP_UPCALL_LIMIT, 19);
 	}
 
 	for (vportid = 0; vportid < MAX_VPORTS; vportid++) {
@@ -729,6 +1432,20 @@ test_stats_vport_xxx_get(int argc, char *argv[])
 		assert(stats_vport_tx_get(vportid) == 42);
 		assert(stats_vport_tx_drop_get(vportid) == 42);
 		assert(stats_vport_overrun_get(vportid) == 42);
+		assert(stats_vport_recycled_get(vportid) == 42);
+		assert(stats_vport_recycle_backlog_get(vportid) == 19);
+		assert(stats_vport_recycle_backlog_max_get(vportid) == 23);
+		/* 19us and 23us both wait under 32us */
+		assert(stats_vport_tx_latency_get(vportid, 5) == 2);
+		assert(stats_vport_rx_bytes_get(vportid) == 42);
+		assert(stats_vport_tx_bytes_get(vportid) == 42);
+		assert(stats_vport_rx_error_get(vportid) == 42);
+		assert(stats_vport_tx_error_get(vportid) == 42);
+		assert(stats_vport_drop_get(vportid, STATS_DROP_RING_FULL) == 42);
+		assert(stats_vport_drop_get(vportid, STATS_DROP_NOMBUF) == 0);
+		assert(stats_vport_drop_get(vportid, STATS_DROP_UPCALL_LIMIT) == 42);
+		assert(stats_vport_get(vportid).rx_bytes == 42);
+		assert(stats_vport_get(vportid).tx_error == 42);
 	}
 }
 
@@ -748,11 +1465,29 @@ test_stats_vport_xxx_clear(int argc, char *argv[])
 		stats_vport_tx_increment(vportid, 23);
 		stats_vport_tx_drop_increment(vportid, 23);
 		stats_vport_overrun_increment(vportid, 23);
+		stats_vport_recycled_increment(vportid, 23);
+		stats_vport_recycle_backlog_update(vportid, 23);
+		stats_vport_tx_latency_record(vportid, 23);
+		stats_vport_rx_bytes_increment(vportid, 23);
+		stats_vport_tx_bytes_increment(vportid, 23);
+		stats_vport_rx_error_increment(vportid, 23);
+		stats_vport_tx_error_increment(vportid, 23);
+		stats_vport_drop_increment(vportid, STATS_DROP_RING_FULL, 23);
+		stats_vport_drop_increment(vportid, STATS_DROP_UPCALL_LIMIT, 23);
 		stats_vport_rx_increment(vportid, 19);
 		stats_vport_rx_drop_increment(vportid, 19);
 		stats_vport_tx_increment(vportid, 19);
 		stats_vport_tx_drop_increment(vportid, 19);
 		stats_vport_overrun_increment(vportid, 19);
+		stats_vport_recycled_increment(vportid, 19);
+		stats_vport_recycle_backlog_update(vportid, 19);
+		stats_vport_tx_latency_record(vportid, 19);
+		stats_vport_rx_bytes_increment(vportid, 19);
+		stats_vport_tx_bytes_increment(vportid, 19);
+		stats_vport_rx_error_increment(vportid, 19);
+		stats_vport_tx_error_increment(vportid, 19);
+		stats_vport_drop_increment(vportid, STATS_DROP_RING_FULL, 19);
+		stats_vport_drop_increment(vportid, STATS_DROP_UPCALL_LIMIT, 19);
 	}
 
 	for (vportid = 0; vportid < MAX_VPORTS; vportid++) {
@@ -762,7 +1497,97 @@ test_stats_vport_xxx_clear(int argc, char *argv[])
 		assert(stats_vport_tx_get(vportid) == 0);
 		assert(stats_vport_tx_drop_get(vportid) == 0);
 		assert(stats_vport_overrun_get(vportid) == 0);
+		assert(stats_vport_recycled_get(vportid) == 0);
+		assert(stats_vport_recycle_backlog_get(vportid) == 0);
+		assert(stats_vport_recycle_backlog_max_get(vportid) == 0);
+		assert(stats_vport_tx_latency_get(vportid, 5) == 0);
+		assert(stats_vport_rx_bytes_get(vportid) == 0);
+		assert(stats_vport_tx_bytes_get(vportid) == 0);
+		assert(stats_vport_rx_error_get(vportid) == 0);
+		assert(stats_vport_tx_error_get(vportid) == 0);
+		assert(stats_vport_drop_get(vportid, STATS_DROP_RING_FULL) == 0);
+		assert(stats_vport_drop_get(vportid, STATS_DROP_UPCALL_LIMIT) == 0);
+	}
+}
+
+/* Check that TX waits are counted in the right histogram buckets */
+static void
+test_stats_vport_tx_latency(int argc, char *argv[])
+{
+	unsigned vportid = PHYPORT0;
+	unsigned bucket = 0;
+
+	stats_init();
+	stats_vport_clear_all();
+
+	stats_vport_tx_latency_record(vportid, 0);
+	stats_vport_tx_latency_record(vportid, 1);
+	stats_vport_tx_latency_record(vportid, 3);
+	stats_vport_tx_latency_record(vportid, 4);
+	stats_vport_tx_latency_record(vportid, 511);
+	stats_vport_tx_latency_record(vportid, 512);
+	stats_vport_tx_latency_record(vportid, UINT64_MAX);
+
+	assert(stats_vport_tx_latency_get(vportid, 0) == 1);
+	assert(stats_vport_tx_latency_get(vportid, 1) == 1);
+	assert(stats_vport_tx_latency_get(vportid, 2) == 1);
+	assert(stats_vport_tx_latency_get(vportid, 3) == 1);
+	assert(stats_vport_tx_latency_get(vportid, 9) == 1);
+	assert(stats_vport_tx_latency_get(vportid,
+	                                  STATS_TX_LATENCY_BUCKETS - 1) == 2);
+
+	stats_vport_clear(vportid);
+	for (bucket = 0; bucket < STATS_TX_LATENCY_BUCKETS; bucket++)
+		assert(stats_vport_tx_latency_get(vportid, bucket) == 0);
+}
+
+/* Check that one in every 'latency_sample_rate' packets is stamped, and
+ * that only stamped packets are counted when sent */
+static void
+test_stats_vport_latency(int argc, char *argv[])
+{
+	struct rte_mbuf mbufs[4];
+	struct rte_mbuf *bufs[4] = {&mbufs[0], &mbufs[1], &mbufs[2], &mbufs[3]};
+	unsigned vportid = CLIENT1;
+	unsigned bucket = 0;
+	uint64_t samples = 0;
+	unsigned i = 0;
+
+	stats_init();
+	stats_vport_clear_all();
+
+	latency_sample_rate = 2;
+	for (i = 0; i < 4; i++) {
+		bufs[i]->pkt.hash.rss = 0xdead;
+		bufs[i]->ol_flags = PKT_RX_RSS_HASH;
 	}
+	/* received 100us ago, which is under 128us and not under 64us */
+	stats_latency_stamp(bufs, 4,
+	                    rte_rdtsc() - 100 * (rte_get_tsc_hz() / US_PER_S));
+	for (i = 0; i < 4; i++)
+		assert(!(bufs[i]->ol_flags & PKT_RX_RSS_HASH));
+	assert(bufs[0]->pkt.hash.rss == 0);
+	assert(bufs[1]->pkt.hash.rss != 0);
+	assert(bufs[2]->pkt.hash.rss == 0);
+	assert(bufs[3]->pkt.hash.rss != 0);
+
+	stats_vport_latency_sample(vportid, bufs, 4);
+	for (bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++)
+		samples += stats_vport_latency_get(vportid, bucket);
+	assert(samples == 2);
+	assert(stats_vport_latency_get(vportid, 7) == 2);
+
+	stats_vport_latency_record(vportid, 0);
+	stats_vport_latency_record(vportid, 511);
+	stats_vport_latency_record(vportid, 512);
+	assert(stats_vport_latency_get(vportid, 0) == 1);
+	assert(stats_vport_latency_get(vportid, STATS_LATENCY_BUCKETS - 2) == 1);
+	assert(stats_vport_latency_get(vportid, STATS_LATENCY_BUCKETS - 1) == 1);
+
+	stats_vport_clear(vportid);
+	for (bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++)
+		assert(stats_vport_latency_get(vportid, bucket) == 0);
+	latency_sample_rate = 0;
 }
 
 /* Try to increment stats for all vswitch counters, which should
@@ -775,8 +1600,16 @@ test_stats_vswitch_increment(int argc, char *argv[])
 
 	stats_vswitch_rx_drop_increment(23);
 	stats_vswitch_tx_drop_increment(23);
+	stats_vswitch_hit_increment(23);
+	stats_vswitch_miss_increment(23);
+	stats_vswitch_lost_increment(23);
+	stats_vswitch_nombuf_increment(23);
 	stats_vswitch_rx_drop_increment(19);
 	stats_vswitch_tx_drop_increment(19);
+	stats_vswitch_hit_increment(19);
+	stats_vswitch_miss_increment(19);
+	stats_vswitch_lost_increment(19);
+	stats_vswitch_nombuf_increment(19);
 }
 
 /* Try to get stats for all vswitch, which should succeed */
@@ -789,11 +1622,23 @@ test_stats_vswitch_get(int argc, char *argv[])
 	/* increment stats so there's something to check */
 	stats_vswitch_rx_drop_increment(23);
 	stats_vswitch_tx_drop_increment(23);
+	stats_vswitch_hit_increment(23);
+	stats_vswitch_miss_increment(23);
+	stats_vswitch_lost_increment(23);
+	stats_vswitch_nombuf_increment(23);
 	stats_vswitch_rx_drop_increment(19);
 	stats_vswitch_tx_drop_increment(19);
+	stats_vswitch_hit_increment(19);
+	stats_vswitch_miss_increment(19);
+	stats_vswitch_lost_increment(19);
+	stats_vswitch_nombuf_increment(19);
 
 	assert(stats_vswitch_rx_drop_get() == 42);
 	assert(stats_vswitch_tx_drop_get() == 42);
+	assert(stats_vswitch_hit_get() == 42);
+	assert(stats_vswitch_miss_get() == 42);
+	assert(stats_vswitch_lost_get() == 42);
+	assert(stats_vswitch_nombuf_get() == 42);
 }
 
 /* Try to get stats for all vswitch, which should succeed */
@@ -806,12 +1651,435 @@ test_stats_vswitch_clear(int argc, char *argv[])
 	/* increment stats so there's something to check */
 	stats_vswitch_rx_drop_increment(23);
 	stats_vswitch_tx_drop_increment(23);
+	stats_vswitch_hit_increment(23);
+	stats_vswitch_miss_increment(23);
+	stats_vswitch_lost_increment(23);
+	stats_vswitch_nombuf_increment(23);
 	stats_vswitch_rx_drop_increment(19);
 	stats_vswitch_tx_drop_increment(19);
+	stats_vswitch_hit_increment(19);
+	stats_vswitch_miss_increment(19);
+	stats_vswitch_lost_increment(19);
+	stats_vswitch_nombuf_increment(19);
 
 	stats_vswitch_clear();
 	assert(stats_vswitch_rx_drop_get() == 0);
 	assert(stats_vswitch_tx_drop_get() == 0);
+	assert(stats_vswitch_hit_get() == 0);
+	assert(stats_vswitch_miss_get() == 0);
+	assert(stats_vswitch_lost_get() == 0);
+	assert(stats_vswitch_nombuf_get() == 0);
+}
+
+/* Check that cycles and loops are counted for the current lcore, and
+ * cleared with the vswitch stats */
+static void
+test_stats_lcore_cycles(int argc, char *argv[])
+{
+	unsigned lcore = rte_lcore_id();
+	unsigned type = 0;
+
+	stats_init();
+	stats_vswitch_clear();
+
+	for (type = 0; type < STATS_CYCLES_MAX; type++) {
+		stats_lcore_cycles_increment(type, 100 + type);
+		stats_lcore_cycles_increment(type, 1);
+	}
+	stats_lcore_loop_increment(true);
+	stats_lcore_loop_increment(false);
+	stats_lcore_loop_increment(false);
+
+	for (type = 0; type < STATS_CYCLES_MAX; type++)
+		assert(stats_lcore_cycles_get(lcore, type) == 101 + type);
+	assert(stats_lcore_loops_get(lcore) == 3);
+	assert(stats_lcore_busy_loops_get(lcore) == 1);
+
+	stats_vswitch_clear();
+	for (type = 0; type < STATS_CYCLES_MAX; type++)
+		assert(stats_lcore_cycles_get(lcore, type) == 0);
+	assert(stats_lcore_loops_get(lcore) == 0);
+	assert(stats_lcore_busy_loops_get(lcore) == 0);
+}
+
+static void
+test_stats_export(int argc, char *argv[])
+{
+	struct stats_export *exp = NULL;
+	unsigned lcore = rte_lcore_id();
+	uint64_t now = rte_get_tsc_hz();
+	uint32_t seq = 0;
+
+	flow_table_init();
+	stats_init();
+	stats_vswitch_clear();
+
+	stats_vswitch_hit_increment(3);
+	stats_vswitch_miss_increment(2);
+	stats_lcore_loop_increment(true);
+
+	exp = stats_export_begin(now);
+	assert(exp != NULL);
+	assert(exp->magic == STATS_EXPORT_MAGIC);
+	assert(exp->version == STATS_EXPORT_VERSION);
+	assert(exp->size == sizeof(struct stats_export));
+	/* readers wait while a snapshot is being written */
+	assert(exp->seq & 1);
+	assert(exp->tsc == now);
+	assert(exp->lcores[lcore].enabled);
+	assert(exp->lcores[lcore].hit == 3);
+	assert(exp->lcores[lcore].miss == 2);
+	assert(exp->lcores[lcore].loops == 1);
+	assert(exp->lcores[lcore].busy_loops == 1);
+	assert(exp->flow_table.flows == 0);
+	assert(exp->flow_table.size == flow_table_size);
+	assert(exp->flow_table.hit == 3);
+	assert(exp->flow_table.miss == 2);
+	stats_export_end(exp);
+
+	seq = stats_export_read_begin(exp);
+	assert(!(seq & 1));
+	assert(!stats_export_read_retry(exp, seq));
+
+	/* nothing is written until the interval has passed */
+	assert(stats_export_begin(now + 1) == NULL);
+	assert(!stats_export_read_retry(exp, seq));
+
+	exp = stats_export_begin(now + rte_get_tsc_hz());
+	assert(exp != NULL);
+	stats_export_end(exp);
+	assert(stats_export_read_retry(exp, seq));
+}
+
+/* Long options sharing a prefix are told apart */
+static void
+test_args_stats_export_interval(int argc, char *argv[])
+{
+	char *args[] = {"ovs_dpdk", "-n", "2", "--stats", "3",
+	                "--stats_export_interval", "250", NULL};
+
+	stats_display_interval = 0;
+	stats_export_interval_ms = STATS_EXPORT_INTERVAL_DEFAULT;
+
+	/* rte_eal_init() has used getopt already */
+	optind = 0;
+	assert(parse_app_args(RTE_MAX_ETHPORTS, RTE_DIM(args) - 1, args) == 0);
+	assert(stats_display_interval == 3);
+	assert(stats_export_interval_ms == 250);
+}
+
+/* Mirror a filtered and sampled burst into the capture ring, then let the
+ * capture tool's lease expire, which should stop the capture */
+static void
+test_capture_in_burst(int argc, char *argv[])
+{
+	struct rte_mempool *pktmbuf_pool;
+	struct rte_mbuf *bufs[4] = {NULL};
+	struct flow_key keys[4] = {{0}};
+	const uint8_t protos[4] = {IPPROTO_TCP, IPPROTO_UDP, IPPROTO_TCP,
+	                           IPPROTO_TCP};
+	struct capture_area *area = NULL;
+	struct capture_record *rec = NULL;
+	struct rte_ring *ring = NULL;
+	char *data = NULL;
+	int i = 0;
+
+	pktmbuf_pool = rte_mempool_create("MProc_pktmbuf_pool",
+                    20, /* num mbufs */
+                    2048 + sizeof(struct rte_mbuf) + 128, /*pktmbuf size */
+                    32, /*cache size */
+                    sizeof(struct rte_pktmbuf_pool_private),
+                    rte_pktmbuf_pool_init,
+                    NULL, rte_pktmbuf_init, NULL, 0, 0);
+
+	for (i = 0; i < 4; i++) {
+		bufs[i] = rte_pktmbuf_alloc(pktmbuf_pool);
+		data = rte_pktmbuf_append(bufs[i], 64 + i);
+		memset(data, i, 64 + i);
+		keys[i].ip_proto = protos[i];
+	}
+
+	capture_init();
+	area = rte_memzone_lookup(MZ_CAPTURE)->addr;
+	ring = rte_ring_lookup(CAPTURE_RING_NAME);
+	assert(area->magic == CAPTURE_MAGIC);
+	assert(capture_in_vport == MAX_VPORTS);
+	assert(capture_out_vport == MAX_VPORTS);
+
+	/* one in two TCP packets received from the port */
+	area->enabled = 1;
+	rte_snprintf(area->vport_name, sizeof(area->vport_name), "port0");
+	area->dir = CAPTURE_DIR_IN;
+	area->sample_rate = 2;
+	area->filter.match = CAPTURE_MATCH_IP_PROTO;
+	area->filter.ip_proto = IPPROTO_TCP;
+	area->heartbeat = rte_rdtsc();
+	area->generation++;
+	capture_update();
+	assert(area->applied == area->generation);
+	assert(area->status == CAPTURE_STATUS_OK);
+	assert(capture_in_vport == 0);
+	assert(capture_out_vport == MAX_VPORTS);
+
+	capture_in_burst(0, bufs, keys, 4);
+	assert(rte_ring_count(ring) == 1);
+	assert(area->lcores[rte_lcore_id()].captured == 1);
+	assert(area->lcores[rte_lcore_id()].dropped == 0);
+
+	assert(rte_ring_sc_dequeue(ring, (void **)&rec) == 0);
+	assert(rec->vportid == 0);
+	assert(rec->dir == CAPTURE_DIR_IN);
+	assert(rec->len == 66);
+	assert(rec->caplen == 66);
+	assert(memcmp(rec->data, rte_pktmbuf_mtod(bufs[2], void *), 66) == 0);
+
+	/* the tap stops once the tool's heartbeat is older than its lease */
+	capture_update();
+	assert(capture_in_vport == 0);
+	area->heartbeat = rte_rdtsc() - 2 * area->tsc_hz * CAPTURE_LEASE_MS / 1000;
+	capture_update();
+	assert(capture_in_vport == MAX_VPORTS);
+	assert(area->status == CAPTURE_STATUS_EXPIRED);
+
+	area->enabled = 0;
+	area->generation++;
+	capture_update();
+	assert(area->applied == area->generation);
+	assert(capture_in_vport == MAX_VPORTS);
+
+	for (i = 0; i < 4; i++)
+		rte_pktmbuf_free(bufs[i]);
+}
+
+/* Capture only the IPv4 packets sent to a vport, once a new configuration
+ * replaces one whose lease has expired */
+static void
+test_capture_out_packet(int argc, char *argv[])
+{
+	struct rte_mbuf *ipv4 = NULL, *ipv6 = NULL;
+	struct capture_area *area = NULL;
+	struct capture_record *rec = NULL;
+	struct rte_ring *ring = NULL;
+
+	ipv4 = flow_key_test_pkt(sizeof(struct ether_hdr) +
+	                         sizeof(struct ipv4_hdr));
+	rte_pktmbuf_mtod(ipv4, struct ether_hdr *)->ether_type =
+		rte_cpu_to_be_16(ETHER_TYPE_IPv4);
+	ipv6 = flow_key_test_pkt(sizeof(struct ether_hdr) +
+	                         sizeof(struct ipv6_hdr));
+	rte_pktmbuf_mtod(ipv6, struct ether_hdr *)->ether_type =
+		rte_cpu_to_be_16(ETHER_TYPE_IPv6);
+
+	capture_init();
+	area = rte_memzone_lookup(MZ_CAPTURE)->addr;
+	ring = rte_ring_lookup(CAPTURE_RING_NAME);
+
+	/* everything received, until the tool stops responding */
+	area->enabled = 1;
+	rte_snprintf(area->vport_name, sizeof(area->vport_name), "port0");
+	area->dir = CAPTURE_DIR_IN;
+	area->sample_rate = 1;
+	area->heartbeat = rte_rdtsc() - 2 * area->tsc_hz * CAPTURE_LEASE_MS / 1000;
+	area->generation++;
+	capture_update();
+	assert(capture_in_vport == 0);
+	capture_update();
+	assert(capture_in_vport == MAX_VPORTS);
+	assert(area->status == CAPTURE_STATUS_EXPIRED);
+
+	/* then only IPv4 packets sent to the port */
+	area->dir = CAPTURE_DIR_OUT;
+	area->filter.match = CAPTURE_MATCH_ETHER_TYPE;
+	area->filter.ether_type = ETHER_TYPE_IPv4;
+	area->heartbeat = rte_rdtsc();
+	area->generation++;
+	capture_update();
+	assert(area->applied == area->generation);
+	assert(area->status == CAPTURE_STATUS_OK);
+	assert(capture_in_vport == MAX_VPORTS);
+	assert(capture_out_vport == 0);
+
+	capture_out_packet(0, ipv6);
+	assert(rte_ring_count(ring) == 0);
+	capture_out_packet(0, ipv4);
+	assert(rte_ring_count(ring) == 1);
+	assert(area->lcores[rte_lcore_id()].captured == 1);
+	assert(area->lcores[rte_lcore_id()].dropped == 0);
+
+	assert(rte_ring_sc_dequeue(ring, (void **)&rec) == 0);
+	assert(rec->vportid == 0);
+	assert(rec->dir == CAPTURE_DIR_OUT);
+	assert(rec->len == rte_pktmbuf_pkt_len(ipv4));
+	assert(memcmp(rec->data, rte_pktmbuf_mtod(ipv4, void *), rec->caplen) == 0);
+
+	/* the packet itself is left to the caller to send */
+	assert(rte_mbuf_refcnt_read(ipv4) == 1);
+
+	rte_pktmbuf_free(ipv4);
+	rte_pktmbuf_free(ipv6);
+}
+
+#define UPCALL_TEST_PENDING_ENTRIES 4096  /* as in datapath.c */
+
+/* Send a miss of the flow with 'hash' received on 'in_port' to vswitchd */
+static void
+upcall_test_miss(uint32_t hash, uint32_t in_port)
+{
+	struct dpdk_upcall info = {0};
+
+	info.cmd = PACKET_CMD_MISS;
+	info.key.in_port = in_port;
+	send_packet_to_vswitchd(flow_key_test_pkt(64), &info, hash);
+}
+
+/* Send more misses of a flow than may be pending, which should drop the
+ * excess until the flow's entry times out */
+static void
+test_send_packet_to_vswitchd__pending_max(int argc, char *argv[])
+{
+	unsigned i = 0;
+
+	stats_init();
+	datapath_init();
+	upcall_pending_max = 4;
+	upcall_rate = 0;
+
+	for (i = 0; i < 6; i++)
+		upcall_test_miss(0x1234, 1);
+	flush_packets_to_vswitchd();
+	assert(stats_vport_tx_get(VSWITCHD) == 4);
+	assert(stats_vport_drop_get(VSWITCHD, STATS_DROP_UPCALL_PENDING) == 2);
+	assert(stats_vport_drop_get(VSWITCHD, STATS_DROP_UPCALL_LIMIT) == 0);
+
+	/* another flow has its own limit */
+	upcall_test_miss(0x1235, 1);
+	flush_packets_to_vswitchd();
+	assert(stats_vport_tx_get(VSWITCHD) == 5);
+
+	/* UPCALL_PENDING_TIMEOUT_MS is 100 */
+	usleep(150000);
+	upcall_test_miss(0x1234, 1);
+	flush_packets_to_vswitchd();
+	assert(stats_vport_tx_get(VSWITCHD) == 6);
+	assert(stats_vport_drop_get(VSWITCHD, STATS_DROP_UPCALL_PENDING) == 2);
+}
+
+/* Alternate the misses of two flows whose hashes share a pending entry,
+ * which should count both against the entry rather than have each reset
+ * the other's count */
+static void
+test_send_packet_to_vswitchd__pending_collision(int argc, char *argv[])
+{
+	unsigned i = 0;
+
+	stats_init();
+	datapath_init();
+	upcall_pending_max = 4;
+	upcall_rate = 0;
+
+	for (i = 0; i < 8; i++) {
+		upcall_test_miss(0x1234, 1);
+		upcall_test_miss(0x1234 + UPCALL_TEST_PENDING_ENTRIES, 1);
+	}
+	flush_packets_to_vswitchd();
+	assert(stats_vport_tx_get(VSWITCHD) == 4);
+	assert(stats_vport_drop_get(VSWITCHD, STATS_DROP_UPCALL_PENDING) == 12);
+}
+
+/* Send misses of distinct flows faster than the upcall rate, which should
+ * admit a bucket's worth, and one more once a token is refilled */
+static void
+test_send_packet_to_vswitchd__rate(int argc, char *argv[])
+{
+	unsigned i = 0;
+
+	stats_init();
+	datapath_init();
+	upcall_pending_max = 0;
+	/* one token every 10ms, and the bucket holds a single token */
+	upcall_rate = 100;
+
+	for (i = 0; i < 5; i++)
+		upcall_test_miss(i, 1);
+	flush_packets_to_vswitchd();
+	assert(stats_vport_tx_get(VSWITCHD) == 1);
+	assert(stats_vport_drop_get(VSWITCHD, STATS_DROP_UPCALL_LIMIT) == 4);
+	assert(stats_vport_drop_get(VSWITCHD, STATS_DROP_UPCALL_PENDING) == 0);
+
+	/* each vport has its own bucket */
+	upcall_test_miss(5, 2);
+	flush_packets_to_vswitchd();
+	assert(stats_vport_tx_get(VSWITCHD) == 2);
+
+	usleep(20000);
+	upcall_test_miss(6, 1);
+	upcall_test_miss(7, 1);
+	flush_packets_to_vswitchd();
+	assert(stats_vport_tx_get(VSWITCHD) == 3);
+	assert(stats_vport_drop_get(VSWITCHD, STATS_DROP_UPCALL_LIMIT) == 5);
+}
+
+/* Send a packet with no headroom for the upcall header, which should be
+ * dropped and counted against a reason like every other upcall drop */
+static void
+test_send_packet_to_vswitchd__no_headroom(int argc, char *argv[])
+{
+	struct dpdk_upcall info = {0};
+	struct rte_mbuf *buf = NULL;
+	uint64_t drops = 0;
+	int i = 0;
+
+	stats_init();
+	datapath_init();
+
+	buf = flow_key_test_pkt(64);
+	buf->pkt.data = buf->buf_addr;
+	info.cmd = PACKET_CMD_MISS;
+	send_packet_to_vswitchd(buf, &info, 0x1234);
+	flush_packets_to_vswitchd();
+
+	assert(stats_vport_tx_get(VSWITCHD) == 0);
+	assert(stats_vport_tx_drop_get(VSWITCHD) == 1);
+	assert(stats_vport_tx_error_get(VSWITCHD) == 1);
+	assert(stats_vport_drop_get(VSWITCHD, STATS_DROP_NO_HEADROOM) == 1);
+	for (i = 0; i < STATS_DROP_MAX; i++)
+		drops += stats_vport_drop_get(VSWITCHD, i);
+	assert(drops == stats_vport_tx_drop_get(VSWITCHD));
+}
+
+/* Queue an upcall after the test's vswitchd core has gone to sleep */
+static int
+upcall_during_sleep(void *arg)
+{
+	struct dpdk_upcall info = {0};
+
+	usleep(100000);
+	info.cmd = PACKET_CMD_ACTION;
+	send_packet_to_vswitchd(arg, &info, 0);
+	flush_packets_to_vswitchd();
+
+	return 0;
+}
+
+/* Sleep while idle and have a switching core queue an upcall, which should
+ * wake the vswitchd core long before the sleep times out. Needs two lcores. */
+static void
+test_wait_for_request_from_vswitchd__upcall(int argc, char *argv[])
+{
+	unsigned lcore = rte_get_next_lcore(rte_lcore_id(), 1, 0);
+	uint64_t start = 0;
+
+	assert(lcore < RTE_MAX_LCORE);
+	stats_init();
+	datapath_init();
+
+	assert(rte_eal_remote_launch(upcall_during_sleep,
+	                             flow_key_test_pkt(64), lcore) == 0);
+	start = rte_rdtsc();
+	wait_for_request_from_vswitchd(10 * US_PER_S);
+	assert(rte_rdtsc() - start < rte_get_tsc_hz());
+	assert(rte_eal_wait_lcore(lcore) == 0);
+	assert(stats_vport_tx_get(VSWITCHD) == 1);
 }
 
 static const struct command commands[] = {
@@ -832,17 +2100,43 @@ static const struct command commands[] = {
 	{"flow_table_del_all", 0, 0, test_flow_table_del_all},
 	{"flow_table_get_flow", 0, 0, test_flow_table_get_flow},
 	{"flow_table_mod_flow", 0, 0, test_flow_table_mod_flow},
+	{"flow_table_count", 0, 0, test_flow_table_count},
+	{"flow_table_add_flow__occupancy", 0, 0, test_flow_table_add_flow__occupancy},
+	{"flow_table_add_flow__same_rss_hash", 0, 0, test_flow_table_add_flow__same_rss_hash},
 
 	{"flow_table_get_first_flow", 0, 0, test_flow_table_get_first_flow},
 	{"flow_table_get_next_flow", 0, 0, test_flow_table_get_next_flow},
+	{"flow_table_lookup__nd_target", 0, 0, test_flow_table_lookup__nd_target},
+	{"switch_packet__microflow_cache", 0, 0, test_switch_packet__microflow_cache},
+	{"switch_packet__tcp_flags", 0, 0, test_switch_packet__tcp_flags},
+
+	{"flow_key_extract__ipv6", 0, 0, test_flow_key_extract__ipv6},
+	{"flow_key_extract__ipv6_truncated_ext_hdr", 0, 0, test_flow_key_extract__ipv6_truncated_ext_hdr},
+	{"flow_key_extract__arp", 0, 0, test_flow_key_extract__arp},
+	{"flow_key_extract_benchmark", 1, 2, bench_flow_key_extract},
+
+	{"memnic_tx_rx", 0, 0, test_memnic_tx_rx},
+	{"memnic_tx__corrupt_tail", 0, 0, test_memnic_tx__corrupt_tail},
 
 	{"stats_vport_xxx_increment", 0, 0, test_stats_vport_xxx_increment},
 	{"stats_vport_xxx_get", 0, 0, test_stats_vport_xxx_get},
 	{"stats_vport_xxx_clear", 0, 0, test_stats_vport_xxx_clear},
+	{"stats_vport_tx_latency", 0, 0, test_stats_vport_tx_latency},
+	{"stats_vport_latency", 0, 0, test_stats_vport_latency},
 
 	{"stats_vswitch_increment", 0, 0, test_stats_vswitch_increment},
 	{"stats_vswitch_get", 0, 0, test_stats_vswitch_get},
 	{"stats_vswitch_clear", 0, 0, test_stats_vswitch_clear},
+	{"stats_lcore_cycles", 0, 0, test_stats_lcore_cycles},
+	{"stats_export", 0, 0, test_stats_export},
+	{"capture_in_burst", 0, 0, test_capture_in_burst},
+	{"capture_out_packet", 0, 0, test_capture_out_packet},
+	{"args_stats_export_interval", 0, 0, test_args_stats_export_interval},
+	{"send_packet_to_vswitchd__pending_max", 0, 0, test_send_packet_to_vswitchd__pending_max},
+	{"send_packet_to_vswitchd__pending_collision", 0, 0, test_send_packet_to_vswitchd__pending_collision},
+	{"send_packet_to_vswitchd__rate", 0, 0, test_send_packet_to_vswitchd__rate},
+	{"send_packet_to_vswitchd__no_headroom", 0, 0, test_send_packet_to_vswitchd__no_headroom},
+	{"wait_for_request_from_vswitchd__upcall", 0, 0, test_wait_for_request_from_vswitchd__upcall},
 	{NULL, 0, 0, NULL},
 };
 
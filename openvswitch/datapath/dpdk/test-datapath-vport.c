@@ -0,0 +1,485 @@
+/*
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2010-2014 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Unit tests of the datapath's vport management, linked with the real
+ * vport.c rather than the stub used by test-datapath.
+ */
+
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_ring.h>
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_ethdev.h>
+#include <rte_eth_ring.h>
+#include <rte_string_fns.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "vport.h"
+#include "datapath.h"
+#include "stats.h"
+#include "sched.h"
+#include "init.h"
+#include "args.h"
+#include "ovdk_datapath_messages.h"
+#include "ut.h"
+
+#include <assert.h>
+
+#define VSWITCHD_MESSAGE_RING_NAME "MProc_Vswitchd_Message_Ring"
+#define VSWITCHD_REPLY_RING_NAME   "MProc_Vswitchd_Reply_Ring"
+#define VPORT_CMD_FAMILY           0xE
+#define OVS_CLIENT_RXQ_NAME        "OVS_Client_%u_RX"
+/* Enough for the mbufs the datapath keeps on the vswitchd alloc ring */
+#define TEST_MBUFS                 1024
+
+/*
+ * Configure a physical port backed by rings, which leaves the packets it
+ * sends on '*tx_ring', and holds packets for up to 'flush_us' to fill a
+ * burst. Must be called before vport_test_init().
+ *
+ * Returns the vport id of the port.
+ */
+static unsigned
+vport_test_ring_port(struct rte_ring **tx_ring, uint32_t flush_us)
+{
+	struct rte_ring *rx_ring = NULL;
+	int port = 0;
+
+	rx_ring = rte_ring_create("test_port_rx", 1024, SOCKET_ID_ANY,
+	                          RING_F_SP_ENQ | RING_F_SC_DEQ);
+	*tx_ring = rte_ring_create("test_port_tx", 1024, SOCKET_ID_ANY,
+	                           RING_F_SP_ENQ | RING_F_SC_DEQ);
+	assert(rx_ring != NULL && *tx_ring != NULL);
+
+	port = rte_eth_from_rings(&rx_ring, 1, tx_ring, 1, 0);
+	assert(port >= 0 && port < MAX_PHYPORTS);
+
+	port_cfg.num_phy_ports = 1;
+	port_cfg.id[0] = port;
+	port_tx_flush_us[port] = flush_us;
+
+	return PHYPORT0 + port;
+}
+
+/* Set up the datapath as init() does, with the physical ports in
+ * 'port_cfg', if any */
+static void
+vport_test_init(void)
+{
+	pktmbuf_pool = rte_mempool_create("MProc_pktmbuf_pool",
+	                TEST_MBUFS, /* num mbufs */
+	                2048 + sizeof(struct rte_mbuf) + 128, /*pktmbuf size */
+	                32, /*cache size */
+	                sizeof(struct rte_pktmbuf_pool_private),
+	                rte_pktmbuf_pool_init,
+	                NULL, rte_pktmbuf_init, NULL, 0, 0);
+	assert(pktmbuf_pool != NULL);
+
+	/* only the client switching core polls vports */
+	nb_cfg_params = 0;
+	stats_init();
+	sched_init();
+	vport_init();
+	datapath_init();
+}
+
+/*
+ * Send vport command 'cmd' for 'request' to the datapath, as vswitchd
+ * does, and return the error code of the reply. 'request' is updated from
+ * the reply.
+ */
+static int
+vport_request(uint8_t cmd, struct dpdk_vport_message *request)
+{
+	struct rte_ring *message_ring = rte_ring_lookup(VSWITCHD_MESSAGE_RING_NAME);
+	struct rte_ring *reply_ring = rte_ring_lookup(VSWITCHD_REPLY_RING_NAME);
+	struct dpdk_message *message = NULL;
+	struct rte_mbuf *mbuf = NULL;
+	int ret = 0;
+
+	assert(message_ring != NULL && reply_ring != NULL);
+
+	mbuf = rte_pktmbuf_alloc(pktmbuf_pool);
+	assert(mbuf != NULL);
+	message = rte_pktmbuf_mtod(mbuf, struct dpdk_message *);
+	memset(message, 0, sizeof(*message));
+	message->type = VPORT_CMD_FAMILY;
+	message->vport_msg = *request;
+	message->vport_msg.cmd = cmd;
+	rte_pktmbuf_data_len(mbuf) = sizeof(*message);
+	rte_pktmbuf_pkt_len(mbuf) = sizeof(*message);
+	assert(rte_ring_sp_enqueue(message_ring, mbuf) == 0);
+
+	handle_request_from_vswitchd();
+
+	assert(rte_ring_sc_dequeue(reply_ring, (void **)&mbuf) == 0);
+	message = rte_pktmbuf_mtod(mbuf, struct dpdk_message *);
+	*request = message->vport_msg;
+	ret = message->type;
+	rte_pktmbuf_free(mbuf);
+
+	return ret;
+}
+
+/* Build a request to add the vport 'port_no' of 'type' named 'name' */
+static struct dpdk_vport_message
+vport_msg_build(uint32_t port_no, enum vport_type type, const char *name)
+{
+	struct dpdk_vport_message request = {0};
+
+	request.port_no = port_no;
+	request.type = type;
+	rte_snprintf(request.port_name, sizeof(request.port_name), "%s", name);
+
+	return request;
+}
+
+/* Add vports as vswitchd does, which should fail for a vport number or name
+ * in use and for bridges */
+static void
+test_vport_cmd_new(int argc, char *argv[])
+{
+	struct dpdk_vport_message request = {0};
+
+	vport_test_init();
+
+	request = vport_msg_build(CLIENT1, VPORT_TYPE_CLIENT, "client1");
+	assert(vport_request(VPORT_CMD_NEW, &request) == 0);
+	assert(request.port_no == CLIENT1);
+	assert(vport_exists(CLIENT1));
+	assert(vport_is_enabled(CLIENT1));
+	assert(vport_get_type(CLIENT1) == VPORT_TYPE_CLIENT);
+	assert(vport_name_to_portid("client1") == CLIENT1);
+	assert(sched_vports[CLIENT1].lcore == client_switching_core);
+
+	/* the vport number is in use */
+	request = vport_msg_build(CLIENT1, VPORT_TYPE_CLIENT, "client2");
+	assert(vport_request(VPORT_CMD_NEW, &request) == EBUSY);
+
+	/* the name is in use */
+	request = vport_msg_build(CLIENT1 + 1, VPORT_TYPE_CLIENT, "client1");
+	assert(vport_request(VPORT_CMD_NEW, &request) == EEXIST);
+	assert(!vport_exists(CLIENT1 + 1));
+
+	/* a number out of the type's range is replaced by a free one */
+	request = vport_msg_build(UINT32_MAX, VPORT_TYPE_CLIENT, "client2");
+	assert(vport_request(VPORT_CMD_NEW, &request) == 0);
+	assert(request.port_no == CLIENT1 + 1);
+	assert(strcmp(request.port_name, "client2") == 0);
+
+	/* bridges only exist in vswitchd */
+	request = vport_msg_build(CLIENT0, VPORT_TYPE_BRIDGE, "br0");
+	assert(vport_request(VPORT_CMD_NEW, &request) == ENODEV);
+	assert(!vport_exists(CLIENT0));
+
+	/* no physical ports were configured */
+	request = vport_msg_build(0, VPORT_TYPE_PHY, "port0");
+	assert(vport_request(VPORT_CMD_NEW, &request) == ENODEV);
+	assert(!vport_exists(PHYPORT0));
+}
+
+/* Delete a vport and add it again, which should reuse its rings */
+static void
+test_vport_cmd_del(int argc, char *argv[])
+{
+	struct dpdk_vport_message request = {0};
+	struct rte_mbuf *mbuf = NULL;
+	struct rte_ring *rx_q = NULL;
+	char ring_name[RTE_RING_NAMESIZE];
+
+	vport_test_init();
+
+	request = vport_msg_build(CLIENT1, VPORT_TYPE_CLIENT, "client1");
+	assert(vport_request(VPORT_CMD_NEW, &request) == 0);
+	rte_snprintf(ring_name, sizeof(ring_name), OVS_CLIENT_RXQ_NAME, CLIENT1);
+	rx_q = rte_ring_lookup(ring_name);
+	assert(rx_q != NULL);
+
+	/* a packet left on the vport's ring is freed with the vport */
+	send_to_vport(CLIENT1, rte_pktmbuf_alloc(pktmbuf_pool));
+	flush_clients();
+	assert(rte_ring_count(rx_q) == 1);
+
+	request = vport_msg_build(CLIENT1, VPORT_TYPE_CLIENT, "");
+	assert(vport_request(VPORT_CMD_DEL, &request) == 0);
+	assert(!vport_exists(CLIENT1));
+	assert(vport_name_to_portid("client1") == UINT32_MAX);
+	assert(rte_ring_count(rx_q) == 0);
+	assert(sched_lcores[client_switching_core].vports.count == 0);
+
+	/* the vport no longer exists */
+	assert(vport_request(VPORT_CMD_DEL, &request) == ENODEV);
+
+	/* packets to the deleted vport are dropped */
+	mbuf = rte_pktmbuf_alloc(pktmbuf_pool);
+	assert(send_to_vport(CLIENT1, mbuf) < 0);
+	assert(stats_vport_drop_get(CLIENT1, STATS_DROP_INVALID_VPORT) == 1);
+
+	request = vport_msg_build(CLIENT1, VPORT_TYPE_CLIENT, "client1");
+	assert(vport_request(VPORT_CMD_NEW, &request) == 0);
+	assert(vport_exists(CLIENT1));
+	assert(rte_ring_lookup(ring_name) == rx_q);
+	assert(sched_lcores[client_switching_core].vports.count == 1);
+	/* the new vport's statistics start from zero */
+	assert(stats_vport_drop_get(CLIENT1, STATS_DROP_INVALID_VPORT) == 0);
+}
+
+/* Delete a vport this core still has packets cached for, which should
+ * free them rather than flush them to the vport's rings later */
+static void
+test_vport_destroy__cached_mbufs(int argc, char *argv[])
+{
+	struct rte_ring *rx_q = NULL;
+	char ring_name[RTE_RING_NAMESIZE];
+	unsigned free_count = 0;
+
+	vport_test_init();
+
+	assert(vport_create(CLIENT1, VPORT_TYPE_CLIENT, "client1") == 0);
+	rte_snprintf(ring_name, sizeof(ring_name), OVS_CLIENT_RXQ_NAME, CLIENT1);
+	rx_q = rte_ring_lookup(ring_name);
+	assert(rx_q != NULL);
+
+	free_count = rte_mempool_count(pktmbuf_pool);
+	assert(send_to_vport(CLIENT1, rte_pktmbuf_alloc(pktmbuf_pool)) == 0);
+	assert(send_to_vport(CLIENT1, rte_pktmbuf_alloc(pktmbuf_pool)) == 0);
+	assert(rte_mempool_count(pktmbuf_pool) == free_count - 2);
+
+	assert(vport_destroy(CLIENT1) == 0);
+	assert(rte_mempool_count(pktmbuf_pool) == free_count);
+	assert(stats_vport_drop_get(CLIENT1, STATS_DROP_INVALID_VPORT) == 2);
+
+	flush_clients();
+	assert(rte_ring_count(rx_q) == 0);
+}
+
+/* Delete a vport while this core's own removal flag is set, as a vhost
+ * device removal on another core would leave it, which should not wait
+ * for this core */
+static void
+test_vport_destroy__own_removal_flag(int argc, char *argv[])
+{
+	unsigned lcore = rte_lcore_id();
+
+	vport_test_init();
+
+	assert(vport_create(CLIENT1, VPORT_TYPE_CLIENT, "client1") == 0);
+	dev_removal_flag[lcore] = REQUEST_DEV_REMOVAL;
+	assert(vport_destroy(CLIENT1) == 0);
+	/* the flag is left for the main loop to ACK */
+	assert(dev_removal_flag[lcore] == REQUEST_DEV_REMOVAL);
+	assert(!vport_exists(CLIENT1));
+}
+
+/* Queue packets for a port that receives nothing, as for one-way traffic,
+ * fewer than a burst at a time, which should hold them for a full burst,
+ * grow the burst while the port is backlogged, and send what is left once
+ * no more are queued */
+static void
+test_flush_nic_tx_ring__tx_only(int argc, char *argv[])
+{
+	struct rte_ring *tx_ring = NULL;
+	unsigned vportid = 0;
+	unsigned pass = 0, i = 0;
+
+	/* packets never wait long enough to be flushed by the timer */
+	vportid = vport_test_ring_port(&tx_ring, US_PER_S);
+	vport_test_init();
+	assert(vport_create(vportid, VPORT_TYPE_PHY, "port0") == 0);
+
+	for (pass = 0; pass < 4; pass++) {
+		for (i = 0; i < 8; i++)
+			assert(send_to_vport(vportid,
+			            rte_pktmbuf_alloc(pktmbuf_pool)) == 0);
+		flush_ports();
+		flush_nic_tx_ring(vportid);
+		assert(rte_ring_count(tx_ring) == (pass < 3 ? 0 : PKT_BURST_SIZE));
+	}
+
+	/* a backlog of more than a burst doubles the burst */
+	for (i = 0; i < 100; i++)
+		assert(send_to_vport(vportid, rte_pktmbuf_alloc(pktmbuf_pool)) == 0);
+	flush_ports();
+	flush_nic_tx_ring(vportid);
+	assert(rte_ring_count(tx_ring) == 2 * PKT_BURST_SIZE);
+
+	for (i = 0; i < 8; i++)
+		assert(send_to_vport(vportid, rte_pktmbuf_alloc(pktmbuf_pool)) == 0);
+	flush_ports();
+	flush_nic_tx_ring(vportid);
+	assert(rte_ring_count(tx_ring) == 4 * PKT_BURST_SIZE);
+
+	/* nothing more was queued, so the rest goes at once */
+	flush_nic_tx_ring(vportid);
+	assert(rte_ring_count(tx_ring) == 140);
+	assert(stats_vport_tx_get(vportid) == 140);
+}
+
+/*
+ * Set up the datapath with this lcore as the client switching core, and
+ * the next 'extra' lcores also switching. Needs 'extra' more lcores.
+ * Returns the first of those.
+ */
+static unsigned
+sched_test_init(unsigned extra)
+{
+	unsigned lcore = rte_lcore_id();
+	unsigned first = RTE_MAX_LCORE;
+	unsigned i = 0;
+
+	client_switching_core = rte_lcore_id();
+	rebalance_interval_ms = 1;
+	vport_test_init();
+
+	for (i = 0; i < extra; i++) {
+		lcore = rte_get_next_lcore(lcore, 1, 0);
+		assert(lcore < RTE_MAX_LCORE);
+		sched_lcores[lcore].switching = true;
+		if (first == RTE_MAX_LCORE)
+			first = lcore;
+	}
+
+	return first;
+}
+
+/* Move vports between lcores, which should fail for vports that don't
+ * exist and for lcores that don't switch packets */
+static void
+test_sched_vport_move(int argc, char *argv[])
+{
+	unsigned self = rte_lcore_id();
+	unsigned other = RTE_MAX_LCORE;
+	unsigned idle = RTE_MAX_LCORE;
+
+	/* the third lcore is left idle */
+	other = sched_test_init(1);
+	idle = rte_get_next_lcore(other, 1, 0);
+	assert(idle < RTE_MAX_LCORE);
+	assert(vport_create(CLIENT1, VPORT_TYPE_CLIENT, "client1") == 0);
+	assert(sched_vports[CLIENT1].lcore == self);
+
+	assert(sched_vport_move(CLIENT1, RTE_MAX_LCORE) == -EINVAL);
+	assert(sched_vport_move(CLIENT1, idle) == -EINVAL);
+	assert(sched_vport_move(CLIENT1 + 1, other) == -ENODEV);
+	assert(sched_vports[CLIENT1].lcore == self);
+
+	assert(sched_vport_move(CLIENT1, self) == 0);
+	assert(sched_lcores[self].vports.count == 1);
+
+	assert(sched_vport_move(CLIENT1, other) == 0);
+	assert(sched_vports[CLIENT1].lcore == other);
+	assert(sched_lcores[self].vports.count == 0);
+	assert(sched_lcores[other].vports.count == 1);
+	assert(sched_lcores[other].vports.ids[0] == CLIENT1);
+}
+
+/* Charge lcores and vports for their polls, which should move the vport
+ * of the busiest lcore that best halves the imbalance to the least busy
+ * lcore, and move nothing once the imbalance is below the minimum */
+static void
+test_sched_rebalance(int argc, char *argv[])
+{
+	unsigned self = rte_lcore_id();
+	unsigned mid = RTE_MAX_LCORE, low = RTE_MAX_LCORE;
+	unsigned i = 0;
+
+	mid = sched_test_init(2);
+	low = rte_get_next_lcore(mid, 1, 0);
+	for (i = 0; i < 4; i++)
+		assert(vport_create(CLIENT1 + i, VPORT_TYPE_CLIENT, NULL) == 0);
+	assert(sched_vport_move(CLIENT1 + 3, mid) == 0);
+
+	/* loads of 800, 300 and 0 per mille */
+	sched_vport_account(self, CLIENT1, 10, 500);
+	sched_vport_account(self, CLIENT1 + 1, 10, 200);
+	sched_vport_account(self, CLIENT1 + 2, 10, 100);
+	sched_vport_account(mid, CLIENT1 + 3, 10, 300);
+	sched_lcores[self].total_cycles += 1000;
+	sched_lcores[mid].total_cycles += 1000;
+	sched_lcores[low].total_cycles += 1000;
+
+	rte_delay_ms(2);
+	sched_rebalance();
+	assert(sched_vports[CLIENT1].lcore == low);
+	assert(sched_vports[CLIENT1 + 1].lcore == self);
+	assert(sched_vports[CLIENT1 + 2].lcore == self);
+	assert(sched_vports[CLIENT1 + 3].lcore == mid);
+	assert(sched_lcores[self].vports.count == 2);
+	assert(sched_lcores[low].vports.count == 1);
+
+	/* loads of 150, 0 and 0 per mille are within SCHED_IMBALANCE_MIN */
+	sched_vport_account(self, CLIENT1 + 1, 10, 150);
+	sched_lcores[self].total_cycles += 1000;
+	sched_lcores[mid].total_cycles += 1000;
+	sched_lcores[low].total_cycles += 1000;
+
+	rte_delay_ms(2);
+	sched_rebalance();
+	assert(sched_vports[CLIENT1 + 1].lcore == self);
+	assert(sched_vports[CLIENT1 + 2].lcore == self);
+	assert(sched_lcores[self].vports.count == 2);
+}
+
+static const struct command commands[] = {
+	{"vport_cmd_new", 0, 0, test_vport_cmd_new},
+	{"vport_cmd_del", 0, 0, test_vport_cmd_del},
+	{"vport_destroy__cached_mbufs", 0, 0, test_vport_destroy__cached_mbufs},
+	{"vport_destroy__own_removal_flag", 0, 0, test_vport_destroy__own_removal_flag},
+	{"flush_nic_tx_ring__tx_only", 0, 0, test_flush_nic_tx_ring__tx_only},
+	{"sched_vport_move", 0, 0, test_sched_vport_move},
+	{"sched_rebalance", 0, 0, test_sched_rebalance},
+	{NULL, 0, 0, NULL},
+};
+
+int
+main(int argc, char *argv[])
+{
+	/* init EAL, parsing EAL args */
+	int count = 0;
+	count = rte_eal_init(argc, argv);
+	assert(count >= 0);
+
+	/* skip the `--` separating EAL params from test params */
+	count++;
+
+	run_command(argc - count, argv + count, commands);
+
+	return EXIT_SUCCESS;
+}
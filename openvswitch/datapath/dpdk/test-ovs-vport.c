@@ -44,6 +44,7 @@
 
 #define CLIENT_PORT_NAME		"Client1"
 #define KNI_PORT_NAME			"KNI1"
+#define MEMNIC_PORT_NAME		"MEMNIC1"
 #define NON_EXISTENT_PORT_NAME	"DOESNOTEXIST"
 
 static struct vport_info *stub_vports = NULL;
@@ -93,6 +94,10 @@ create_vport_client(struct vport_info *vport)
 	client->free_q = create_ring("Client_FREE");
 	rte_snprintf(client->ring_names.free, sizeof(client->ring_names.free),
 			"Client_FREE");
+
+	client->alloc_q = create_ring("Client_ALLOC");
+	rte_snprintf(client->ring_names.alloc, sizeof(client->ring_names.alloc),
+			"Client_ALLOC");
 }
 
 static void
@@ -132,6 +137,20 @@ create_vport_kni(struct vport_info *vport)
 			"KNI_SYNC");
 }
 
+static void
+create_vport_memnic(struct vport_info *vport)
+{
+	struct vport_memnic *memnic;
+
+	vport->type = VPORT_TYPE_MEMNIC;
+	rte_snprintf(vport->name, sizeof(vport->name), MEMNIC_PORT_NAME);
+
+	memnic = &vport->memnic;
+
+	create_memzone("MEMNIC_AREA");
+	rte_snprintf(memnic->mz_name, sizeof(memnic->mz_name), "MEMNIC_AREA");
+}
+
 static void
 set_up_all(void)
 {
@@ -144,6 +163,7 @@ set_up_all(void)
 	stub_vports = stub_vports_mz->addr;
 	create_vport_client(&stub_vports[0]);
 	create_vport_kni(&stub_vports[1]);
+	create_vport_memnic(&stub_vports[2]);
 	assert(stub_vports_mz == ovs_vport_lookup_vport_info());
 
 	pktmbuf_pool = rte_mempool_create(PKTMBUF_POOL_NAME, 32, 16, 32, 32, NULL,
@@ -159,6 +179,9 @@ test_valid_vport(int argc __rte_unused, char *argv[] __rte_unused)
 	assert(ovs_vport_is_vport_client(NON_EXISTENT_PORT_NAME) < 0);
 	assert(ovs_vport_is_vport_kni(KNI_PORT_NAME) == 0);
 	assert(ovs_vport_is_vport_kni(NON_EXISTENT_PORT_NAME) < 0);
+	assert(ovs_vport_is_vport_memnic(MEMNIC_PORT_NAME) == 0);
+	assert(ovs_vport_is_vport_memnic(KNI_PORT_NAME) < 0);
+	assert(ovs_vport_is_vport_memnic(NON_EXISTENT_PORT_NAME) < 0);
 }
 
 static void
@@ -169,9 +192,11 @@ test_vport_client_lookup(int argc __rte_unused, char *argv[] __rte_unused)
 	assert(ovs_vport_client_lookup_rx_q(CLIENT_PORT_NAME) == client->rx_q);
 	assert(ovs_vport_client_lookup_tx_q(CLIENT_PORT_NAME) == client->tx_q);
 	assert(ovs_vport_client_lookup_free_q(CLIENT_PORT_NAME) == client->free_q);
+	assert(ovs_vport_client_lookup_alloc_q(CLIENT_PORT_NAME) == client->alloc_q);
 	assert(ovs_vport_client_lookup_rx_q(NON_EXISTENT_PORT_NAME) == NULL);
 	assert(ovs_vport_client_lookup_tx_q(NON_EXISTENT_PORT_NAME) == NULL);
 	assert(ovs_vport_client_lookup_free_q(NON_EXISTENT_PORT_NAME) == NULL);
+	assert(ovs_vport_client_lookup_alloc_q(NON_EXISTENT_PORT_NAME) == NULL);
 }
 
 static void
@@ -204,6 +229,18 @@ test_vport_kni_lookup(int argc __rte_unused, char *argv[] __rte_unused)
 	assert(ovs_vport_kni_lookup_sync_fifo(NON_EXISTENT_PORT_NAME) == NULL);
 }
 
+static void
+test_vport_memnic_lookup(int argc __rte_unused, char *argv[] __rte_unused)
+{
+	struct vport_memnic *memnic = &stub_vports[2].memnic;
+	const struct rte_memzone *mz = NULL;
+
+	mz = ovs_vport_memnic_lookup_memzone(MEMNIC_PORT_NAME);
+	assert(strcmp(mz->name, memnic->mz_name) == 0);
+
+	assert(ovs_vport_memnic_lookup_memzone(NON_EXISTENT_PORT_NAME) == NULL);
+}
+
 static void
 test_lookup_packet_mempool(int argc __rte_unused, char *argv[] __rte_unused)
 {
@@ -232,6 +269,7 @@ static const struct command commands[] = {
 	{"valid_vport", 0, 0, test_valid_vport},
 	{"vport_client_lookup", 0, 0, test_vport_client_lookup},
 	{"vport_kni_lookup", 0, 0, test_vport_kni_lookup},
+	{"vport_memnic_lookup", 0, 0, test_vport_memnic_lookup},
 	{"lookup_packet_mempool", 0, 0, test_lookup_packet_mempool},
 	{"is_vport_name_valid", 0, 0, test_is_vport_name_valid},
 
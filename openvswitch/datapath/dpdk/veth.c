@@ -88,10 +88,14 @@ veth_kni_alloc(struct rte_kni **kni, uint8_t port_id)
 
 	veth = rte_kni_alloc(pktmbuf_pool, &conf, &ops);
 
-	if (!veth)
-		rte_exit(EXIT_FAILURE, "Failed to create kni for port: %d\n", port_id);
-	if (rte_kni_get(conf.name) != veth)
-		rte_exit(EXIT_FAILURE, "Failed to get kni dev for port: %d\n", port_id);
+	if (!veth) {
+		RTE_LOG(ERR, APP, "Failed to create kni for port: %d\n", port_id);
+		return -1;
+	}
+	if (rte_kni_get(conf.name) != veth) {
+		RTE_LOG(ERR, APP, "Failed to get kni dev for port: %d\n", port_id);
+		return -1;
+	}
 
 	RTE_LOG(INFO, APP, "Initialised KNI vEth %d\n", port_id);
 
@@ -100,18 +104,21 @@ veth_kni_alloc(struct rte_kni **kni, uint8_t port_id)
 	return 0;
 }
 
-void
-init_veth(void)
+int
+veth_port_init(uint8_t port_id)
 {
-	uint8_t port_id = 0;
 	struct rte_kni *kni = NULL;
 
-	/* Create the rte_kni fifos for each KNI port */
-	for (port_id = 0; port_id < num_veth; port_id++) {
-		if (veth_kni_alloc(&kni, port_id) >= 0)
-			rte_veth_list[port_id] = kni;
-		else
-			RTE_LOG(ERR, APP, "Failed to initialise vEth on invalid port %d\n",
-			                port_id);
+	/* The KNI device of a deleted vEth port is kept for reuse */
+	if (rte_veth_list[port_id] != NULL)
+		return 0;
+
+	if (veth_kni_alloc(&kni, port_id) < 0) {
+		RTE_LOG(ERR, APP, "Failed to initialise vEth on port %d\n",
+		        port_id);
+		return -1;
 	}
+	rte_veth_list[port_id] = kni;
+
+	return 0;
 }
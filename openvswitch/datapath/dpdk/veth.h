@@ -39,10 +39,10 @@
 
 struct rte_kni *rte_veth_list[MAX_VETH_PORTS];
 
-/* Reserves memory for MAX_VETH_PORTS number of KNI ports and initialises
- * the fifos
+/* Creates the KNI device backing vEth port 'port_id', unless it already
+ * exists. Returns 0 on success, -1 on failure.
  */
-void
-init_veth(void);
+int
+veth_port_init(uint8_t port_id);
 
 #endif
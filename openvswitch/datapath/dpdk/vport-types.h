@@ -61,6 +61,7 @@ struct vport_client_ring_names {
 	char rx[RTE_RING_NAMESIZE];
 	char tx[RTE_RING_NAMESIZE];
 	char free[RTE_RING_NAMESIZE];
+	char alloc[RTE_RING_NAMESIZE];
 };
 
 enum vport_type {
@@ -72,6 +73,54 @@ enum vport_type {
 	VPORT_TYPE_KNI,
 	VPORT_TYPE_VETH,
 	VPORT_TYPE_VHOST,
+	VPORT_TYPE_MEMNIC,
+};
+
+/*
+ * Shared memory layout of a MEMNIC vport.
+ *
+ * Packets are exchanged with the guest through two descriptor rings, one
+ * per direction. A descriptor holds the offset and length of a packet in
+ * 'bufs', so guests need no knowledge of DPDK mbufs or mempools.
+ *
+ * Each ring has one producer and one consumer. 'head' and 'tail' are free
+ * running counters; slot 'n' of a ring is desc[n % MEMNIC_RING_SIZE]. The
+ * producer fills a burst of descriptors and publishes them with a single
+ * store to 'head', after a write barrier. The consumer hands a burst of
+ * slots back with a single store to 'tail'. 'head' and 'tail' live on
+ * separate cache lines so that each side only ever writes its own line.
+ *
+ * The host copies packets for the guest into bufs[slot] of the 'to_guest'
+ * ring. The guest may place the packets it sends anywhere in 'bufs'; by
+ * convention it uses bufs[MEMNIC_RING_SIZE + slot] of the 'from_guest'
+ * ring. The host copies them out before advancing 'from_guest.tail'.
+ */
+#define MEMNIC_MAGIC		0x43494e4d	/* "MNIC" */
+#define MEMNIC_VERSION		1
+#define MEMNIC_RING_SIZE	512			/* Power of two */
+#define MEMNIC_BUF_SIZE		2048
+#define MEMNIC_NUM_BUFS		(2 * MEMNIC_RING_SIZE)
+
+struct memnic_desc {
+	uint32_t offset;		/* Offset of packet data from start of 'bufs' */
+	uint16_t len;			/* Packet length in bytes */
+	uint16_t reserved;
+};
+
+struct memnic_ring {
+	volatile uint32_t head __rte_cache_aligned;	/* Written by producer */
+	volatile uint32_t tail __rte_cache_aligned;	/* Written by consumer */
+	struct memnic_desc desc[MEMNIC_RING_SIZE] __rte_cache_aligned;
+};
+
+struct memnic_area {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t ring_size;
+	uint32_t buf_size;
+	struct memnic_ring to_guest __rte_cache_aligned;
+	struct memnic_ring from_guest __rte_cache_aligned;
+	uint8_t bufs[MEMNIC_NUM_BUFS][MEMNIC_BUF_SIZE] __rte_cache_aligned;
 };
 
 struct vport_phy {
@@ -84,14 +133,23 @@ struct vport_client {
 	struct rte_ring *rx_q;
 	struct rte_ring *tx_q;
 	struct rte_ring *free_q;
+	struct rte_ring *alloc_q;
 };
 
 struct vport_kni {
 	struct vport_kni_fifo_names fifo_names;
+	struct rte_ring *tx_q;
 	uint8_t index;
 };
 
 struct vport_veth {
+	struct rte_ring *tx_q;
+	uint8_t index;
+};
+
+struct vport_memnic {
+	char mz_name[RTE_MEMZONE_NAMESIZE];
+	struct memnic_area *area;
 	uint8_t index;
 };
 
@@ -112,6 +170,7 @@ struct vport_info {
 		struct vport_kni kni;
 		struct vport_veth veth;
 		struct vport_vhost vhost;
+		struct vport_memnic memnic;
 	};
 };
 
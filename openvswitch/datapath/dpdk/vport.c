@@ -34,18 +34,25 @@
 
 #include <linux/virtio_net.h>
 #include <linux/virtio_ring.h>
+#include <errno.h>
 #include <string.h>
 
 #include <rte_ethdev.h>
 #include <rte_cycles.h>
+#include <rte_atomic.h>
 #include <rte_memzone.h>
 #include <rte_malloc.h>
 #include <rte_string_fns.h>
+#include <rte_hash.h>
+#include <rte_jhash.h>
 
 #include "init.h"
 #include "vport.h"
 #include "stats.h"
+#include "stats-types.h"
 #include "args.h"
+#include "sched.h"
+#include "capture.h"
 #include "kni.h"
 #include "veth.h"
 #include "virtio-net.h"
@@ -56,22 +63,37 @@
 
 #define RTE_LOGTYPE_APP        RTE_LOGTYPE_USER1
 #define NO_FLAGS               0
-#define SOCKET0                0
 
 #define MZ_PORT_INFO           "OVS_port_info"
 #define OVS_CLIENT_RXQ_NAME    "OVS_Client_%u_RX"
 #define OVS_CLIENT_TXQ_NAME    "OVS_Client_%u_TX"
 #define OVS_CLIENT_FREE_Q_NAME "OVS_Client_%u_FREE_Q"
+#define OVS_CLIENT_ALLOC_Q_NAME "OVS_Client_%u_ALLOC_Q"
 #define OVS_PORT_TXQ_NAME      "OVS_PORT_%u_TX"
+#define OVS_KNI_TXQ_NAME       "OVS_KNI_%u_TX"
+#define OVS_VETH_TXQ_NAME      "OVS_VETH_%u_TX"
+#define OVS_MEMNIC_MZ_NAME     "OVS_MEMNIC_%u"
+#define VPORT_NAME_HASH        "OVS_vport_names"
+#define VPORT_NAME_HASH_BUCKET_ENTRIES 4
+#define NUM_VPORT_TYPES        (VPORT_TYPE_MEMNIC + 1)
 
 /* Ethernet port TX/RX ring sizes */
 #define RTE_MP_RX_DESC_DEFAULT 512
 #define RTE_MP_TX_DESC_DEFAULT 512
 /* Ring size for communication with clients */
 #define CLIENT_QUEUE_RINGSIZE  4096
+/*
+ * Ring size for pre-allocated mbufs handed to clients. Kept well below
+ * the per-client share of the mbuf pool so that idle guests can't starve
+ * the rest of the switch.
+ */
+#define CLIENT_ALLOC_QUEUE_RINGSIZE 512
 
-#define PORT_FLUSH_PERIOD_US  (100) /* TX drain every ~100us */
+#define CLIENT_RECYCLE_PERIOD_US (20) /* free_q/alloc_q service every ~20us */
+/* Most mbufs recycled per client per period, in each direction */
+#define CLIENT_RECYCLE_MAX     (4 * PKT_BURST_SIZE)
 #define LOCAL_MBUF_CACHE_SIZE  32
+#define PORT_TX_BURST_MAX      (4 * PKT_BURST_SIZE)
 #define CACHE_NAME_LEN         32
 #define MAX_QUEUE_NAME_SIZE    32
 
@@ -87,6 +109,10 @@
 uint32_t burst_tx_delay_time = BURST_TX_WAIT_US;
 /* Specify the number of retries on TX. */
 uint32_t burst_tx_retry_num = BURST_TX_RETRIES;
+/* Time in useconds each physical port holds packets to fill a TX burst */
+uint32_t port_tx_flush_us[MAX_PHYPORTS] = {
+	[0 ... MAX_PHYPORTS - 1] = PORT_FLUSH_PERIOD_US
+};
 
 /*
  * RX and TX Prefetch, Host, and Write-back threshold values should be
@@ -140,6 +166,17 @@ struct local_mbuf_cache {
 	struct rte_mbuf *cache[LOCAL_MBUF_CACHE_SIZE];
 	                   /* per-port and per-core local mbuf cache */
 	unsigned count;    /* number of mbufs in the local cache */
+	bool queued;       /* on this core's list of caches to flush */
+};
+
+/*
+ * Per-core list of the vports of one type whose local caches have had
+ * mbufs added since they were last flushed, so that flushing only visits
+ * those rather than every vport of the type.
+ */
+struct local_mbuf_cache_list {
+	unsigned count;
+	uint8_t vportids[MAX_VPORTS];
 };
 
 /*
@@ -151,26 +188,73 @@ struct local_mbuf_cache {
 static struct local_mbuf_cache **client_mbuf_cache = NULL;
 static struct local_mbuf_cache **port_mbuf_cache = NULL;
 static struct local_mbuf_cache **vhost_mbuf_cache = NULL;
+static struct local_mbuf_cache **memnic_mbuf_cache = NULL;
+static struct local_mbuf_cache **kni_mbuf_cache = NULL;
+static struct local_mbuf_cache **veth_mbuf_cache = NULL;
+static struct local_mbuf_cache_list *client_cache_list = NULL;
+static struct local_mbuf_cache_list *port_cache_list = NULL;
+static struct local_mbuf_cache_list *vhost_cache_list = NULL;
+static struct local_mbuf_cache_list *memnic_cache_list = NULL;
+static struct local_mbuf_cache_list *kni_cache_list = NULL;
+static struct local_mbuf_cache_list *veth_cache_list = NULL;
 
 static int send_to_client(uint32_t client, struct rte_mbuf *buf);
 static int send_to_port(uint32_t vportid, struct rte_mbuf *buf);
 static int send_to_kni(uint32_t vportid, struct rte_mbuf *buf);
 static int send_to_veth(uint32_t vportid, struct rte_mbuf *buf);
 static int send_to_vhost(uint32_t vportid, struct rte_mbuf *buf);
+static int send_to_memnic(uint32_t vportid, struct rte_mbuf *buf);
 static uint16_t receive_from_client(uint32_t client, struct rte_mbuf **bufs);
 static uint16_t receive_from_port(uint32_t vportid, struct rte_mbuf **bufs);
 static uint16_t receive_from_kni(uint32_t vportid, struct rte_mbuf **bufs);
 static uint16_t receive_from_veth(uint32_t vportid, struct rte_mbuf **bufs);
 static uint16_t receive_from_vhost(uint32_t vportid, struct rte_mbuf **bufs);
+static uint16_t receive_from_memnic(uint32_t vportid, struct rte_mbuf **bufs);
 static void flush_phy_port_cache(uint32_t vportid);
 static void flush_client_port_cache(uint32_t clientid);
 static void flush_vhost_dev_port_cache(uint32_t vportid);
+static void flush_memnic_port_cache(uint32_t vportid);
+static void flush_kni_port_cache(uint32_t vportid);
+static void flush_veth_port_cache(uint32_t vportid);
 
 /* vports details */
 static struct vport_info *vports;
 
-/* Drain period to flush packets out of the physical ports and caches */
-static uint64_t port_flush_period;
+/* Existing vports of each type */
+static struct vport_list active_vports[NUM_VPORT_TYPES];
+
+/* vport names, mapped through their hash table position to vport ids */
+static struct rte_hash *vport_names;
+static uint32_t vport_name_map[MAX_VPORTS];
+
+static struct rte_hash_parameters vport_names_params = {
+	.name = VPORT_NAME_HASH,
+	.entries = MAX_VPORTS,
+	.bucket_entries = VPORT_NAME_HASH_BUCKET_ENTRIES,
+	.key_len = VPORT_INFO_NAMESZ,
+	.hash_func = rte_jhash,
+	.hash_func_init_val = 0,
+	.socket_id = SOCKET_ID_ANY,
+};
+
+/*
+ * Transmit state of each physical port, only used by the core that polls
+ * the port.
+ */
+struct port_tx_state {
+	uint64_t flush_period;  /* cycles packets may wait to fill a burst */
+	uint64_t pending_tsc;   /* when packets were first seen queued, or 0 */
+	unsigned burst;         /* packets to send in one burst */
+	unsigned queued;        /* packets left queued by the last flush */
+} __rte_cache_aligned;
+
+static struct port_tx_state port_tx[MAX_PHYPORTS];
+static uint64_t cycles_per_us;
+/* Period and next due time for servicing each client's free/alloc rings */
+static uint64_t client_recycle_period;
+static uint64_t client_recycle_tsc[MAX_CLIENTS];
+/* Whether vhost ports can be added */
+static bool vhost_supported;
 
 /*
  * Given the queue name template, get the queue name
@@ -201,26 +285,64 @@ get_free_queue_name(unsigned id)
 	return get_queue_name(id, OVS_CLIENT_FREE_Q_NAME);
 }
 
+static inline const char *
+get_alloc_queue_name(unsigned id)
+{
+	return get_queue_name(id, OVS_CLIENT_ALLOC_Q_NAME);
+}
+
 static inline const char *
 get_port_tx_queue_name(unsigned id)
 {
 	return get_queue_name(id, OVS_PORT_TXQ_NAME);
 }
 
+static inline const char *
+get_kni_tx_queue_name(unsigned id)
+{
+	return get_queue_name(id, OVS_KNI_TXQ_NAME);
+}
+
+static inline const char *
+get_veth_tx_queue_name(unsigned id)
+{
+	return get_queue_name(id, OVS_VETH_TXQ_NAME);
+}
+
 /*
- * Attempts to create a ring or exit
+ * Attempts to create a ring of 'size' entries on 'socket'. Rings can't be
+ * freed, so the ring of a vport that was deleted is looked up and reused.
  */
 static inline struct rte_ring *
-queue_create(const char *ring_name, int flags)
+queue_create(const char *ring_name, unsigned size, unsigned socket, int flags)
 {
 	struct rte_ring *ring;
 
-	ring = rte_ring_create(ring_name, CLIENT_QUEUE_RINGSIZE, SOCKET0, flags);
+	ring = rte_ring_lookup(ring_name);
+	if (ring == NULL)
+		ring = rte_ring_create(ring_name, size, socket, flags);
 	if (ring == NULL)
-		rte_exit(EXIT_FAILURE, "Cannot create '%s' ring \n", ring_name);
+		RTE_LOG(ERR, APP, "Cannot create '%s' ring\n", ring_name);
 	return ring;
 }
 
+/*
+ * Free every mbuf left in 'ring'
+ */
+static void
+queue_drain(struct rte_ring *ring)
+{
+	void *objs[PKT_BURST_SIZE];
+	unsigned count, i;
+
+	if (ring == NULL)
+		return;
+
+	while ((count = rte_ring_dequeue_burst(ring, objs, PKT_BURST_SIZE)) > 0)
+		for (i = 0; i < count; i++)
+			rte_pktmbuf_free(objs[i]);
+}
+
 /*
  * Macro to print out packet contents. Wrapped in debug define so that the
  * data path is not effected when debug is disabled.
@@ -505,8 +627,9 @@ vhost_dequeue_burst(struct virtio_net *dev, struct rte_mbuf **pkts, unsigned cou
 		vq->used->ring[used_idx].len = 0;
 
 		/* Allocate an mbuf and populate the structure. */
-		mbuf = rte_pktmbuf_alloc(pktmbuf_pool);
+		mbuf = rte_pktmbuf_alloc(pktmbuf_pool_get(rte_socket_id()));
 		if (unlikely(mbuf == NULL)) {
+			stats_vswitch_nombuf_increment(INC_BY_1);
 			RTE_LOG(ERR, APP, "Failed to allocate memory for mbuf.\n");
 			return packet_success;
 		}
@@ -539,23 +662,39 @@ vhost_dequeue_burst(struct virtio_net *dev, struct rte_mbuf **pkts, unsigned cou
  * - configure number of rx and tx rings
  * - set up each rx ring, to pull from the main mbuf pool
  * - set up each tx ring
- * - start the port and report its status to stdout
+ *
+ * The port is only started, and its rx rings filled with mbufs, when its
+ * vport is added.
  */
 static int
 init_port(uint8_t port_num)
 {
 	/* for port configuration all features are off by default */
-	const struct rte_eth_conf port_conf = {
+	struct rte_eth_conf port_conf = {
 		.rxmode = {
 			.mq_mode = ETH_RSS
 		}
 	};
-	const uint16_t rx_rings = 1, tx_rings = num_clients;
-	struct rte_eth_link link = {0};
+	/* Only the core flushing the port's TX queue sends, on queue 0. Its
+	 * vport can be added and deleted at runtime, so this doesn't depend on
+	 * the vports configured at startup. */
+	const uint16_t rx_rings = 1, tx_rings = 1;
+	unsigned socket = port_socket_id(port_num);
 	uint16_t q = 0;
 	int retval = 0;
 
-	printf("Port %u init ... ", (unsigned)port_num);
+	if (port_is_jumbo(port_num)) {
+		port_conf.rxmode.jumbo_frame = 1;
+		port_conf.rxmode.max_rx_pkt_len = JUMBO_FRAME_MAX_SIZE;
+	}
+
+	/* Have the NIC hash with the key and fields the flow table uses */
+	if (use_rss_hash) {
+		port_conf.rx_adv_conf.rss_conf.rss_key = (uint8_t *)flow_rss_key;
+		port_conf.rx_adv_conf.rss_conf.rss_hf = FLOW_RSS_HF;
+	}
+
+	printf("Port %u init on socket %u ... ", (unsigned)port_num, socket);
 	fflush(stdout);
 
 	/* Standard DPDK port initialisation - config port, then set up
@@ -566,27 +705,41 @@ init_port(uint8_t port_num)
 
 	for (q = 0; q < rx_rings; q++) {
 		retval = rte_eth_rx_queue_setup(port_num, q, RTE_MP_RX_DESC_DEFAULT,
-				SOCKET0, &rx_conf_default, pktmbuf_pool);
+				socket, &rx_conf_default, port_pktmbuf_pool(port_num));
 		if (retval < 0) return retval;
 	}
 
 	for (q = 0; q < tx_rings; q ++) {
 		retval = rte_eth_tx_queue_setup(port_num, q, RTE_MP_TX_DESC_DEFAULT,
-				SOCKET0, &tx_conf_default);
+				socket, &tx_conf_default);
 		if (retval < 0)
 			return retval;
 	}
 
 	rte_eth_promiscuous_enable(port_num);
 
+	printf("done\n");
+
+	return 0;
+}
+
+/**
+ * Start an initialised port and report its status to stdout
+ */
+static int
+start_port(uint8_t port_num)
+{
+	struct rte_eth_link link = {0};
+	int retval = 0;
+
 	retval = rte_eth_dev_start(port_num);
 	if (retval < 0)
 		return retval;
 
-	printf( "done: ");
+	printf("Port %u started: ", (unsigned)port_num);
 
-	/* get link status */
-	rte_eth_link_get(port_num, &link);
+	/* get link status, without blocking the caller until it is up */
+	rte_eth_link_get_nowait(port_num, &link);
 	if (link.link_status) {
 		printf(" Link Up - speed %u Mbps - %s\n",
 			   (uint32_t) link.link_speed,
@@ -612,74 +765,373 @@ secure_rte_zmalloc(const char *type, size_t size, unsigned align)
 }
 
 /**
- * Set up the DPDK rings which will be used to pass packets, via
- * pointers, between the multi-process server and client processes.
- * Each client needs one RX queue.
+ * Allocate a per-core mbuf cache for each of 'num_vports' vports of one
+ * type, and a per-core list of those to flush in 'lists'. These are sized
+ * for the most vports of the type that can exist, as vports are added
+ * while other cores are using the caches.
  */
-static int
-init_shm_rings(void)
+static struct local_mbuf_cache **
+init_mbuf_caches(const char *type, unsigned num_vports,
+                 struct local_mbuf_cache_list **lists)
 {
-	unsigned i, clientid;
+	struct local_mbuf_cache **caches = NULL;
 	char cache_name[CACHE_NAME_LEN];
+	unsigned i;
 
-	client_mbuf_cache = secure_rte_zmalloc("per-core-client cache",
-			sizeof(*client_mbuf_cache) * rte_lcore_count(), 0);
+	rte_snprintf(cache_name, sizeof(cache_name), "per-core-%s cache", type);
+	caches = secure_rte_zmalloc(cache_name,
+			sizeof(*caches) * rte_lcore_count(), 0);
+
+	rte_snprintf(cache_name, sizeof(cache_name), "per-core-%s list", type);
+	*lists = secure_rte_zmalloc(cache_name,
+			sizeof(**lists) * rte_lcore_count(), 0);
 
 	for (i = 0; i < rte_lcore_count(); i++) {
-		rte_snprintf(cache_name, sizeof(cache_name), "core%u client cache", i);
-		client_mbuf_cache[i] = secure_rte_zmalloc(cache_name,
-				sizeof(**client_mbuf_cache) * num_clients, 0);
+		rte_snprintf(cache_name, sizeof(cache_name), "core%u %s cache",
+		             i, type);
+		caches[i] = secure_rte_zmalloc(cache_name,
+				sizeof(**caches) * num_vports, 0);
 	}
 
-	port_mbuf_cache = secure_rte_zmalloc("per-core-core cache",
-			sizeof(*port_mbuf_cache) * rte_lcore_count(), 0);
+	return caches;
+}
 
-	for (i = 0; i < rte_lcore_count(); i++) {
-		rte_snprintf(cache_name, sizeof(cache_name), "core%u port cache", i);
-		port_mbuf_cache[i] = secure_rte_zmalloc(cache_name,
-				sizeof(**port_mbuf_cache) * ports->num_phy_ports, 0);
+/*
+ * Client, KNI and vEth ports share mbufs with guests or the kernel, which
+ * can only address the shared mbuf pool. They can't be added if any
+ * physical port receives into another pool.
+ */
+static bool
+shared_pool_only(void)
+{
+	unsigned i;
+
+	for (i = 0; i < port_cfg.num_phy_ports; i++)
+		if (port_pktmbuf_pool(port_cfg.id[i]) != pktmbuf_pool)
+			return false;
+
+	return true;
+}
+
+/*
+ * Set up the DPDK rings which will be used to pass packets, via
+ * pointers, between the multi-process server and client process.
+ */
+static int
+client_create(unsigned clientid)
+{
+	struct vport_client *cl = &vports[clientid].client;
+
+	if (!shared_pool_only())
+		return -EOPNOTSUPP;
+
+	/* Create a "multi producer multi consumer" queue for each client */
+	cl->rx_q = queue_create(get_rx_queue_name(clientid),
+	                        CLIENT_QUEUE_RINGSIZE, switching_socket,
+	                        NO_FLAGS);
+	cl->tx_q = queue_create(get_tx_queue_name(clientid),
+	                        CLIENT_QUEUE_RINGSIZE, switching_socket,
+	                        NO_FLAGS);
+	/*
+	 * Guests can't touch the mempool directly, so mbufs are recycled
+	 * through these two rings. Only the client switching core
+	 * drains free_q and fills alloc_q.
+	 */
+	cl->free_q = queue_create(get_free_queue_name(clientid),
+	                        CLIENT_QUEUE_RINGSIZE, switching_socket,
+	                        RING_F_SC_DEQ);
+	cl->alloc_q = queue_create(get_alloc_queue_name(clientid),
+	                        CLIENT_ALLOC_QUEUE_RINGSIZE, switching_socket,
+	                        RING_F_SP_ENQ);
+	if (cl->rx_q == NULL || cl->tx_q == NULL ||
+	    cl->free_q == NULL || cl->alloc_q == NULL)
+		return -ENOMEM;
+
+	rte_snprintf(cl->ring_names.rx, sizeof(cl->ring_names.rx), "%s",
+			cl->rx_q->name);
+	rte_snprintf(cl->ring_names.tx, sizeof(cl->ring_names.tx), "%s",
+			cl->tx_q->name);
+	rte_snprintf(cl->ring_names.free, sizeof(cl->ring_names.free), "%s",
+			cl->free_q->name);
+	rte_snprintf(cl->ring_names.alloc, sizeof(cl->ring_names.alloc), "%s",
+			cl->alloc_q->name);
+
+	client_recycle_tsc[clientid] = 0;
+
+	return 0;
+}
+
+/*
+ * Start a physical port and create the ring that switching cores queue
+ * its packets on. Only ports given in the port mask can be added.
+ */
+static int
+phy_create(unsigned vportid)
+{
+	struct vport_phy *phy = &vports[vportid].phy;
+	uint8_t port_num = vportid - PHYPORT0;
+	unsigned i;
+
+	for (i = 0; i < port_cfg.num_phy_ports; i++)
+		if (port_cfg.id[i] == port_num)
+			break;
+	if (i == port_cfg.num_phy_ports)
+		return -ENODEV;
+
+	phy->index = port_num;
+	port_tx[port_num].pending_tsc = 0;
+	port_tx[port_num].burst = PKT_BURST_SIZE;
+	port_tx[port_num].queued = 0;
+	phy->tx_q = queue_create(get_port_tx_queue_name(port_num),
+	                         CLIENT_QUEUE_RINGSIZE,
+	                         port_socket_id(port_num), RING_F_SC_DEQ);
+	if (phy->tx_q == NULL)
+		return -ENOMEM;
+
+	if (start_port(port_num) < 0) {
+		RTE_LOG(ERR, APP, "Cannot start port %u\n", port_num);
+		return -EIO;
 	}
 
-	if (num_vhost) {
-		vhost_mbuf_cache = secure_rte_zmalloc("per-core-vhost cache",
-				sizeof(*vhost_mbuf_cache) * rte_lcore_count(), 0);
+	return 0;
+}
+
+/*
+ * Create the fifos of a KNI port, and the ring which switching cores
+ * queue its packets on.
+ *
+ * KNI and vEth fifos are single producer, so every switching core
+ * queues to these rings and only the client switching core moves
+ * packets on into the fifos.
+ */
+static int
+kni_create(unsigned vportid)
+{
+	struct vport_kni *kni = &vports[vportid].kni;
+
+	if (!shared_pool_only())
+		return -EOPNOTSUPP;
+
+	kni->index = vportid - KNI0;
+	if (kni_port_init(kni->index, &kni->fifo_names) < 0)
+		return -ENOMEM;
+
+	kni->tx_q = queue_create(get_kni_tx_queue_name(kni->index),
+	                         CLIENT_QUEUE_RINGSIZE, switching_socket,
+	                         RING_F_SC_DEQ);
+	if (kni->tx_q == NULL)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/*
+ * Create the KNI device of a vEth port, and the ring which switching cores
+ * queue its packets on.
+ */
+static int
+veth_create(unsigned vportid)
+{
+	struct vport_veth *veth = &vports[vportid].veth;
+
+	if (!shared_pool_only())
+		return -EOPNOTSUPP;
+
+	veth->index = vportid - VETH0;
+	if (veth_port_init(veth->index) < 0)
+		return -ENODEV;
+
+	veth->tx_q = queue_create(get_veth_tx_queue_name(veth->index),
+	                          CLIENT_QUEUE_RINGSIZE, switching_socket,
+	                          RING_F_SC_DEQ);
+	if (veth->tx_q == NULL)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/*
+ * Vhost ports have no resources of their own until a guest's virtio
+ * device, with the same name, comes up.
+ */
+static int
+vhost_create(unsigned vportid)
+{
+	if (!vhost_supported)
+		return -EOPNOTSUPP;
+
+	vports[vportid].vhost.index = vportid - VHOST0;
+	vports[vportid].vhost.dev = NULL;
+
+	return 0;
+}
+
+/*
+ * Reserve, or reuse, the shared memory of a MEMNIC port.
+ */
+static int
+memnic_create(unsigned vportid)
+{
+	struct vport_memnic *memnic = &vports[vportid].memnic;
+
+	memnic->index = vportid - MEMNIC0;
+	rte_snprintf(memnic->mz_name, sizeof(memnic->mz_name),
+	             OVS_MEMNIC_MZ_NAME, memnic->index);
+	memnic->area = memnic_port_init(memnic->index, memnic->mz_name,
+	                                switching_socket);
+	if (memnic->area == NULL)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/*
+ * Add 'vportid' to the end of 'list'. The id is written before the count
+ * that makes it visible to switching cores.
+ */
+void
+vport_list_add(struct vport_list *list, uint32_t vportid)
+{
+	list->ids[list->count] = vportid;
+	rte_wmb();
+	list->count++;
+}
+
+/*
+ * Remove 'vportid' from 'list' by moving the last id into its place.
+ * Switching cores may see the old list until they are next quiesced.
+ */
+void
+vport_list_del(struct vport_list *list, uint32_t vportid)
+{
+	unsigned i = 0;
 
-		for (i = 0; i < rte_lcore_count(); i++) {
-			rte_snprintf(cache_name, sizeof(cache_name), "core%u vhost cache", i);
-			vhost_mbuf_cache[i] = secure_rte_zmalloc(cache_name,
-					sizeof(**vhost_mbuf_cache) * num_vhost, 0);
+	for (i = 0; i < list->count; i++) {
+		if (list->ids[i] == vportid) {
+			list->ids[i] = list->ids[list->count - 1];
+			rte_wmb();
+			list->count--;
+			return;
 		}
 	}
+}
 
-	for (i = 0; i < num_clients; i++) {
-		clientid = CLIENT1 + i;
+/*
+ * Copy 'name' into the zero padded 'key' used to look it up in the vport
+ * name hash table. Returns false if 'name' is too long to be a vport name.
+ */
+static inline bool
+vport_name_key(const char *name, char key[VPORT_INFO_NAMESZ])
+{
+	size_t length = strnlen(name, VPORT_INFO_NAMESZ);
 
-		struct vport_client *cl = &vports[clientid].client;
-		RTE_LOG(INFO, APP, "Initialising Client %d\n", clientid);
-		/* Create a "multi producer multi consumer" queue for each client */
-		cl->rx_q = queue_create(get_rx_queue_name(clientid), NO_FLAGS);
-		rte_snprintf(cl->ring_names.rx, sizeof(cl->ring_names.rx), "%s",
-				cl->rx_q->name);
+	if (length == VPORT_INFO_NAMESZ)
+		return false;
 
-		cl->tx_q = queue_create(get_tx_queue_name(clientid), NO_FLAGS);
-		rte_snprintf(cl->ring_names.tx, sizeof(cl->ring_names.tx), "%s",
-				cl->tx_q->name);
+	memset(key, 0, VPORT_INFO_NAMESZ);
+	memcpy(key, name, length);
+	return true;
+}
 
-		cl->free_q = queue_create(get_free_queue_name(clientid), NO_FLAGS);
-		rte_snprintf(cl->ring_names.free, sizeof(cl->ring_names.free), "%s",
-				cl->free_q->name);
+/* Add the name of vport 'vportid' to the vport name hash table */
+static void
+vport_name_add(unsigned vportid)
+{
+	char key[VPORT_INFO_NAMESZ];
+	int32_t pos = 0;
+
+	vport_name_key(vports[vportid].name, key);
+	pos = rte_hash_add_key(vport_names, key);
+	if (pos < 0) {
+		RTE_LOG(WARNING, APP, "Cannot add name of vport %u to hash "
+		        "table\n", vportid);
+		return;
 	}
+	vport_name_map[pos] = vportid;
+}
 
-	for (i = 0; i < ports->num_phy_ports; i++) {
-		struct vport_phy *phy = &vports[PHYPORT0 + i].phy;
-		RTE_LOG(INFO, APP, "Initialising Port %d\n", i);
-		/* Create an RX queue for each ports */
-		phy->tx_q = queue_create(get_port_tx_queue_name(i), RING_F_SC_DEQ);
+/* Remove the name of vport 'vportid' from the vport name hash table */
+static void
+vport_name_del(unsigned vportid)
+{
+	char key[VPORT_INFO_NAMESZ];
+
+	vport_name_key(vports[vportid].name, key);
+	rte_hash_del_key(vport_names, key);
+}
+
+/*
+ * Wait until every other lcore has started a new pass of its main loop.
+ * After this, no core can still be using, or hold cached mbufs for, a
+ * vport that was disabled beforehand.
+ */
+void
+vport_quiesce(void)
+{
+	unsigned lcore;
+
+	RTE_LCORE_FOREACH(lcore) {
+		if (lcore != rte_lcore_id())
+			dev_removal_flag[lcore] = REQUEST_DEV_REMOVAL;
 	}
 
-	return 0;
+	/* The caller's own flag may be set by a vhost device removal, which
+	 * waits for this core in turn, so it is left for the main loop */
+	RTE_LCORE_FOREACH(lcore) {
+		if (lcore == rte_lcore_id())
+			continue;
+		while (dev_removal_flag[lcore] != ACK_DEV_REMOVAL)
+			rte_pause();
+	}
 }
 
+/*
+ * Free the mbufs the current core has cached for 'vportid', which has been
+ * disabled, so that they are not flushed to its queues later. Other cores
+ * have flushed their caches by the time vport_quiesce() returns.
+ */
+static void
+vport_cache_discard(unsigned vportid, enum vport_type type)
+{
+	struct local_mbuf_cache *cache = NULL;
+	unsigned lcore_id = lcore_map[rte_lcore_id()];
+	unsigned i = 0;
+
+	switch (type) {
+	case VPORT_TYPE_CLIENT:
+		cache = &client_mbuf_cache[lcore_id][vportid - CLIENT1];
+		break;
+	case VPORT_TYPE_PHY:
+		cache = &port_mbuf_cache[lcore_id][vportid - PHYPORT0];
+		break;
+	case VPORT_TYPE_KNI:
+		cache = &kni_mbuf_cache[lcore_id][vportid - KNI0];
+		break;
+	case VPORT_TYPE_VETH:
+		cache = &veth_mbuf_cache[lcore_id][vportid - VETH0];
+		break;
+	case VPORT_TYPE_VHOST:
+		if (vhost_mbuf_cache != NULL)
+			cache = &vhost_mbuf_cache[lcore_id][vportid - VHOST0];
+		break;
+	case VPORT_TYPE_MEMNIC:
+		cache = &memnic_mbuf_cache[lcore_id][vportid - MEMNIC0];
+		break;
+	default:
+		break;
+	}
+
+	if (cache == NULL || cache->count == 0)
+		return;
+
+	for (i = 0; i < cache->count; i++)
+		rte_pktmbuf_free(cache->cache[i]);
+	stats_vswitch_tx_drop_increment(cache->count);
+	stats_vport_drop_increment(vportid, STATS_DROP_INVALID_VPORT,
+	                           cache->count);
+	/* The cache stays on the flush list, where it is now skipped */
+	cache->count = 0;
+}
 
 void
 vport_init(void)
@@ -711,6 +1163,10 @@ vport_init(void)
 
 	ports->num_phy_ports = port_cfg.num_phy_ports;
 
+	vport_names = rte_hash_create(&vport_names_params);
+	if (vport_names == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot create vport name hash table\n");
+
 	/* vports setup */
 
 	/* vport 0 is for vswitchd */
@@ -718,43 +1174,11 @@ vport_init(void)
 	vport_disable(0);
 	vport_set_name(0, "vswitchd");
 
-	/* vport for client */
-	for (i = CLIENT1; i < num_clients; i++) {
-		vports[i].type = VPORT_TYPE_CLIENT;
-		vport_disable(i);
-		vport_set_name(i, "Client%u", i);
-	}
-	/* vport for kni */
-	for (i = 0; i < num_kni; i++) {
-		vports[KNI0 + i].type = VPORT_TYPE_KNI;
-		vports[KNI0 + i].kni.index = i;
-		vport_disable(KNI0 + i);
-		vport_set_name(KNI0 + i, "KNI%u", i);
-	}
-	/* vport for veth */
-	for (i = 0; i < num_veth; i++) {
-		vports[VETH0 + i].type = VPORT_TYPE_VETH;
-		vports[VETH0 + i].veth.index = i;
-		vport_disable(VETH0 + i);
-		vport_set_name(VETH0 + i, "vEth Port  %2u", i);
-	}
-	/* vport for vhost */
-	for (i = 0; i < num_vhost; i++) {
-		vports[VHOST0 + i].type = VPORT_TYPE_VHOST;
-		vports[VHOST0 + i].vhost.index = i;
-		vport_disable(VHOST0 + i);
-		vport_set_name(VHOST0 + i, "vHost Port %2u", i);
-	}
-
-	/* now initialise the physical ports we will use */
+	/*
+	 * All other vports are created when vswitchd adds them. Physical
+	 * ports are configured now, but only started when added.
+	 */
 	for (i = 0; i < ports->num_phy_ports; i++) {
-		unsigned int vportid = cfg_params[i].port_id;
-
-		vports[vportid].type = VPORT_TYPE_PHY;
-		vports[vportid].phy.index = port_cfg.id[i];
-		vport_disable(vportid);
-		vport_set_name(vportid, "Port       %2u", port_cfg.id[i]);
-
 		retval = init_port(port_cfg.id[i]);
 		if (retval != 0)
 			rte_exit(EXIT_FAILURE, "Cannot initialise port %u\n", i);
@@ -766,113 +1190,275 @@ vport_init(void)
 		if (rte_lcore_is_enabled(i))
 			lcore_map[i] = core_count++;
 
-	/* initialise the client queues/rings for inter process comms */
-	init_shm_rings();
-
-	/* initalise kni queues */
-	init_kni();
-
-	/* initalise veth queues */
-	init_veth();
+	client_mbuf_cache = init_mbuf_caches("client", MAX_CLIENTS,
+	                                     &client_cache_list);
+	port_mbuf_cache = init_mbuf_caches("port", MAX_PHYPORTS,
+	                                   &port_cache_list);
+	kni_mbuf_cache = init_mbuf_caches("kni", MAX_KNI_PORTS,
+	                                  &kni_cache_list);
+	veth_mbuf_cache = init_mbuf_caches("veth", MAX_VETH_PORTS,
+	                                   &veth_cache_list);
+	memnic_mbuf_cache = init_mbuf_caches("memnic", MAX_MEMNIC_PORTS,
+	                                     &memnic_cache_list);
+	/* vhost-cuse is only set up if vhost ports were requested */
+	vhost_supported = num_vhost != 0;
+	if (vhost_supported)
+		vhost_mbuf_cache = init_mbuf_caches("vhost", MAX_VHOST_PORTS,
+		                                    &vhost_cache_list);
 
 	/* initialize flush periods using CPU frequency */
-	port_flush_period = (rte_get_tsc_hz() + US_PER_S - 1) /
-	        US_PER_S * PORT_FLUSH_PERIOD_US;
+	cycles_per_us = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S;
+	for (i = 0; i < MAX_PHYPORTS; i++)
+		port_tx[i].flush_period = cycles_per_us * port_tx_flush_us[i];
+	client_recycle_period = (rte_get_tsc_hz() + US_PER_S - 1) /
+	        US_PER_S * CLIENT_RECYCLE_PERIOD_US;
 }
 
 /*
- * Enqueue a single packet to a client rx ring
+ * Create vport 'vportid' of the given 'type', allocating its rings, fifos
+ * and shared memory, and name it 'name'. 'vportid' must be free and within
+ * the range of 'type'.
+ *
+ * Returns 0 on success, else a negative errno value.
  */
-static inline int
-send_to_client(uint32_t client, struct rte_mbuf *buf)
+int
+vport_create(unsigned vportid, enum vport_type type, const char *name)
 {
-	int ret, i;
-	struct rte_mbuf *freebufs[PKT_BURST_SIZE];
-	struct vport_client *cl = NULL;
-	struct local_mbuf_cache *per_cl_cache = NULL;
-	unsigned lcore_id = lcore_map[rte_lcore_id()];
+	char vport_name[VPORT_INFO_NAMESZ];
+	int retval = 0;
 
-	per_cl_cache = &client_mbuf_cache[lcore_id][client - CLIENT1];
+	if (!vport_id_is_valid(vportid, type) || vport_exists(vportid))
+		return -EINVAL;
 
-	per_cl_cache->cache[per_cl_cache->count++] = buf;
+	if (name != NULL && *name != '\0')
+		rte_snprintf(vport_name, sizeof(vport_name), "%s", name);
+	else
+		rte_snprintf(vport_name, sizeof(vport_name), "vport%u", vportid);
+	if (vport_name_to_portid(vport_name) != UINT32_MAX)
+		return -EEXIST;
 
-	if (unlikely(per_cl_cache->count == LOCAL_MBUF_CACHE_SIZE))
-		flush_client_port_cache(client);
+	switch (type) {
+	case VPORT_TYPE_CLIENT:
+		retval = client_create(vportid);
+		break;
+	case VPORT_TYPE_PHY:
+		retval = phy_create(vportid);
+		break;
+	case VPORT_TYPE_KNI:
+		retval = kni_create(vportid);
+		break;
+	case VPORT_TYPE_VETH:
+		retval = veth_create(vportid);
+		break;
+	case VPORT_TYPE_VHOST:
+		retval = vhost_create(vportid);
+		break;
+	case VPORT_TYPE_MEMNIC:
+		retval = memnic_create(vportid);
+		break;
+	default:
+		return -EINVAL;
+	}
 
-	cl = &vports[client].client;
-	ret = rte_ring_mc_dequeue_burst(cl->free_q, (void *)freebufs, PKT_BURST_SIZE);
-	for (i = 0; i < ret; i++)
-		rte_pktmbuf_free(freebufs[i]);
+	if (retval < 0) {
+		RTE_LOG(ERR, APP, "Cannot create vport %u: %s\n", vportid,
+		        strerror(-retval));
+		return retval;
+	}
+
+	stats_vport_clear(vportid);
+	memcpy(vports[vportid].name, vport_name, sizeof(vport_name));
+	vport_name_add(vportid);
+	vports[vportid].enabled = true;
+
+	/* Publish the vport only once it is fully set up */
+	rte_wmb();
+	vports[vportid].type = type;
+	vport_list_add(&active_vports[type], vportid);
+	sched_vport_add(vportid);
 
 	return 0;
 }
 
 /*
- * Enqueue single packet to a port
+ * Delete vport 'vportid'. Its mbufs are returned to the pool, and its
+ * rings, fifos and shared memory are kept to be reused if it is added
+ * again, as DPDK can't free them.
+ *
+ * Returns 0 on success, else a negative errno value.
  */
-static inline int
-send_to_port(uint32_t vportid, struct rte_mbuf *buf)
+int
+vport_destroy(unsigned vportid)
 {
-	unsigned lcore_id = lcore_map[rte_lcore_id()];
-	struct local_mbuf_cache *per_port_cache =
-			&port_mbuf_cache[lcore_id][vportid - PHYPORT0];
+	struct vport_info *info = NULL;
+	enum vport_type type;
 
-	per_port_cache->cache[per_port_cache->count++] = buf;
+	if (!vport_is_enabled(vportid))
+		return -ENODEV;
 
-	if (unlikely(per_port_cache->count == LOCAL_MBUF_CACHE_SIZE))
-		flush_phy_port_cache(vportid);
+	info = &vports[vportid];
+	type = info->type;
+	vport_list_del(&active_vports[type], vportid);
+	sched_vport_del(vportid);
+	info->type = VPORT_TYPE_DISABLED;
+	info->enabled = false;
+	rte_wmb();
+
+	vport_quiesce();
+	vport_cache_discard(vportid, type);
+
+	switch (type) {
+	case VPORT_TYPE_CLIENT:
+		queue_drain(info->client.rx_q);
+		queue_drain(info->client.tx_q);
+		queue_drain(info->client.free_q);
+		queue_drain(info->client.alloc_q);
+		break;
+	case VPORT_TYPE_PHY:
+		rte_eth_dev_stop(info->phy.index);
+		queue_drain(info->phy.tx_q);
+		break;
+	case VPORT_TYPE_KNI:
+		queue_drain(info->kni.tx_q);
+		break;
+	case VPORT_TYPE_VETH:
+		queue_drain(info->veth.tx_q);
+		break;
+	case VPORT_TYPE_VHOST:
+		info->vhost.dev = NULL;
+		break;
+	default:
+		break;
+	}
+
+	vport_name_del(vportid);
+	memset(info->name, 0, sizeof(info->name));
 
 	return 0;
 }
 
 /*
- * Enqueue single packet to a KNI fifo
+ * Add 'buf' to 'cache', the current core's cache for 'vportid', queueing
+ * the cache on 'list' to be flushed if it isn't already.
  */
-static inline int
-send_to_kni(uint32_t vportid, struct rte_mbuf *buf)
+static inline void __attribute__((always_inline))
+mbuf_cache_add(struct local_mbuf_cache *cache,
+               struct local_mbuf_cache_list *list, uint32_t vportid,
+               struct rte_mbuf *buf)
 {
-	int i = 0;
-	int tx_count = 0;
-
-	i = vports[vportid].kni.index;
-	rte_spinlock_lock(&rte_kni_locks[i]);
-	tx_count = rte_kni_tx_burst(&rte_kni_list[i], &buf, 1);
-	rte_spinlock_unlock(&rte_kni_locks[i]);
+	if (unlikely(!cache->queued)) {
+		cache->queued = true;
+		list->vportids[list->count++] = vportid;
+	}
+	cache->cache[cache->count++] = buf;
+}
 
-	/* FIFO is full */
-	if (tx_count == 0) {
-		rte_pktmbuf_free(buf);
-		stats_vport_rx_drop_increment(vportid, INC_BY_1);
-		stats_vswitch_tx_drop_increment(INC_BY_1);
-	} else {
-		stats_vport_rx_increment(vportid, INC_BY_1);
+/* Total length of the packets in 'bufs' */
+static inline uint64_t __attribute__((always_inline))
+mbuf_bytes(struct rte_mbuf **bufs, unsigned count)
+{
+	uint64_t bytes = 0;
+	unsigned i = 0;
+
+	for (i = 0; i < count; i++)
+		bytes += rte_pktmbuf_pkt_len(bufs[i]);
+
+	return bytes;
+}
+
+/*
+ * Flush the current core's caches on 'list' with 'flush', where 'caches'
+ * holds the core's caches of the vports of one type starting at 'base'.
+ */
+static inline void __attribute__((always_inline))
+flush_cache_list(struct local_mbuf_cache *caches,
+                 struct local_mbuf_cache_list *list, uint32_t base,
+                 void (*flush)(uint32_t))
+{
+	struct local_mbuf_cache *cache = NULL;
+	uint32_t vportid = 0;
+	unsigned i = 0;
+
+	for (i = 0; i < list->count; i++) {
+		vportid = list->vportids[i];
+		cache = &caches[vportid - base];
+		cache->queued = false;
+		/* A full cache is flushed as soon as it fills */
+		if (cache->count)
+			flush(vportid);
 	}
+	list->count = 0;
+}
+
+/*
+ * Enqueue a single packet to a client rx ring
+ */
+static inline int
+send_to_client(uint32_t client, struct rte_mbuf *buf)
+{
+	struct local_mbuf_cache *per_cl_cache = NULL;
+	unsigned lcore_id = lcore_map[rte_lcore_id()];
+
+	per_cl_cache = &client_mbuf_cache[lcore_id][client - CLIENT1];
+
+	mbuf_cache_add(per_cl_cache, &client_cache_list[lcore_id], client, buf);
+
+	if (unlikely(per_cl_cache->count == LOCAL_MBUF_CACHE_SIZE))
+		flush_client_port_cache(client);
 
 	return 0;
 }
 
 /*
- * Enqueue single packet to a vETH fifo
+ * Enqueue single packet to a port
+ */
+static inline int
+send_to_port(uint32_t vportid, struct rte_mbuf *buf)
+{
+	unsigned lcore_id = lcore_map[rte_lcore_id()];
+	struct local_mbuf_cache *per_port_cache =
+			&port_mbuf_cache[lcore_id][vportid - PHYPORT0];
+
+	mbuf_cache_add(per_port_cache, &port_cache_list[lcore_id], vportid, buf);
+
+	if (unlikely(per_port_cache->count == LOCAL_MBUF_CACHE_SIZE))
+		flush_phy_port_cache(vportid);
+
+	return 0;
+}
+
+/*
+ * Enqueue single packet to a KNI port
+ */
+static inline int
+send_to_kni(uint32_t vportid, struct rte_mbuf *buf)
+{
+	unsigned lcore_id = lcore_map[rte_lcore_id()];
+	struct local_mbuf_cache *per_kni_cache =
+			&kni_mbuf_cache[lcore_id][vportid - KNI0];
+
+	mbuf_cache_add(per_kni_cache, &kni_cache_list[lcore_id], vportid, buf);
+
+	if (unlikely(per_kni_cache->count == LOCAL_MBUF_CACHE_SIZE))
+		flush_kni_port_cache(vportid);
+
+	return 0;
+}
+
+/*
+ * Enqueue single packet to a vETH port
  */
 static int
 send_to_veth(uint32_t vportid, struct rte_mbuf *buf)
 {
-	int i = 0;
-	int tx_count = 0;
+	unsigned lcore_id = lcore_map[rte_lcore_id()];
+	struct local_mbuf_cache *per_veth_cache =
+			&veth_mbuf_cache[lcore_id][vportid - VETH0];
 
-	i = vports[vportid].veth.index;
-	/* Spinlocks not needed here as veth only used for OFTest currently. This
-	 * may change in the future */
-	tx_count = rte_kni_tx_burst(rte_veth_list[i], &buf, 1);
+	mbuf_cache_add(per_veth_cache, &veth_cache_list[lcore_id], vportid, buf);
 
-	/* FIFO is full */
-	if (tx_count == 0) {
-		rte_pktmbuf_free(buf);
-		stats_vport_rx_drop_increment(vportid, INC_BY_1);
-		stats_vswitch_tx_drop_increment(INC_BY_1);
-	} else {
-		stats_vport_rx_increment(vportid, INC_BY_1);
-	}
+	if (unlikely(per_veth_cache->count == LOCAL_MBUF_CACHE_SIZE))
+		flush_veth_port_cache(vportid);
 
 	return 0;
 }
@@ -884,9 +1470,11 @@ static int
 send_to_vhost(uint32_t vportid, struct rte_mbuf *buf)
 {
 	struct local_mbuf_cache *per_vhost_cache = NULL;
+	unsigned lcore_id = lcore_map[rte_lcore_id()];
 
-	per_vhost_cache = &vhost_mbuf_cache[rte_lcore_id()][vportid - VHOST0];
-	per_vhost_cache->cache[per_vhost_cache->count++] = buf;
+	per_vhost_cache = &vhost_mbuf_cache[lcore_id][vportid - VHOST0];
+	mbuf_cache_add(per_vhost_cache, &vhost_cache_list[lcore_id], vportid,
+	               buf);
 
 	if (unlikely(per_vhost_cache->count == LOCAL_MBUF_CACHE_SIZE))
 		flush_vhost_dev_port_cache(vportid);
@@ -894,15 +1482,38 @@ send_to_vhost(uint32_t vportid, struct rte_mbuf *buf)
 	return 0;
 }
 
+/*
+ * Enqueue a single packet to a memnic port
+ */
+static int
+send_to_memnic(uint32_t vportid, struct rte_mbuf *buf)
+{
+	struct local_mbuf_cache *per_memnic_cache = NULL;
+	unsigned lcore_id = lcore_map[rte_lcore_id()];
+
+	per_memnic_cache = &memnic_mbuf_cache[lcore_id][vportid - MEMNIC0];
+	mbuf_cache_add(per_memnic_cache, &memnic_cache_list[lcore_id], vportid,
+	               buf);
+
+	if (unlikely(per_memnic_cache->count == LOCAL_MBUF_CACHE_SIZE))
+		flush_memnic_port_cache(vportid);
+
+	return 0;
+}
+
 int
 send_to_vport(uint32_t vportid, struct rte_mbuf *buf)
 {
 	if (unlikely(vportid >= MAX_VPORTS)) {
 		RTE_LOG(WARNING, APP,
 			"sending to invalid vport: %u\n", vportid);
+		stats_vswitch_tx_drop_increment(INC_BY_1);
 		goto drop;
 	}
 
+	if (unlikely(vportid == capture_out_vport))
+		capture_out_packet(vportid, buf);
+
 	switch (vports[vportid].type) {
 	case VPORT_TYPE_PHY:
 		return send_to_port(vportid, buf);
@@ -914,9 +1525,17 @@ send_to_vport(uint32_t vportid, struct rte_mbuf *buf)
 		return send_to_veth(vportid, buf);
 	case VPORT_TYPE_VHOST:
 		return send_to_vhost(vportid, buf);
+	case VPORT_TYPE_MEMNIC:
+		return send_to_memnic(vportid, buf);
 	case VPORT_TYPE_VSWITCHD:
 		/* DPDK vSwitch cannot handle it now, ignore */
 		break;
+	case VPORT_TYPE_DISABLED:
+		/* Flows can outlive a deleted vport */
+		stats_vswitch_tx_drop_increment(INC_BY_1);
+		stats_vport_drop_increment(vportid, STATS_DROP_INVALID_VPORT,
+		                           INC_BY_1);
+		break;
 	default:
 		RTE_LOG(WARNING, APP, "unknown vport %u type %u\n",
 			vportid, vports[vportid].type);
@@ -939,8 +1558,10 @@ receive_from_veth(uint32_t vportid, struct rte_mbuf **bufs)
 	i = vports[vportid].veth.index;
 	rx_count = rte_kni_rx_burst(rte_veth_list[i], bufs, PKT_BURST_SIZE);
 
-	if (likely(rx_count != 0))
+	if (likely(rx_count != 0)) {
 		stats_vport_tx_increment(vportid, rx_count);
+		stats_vport_tx_bytes_increment(vportid, mbuf_bytes(bufs, rx_count));
+	}
 
 	/* handle callbacks, i.e. ifconfig */
 	rte_kni_handle_request(rte_veth_list[i]);
@@ -960,12 +1581,94 @@ receive_from_kni(uint32_t vportid, struct rte_mbuf **bufs)
 	i = vports[vportid].kni.index;
 	rx_count = rte_kni_rx_burst(&rte_kni_list[i], bufs, PKT_BURST_SIZE);
 
-	if (likely(rx_count > 0))
+	if (likely(rx_count > 0)) {
 		stats_vport_tx_increment(vportid, rx_count);
+		stats_vport_tx_bytes_increment(vportid, mbuf_bytes(bufs, rx_count));
+	}
 
 	return rx_count;
 }
 
+/*
+ * Return mbufs released by a client to the mempool and top up its alloc
+ * ring. Guests can't use the mempool's per-lcore caches, so all mempool
+ * access for a client happens here, in bursts, on the one core that
+ * polls it. Buffers freed from free_q land in this core's cache and are
+ * handed straight back out by the refill.
+ *
+ * At most CLIENT_RECYCLE_MAX mbufs are moved each way per call, so a
+ * large backlog is worked off over several periods rather than stalling
+ * the switching loop.
+ */
+static inline void
+recycle_client_mbufs(uint32_t clientid)
+{
+	struct vport_client *cl = &vports[clientid].client;
+	struct rte_mbuf *bufs[PKT_BURST_SIZE];
+	unsigned backlog = 0, done = 0, count = 0, i = 0;
+
+	backlog = rte_ring_count(cl->free_q);
+	stats_vport_recycle_backlog_update(clientid, backlog);
+
+	while (done < backlog && done < CLIENT_RECYCLE_MAX) {
+		count = rte_ring_sc_dequeue_burst(cl->free_q, (void **)bufs,
+		                                  PKT_BURST_SIZE);
+		if (count == 0)
+			break;
+		for (i = 0; i < count; i++)
+			rte_pktmbuf_free(bufs[i]);
+		done += count;
+	}
+	if (done)
+		stats_vport_recycled_increment(clientid, done);
+
+	for (done = 0; done < CLIENT_RECYCLE_MAX; done += count) {
+		if (rte_ring_free_count(cl->alloc_q) < PKT_BURST_SIZE)
+			break;
+
+		for (count = 0; count < PKT_BURST_SIZE; count++) {
+			bufs[count] = rte_pktmbuf_alloc(pktmbuf_pool);
+			if (unlikely(bufs[count] == NULL)) {
+				stats_vswitch_nombuf_increment(INC_BY_1);
+				break;
+			}
+		}
+
+		if (count)
+			rte_ring_sp_enqueue_bulk(cl->alloc_q, (void **)bufs, count);
+		if (count < PKT_BURST_SIZE)
+			break;
+	}
+}
+
+/*
+ * Service the free and alloc rings of every client whose recycle period
+ * has elapsed.
+ *
+ * This must only be called by the client switching core, which is the
+ * sole consumer of each free_q and sole producer of each alloc_q.
+ */
+inline void
+recycle_clients(void)
+{
+	const struct vport_list *list = &active_vports[VPORT_TYPE_CLIENT];
+	uint32_t clientid = 0;
+	/* Not curr_tsc, which stops while the vswitchd core sleeps */
+	uint64_t now = rte_rdtsc();
+	unsigned i = 0;
+
+	for (i = 0; i < list->count; i++) {
+		clientid = list->ids[i];
+		/* A client being deleted may still be listed until it is
+		 * quiesced */
+		if (vports[clientid].type != VPORT_TYPE_CLIENT ||
+		    now < client_recycle_tsc[clientid])
+			continue;
+		client_recycle_tsc[clientid] = now + client_recycle_period;
+		recycle_client_mbufs(clientid);
+	}
+}
+
 /*
  * Receive burst of packets from client
  */
@@ -981,6 +1684,7 @@ receive_from_client(uint32_t client, struct rte_mbuf **bufs)
 
 	/* Update number of packets transmitted by client */
 	stats_vport_tx_increment(client, rx_count);
+	stats_vport_tx_bytes_increment(client, mbuf_bytes(bufs, rx_count));
 
 	return rx_count;
 }
@@ -998,13 +1702,36 @@ receive_from_port(uint32_t vportid, struct rte_mbuf **bufs)
 			bufs, PKT_BURST_SIZE);
 
 	/* Now process the NIC packets read */
-	if (likely(rx_count > 0))
+	if (likely(rx_count > 0)) {
 		stats_vport_rx_increment(vportid, rx_count);
+		stats_vport_rx_bytes_increment(vportid, mbuf_bytes(bufs, rx_count));
+	}
 
 	return rx_count;
 }
 
 
+/*
+ * Receive burst of packets from memnic port. Only the client switching
+ * core polls memnic ports, so the ring has a single consumer.
+ */
+static inline uint16_t
+receive_from_memnic(uint32_t vportid, struct rte_mbuf **bufs)
+{
+	uint16_t rx_count = 0;
+
+	rx_count = memnic_rx_burst(vportid - MEMNIC0,
+	                           pktmbuf_pool_get(rte_socket_id()),
+	                           bufs, PKT_BURST_SIZE);
+
+	if (likely(rx_count != 0)) {
+		stats_vport_tx_increment(vportid, rx_count);
+		stats_vport_tx_bytes_increment(vportid, mbuf_bytes(bufs, rx_count));
+	}
+
+	return rx_count;
+}
+
 /*
  * Receive burst of packets from vhost port.
  */
@@ -1023,6 +1750,7 @@ receive_from_vhost(uint32_t vportid, struct rte_mbuf **bufs)
 
 	/* Update number of packets transmitted by vHost device */
 	stats_vport_tx_increment(vportid, rx_count);
+	stats_vport_tx_bytes_increment(vportid, mbuf_bytes(bufs, rx_count));
 
 	return rx_count;
 }
@@ -1037,6 +1765,9 @@ receive_from_vport(uint32_t vportid, struct rte_mbuf **bufs)
 	}
 
 	switch (vports[vportid].type) {
+	case VPORT_TYPE_DISABLED:
+		/* Not created yet, or deleted */
+		return 0;
 	case VPORT_TYPE_PHY:
 		return receive_from_port(vportid, bufs);
 	case VPORT_TYPE_CLIENT:
@@ -1047,6 +1778,8 @@ receive_from_vport(uint32_t vportid, struct rte_mbuf **bufs)
 		return receive_from_veth(vportid, bufs);
 	case VPORT_TYPE_VHOST:
 		return receive_from_vhost(vportid, bufs);
+	case VPORT_TYPE_MEMNIC:
+		return receive_from_memnic(vportid, bufs);
 	default:
 		RTE_LOG(WARNING, APP,
 			"receiving from unknown vport %u type %u\n",
@@ -1057,45 +1790,84 @@ receive_from_vport(uint32_t vportid, struct rte_mbuf **bufs)
 }
 
 /*
- * Flush packets scheduled for transmit on ports
+ * Flush packets scheduled for transmit on ports.
+ *
+ * Packets are held until a full burst is queued, the first of them has
+ * waited for the port's flush period, or nothing was queued for the port
+ * since the last flush, so no more are likely to follow soon. The burst
+ * doubles while a full burst is still queued after sending one, and halves
+ * when less than half a burst was queued, between PKT_BURST_SIZE and
+ * PORT_TX_BURST_MAX.
  */
 inline void
 flush_nic_tx_ring(unsigned vportid)
 {
-	struct rte_mbuf *pkts[PKT_BURST_SIZE];
+	struct rte_mbuf *pkts[PORT_TX_BURST_MAX];
 	struct vport_phy *phy = &vports[vportid].phy;
-	static uint64_t prev_tsc[MAX_PHYPORTS] = { 0 };
+	struct port_tx_state *tx = NULL;
 	uint8_t portid = phy->index;
-	uint64_t diff_tsc, cur_tsc = rte_rdtsc();
-	unsigned tx_count, pkts_sent, i;
+	uint64_t cur_tsc = 0, bytes = 0;
+	unsigned queued, tx_count, pkts_sent, i;
+	bool idle = false;
 
-	tx_count = rte_ring_count(phy->tx_q);
+	/* The port is stopped until its vport is added */
+	if (unlikely(vports[vportid].type != VPORT_TYPE_PHY))
+		return;
 
-	/* If queue idles with less than PKT_BURST packets, drain it*/
-	if (tx_count < PKT_BURST_SIZE) {
-		diff_tsc = cur_tsc - prev_tsc[portid];
-		if (unlikely(diff_tsc < port_flush_period))
-			return;
+	tx = &port_tx[vportid - PHYPORT0];
+	queued = rte_ring_count(phy->tx_q);
+	if (queued == 0) {
+		tx->pending_tsc = 0;
+		tx->queued = 0;
+		return;
 	}
 
-	/* maximum number of packets that can be handles is PKT_BURST_SIZE */
-	if (tx_count > PKT_BURST_SIZE)
-		tx_count = PKT_BURST_SIZE;
+	/* Whichever cores queue the port's packets, none have since */
+	idle = queued <= tx->queued;
+	tx->queued = queued;
+
+	cur_tsc = rte_rdtsc();
+	if (tx->pending_tsc == 0)
+		tx->pending_tsc = cur_tsc;
 
+	if (queued < tx->burst && !idle &&
+	    cur_tsc - tx->pending_tsc < tx->flush_period)
+		return;
+
+	tx_count = RTE_MIN(queued, tx->burst);
 	if (unlikely(rte_ring_dequeue_bulk(phy->tx_q, (void **)pkts, tx_count) != 0))
 		return;
+	tx->queued = queued - tx_count;
+
+	if (latency_sample_rate)
+		stats_vport_latency_sample(vportid, pkts, tx_count);
 
+	bytes = mbuf_bytes(pkts, tx_count);
 	pkts_sent = rte_eth_tx_burst(portid, 0, pkts, tx_count);
 
-	prev_tsc[portid] = cur_tsc;
+	/* The wait of the first packet queued, which is the longest */
+	stats_vport_tx_latency_record(vportid,
+	        (cur_tsc - tx->pending_tsc) / cycles_per_us);
+	/* Packets left queued are timed from now */
+	tx->pending_tsc = queued > tx_count ? cur_tsc : 0;
+
+	if (queued - tx_count >= tx->burst && tx->burst < PORT_TX_BURST_MAX)
+		tx->burst *= 2;
+	else if (queued < tx->burst / 2 && tx->burst > PKT_BURST_SIZE)
+		tx->burst /= 2;
 
 	if (unlikely(pkts_sent < tx_count)) {
-		for (i = pkts_sent; i < tx_count; i++)
+		for (i = pkts_sent; i < tx_count; i++) {
+			bytes -= rte_pktmbuf_pkt_len(pkts[i]);
 			rte_pktmbuf_free(pkts[i]);
+		}
 
 		stats_vport_tx_drop_increment(vportid, tx_count - pkts_sent);
+		stats_vport_drop_increment(vportid, STATS_DROP_RING_FULL,
+		                           tx_count - pkts_sent);
 	}
 	stats_vport_tx_increment(vportid, pkts_sent);
+	stats_vport_tx_bytes_increment(vportid, bytes);
 }
 
 /*
@@ -1108,18 +1880,11 @@ flush_nic_tx_ring(unsigned vportid)
 inline void
 flush_ports(void)
 {
-	uint32_t portid = 0;
 	unsigned lcore_id = lcore_map[rte_lcore_id()];
-	struct local_mbuf_cache *per_port_cache = NULL;
-
-	/* iterate over all port caches for this core */
-	for (portid = 0; portid < ports->num_phy_ports; portid++) {
-		per_port_cache = &port_mbuf_cache[lcore_id][portid];
-		if (per_port_cache->count)
-			flush_phy_port_cache(portid + PHYPORT0);
-	}
 
-	return;
+	/* iterate over the port caches this core has used */
+	flush_cache_list(port_mbuf_cache[lcore_id], &port_cache_list[lcore_id],
+	                 PHYPORT0, flush_phy_port_cache);
 }
 
 /*
@@ -1150,7 +1915,8 @@ flush_phy_port_cache(uint32_t vportid)
 
 		stats_vswitch_tx_drop_increment(dropped);
 		stats_vport_tx_drop_increment(vportid, dropped);
-		/* TODO: stats_vport_overrun_increment */
+		stats_vport_overrun_increment(vportid, dropped);
+		stats_vport_drop_increment(vportid, STATS_DROP_RING_FULL, dropped);
 	}
 
 	per_port_cache->count = 0;
@@ -1166,16 +1932,12 @@ flush_phy_port_cache(uint32_t vportid)
 inline void
 flush_clients(void)
 {
-	uint32_t clientid = 0;
 	unsigned lcore_id = lcore_map[rte_lcore_id()];
-	struct local_mbuf_cache *per_client_cache = NULL;
 
-	/* iterate over all client caches for this core */
-	for (clientid = 0; clientid < num_clients; clientid++) {
-		per_client_cache = &client_mbuf_cache[lcore_id][clientid];
-		if (per_client_cache->count)
-			flush_client_port_cache(clientid + CLIENT1);
-	}
+	/* iterate over the client caches this core has used */
+	flush_cache_list(client_mbuf_cache[lcore_id],
+	                 &client_cache_list[lcore_id], CLIENT1,
+	                 flush_client_port_cache);
 }
 
 /*
@@ -1190,25 +1952,36 @@ flush_client_port_cache(uint32_t clientid)
 	struct local_mbuf_cache *per_cl_cache = NULL;
 	unsigned tx_count = 0, i = 0;
 	unsigned lcore_id = lcore_map[rte_lcore_id()];
+	uint64_t bytes = 0;
 
 	per_cl_cache = &client_mbuf_cache[lcore_id][clientid - CLIENT1];
 
 	cl = &vports[clientid].client;
 
+	/* the client owns the mbufs once they are enqueued */
+	if (latency_sample_rate)
+		stats_vport_latency_sample(clientid, per_cl_cache->cache,
+		                           per_cl_cache->count);
+
+	bytes = mbuf_bytes(per_cl_cache->cache, per_cl_cache->count);
 	tx_count = rte_ring_mp_enqueue_burst(cl->rx_q,
 				(void **)per_cl_cache->cache, per_cl_cache->count);
 
 	if (unlikely(tx_count < per_cl_cache->count)) {
 		uint8_t dropped = per_cl_cache->count - tx_count;
-		for (i = tx_count; i < per_cl_cache->count; i++)
+		for (i = tx_count; i < per_cl_cache->count; i++) {
+			bytes -= rte_pktmbuf_pkt_len(per_cl_cache->cache[i]);
 			rte_pktmbuf_free(per_cl_cache->cache[i]);
+		}
 
 		stats_vswitch_tx_drop_increment(dropped);
 		stats_vport_rx_drop_increment(clientid, dropped);
-		/* TODO: stats_vport_overrun_increment */
+		stats_vport_overrun_increment(clientid, dropped);
+		stats_vport_drop_increment(clientid, STATS_DROP_RING_FULL, dropped);
 	}
 
 	stats_vport_rx_increment(clientid, tx_count);
+	stats_vport_rx_bytes_increment(clientid, bytes);
 
 	per_cl_cache->count = 0;
 }
@@ -1223,20 +1996,14 @@ flush_client_port_cache(uint32_t clientid)
 void
 flush_vhost_devs(void)
 {
-	uint32_t vhostid = 0;
-	uint8_t lcore_id = rte_lcore_id();
-	struct local_mbuf_cache *per_vhost_cache = NULL;
+	unsigned lcore_id = lcore_map[rte_lcore_id()];
 
-	/* iterate over all vhost caches for this core */
-	for (vhostid = 0; vhostid < num_vhost; vhostid++) {
-		per_vhost_cache = &vhost_mbuf_cache[lcore_id][vhostid];
-		/* only flush when we have exceeded our deadline */
-		if (per_vhost_cache->count) {
-			flush_vhost_dev_port_cache(vhostid + VHOST0);
-		}
-	}
+	if (!vhost_supported)
+		return;
 
-	return;
+	/* iterate over the vhost caches this core has used */
+	flush_cache_list(vhost_mbuf_cache[lcore_id], &vhost_cache_list[lcore_id],
+	                 VHOST0, flush_vhost_dev_port_cache);
 }
 
 /*
@@ -1250,14 +2017,21 @@ flush_vhost_dev_port_cache(uint32_t vportid)
 	int tx_count;
 	unsigned  i;
 
-	per_vhost_cache = &vhost_mbuf_cache[rte_lcore_id()][vportid - VHOST0];
+	per_vhost_cache =
+		&vhost_mbuf_cache[lcore_map[rte_lcore_id()]][vportid - VHOST0];
 
 	dev = vports[vportid].vhost.dev;
 
 	if(unlikely(dev == NULL)){
 		stats_vswitch_tx_drop_increment(per_vhost_cache->count);
 		stats_vport_rx_drop_increment(vportid, per_vhost_cache->count);
+		stats_vport_drop_increment(vportid, STATS_DROP_INVALID_VPORT,
+		                           per_vhost_cache->count);
 	} else {
+		if (latency_sample_rate)
+			stats_vport_latency_sample(vportid, per_vhost_cache->cache,
+			                           per_vhost_cache->count);
+
 		tx_count = vhost_enqueue_burst(dev,
 				(struct rte_mbuf**)per_vhost_cache->cache, per_vhost_cache->count);
 
@@ -1265,8 +2039,12 @@ flush_vhost_dev_port_cache(uint32_t vportid)
 			uint8_t dropped = per_vhost_cache->count - tx_count;
 			stats_vswitch_tx_drop_increment(dropped);
 			stats_vport_rx_drop_increment(vportid, dropped);
+			stats_vport_drop_increment(vportid, STATS_DROP_VHOST_FULL,
+			                           dropped);
 		}
 		stats_vport_rx_increment(vportid, tx_count);
+		stats_vport_rx_bytes_increment(vportid,
+		        mbuf_bytes(per_vhost_cache->cache, tx_count));
 	}
 	for (i = 0; i < per_vhost_cache->count; i++)
 		rte_pktmbuf_free_seg(per_vhost_cache->cache[i]);
@@ -1274,6 +2052,204 @@ flush_vhost_dev_port_cache(uint32_t vportid)
 	per_vhost_cache->count = 0;
 }
 
+/*
+ * This function must be called periodically to ensure that no mbufs get
+ * stuck in the memnic mbuf caches.
+ *
+ * This must be called by each core that sends to memnic ports.
+ */
+void
+flush_memnic_ports(void)
+{
+	unsigned lcore_id = lcore_map[rte_lcore_id()];
+
+	flush_cache_list(memnic_mbuf_cache[lcore_id],
+	                 &memnic_cache_list[lcore_id], MEMNIC0,
+	                 flush_memnic_port_cache);
+}
+
+/*
+ * Copies the mbufs in a memnic port's cache for the current lcore to the
+ * guest and frees them.
+ */
+static inline void
+flush_memnic_port_cache(uint32_t vportid)
+{
+	struct local_mbuf_cache *per_memnic_cache = NULL;
+	unsigned lcore_id = lcore_map[rte_lcore_id()];
+	unsigned tx_count = 0, too_big = 0, ring_full = 0, i = 0;
+	uint64_t bytes = 0;
+
+	per_memnic_cache = &memnic_mbuf_cache[lcore_id][vportid - MEMNIC0];
+
+	if (latency_sample_rate)
+		stats_vport_latency_sample(vportid, per_memnic_cache->cache,
+		                           per_memnic_cache->count);
+
+	tx_count = memnic_tx_burst(vportid - MEMNIC0, per_memnic_cache->cache,
+	                           per_memnic_cache->count, &bytes, &too_big);
+
+	if (unlikely(tx_count < per_memnic_cache->count)) {
+		unsigned dropped = per_memnic_cache->count - tx_count;
+
+		ring_full = dropped - too_big;
+		stats_vswitch_tx_drop_increment(dropped);
+		stats_vport_rx_drop_increment(vportid, dropped);
+		if (ring_full)
+			stats_vport_drop_increment(vportid, STATS_DROP_RING_FULL,
+			                           ring_full);
+		if (too_big)
+			stats_vport_drop_increment(vportid, STATS_DROP_TOO_BIG,
+			                           too_big);
+	}
+	stats_vport_rx_increment(vportid, tx_count);
+	stats_vport_rx_bytes_increment(vportid, bytes);
+
+	for (i = 0; i < per_memnic_cache->count; i++)
+		rte_pktmbuf_free(per_memnic_cache->cache[i]);
+
+	per_memnic_cache->count = 0;
+}
+
+/*
+ * This function must be called periodically to ensure that no mbufs get
+ * stuck in the KNI and vEth mbuf caches.
+ *
+ * This must be called by each core that calls send_to_kni() or
+ * send_to_veth()
+ */
+void
+flush_kni_ports(void)
+{
+	unsigned lcore_id = lcore_map[rte_lcore_id()];
+
+	flush_cache_list(kni_mbuf_cache[lcore_id], &kni_cache_list[lcore_id],
+	                 KNI0, flush_kni_port_cache);
+	flush_cache_list(veth_mbuf_cache[lcore_id], &veth_cache_list[lcore_id],
+	                 VETH0, flush_veth_port_cache);
+}
+
+/*
+ * Move the mbufs in 'cache' to a KNI or vEth TX pre-queue ring, dropping
+ * whatever doesn't fit.
+ */
+static inline void
+flush_cache_to_kni_ring(uint32_t vportid, struct local_mbuf_cache *cache,
+                        struct rte_ring *tx_q)
+{
+	unsigned tx_count = 0, i = 0;
+
+	tx_count = rte_ring_mp_enqueue_burst(tx_q, (void **)cache->cache,
+	                                     cache->count);
+
+	if (unlikely(tx_count < cache->count)) {
+		unsigned dropped = cache->count - tx_count;
+		for (i = tx_count; i < cache->count; i++)
+			rte_pktmbuf_free(cache->cache[i]);
+
+		stats_vswitch_tx_drop_increment(dropped);
+		stats_vport_rx_drop_increment(vportid, dropped);
+		stats_vport_overrun_increment(vportid, dropped);
+		stats_vport_drop_increment(vportid, STATS_DROP_RING_FULL, dropped);
+	}
+
+	cache->count = 0;
+}
+
+/*
+ * Flush any mbufs in a KNI port's cache to its TX pre-queue ring
+ */
+static inline void
+flush_kni_port_cache(uint32_t vportid)
+{
+	unsigned lcore_id = lcore_map[rte_lcore_id()];
+
+	flush_cache_to_kni_ring(vportid,
+	                        &kni_mbuf_cache[lcore_id][vportid - KNI0],
+	                        vports[vportid].kni.tx_q);
+}
+
+/*
+ * Flush any mbufs in a vEth port's cache to its TX pre-queue ring
+ */
+static inline void
+flush_veth_port_cache(uint32_t vportid)
+{
+	unsigned lcore_id = lcore_map[rte_lcore_id()];
+
+	flush_cache_to_kni_ring(vportid,
+	                        &veth_mbuf_cache[lcore_id][vportid - VETH0],
+	                        vports[vportid].veth.tx_q);
+}
+
+/*
+ * Pass one burst from a TX pre-queue ring to its KNI fifo. The fifo has a
+ * single producer, so only one core may call this for a given port.
+ */
+static inline void
+flush_kni_fifo(uint32_t vportid, struct rte_kni *kni, struct rte_ring *tx_q)
+{
+	struct rte_mbuf *pkts[PKT_BURST_SIZE];
+	unsigned rx_count, tx_count, i;
+	uint64_t bytes = 0;
+
+	rx_count = rte_ring_sc_dequeue_burst(tx_q, (void **)pkts, PKT_BURST_SIZE);
+	if (rx_count == 0)
+		return;
+
+	if (latency_sample_rate)
+		stats_vport_latency_sample(vportid, pkts, rx_count);
+
+	bytes = mbuf_bytes(pkts, rx_count);
+	tx_count = rte_kni_tx_burst(kni, pkts, rx_count);
+
+	/* FIFO is full */
+	if (unlikely(tx_count < rx_count)) {
+		unsigned dropped = rx_count - tx_count;
+		for (i = tx_count; i < rx_count; i++) {
+			bytes -= rte_pktmbuf_pkt_len(pkts[i]);
+			rte_pktmbuf_free(pkts[i]);
+		}
+
+		stats_vswitch_tx_drop_increment(dropped);
+		stats_vport_rx_drop_increment(vportid, dropped);
+		stats_vport_drop_increment(vportid, STATS_DROP_RING_FULL, dropped);
+	}
+	stats_vport_rx_increment(vportid, tx_count);
+	stats_vport_rx_bytes_increment(vportid, bytes);
+}
+
+/*
+ * Drain the KNI and vEth TX pre-queue rings into their fifos.
+ *
+ * Only the client switching core, which also polls these ports, may call
+ * this.
+ */
+void
+flush_kni_tx_rings(void)
+{
+	const struct vport_list *list = NULL;
+	uint32_t vportid = 0;
+	unsigned i = 0;
+
+	/* A vport being deleted may still be listed until it is quiesced */
+	list = &active_vports[VPORT_TYPE_KNI];
+	for (i = 0; i < list->count; i++) {
+		vportid = list->ids[i];
+		if (vports[vportid].type == VPORT_TYPE_KNI)
+			flush_kni_fifo(vportid, &rte_kni_list[vportid - KNI0],
+			               vports[vportid].kni.tx_q);
+	}
+
+	list = &active_vports[VPORT_TYPE_VETH];
+	for (i = 0; i < list->count; i++) {
+		vportid = list->ids[i];
+		if (vports[vportid].type == VPORT_TYPE_VETH)
+			flush_kni_fifo(vportid, rte_veth_list[vportid - VETH0],
+			               vports[vportid].veth.tx_q);
+	}
+}
+
 /* Helper functions for vport management */
 
 /* Get 'vportid' for a vport with the given 'name'.
@@ -1285,62 +2261,78 @@ flush_vhost_dev_port_cache(uint32_t vportid)
 uint32_t
 vport_name_to_portid(const char *name)
 {
-	int i = 0;
+	char key[VPORT_INFO_NAMESZ];
+	int32_t pos = 0;
 
-	for (i = 0; i < MAX_VPORTS; i++) {
-		if (vport_exists(i) &&
-		    !strncmp(vports[i].name, name, MAX_VPORT_NAME_SIZE))
-			return i;
-	}
+	if (!vport_name_key(name, key))
+		return UINT32_MAX;
+
+	pos = rte_hash_lookup(vport_names, key);
+	if (pos < 0)
+		return UINT32_MAX;  /* Name not found */
 
-	return UINT32_MAX;  /* Name not found */
+	return vport_name_map[pos];
 }
 
-/* Get an array index for next available vport of given 'type'.
+/* Get the range ['start', 'end') of vport ids that vports of 'type' use.
  *
- * Returns an index if any free devices available, else 'MAX_VPORTS'.
+ * Returns false if vports of 'type' can't be created.
  */
-uint32_t
-vport_next_available_index(enum vport_type type)
+static bool
+vport_type_range(enum vport_type type, uint32_t *start, uint32_t *end)
 {
-	uint32_t start_idx = 0, end_idx = 0, i = 0;
-
 	switch (type) {
-	/* TODO - remove this when bridges no longer need it */
-	case VPORT_TYPE_VSWITCHD:
-	case VPORT_TYPE_BRIDGE:
-		/* TODO - we currently only support one bridge, which is
-		 * hardcoded to port 0. */
-		return CLIENT0;
 	case VPORT_TYPE_CLIENT:
-		start_idx = CLIENT1;
-		/* Currently, num_clients includes client 0, thus client 0
-		 * must be subtracted from the range */
-		end_idx = CLIENT1 + (num_clients - 1);
+		*start = CLIENT1;
+		*end = MAX_CLIENTS;
 		break;
 	case VPORT_TYPE_PHY:
-		start_idx = PHYPORT0;
-		end_idx = KNI0;
+		*start = PHYPORT0;
+		*end = PHYPORT0 + MAX_PHYPORTS;
 		break;
 	case VPORT_TYPE_KNI:
-		start_idx = KNI0;
-		end_idx = KNI0 + num_kni;
+		*start = KNI0;
+		*end = KNI0 + MAX_KNI_PORTS;
 		break;
 	case VPORT_TYPE_VETH:
-		start_idx = VETH0;
-		end_idx = VETH0 + num_veth;
+		*start = VETH0;
+		*end = VETH0 + MAX_VETH_PORTS;
 		break;
 	case VPORT_TYPE_VHOST:
-		start_idx = VHOST0;
-		end_idx = VHOST0 + num_vhost;
+		*start = VHOST0;
+		*end = VHOST0 + MAX_VHOST_PORTS;
+		break;
+	case VPORT_TYPE_MEMNIC:
+		*start = MEMNIC0;
+		*end = MEMNIC0 + MAX_MEMNIC_PORTS;
 		break;
-	case VPORT_TYPE_DISABLED:
 	default:
-		return MAX_VPORTS;
+		return false;
 	}
 
+	return true;
+}
+
+/* Get an array index for next available vport of given 'type'.
+ *
+ * Returns an index if any free devices available, else 'MAX_VPORTS'.
+ */
+uint32_t
+vport_next_available_index(enum vport_type type)
+{
+	uint32_t start_idx = 0, end_idx = 0, i = 0;
+
+	/* TODO - remove this when bridges no longer need it */
+	/* TODO - we currently only support one bridge, which is
+	 * hardcoded to port 0. */
+	if (type == VPORT_TYPE_VSWITCHD || type == VPORT_TYPE_BRIDGE)
+		return CLIENT0;
+
+	if (!vport_type_range(type, &start_idx, &end_idx))
+		return MAX_VPORTS;
+
 	for (i = start_idx; i < end_idx; i++) {
-		if (vport_exists(i) && !vport_is_enabled(i))
+		if (!vport_exists(i))
 			return i;
 	}
 
@@ -1351,28 +2343,26 @@ vport_next_available_index(enum vport_type type)
 inline bool
 vport_id_is_valid(unsigned vportid, enum vport_type type)
 {
+	uint32_t start_idx = 0, end_idx = 0;
+
 	/* Special case for bridges, until a special bridge range of ports is
 	 * assigned */
-	if (vports[vportid].type == VPORT_TYPE_VSWITCHD &&
-		type == VPORT_TYPE_BRIDGE)
+	if (vportid == CLIENT0 && type == VPORT_TYPE_BRIDGE)
 		return true;
 
-	/* We assume that type stored in the 'vports' array is constant, and
-	 * therefore indicative of the type of vport that can be stored at that
-	 * index. */
-	if(vportid < MAX_VPORTS)
-		return vports[vportid].type == type;
+	/* Each type of vport has a fixed range of ids */
+	if (!vport_type_range(type, &start_idx, &end_idx))
+		return false;
 
-	return false;
+	return vportid >= start_idx && vportid < end_idx;
 }
 
 /* Check if vport indicated by 'vportid' currently exists in the datapath. */
 inline bool
 vport_exists(unsigned vportid)
 {
-	/* We can assume that 'vports[vportid].type' will be 0 for unitialised
-	 * ports, owing to a prior memset on the 'vports' struct. This will need
-	 * to change when ports are dynamically added/removed in the datapath. */
+	/* 'vports[vportid].type' is only set once a vport has been created,
+	 * and is cleared again when it is destroyed. */
 	return (vportid < MAX_VPORTS && vports[vportid].type != VPORT_TYPE_DISABLED);
 }
 
@@ -1385,9 +2375,11 @@ vport_set_name(unsigned vportid, const char *fmt, ...)
 	va_list ap;
 
 	if(vport_exists(vportid)) {
+		vport_name_del(vportid);
 		va_start(ap, fmt);
 		vsnprintf(vports[vportid].name, VPORT_INFO_NAMESZ, fmt, ap);
 		va_end(ap);
+		vport_name_add(vportid);
 	}
 }
 
@@ -1440,12 +2432,13 @@ vport_is_enabled(unsigned vportid)
 inline int
 vport_vhost_up(struct virtio_net *dev)
 {
-	uint32_t vhostid;
+	const struct vport_list *list = &active_vports[VPORT_TYPE_VHOST];
 	struct vport_info *info;
+	unsigned i;
 
 	/* Search for the portname and set the dev pointer. */
-	for (vhostid = 0; vhostid < num_vhost; vhostid++) {
-		info = &vports[VHOST0 + vhostid];
+	for (i = 0; i < list->count; i++) {
+		info = &vports[list->ids[i]];
 		if (strncmp(dev->port_name, info->name, strnlen(dev->port_name,
 				sizeof(dev->port_name))) == 0 &&
 			(strnlen(dev->port_name, sizeof(dev->port_name)) ==
@@ -1465,12 +2458,13 @@ vport_vhost_up(struct virtio_net *dev)
 inline int
 vport_vhost_down(struct virtio_net *dev)
 {
-	uint32_t vhostid;
+	const struct vport_list *list = &active_vports[VPORT_TYPE_VHOST];
 	struct vport_info *info;
+	unsigned i;
 
 	/* Search for the portname and clear the dev pointer. */
-	for (vhostid = 0; vhostid < num_vhost; vhostid++) {
-		info = &vports[VHOST0 + vhostid];
+	for (i = 0; i < list->count; i++) {
+		info = &vports[list->ids[i]];
 		if (strncmp(dev->port_name, info->name, strnlen(dev->port_name,
 				sizeof(dev->port_name))) == 0 &&
 			(strnlen(dev->port_name, sizeof(dev->port_name)) ==
@@ -1487,21 +2481,92 @@ vport_vhost_down(struct virtio_net *dev)
 	return -1;
 }
 
-void
-vport_set_kni_fifo_names(unsigned vportid,
-		const struct vport_kni_fifo_names *names)
+static unsigned
+queue_export(struct stats_export_queue *queues, unsigned n, unsigned max,
+             unsigned vportid, enum stats_export_queue_type type,
+             const struct rte_ring *ring)
 {
-	struct vport_kni_fifo_names *internal;
+	if (ring == NULL || n >= max)
+		return n;
 
-	if(vport_exists(vportid)) {
-		internal = &vports[vportid].kni.fifo_names;
-
-		rte_snprintf(internal->tx, sizeof(internal->tx), "%s", names->tx);
-		rte_snprintf(internal->rx, sizeof(internal->rx), "%s", names->rx);
-		rte_snprintf(internal->alloc, sizeof(internal->alloc), "%s", names->alloc);
-		rte_snprintf(internal->free, sizeof(internal->free), "%s", names->free);
-		rte_snprintf(internal->req, sizeof(internal->req), "%s", names->req);
-		rte_snprintf(internal->resp, sizeof(internal->resp), "%s", names->resp);
-		rte_snprintf(internal->sync, sizeof(internal->sync), "%s", names->sync);
+	queues[n].vportid = vportid;
+	queues[n].type = type;
+	queues[n].count = rte_ring_count(ring);
+	queues[n].size = ring->prod.mask;
+
+	return n + 1;
+}
+
+static unsigned
+memnic_queue_export(struct stats_export_queue *queues, unsigned n,
+                    unsigned max, unsigned vportid,
+                    enum stats_export_queue_type type,
+                    const struct memnic_ring *ring)
+{
+	if (n >= max)
+		return n;
+
+	queues[n].vportid = vportid;
+	queues[n].type = type;
+	queues[n].count = ring->head - ring->tail;
+	queues[n].size = MEMNIC_RING_SIZE;
+
+	return n + 1;
+}
+
+/*
+ * Fill 'queues' with the depth of up to 'max' rings between the switch and
+ * the vports, and return how many were filled in. vHost virtqueues belong
+ * to the guest and are not included.
+ */
+unsigned
+vport_queues_export(struct stats_export_queue *queues, unsigned max)
+{
+	const struct vport_info *info = NULL;
+	unsigned vportid = 0, n = 0;
+
+	for (vportid = 0; vportid < MAX_VPORTS; vportid++) {
+		if (!vport_exists(vportid))
+			continue;
+		info = &vports[vportid];
+
+		switch (info->type) {
+		case VPORT_TYPE_PHY:
+			n = queue_export(queues, n, max, vportid,
+			                 STATS_EXPORT_QUEUE_TX, info->phy.tx_q);
+			break;
+		case VPORT_TYPE_CLIENT:
+			n = queue_export(queues, n, max, vportid,
+			                 STATS_EXPORT_QUEUE_TX, info->client.rx_q);
+			n = queue_export(queues, n, max, vportid,
+			                 STATS_EXPORT_QUEUE_RX, info->client.tx_q);
+			n = queue_export(queues, n, max, vportid,
+			                 STATS_EXPORT_QUEUE_FREE, info->client.free_q);
+			n = queue_export(queues, n, max, vportid,
+			                 STATS_EXPORT_QUEUE_ALLOC, info->client.alloc_q);
+			break;
+		case VPORT_TYPE_KNI:
+			n = queue_export(queues, n, max, vportid,
+			                 STATS_EXPORT_QUEUE_TX, info->kni.tx_q);
+			break;
+		case VPORT_TYPE_VETH:
+			n = queue_export(queues, n, max, vportid,
+			                 STATS_EXPORT_QUEUE_TX, info->veth.tx_q);
+			break;
+		case VPORT_TYPE_MEMNIC:
+			if (info->memnic.area == NULL)
+				break;
+			n = memnic_queue_export(queues, n, max, vportid,
+			                        STATS_EXPORT_QUEUE_TX,
+			                        &info->memnic.area->to_guest);
+			n = memnic_queue_export(queues, n, max, vportid,
+			                        STATS_EXPORT_QUEUE_RX,
+			                        &info->memnic.area->from_guest);
+			break;
+		default:
+			break;
+		}
 	}
+
+	return n;
 }
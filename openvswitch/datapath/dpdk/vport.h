@@ -43,22 +43,26 @@
 #include "kni.h"
 #include "veth.h"
 #include "vhost.h"
+#include "memnic.h"
 
 #define MAX_PHYPORTS           16
 #define MAX_CLIENTS            16
 #define MAX_VHOST_PORTS        64
 #define PKT_BURST_SIZE         32u
+#define PORT_FLUSH_PERIOD_US   100 /* default TX burst deadline */
 #define CLIENT0                0
 #define CLIENT1                1
 #define PHYPORT0               0x10
 #define KNI0                   0x20
 #define VETH0                  0x40
 #define VHOST0                 0x50
+#define MEMNIC0                0x90
 #define CLIENT_MASK            0x00
 #define PORT_MASK              0x0F
 #define KNI_MASK               0x1F
 #define VETH_MASK              0x3F
 #define VHOST_MASK             0x4F
+#define MEMNIC_MASK            0x8F
 #define MAX_VPORT_NAME_SIZE    32
 
 struct port_info {
@@ -79,8 +83,18 @@ struct port_stats {
 
 struct port_info *ports;
 
+/* TX burst deadline of each physical port, in useconds */
+extern uint32_t port_tx_flush_us[MAX_PHYPORTS];
+
+/* Dense list of vport ids */
+struct vport_list {
+	volatile unsigned count;
+	volatile uint8_t ids[MAX_VPORTS];
+};
+
 struct virtio_net;
 struct virtio_net_hdr_mrg_rxbuf;
+struct stats_export_queue;
 
 /* Flags to communicate if a device can be removed safely from ovs_dpdk data path. */
 #define REQUEST_DEV_REMOVAL 1
@@ -90,6 +104,9 @@ volatile uint8_t dev_removal_flag[RTE_MAX_LCORE];   /* Flag to synchronize devic
 
 void vport_init(void);
 void vport_fini(void);
+int vport_create(unsigned vportid, enum vport_type type, const char *name);
+int vport_destroy(unsigned vportid);
+void vport_quiesce(void);
 
 int send_to_vport(uint32_t vportid, struct rte_mbuf *buf);
 uint16_t receive_from_vport(uint32_t vportid, struct rte_mbuf **bufs);
@@ -99,6 +116,8 @@ uint32_t vport_name_to_portid(const char *name);
 uint32_t vport_next_available_index(enum vport_type type);
 bool vport_id_is_valid(unsigned vportid, enum vport_type type);
 bool vport_exists(unsigned vportid);
+void vport_list_add(struct vport_list *list, uint32_t vportid);
+void vport_list_del(struct vport_list *list, uint32_t vportid);
 
 void vport_set_name(unsigned vportid, const char *fmt, ...);
 char *vport_get_name(unsigned vportid);
@@ -106,14 +125,17 @@ enum vport_type vport_get_type(unsigned vportid);
 void vport_enable(unsigned vportid);
 void vport_disable(unsigned vportid);
 bool vport_is_enabled(unsigned vportid);
+unsigned vport_queues_export(struct stats_export_queue *queues, unsigned max);
 
 int vport_vhost_up(struct virtio_net *dev);
 int vport_vhost_down(struct virtio_net *dev);
-void vport_set_kni_fifo_names(unsigned vportid,
-     const struct vport_kni_fifo_names *kni_fifos);
 
 void flush_clients(void);
+void recycle_clients(void);
 void flush_ports(void);
 void flush_vhost_devs(void);
+void flush_memnic_ports(void);
+void flush_kni_ports(void);
+void flush_kni_tx_rings(void);
 
 #endif /* __VPORT_H_ */
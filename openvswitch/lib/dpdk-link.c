@@ -26,48 +26,94 @@
 #include "dpdk-link.h"
 #include "dpif-dpdk.h"
 #include "common.h"
+#include "ofpbuf.h"
+#include "ovs-thread.h"
 
 #include "vlog.h"
 
 #include <unistd.h>
 #include <assert.h>
+#include <string.h>
 #include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/ioctl.h>
 #include <stdbool.h>
 
 VLOG_DEFINE_THIS_MODULE(dpdk_link);
 
 #define PKT_BURST_SIZE 256
 
-#define VSWITCHD_PACKET_RING_NAME  "MProc_Vswitchd_Packet_Ring"
+#define VSWITCHD_PACKET_RING_NAME  "MProc_Vswitchd_Packet_Ring_%u"
+#define VSWITCHD_PACKET_RINGS      4   /* Must match the datapath */
 #define VSWITCHD_REPLY_RING_NAME   "MProc_Vswitchd_Reply_Ring"
 #define VSWITCHD_MESSAGE_RING_NAME "MProc_Vswitchd_Message_Ring"
 #define VSWITCHD_FREE_RING_NAME    "MProc_Vswitchd_Free_Ring"
 #define VSWITCHD_ALLOC_RING_NAME   "MProc_Vswitchd_Alloc_Ring"
 
+#define DATAPATH_SOCKNAME "\0ovdk-datapath"
+
 #ifdef PG_DEBUG
 #define DPDK_DEBUG() printf("DPDK-LINK.c %s Line %d\n", __FUNCTION__, __LINE__);
 #else
 #define DPDK_DEBUG()
 #endif
 
+/* The datapath is signalled so that a sleeping vswitchd core frees the
+ * mbufs, or refills the alloc ring, without waiting for its sleep to end. */
 #define enqueue_mbufs_to_be_freed(mbufs, num_mbufs) { \
-    while (rte_ring_mp_enqueue_bulk(free_ring, mbufs, num_mbufs) != 0); \
+    while (rte_ring_mp_enqueue_bulk(free_ring, mbufs, num_mbufs) != 0) \
+        dpdk_link_signal_datapath(); \
+    dpdk_link_signal_datapath(); \
 }
 
 #define enqueue_mbuf_to_be_freed(mbuf) { \
-    while (rte_ring_mp_enqueue(free_ring, mbuf) != 0); \
+    while (rte_ring_mp_enqueue(free_ring, mbuf) != 0) \
+        dpdk_link_signal_datapath(); \
+    dpdk_link_signal_datapath(); \
 }
 
 #define alloc_mbufs(mbufs, num_mbufs) { \
-    while (rte_ring_mc_dequeue_bulk(alloc_ring, mbufs, num_mbufs) != 0); \
+    while (rte_ring_mc_dequeue_bulk(alloc_ring, mbufs, num_mbufs) != 0) \
+        dpdk_link_signal_datapath(); \
 }
 
+static void dpdk_link_signal_datapath(void);
+
 static struct rte_ring *message_ring = NULL;
 static struct rte_ring *reply_ring = NULL;
-static struct rte_ring *packet_ring = NULL;
+static struct rte_ring *packet_ring[VSWITCHD_PACKET_RINGS] = {NULL};
 static struct rte_ring *free_ring = NULL;
 static struct rte_ring *alloc_ring = NULL;
 
+/* Used to wake the datapath's vswitchd core if it is sleeping */
+static int datapath_sock = -1;
+
+/* Upcalls dequeued in a burst from one of the packet rings, handed out one
+ * at a time by dpdk_link_recv_packet(). */
+static struct ovs_mutex upcall_mutex = OVS_MUTEX_INITIALIZER;
+static struct rte_mbuf *upcall_mbufs[PKT_BURST_SIZE] OVS_GUARDED_BY(upcall_mutex);
+static unsigned upcall_head OVS_GUARDED_BY(upcall_mutex) = 0;
+static unsigned upcall_count OVS_GUARDED_BY(upcall_mutex) = 0;
+static unsigned upcall_next_ring OVS_GUARDED_BY(upcall_mutex) = 0;
+
+/* Wakes up the datapath's vswitchd core, in case it is sleeping while idle.
+ * Errors are ignored - the datapath polls if it is not sleeping. */
+static void
+dpdk_link_signal_datapath(void)
+{
+    static struct sockaddr_un addr;
+    int n = 0;
+
+    if (!addr.sun_family) {
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, DATAPATH_SOCKNAME, sizeof(DATAPATH_SOCKNAME));
+    }
+
+    sendto(datapath_sock, &n, sizeof(n), 0,
+           (struct sockaddr *)&addr, sizeof(addr));
+}
+
 /* Sends 'packet' and 'request' data to datapath. */
 int
 dpdk_link_send(struct dpif_dpdk_message *request,
@@ -106,6 +152,8 @@ dpdk_link_send_bulk(struct dpif_dpdk_message *request,
             request[i].flow_msg.id = tid;
         else if (request->type == DPIF_DPDK_VPORT_FAMILY)
             request[i].vport_msg.id = tid;
+        else if (request->type == DPIF_DPDK_DP_FAMILY)
+            request[i].dp_msg.id = tid;
 
         mbuf_data = rte_pktmbuf_mtod(mbufs[i], uint8_t *);
         rte_memcpy(mbuf_data, &request[i], sizeof(request[i]));
@@ -138,6 +186,10 @@ dpdk_link_send_bulk(struct dpif_dpdk_message *request,
         ret = 0;
     }
 
+    if (!ret) {
+        dpdk_link_signal_datapath();
+    }
+
     return ret;
 }
 
@@ -164,6 +216,16 @@ dpdk_link_recv_reply(struct dpif_dpdk_message *reply)
         pktmbuf_len = rte_pktmbuf_data_len(mbuf);
 
         switch(((struct dpif_dpdk_message *)pktmbuf_data)->type) {
+        case DPIF_DPDK_DP_FAMILY:
+            /* Allow multi-threading */
+            if (((struct dpif_dpdk_message *)pktmbuf_data)->dp_msg.id != tid ){
+                /* Don't touch other processes' packets - re-enqueue */
+                while (rte_ring_mp_enqueue(reply_ring, (void *)mbuf) != 0)
+                    ;
+            } else {
+                loop = false;
+            }
+            break;
         case DPIF_DPDK_VPORT_FAMILY:
             /* Allow multi-threading */
             if (((struct dpif_dpdk_message *)pktmbuf_data)->vport_msg.id != tid ){
@@ -201,10 +263,30 @@ dpdk_link_recv_reply(struct dpif_dpdk_message *reply)
     return 0;
 }
 
-/* Blocking function that waits for a packet from datapath. 'pkt' will get
- * populated with packet data. */
+/* Refills the upcall burst from the next non-empty packet ring. The rings
+ * are visited round-robin so that no ring is starved. */
+static void
+dpdk_link_refill_upcalls(void)
+    OVS_REQUIRES(upcall_mutex)
+{
+    int i = 0;
+
+    upcall_head = 0;
+    upcall_count = 0;
+
+    for (i = 0; i < VSWITCHD_PACKET_RINGS && !upcall_count; i++) {
+        upcall_count = rte_ring_mc_dequeue_burst(packet_ring[upcall_next_ring],
+                                                 (void **)upcall_mbufs,
+                                                 PKT_BURST_SIZE);
+        upcall_next_ring = (upcall_next_ring + 1) & (VSWITCHD_PACKET_RINGS - 1);
+    }
+}
+
+/* Non-blocking function that receives a packet from datapath. The packet
+ * data is appended to 'buf' and the upcall information is copied to 'info'.
+ * Returns EAGAIN if no packet is available. */
 int
-dpdk_link_recv_packet(struct ofpbuf **pkt, struct dpif_dpdk_upcall *info)
+dpdk_link_recv_packet(struct ofpbuf *buf, struct dpif_dpdk_upcall *info)
 {
     struct rte_mbuf *mbuf = NULL;
     uint16_t pktmbuf_len = 0;
@@ -212,17 +294,31 @@ dpdk_link_recv_packet(struct ofpbuf **pkt, struct dpif_dpdk_upcall *info)
 
     DPDK_DEBUG()
 
-    if (rte_ring_mc_dequeue(packet_ring, (void **)&mbuf) != 0) {
-        return EAGAIN;
+    ovs_mutex_lock(&upcall_mutex);
+
+    if (upcall_head == upcall_count) {
+        dpdk_link_refill_upcalls();
+        if (!upcall_count) {
+            ovs_mutex_unlock(&upcall_mutex);
+            return EAGAIN;
+        }
     }
 
+    mbuf = upcall_mbufs[upcall_head++];
+
     pktmbuf_data = rte_pktmbuf_mtod(mbuf, void *);
     pktmbuf_len = rte_pktmbuf_data_len(mbuf);
     rte_memcpy(info, pktmbuf_data, sizeof(*info));
     pktmbuf_data = (uint8_t *)pktmbuf_data + sizeof(*info);
-    *pkt = ofpbuf_clone_data(pktmbuf_data, pktmbuf_len - sizeof(*info));
+    ofpbuf_put(buf, pktmbuf_data, pktmbuf_len - sizeof(*info));
 
-    enqueue_mbuf_to_be_freed(mbuf);
+    /* Return the whole burst to the datapath once it has been consumed */
+    if (upcall_head == upcall_count) {
+        enqueue_mbufs_to_be_freed((void * const *)upcall_mbufs, upcall_count);
+        upcall_head = upcall_count = 0;
+    }
+
+    ovs_mutex_unlock(&upcall_mutex);
 
     return 0;
 }
@@ -234,6 +330,10 @@ dpdk_link_recv_packet(struct ofpbuf **pkt, struct dpif_dpdk_upcall *info)
 int
 dpdk_link_init(void)
 {
+    char ring_name[RTE_RING_NAMESIZE];
+    int one = 1;
+    int i = 0;
+
     DPDK_DEBUG()
 
     reply_ring = rte_ring_lookup(VSWITCHD_REPLY_RING_NAME);
@@ -248,10 +348,13 @@ dpdk_link_init(void)
                      "Cannot get message ring - is datapath running?\n");
     }
 
-    packet_ring = rte_ring_lookup(VSWITCHD_PACKET_RING_NAME);
-    if (packet_ring == NULL) {
-        rte_exit(EXIT_FAILURE,
-                     "Cannot get packet ring - is datapath running?\n");
+    for (i = 0; i < VSWITCHD_PACKET_RINGS; i++) {
+        snprintf(ring_name, sizeof(ring_name), VSWITCHD_PACKET_RING_NAME, i);
+        packet_ring[i] = rte_ring_lookup(ring_name);
+        if (packet_ring[i] == NULL) {
+            rte_exit(EXIT_FAILURE,
+                         "Cannot get packet ring - is datapath running?\n");
+        }
     }
 
     free_ring = rte_ring_lookup(VSWITCHD_FREE_RING_NAME);
@@ -266,5 +369,10 @@ dpdk_link_init(void)
                      "Cannot get alloc ring - is datapath running?\n");
     }
 
+    datapath_sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (datapath_sock < 0 || ioctl(datapath_sock, FIONBIO, &one) < 0) {
+        rte_exit(EXIT_FAILURE, "Cannot create datapath socket\n");
+    }
+
     return 0;
 }
@@ -23,6 +23,6 @@ int dpdk_link_init(void);
 int dpdk_link_send(struct dpif_dpdk_message *, const struct ofpbuf *);
 int dpdk_link_send_bulk(struct dpif_dpdk_message *, const struct ofpbuf *const *, size_t);
 int dpdk_link_recv_reply(struct dpif_dpdk_message *);
-int dpdk_link_recv_packet(struct ofpbuf **, struct dpif_dpdk_upcall *);
+int dpdk_link_recv_packet(struct ofpbuf *, struct dpif_dpdk_upcall *);
 
 #endif /* DPDK_LINK_H */
@@ -62,6 +62,9 @@ static int dpdk_sock = -1;
 
 static struct vlog_rate_limit dpmsg_rl = VLOG_RATE_LIMIT_INIT(600, 600);
 
+static int dpif_dpdk_dp_transact(struct dpif_dpdk_dp_message *request,
+                                 struct dpif_dpdk_dp_message *reply);
+
 static void dpif_dpdk_vport_init(struct dpif_dpdk_vport_message *);
 static int dpif_dpdk_vport_transact(struct dpif_dpdk_vport_message *request,
                                    struct dpif_dpdk_vport_message *reply);
@@ -163,14 +166,25 @@ dpif_dpdk_get_stats(const struct dpif *dpif_ OVS_UNUSED,
 {
     DPDK_DEBUG()
 
+    struct dpif_dpdk_dp_message request;
+    int error = 0;
+
     if(stats == NULL){
         return EINVAL;
     }
 
-    stats->n_hit = 0;
-    stats->n_missed = 0;
-    stats->n_lost = 0;
-    stats->n_flows = 0;
+    memset(&request, 0, sizeof(request));
+    request.cmd = OVS_DP_CMD_GET;
+
+    error = dpif_dpdk_dp_transact(&request, &request);
+    if (error) {
+        return error;
+    }
+
+    stats->n_hit = request.stats.n_hit;
+    stats->n_missed = request.stats.n_missed;
+    stats->n_lost = request.stats.n_lost;
+    stats->n_flows = request.stats.n_flows;
 
     return 0;
 }
@@ -196,6 +210,8 @@ dpif_dpdk_odport_type(const char *type)
         vport_type = VPORT_TYPE_VETH;
     else if (!strncmp(type, "dpdkvhost", DPDK_PORT_MAX_STRING_LEN))
         vport_type = VPORT_TYPE_VHOST;
+    else if (!strncmp(type, "dpdkmemnic", DPDK_PORT_MAX_STRING_LEN))
+        vport_type = VPORT_TYPE_MEMNIC;
     else
         VLOG_ERR("failed to get ODP type from OFP type '%s'", type);
 
@@ -230,6 +246,9 @@ dpif_dpdk_ofport_type(enum dpif_dpdk_vport_type type, char *vport_type)
     case VPORT_TYPE_VHOST:
         strncpy(vport_type, "dpdkvhost", DPDK_PORT_MAX_STRING_LEN);
         break;
+    case VPORT_TYPE_MEMNIC:
+        strncpy(vport_type, "dpdkmemnic", DPDK_PORT_MAX_STRING_LEN);
+        break;
     case VPORT_TYPE_DISABLED:
     default:
         VLOG_ERR("failed to get OFP type from ODP type '%d'", type);
@@ -504,6 +523,31 @@ dpif_dpdk_port_get_stats(const char *name, struct dpif_dpdk_vport_stats *stats)
     return error;
 }
 
+/* Return the latency histogram of packets sent to the vport associated with
+ * 'name'. Bucket 0 counts packets that spent under 1us in the datapath,
+ * bucket i under 2^i us, and the last bucket all slower packets. Only
+ * packets sampled by the datapath's --latency_sample option are counted.
+ */
+int
+dpif_dpdk_port_get_latency(const char *name,
+                           uint64_t latency[DPIF_DPDK_LATENCY_BUCKETS])
+{
+    struct dpif_dpdk_vport_message request, reply;
+    int error;
+
+    DPDK_DEBUG()
+
+    dpif_dpdk_vport_init(&request);
+    strncpy(request.port_name, name, DPDK_PORT_MAX_STRING_LEN);
+    request.cmd = OVS_VPORT_CMD_GET;
+    error = dpif_dpdk_vport_transact(&request, &reply);
+
+    if (!error)
+        memcpy(latency, reply.latency, sizeof(reply.latency));
+
+    return error;
+}
+
 /*
  * This function will initialize a dpif_dpdk_flow_message for get.
  */
@@ -1003,9 +1047,9 @@ dpif_dpdk_queue_to_priority(const struct dpif *dpif OVS_UNUSED,
 static int
 dpif_dpdk_recv(struct dpif *dpif_ OVS_UNUSED,
                struct dpif_upcall *upcall,
-               struct ofpbuf *ofpbuf OVS_UNUSED)
+               struct ofpbuf *buf)
 {
-    struct ofpbuf *buf = NULL;
+    uint32_t keybuf[DIV_ROUND_UP(ODPUTIL_FLOW_KEY_BYTES, 4)];
     struct ofpbuf key;
     struct flow flow;
     struct dpif_dpdk_upcall info;
@@ -1015,11 +1059,13 @@ dpif_dpdk_recv(struct dpif *dpif_ OVS_UNUSED,
 
     DPDK_DEBUG()
 
-    if(upcall == NULL) {
+    if (upcall == NULL || buf == NULL) {
         return EINVAL;
     }
 
-    error = dpdk_link_recv_packet(&buf, &info);
+    /* The packet is placed directly in the caller's buffer, which is
+     * released along with the upcall. */
+    error = dpdk_link_recv_packet(buf, &info);
 
     if (!error) {
         switch (info.cmd) {
@@ -1036,7 +1082,7 @@ dpif_dpdk_recv(struct dpif *dpif_ OVS_UNUSED,
         }
 
         dpif_dpdk_flow_key_to_flow(&info.key, &flow);
-        ofpbuf_init(&key, 0);
+        ofpbuf_use_stack(&key, keybuf, sizeof keybuf);
         /* There are two port numbering schemes, odp_port and ofp_port for
          * the datapath and OpenFlow layer respectively. Rather than having
          * conversion logic here we require that you use ofport_request when
@@ -1052,9 +1098,6 @@ dpif_dpdk_recv(struct dpif *dpif_ OVS_UNUSED,
         upcall->key = ofpbuf_tail(buf);
         upcall->key_len = key.size;
         upcall->userdata = 0;
-
-        /* free memory allocated in ofpbuf key */
-        ofpbuf_uninit(&key);
     }
 
     SIGNAL_HANDLED(dpdk_sock, sock_msg);
@@ -1188,6 +1231,43 @@ dpif_dpdk_vport_transact(struct dpif_dpdk_vport_message *request,
     return request_buf.type;
 }
 
+/*
+ * Carry out a transaction with the datapath specified in 'request'.
+ * If there is an error this function returns a positive errno value.
+ * If the reply is not null, this functions stores the reply in '*reply'.
+ * The type of this reply is expected to be a datapath message.
+ */
+static int
+dpif_dpdk_dp_transact(struct dpif_dpdk_dp_message *request,
+                      struct dpif_dpdk_dp_message *reply)
+{
+    struct dpif_dpdk_message request_buf;
+    int error = 0;
+
+    DPDK_DEBUG()
+
+    request_buf.type = DPIF_DPDK_DP_FAMILY;
+
+    request_buf.dp_msg = *request;
+
+    error = dpdk_link_send(&request_buf, NULL);
+    if (error) {
+        return error;
+    }
+
+    error = dpdk_link_recv_reply(&request_buf);
+
+    if (error) {
+        return error;
+    }
+
+    if (reply) {
+        *reply = request_buf.dp_msg;
+    }
+
+    return request_buf.type;
+}
+
 /* Clears 'flow' to "empty" values. */
 static void
 dpif_dpdk_flow_init(struct dpif_dpdk_flow_message *flow_msg)
@@ -1267,14 +1347,34 @@ dpif_dpdk_flow_key_from_flow(struct dpif_dpdk_flow_key *key,
     vlan_tci = rte_be_to_cpu_16(flow->vlan_tci);
     key->vlan_id = vlan_tci & VLAN_ID_MASK;
     key->vlan_prio = vlan_tci >> VLAN_PRIO_SHIFT;
-    key->ip_src = rte_be_to_cpu_32(flow->nw_src);
-    key->ip_dst = rte_be_to_cpu_32(flow->nw_dst);
     key->ip_proto = flow->nw_proto;
     key->ip_tos = flow->nw_tos;
     key->ip_ttl = flow->nw_ttl;
     key->ip_frag = flow->nw_frag == 0 ? OVS_FRAG_TYPE_NONE
                  : flow->nw_frag == FLOW_NW_FRAG_ANY ? OVS_FRAG_TYPE_FIRST
                  : OVS_FRAG_TYPE_LATER;
+
+    /* Address fields share storage, so only fill in those of this type */
+    switch (key->ether_type) {
+    case ETH_TYPE_IPV6:
+        memcpy(key->ipv6_src, &flow->ipv6_src, sizeof key->ipv6_src);
+        memcpy(key->ipv6_dst, &flow->ipv6_dst, sizeof key->ipv6_dst);
+        key->ipv6_label = ntohl(flow->ipv6_label);
+        if (flow->nw_proto == IPPROTO_ICMPV6) {
+            memcpy(key->nd_target, &flow->nd_target, sizeof key->nd_target);
+            memcpy(key->nd_sll.addr_bytes, flow->arp_sha, ETHER_ADDR_LEN);
+            memcpy(key->nd_tll.addr_bytes, flow->arp_tha, ETHER_ADDR_LEN);
+        }
+        break;
+    case ETH_TYPE_ARP:
+        memcpy(key->arp_sha.addr_bytes, flow->arp_sha, ETHER_ADDR_LEN);
+        memcpy(key->arp_tha.addr_bytes, flow->arp_tha, ETHER_ADDR_LEN);
+        /* Fall through */
+    default:
+        key->ip_src = rte_be_to_cpu_32(flow->nw_src);
+        key->ip_dst = rte_be_to_cpu_32(flow->nw_dst);
+        break;
+    }
     key->tran_src_port = rte_be_to_cpu_16(flow->tp_src);
     key->tran_dst_port = rte_be_to_cpu_16(flow->tp_dst);
 }
@@ -1293,8 +1393,24 @@ dpif_dpdk_flow_key_to_flow(const struct dpif_dpdk_flow_key *key,
     flow->dl_type = rte_cpu_to_be_16(key->ether_type);
     if (key->vlan_id != 0)
         flow->vlan_tci = rte_cpu_to_be_16(key->vlan_prio << VLAN_PRIO_SHIFT | key->vlan_id | VLAN_CFI);
-    flow->nw_src = rte_cpu_to_be_32(key->ip_src);
-    flow->nw_dst = rte_cpu_to_be_32(key->ip_dst);
+    switch (key->ether_type) {
+    case ETH_TYPE_IPV6:
+        memcpy(&flow->ipv6_src, key->ipv6_src, sizeof flow->ipv6_src);
+        memcpy(&flow->ipv6_dst, key->ipv6_dst, sizeof flow->ipv6_dst);
+        flow->ipv6_label = htonl(key->ipv6_label);
+        memcpy(&flow->nd_target, key->nd_target, sizeof flow->nd_target);
+        memcpy(flow->arp_sha, key->nd_sll.addr_bytes, ETHER_ADDR_LEN);
+        memcpy(flow->arp_tha, key->nd_tll.addr_bytes, ETHER_ADDR_LEN);
+        break;
+    case ETH_TYPE_ARP:
+        memcpy(flow->arp_sha, key->arp_sha.addr_bytes, ETHER_ADDR_LEN);
+        memcpy(flow->arp_tha, key->arp_tha.addr_bytes, ETHER_ADDR_LEN);
+        /* Fall through */
+    default:
+        flow->nw_src = rte_cpu_to_be_32(key->ip_src);
+        flow->nw_dst = rte_cpu_to_be_32(key->ip_dst);
+        break;
+    }
     flow->nw_proto = key->ip_proto;
     flow->nw_tos = key->ip_tos;
     flow->nw_ttl = key->ip_ttl;
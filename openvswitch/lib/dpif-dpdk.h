@@ -25,11 +25,13 @@
 #include "dpif.h"
 #include "common.h"
 
+#define DPIF_DPDK_DP_FAMILY        0xD
 #define DPIF_DPDK_VPORT_FAMILY     0xE
 #define DPIF_DPDK_FLOW_FAMILY      0xF
 #define DPIF_DPDK_PACKET_FAMILY    0x1F
 
 #define DPDK_PORT_MAX_STRING_LEN   32
+#define DPIF_DPDK_LATENCY_BUCKETS  11
 
 struct dpif_dpdk_vport_stats {
 	uint64_t rx;        /* Rx packet count */
@@ -42,21 +44,43 @@ struct dpif_dpdk_vport_stats {
 	uint64_t tx_error;  /* Tx error packet count */
 };
 
+struct dpif_dpdk_dp_stats {
+	uint64_t n_hit;     /* Number of flow table matches */
+	uint64_t n_missed;  /* Number of flow table misses */
+	uint64_t n_lost;    /* Number of misses not sent to vswitchd */
+	uint64_t n_flows;   /* Number of flows present */
+};
+
+/* Must match struct flow_key in the datapath */
 struct dpif_dpdk_flow_key {
 	odp_port_t in_port;
 	struct ether_addr ether_dst;
 	struct ether_addr ether_src;
 	uint16_t ether_type;
-	uint16_t vlan_id;
-	uint8_t vlan_prio;
-	uint32_t ip_src;
-	uint32_t ip_dst;
+	uint16_t vlan_id:12;
+	uint16_t vlan_prio:4;
 	uint8_t ip_proto;
 	uint8_t ip_tos;
 	uint8_t ip_ttl;
 	uint8_t ip_frag;
 	uint16_t tran_src_port;
 	uint16_t tran_dst_port;
+	union {
+		struct {
+			uint32_t ip_src;
+			uint32_t ip_dst;
+			struct ether_addr arp_sha;
+			struct ether_addr arp_tha;
+		};
+		struct {
+			uint8_t ipv6_src[16];
+			uint8_t ipv6_dst[16];
+			uint32_t ipv6_label;
+		};
+	};
+	uint8_t nd_target[16];
+	struct ether_addr nd_sll;
+	struct ether_addr nd_tll;
 } __attribute__((__packed__));
 
 struct dpif_dpdk_flow_stats {
@@ -85,7 +109,8 @@ enum dpif_dpdk_vport_type {
 	VPORT_TYPE_CLIENT,
 	VPORT_TYPE_KNI,
 	VPORT_TYPE_VETH,
-	VPORT_TYPE_VHOST
+	VPORT_TYPE_VHOST,
+	VPORT_TYPE_MEMNIC
 };
 
 enum dpif_dpdk_action_type {
@@ -122,6 +147,14 @@ struct dpif_dpdk_action {
 	} data;
 };
 
+/* A 'datapath' message between vswitchd <-> datapath. */
+struct dpif_dpdk_dp_message {
+	uint32_t id;              /* Thread ID of sending thread */
+	uint8_t cmd;              /* Command to execute on datapath. */
+	uint32_t flags;           /* Additional flags, if any, or null. */
+	struct dpif_dpdk_dp_stats stats;  /* Current statistics for the datapath. */
+};
+
 /* A 'vport managment' message between vswitchd <-> datapath. */
 struct dpif_dpdk_vport_message {
 	uint32_t id;              /* Thread ID of sending thread */
@@ -132,6 +165,8 @@ struct dpif_dpdk_vport_message {
 	enum dpif_dpdk_vport_type type;      /* Type of the vport */
 	char reserved[16];           /* Padding - currently reserved for future use */
 	struct dpif_dpdk_vport_stats stats;  /* Current statistics for the given vport. */
+	uint64_t latency[DPIF_DPDK_LATENCY_BUCKETS];  /* Sampled packets sent to
+	                                               the vport, by latency */
 };
 
 struct dpif_dpdk_flow_message {
@@ -152,6 +187,7 @@ struct dpif_dpdk_packet_message {
 struct dpif_dpdk_message {
 	int16_t type;        /* Message type, if a request, or return code */
 	union {              /* Actual message */
+		struct dpif_dpdk_dp_message dp_msg;
 		struct dpif_dpdk_vport_message vport_msg;
 		struct dpif_dpdk_flow_message flow_msg;
 		struct dpif_dpdk_packet_message packet_msg;
@@ -172,5 +208,7 @@ struct dpif_dpdk_flow_state {
 };
 
 int dpif_dpdk_port_get_stats(const char *name, struct dpif_dpdk_vport_stats *stats);
+int dpif_dpdk_port_get_latency(const char *name,
+                               uint64_t latency[DPIF_DPDK_LATENCY_BUCKETS]);
 
 #endif /* dpif-dpdk.h */
@@ -20,6 +20,7 @@
 #include <rte_ethdev.h>
 
 #include <inttypes.h>
+#include <stdio.h>
 
 #include "common.h"
 #include "netdev-provider.h"
@@ -146,6 +147,35 @@ netdev_dpdk_get_stats(const struct netdev *netdev_,
     return error;
 }
 
+/* Report the latency histogram of sampled packets sent to the vport in the
+ * Interface's status column, as "latency_lt_<N>us" for each bucket and
+ * "latency_ge_<N>us" for the last. */
+static int
+netdev_dpdk_get_status(const struct netdev *netdev_, struct smap *smap)
+{
+    uint64_t latency[DPIF_DPDK_LATENCY_BUCKETS];
+    char key[32];
+    int error = 0;
+    int i = 0;
+
+    DPDK_DEBUG()
+
+    error = dpif_dpdk_port_get_latency(netdev_get_name(netdev_), latency);
+    if (error) {
+        return error;
+    }
+
+    for (i = 0; i < DPIF_DPDK_LATENCY_BUCKETS - 1; i++) {
+        snprintf(key, sizeof key, "latency_lt_%uus", 1u << i);
+        smap_add_format(smap, key, "%"PRIu64, latency[i]);
+    }
+    snprintf(key, sizeof key, "latency_ge_%uus",
+             1u << (DPIF_DPDK_LATENCY_BUCKETS - 2));
+    smap_add_format(smap, key, "%"PRIu64, latency[i]);
+
+    return 0;
+}
+
 static int
 netdev_dpdk_update_flags(struct netdev *netdev OVS_UNUSED, enum netdev_flags off OVS_UNUSED,
                           enum netdev_flags on OVS_UNUSED, enum netdev_flags *old_flagsp)
@@ -295,7 +325,7 @@ const struct netdev_class netdev_dpdk_client_class =
     NULL,
     NULL,
     NULL,
-    NULL,
+    netdev_dpdk_get_status,
     NULL,
     netdev_dpdk_update_flags,
     netdev_dpdk_change_seq,
@@ -353,7 +383,7 @@ const struct netdev_class netdev_dpdk_kni_class =
     NULL,
     NULL,
     NULL,
-    NULL,
+    netdev_dpdk_get_status,
     NULL,
     netdev_dpdk_update_flags,
     netdev_dpdk_change_seq,
@@ -411,7 +441,7 @@ const struct netdev_class netdev_dpdk_phy_class =
     NULL,
     NULL,
     NULL,
-    NULL,
+    netdev_dpdk_get_status,
     NULL,
     netdev_dpdk_update_flags,
     netdev_dpdk_change_seq,
@@ -469,7 +499,7 @@ const struct netdev_class netdev_dpdk_veth_class =
     NULL,
     NULL,
     NULL,
-    NULL,
+    netdev_dpdk_get_status,
     NULL,
     netdev_dpdk_update_flags,
     netdev_dpdk_change_seq,
@@ -527,8 +557,66 @@ const struct netdev_class netdev_dpdk_vhost_class =
     NULL,
     NULL,
     NULL,
+    netdev_dpdk_get_status,
+    NULL,
+    netdev_dpdk_update_flags,
+    netdev_dpdk_change_seq,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+const struct netdev_class netdev_dpdk_memnic_class =
+{
+    "dpdkmemnic",
+    netdev_dpdk_init,
+    netdev_dpdk_run,
+    netdev_dpdk_wait,
+    netdev_dpdk_alloc,
+    netdev_dpdk_construct,
+    netdev_dpdk_destruct,
+    netdev_dpdk_dealloc,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    netdev_dpdk_set_etheraddr,
+    netdev_dpdk_get_etheraddr,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    netdev_dpdk_get_stats,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
     NULL,
     NULL,
+    NULL,
+    NULL,
+    netdev_dpdk_get_status,
+    NULL,
     netdev_dpdk_update_flags,
     netdev_dpdk_change_seq,
     NULL,
@@ -585,7 +673,7 @@ const struct netdev_class netdev_dpdk_internal_class =
     NULL,
     NULL,
     NULL,
-    NULL,
+    netdev_dpdk_get_status,
     NULL,
     netdev_dpdk_update_flags,
     netdev_dpdk_change_seq,
@@ -666,6 +666,7 @@ extern const struct netdev_class netdev_dpdk_kni_class;
 extern const struct netdev_class netdev_dpdk_phy_class;
 extern const struct netdev_class netdev_dpdk_veth_class;
 extern const struct netdev_class netdev_dpdk_vhost_class;
+extern const struct netdev_class netdev_dpdk_memnic_class;
 extern const struct netdev_class netdev_dpdk_internal_class;
 #if defined(__FreeBSD__) || defined(__NetBSD__)
 extern const struct netdev_class netdev_bsd_class;
@@ -56,8 +56,8 @@ struct flow flow;
 struct nlattr actions_unit;
 
 static struct rte_mempool *pktmbuf_pool = NULL;
-/* ring to send packets to vswitchd */
-static struct rte_ring *vswitchd_packet_ring = NULL;
+/* rings to send packets to vswitchd */
+static struct rte_ring *vswitchd_packet_ring[VSWITCHD_PACKET_RINGS] = {NULL};
 /* ring to receive messages from vswitchd */
 struct rte_ring *vswitchd_message_ring = NULL;
 /* ring to send reply messages to vswitchd */
@@ -104,6 +104,19 @@ void create_dpdk_port_query_reply(struct dpif_dpdk_message *reply,
 	reply->type = return_code;
 }
 
+void
+create_dpdk_dp_get_reply(struct dpif_dpdk_message *reply, uint64_t n_hit,
+                         uint64_t n_missed, uint64_t n_lost, uint64_t n_flows)
+{
+	memset(reply, 0, sizeof(*reply));
+
+	reply->dp_msg.stats.n_hit = n_hit;
+	reply->dp_msg.stats.n_missed = n_missed;
+	reply->dp_msg.stats.n_lost = n_lost;
+	reply->dp_msg.stats.n_flows = n_flows;
+	reply->type = 0;
+}
+
 void
 create_dpdk_flow_get_reply(struct dpif_dpdk_message *reply)
 {
@@ -211,6 +224,30 @@ enqueue_reply_on_reply_ring(struct dpif_dpdk_message reply)
 	return 0;
 }
 
+/* Put an upcall with 'info' and a zeroed packet of 'pkt_len' bytes on packet
+ * ring 'ringid', ready to be dequeued by dpif_dpdk_recv */
+int
+enqueue_upcall_on_packet_ring(const struct dpif_dpdk_upcall *info,
+                              unsigned ringid, unsigned pkt_len)
+{
+	struct rte_mbuf *mbuf = NULL;
+	uint8_t *pktmbuf_data = NULL;
+
+	if (rte_ring_mc_dequeue(vswitchd_alloc_ring, (void**)&mbuf) != 0)
+		return -1;
+
+	pktmbuf_data = rte_pktmbuf_mtod(mbuf, uint8_t *);
+	rte_memcpy(pktmbuf_data, info, sizeof(*info));
+	memset(pktmbuf_data + sizeof(*info), 0, pkt_len);
+	rte_pktmbuf_data_len(mbuf) = sizeof(*info) + pkt_len;
+
+	if (rte_ring_mp_enqueue(vswitchd_packet_ring[ringid], mbuf) < 0) {
+		rte_ring_mp_enqueue(vswitchd_free_ring, mbuf);
+		return -1;
+	}
+	return 0;
+}
+
 /* dpdk_link_send() looks up each of these rings and will exit if
  * it doesn't find them so we must declare them.
  *
@@ -220,6 +257,7 @@ enqueue_reply_on_reply_ring(struct dpif_dpdk_message reply)
 void
 init_test_rings(unsigned mempool_size)
 {
+	char ring_name[RTE_RING_NAMESIZE] = {0};
 	int i = 0;
 	struct rte_mbuf *mbuf;
 
@@ -231,10 +269,14 @@ init_test_rings(unsigned mempool_size)
 	                     rte_pktmbuf_pool_init,
 	                     NULL, rte_pktmbuf_init, NULL, 0, 0);
 
-	vswitchd_packet_ring = rte_ring_create(VSWITCHD_PACKET_RING_NAME,
-			         VSWITCHD_RINGSIZE, SOCKET0, NO_FLAGS);
-	if (vswitchd_packet_ring == NULL)
-		rte_exit(EXIT_FAILURE, "Cannot create packet ring for vswitchd");
+	for (i = 0; i < VSWITCHD_PACKET_RINGS; i++) {
+		rte_snprintf(ring_name, sizeof(ring_name),
+		             VSWITCHD_PACKET_RING_NAME, i);
+		vswitchd_packet_ring[i] = rte_ring_create(ring_name,
+		         VSWITCHD_RINGSIZE, SOCKET0, NO_FLAGS);
+		if (vswitchd_packet_ring[i] == NULL)
+			rte_exit(EXIT_FAILURE, "Cannot create packet ring for vswitchd");
+	}
 
 	vswitchd_reply_ring = rte_ring_create(VSWITCHD_REPLY_RING_NAME,
 	        VSWITCHD_RINGSIZE, SOCKET0, NO_FLAGS);
@@ -35,7 +35,8 @@
 #include "common.h"
 
 #define VSWITCHD_RINGSIZE   2048
-#define VSWITCHD_PACKET_RING_NAME  "MProc_Vswitchd_Packet_Ring"
+#define VSWITCHD_PACKET_RING_NAME  "MProc_Vswitchd_Packet_Ring_%u"
+#define VSWITCHD_PACKET_RINGS      4
 #define VSWITCHD_REPLY_RING_NAME   "MProc_Vswitchd_Reply_Ring"
 #define VSWITCHD_MESSAGE_RING_NAME "MProc_Vswitchd_Message_Ring"
 #define VSWITCHD_FREE_RING_NAME    "MProc_Vswitchd_Free_Ring"
@@ -82,10 +83,15 @@ void create_dpdk_port_query_reply(struct dpif_dpdk_message *reply,
     uint32_t port_no, char port_name[32], enum dpif_dpdk_vport_type type,
     int return_code);
 
+void create_dpdk_dp_get_reply(struct dpif_dpdk_message *reply,
+                              uint64_t n_hit, uint64_t n_missed,
+                              uint64_t n_lost, uint64_t n_flows);
 void create_dpdk_flow_get_reply(struct dpif_dpdk_message *reply);
 void create_dpdk_flow_put_reply(struct dpif_dpdk_message *reply);
 void create_dpdk_flow_del_reply(struct dpif_dpdk_message *reply, uint8_t flow_exists);
 void create_dpif_flow_put_message(struct dpif_flow_put *put);
 int enqueue_reply_on_reply_ring(struct dpif_dpdk_message reply);
+int enqueue_upcall_on_packet_ring(const struct dpif_dpdk_upcall *info,
+                                  unsigned ringid, unsigned pkt_len);
 void create_dpif_flow_del_message(struct dpif_flow_del *del);
 void init_test_rings(unsigned mempool_size);
@@ -51,6 +51,7 @@
 #include "dpdk-link.h"
 #include "netdev-provider.h"
 #include "netlink.h"
+#include "ofpbuf.h"
 #include "common.h"
 
 #include "dpdk-ring-stub.h"
@@ -76,6 +77,7 @@ void test_dpif_dpdk_flow_flush(struct dpif *dpif_p);
 void test_dpif_dpdk_flow_dump_start(struct dpif *dpif_p);
 void test_dpif_dpdk_flow_dump_next(struct dpif *dpif_p);
 void test_dpif_dpdk_flow_dump_done(struct dpif *dpif_p);
+void test_dpif_dpdk_recv(struct dpif *dpif_p);
 
 int
 main(int argc, char *argv[])
@@ -111,10 +113,11 @@ main(int argc, char *argv[])
 			{"dpif_dpdk_flow_flush", no_argument, 0, 'n'},
 			{"dpif_dpdk_flow_dump_start", no_argument, 0, 'o'},
 			{"dpif_dpdk_flow_dump_next", no_argument, 0, 'p'},
+			{"dpif_dpdk_recv", no_argument, 0, 'q'},
 			{0, 0, 0, 0}
 		};
 		int option_index = 0;
-		c = getopt_long(argc-4, argv+4, "abcdefghijklmnop", long_options, &option_index);
+		c = getopt_long(argc-4, argv+4, "abcdefghijklmnopq", long_options, &option_index);
 
 		/* Can run any function from the dpif_p */
 		dpif_p->dpif_class->destroy(dpif_p);
@@ -188,6 +191,10 @@ main(int argc, char *argv[])
 			test_dpif_dpdk_flow_dump_next(dpif_p);
 			break;
 
+			case 'q':
+			test_dpif_dpdk_recv(dpif_p);
+			break;
+
 			default:
 			abort();
 		}
@@ -200,14 +207,36 @@ main(int argc, char *argv[])
 void
 test_dpif_dpdk_get_stats(struct dpif *dpif_p)
 {
-	int result = -1;
+	struct dpif_dpdk_message reply;
+	struct dpif_dpdk_message *request;
 	struct dpif_dp_stats stats;
+	struct rte_mbuf *mbuf = NULL;
+	void *pktmbuf_data = NULL;
+	int result = -1;
+
+	/* Test null stats */
+	result = dpif_p->dpif_class->get_stats(dpif_p, NULL);
+	assert(result == EINVAL);
+
+	create_dpdk_dp_get_reply(&reply, 10, 3, 1, 2);
+	result = enqueue_reply_on_reply_ring(reply);
+	assert(result == 0);
+
 	result = dpif_p->dpif_class->get_stats(dpif_p, &stats);
 	assert(result == 0);
-	assert(stats.n_hit == 0);
-	assert(stats.n_missed == 0);
-	assert(stats.n_lost == 0);
-	assert(stats.n_flows == 0);
+	assert(stats.n_hit == 10);
+	assert(stats.n_missed == 3);
+	assert(stats.n_lost == 1);
+	assert(stats.n_flows == 2);
+
+	/* Check the request sent to the datapath */
+	assert(rte_ring_count(vswitchd_message_ring) == 1);
+	result = rte_ring_sc_dequeue(vswitchd_message_ring, (void **)&mbuf);
+	assert(result == 0);
+	pktmbuf_data = rte_pktmbuf_mtod(mbuf, void *);
+	request = (struct dpif_dpdk_message *)pktmbuf_data;
+	assert(request->type == DPIF_DPDK_DP_FAMILY);
+	assert(request->dp_msg.cmd == OVS_DP_CMD_GET);
 	printf(" %s\n", __FUNCTION__);
 }
 
@@ -635,3 +664,53 @@ test_dpif_dpdk_flow_dump_done(struct dpif *dpif_p)
 	assert(result == EINVAL);
 	printf(" %s\n", __FUNCTION__);
 }
+
+void
+test_dpif_dpdk_recv(struct dpif *dpif_p)
+{
+	struct dpif_dpdk_upcall info;
+	struct dpif_upcall upcall;
+	struct ofpbuf buf;
+	int result = 0;
+
+	memset(&info, 0, sizeof(info));
+	info.cmd = OVS_PACKET_CMD_MISS;
+
+	/* Test null upcall */
+	result = dpif_p->dpif_class->recv(dpif_p, NULL, NULL);
+	assert(result == EINVAL);
+
+	/* Test no upcalls */
+	ofpbuf_init(&buf, 0);
+	result = dpif_p->dpif_class->recv(dpif_p, &upcall, &buf);
+	assert(result == EAGAIN);
+	ofpbuf_uninit(&buf);
+
+	/* Test upcalls are received from every packet ring */
+	result = enqueue_upcall_on_packet_ring(&info, 0, 64);
+	assert(result == 0);
+	result = enqueue_upcall_on_packet_ring(&info, VSWITCHD_PACKET_RINGS - 1, 128);
+	assert(result == 0);
+
+	ofpbuf_init(&buf, 0);
+	result = dpif_p->dpif_class->recv(dpif_p, &upcall, &buf);
+	assert(result == 0);
+	assert(upcall.type == DPIF_UC_MISS);
+	assert(upcall.packet == &buf);
+	assert(upcall.packet->size == 64 || upcall.packet->size == 128);
+	assert(upcall.key_len != 0);
+	ofpbuf_uninit(&buf);
+
+	ofpbuf_init(&buf, 0);
+	result = dpif_p->dpif_class->recv(dpif_p, &upcall, &buf);
+	assert(result == 0);
+	assert(upcall.type == DPIF_UC_MISS);
+	assert(upcall.packet->size == 64 || upcall.packet->size == 128);
+	ofpbuf_uninit(&buf);
+
+	ofpbuf_init(&buf, 0);
+	result = dpif_p->dpif_class->recv(dpif_p, &upcall, &buf);
+	assert(result == EAGAIN);
+	ofpbuf_uninit(&buf);
+	printf(" %s\n", __FUNCTION__);
+}
@@ -139,4 +139,5 @@ include utilities/bugtool/automake.mk
 
 if HAVE_DPDK
 SUBDIRS += utilities/ovs-ivshm-mngr utilities/ovs-ivshm-mngr/test
+SUBDIRS += utilities/ovs-dpdk-stats utilities/ovs-dpdk-capture
 endif
@@ -0,0 +1,442 @@
+/*
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2010-2014 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+
+#include <rte_eal.h>
+#include <rte_config.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_log.h>
+#include <rte_memzone.h>
+#include <rte_ring.h>
+#include <rte_string_fns.h>
+
+#include <capture-types.h>
+
+#define RTE_LOGTYPE_APP RTE_LOGTYPE_USER1
+#define CAPTURE_BURST 32
+/* Time to wait for the datapath to apply a configuration */
+#define CAPTURE_APPLY_TIMEOUT_MS 1000
+#define CAPTURE_IDLE_SLEEP_US 1000
+
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_LINKTYPE_ETHERNET 1
+
+#define usage(...) do {				\
+	RTE_LOG(ERR, APP, __VA_ARGS__);	\
+	print_usage();					\
+} while(0);
+
+struct pcap_file_header {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+struct pcap_record_header {
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+static struct capture_area *area = NULL;
+static struct rte_ring *capture_ring = NULL;
+static struct rte_ring *free_ring = NULL;
+
+static const char *port_name = NULL;
+static const char *file_name = NULL;
+static uint32_t dir = CAPTURE_DIR_IN | CAPTURE_DIR_OUT;
+static uint32_t sample_rate = 1;
+static uint64_t max_packets = 0;
+static struct capture_filter filter;
+
+static volatile sig_atomic_t stop = 0;
+
+static void
+print_usage(void)
+{
+	printf("\nUsage:\n"
+			"   ovs-dpdk-capture [EAL options] --proc-type=secondary --"
+			" -p PORT -w FILE [-d in|out|both] [-s RATE] [-c COUNT]"
+			" [FIELD=VALUE...]\n\n"
+			"Options:\n"
+			"   -p: name of the port to capture\n"
+			"   -w: pcap file to write, '-' for stdout\n"
+			"   -d: capture packets the switch receives from the port (in),"
+			" sends to it (out) or both (default)\n"
+			"   -s: capture one in RATE packets that pass the filter\n"
+			"   -c: stop after COUNT packets\n\n"
+			"Filter fields, all of which must match:\n"
+			"   ether_type, vlan_id, ip_proto, ip_src=A.B.C.D[/LEN],"
+			" ip_dst=A.B.C.D[/LEN], tp_src, tp_dst\n\n");
+}
+
+static int
+parse_ip(const char *value, uint32_t *ip, uint32_t *mask)
+{
+	char addr[INET_ADDRSTRLEN] = {0};
+	const char *slash = NULL;
+	struct in_addr in;
+	int len = 32;
+
+	slash = strchr(value, '/');
+	if (slash != NULL) {
+		len = atoi(slash + 1);
+		if (len < 0 || len > 32)
+			return -1;
+	}
+	rte_snprintf(addr, sizeof(addr), "%.*s",
+	             slash != NULL ? (int)(slash - value) : (int)strlen(value),
+	             value);
+	if (inet_pton(AF_INET, addr, &in) != 1)
+		return -1;
+
+	*ip = ntohl(in.s_addr);
+	*mask = len == 0 ? 0 : UINT32_MAX << (32 - len);
+	return 0;
+}
+
+/* Add a 'field=value' term to the filter */
+static int
+parse_filter(char *term)
+{
+	char *value = NULL;
+	unsigned long num = 0;
+
+	value = strchr(term, '=');
+	if (value == NULL)
+		return -1;
+	*value++ = '\0';
+	num = strtoul(value, NULL, 0);
+
+	if (!strcmp(term, "ether_type")) {
+		filter.match |= CAPTURE_MATCH_ETHER_TYPE;
+		filter.ether_type = num;
+	} else if (!strcmp(term, "vlan_id")) {
+		filter.match |= CAPTURE_MATCH_VLAN_ID;
+		filter.vlan_id = num;
+	} else if (!strcmp(term, "ip_proto")) {
+		filter.match |= CAPTURE_MATCH_IP_PROTO;
+		filter.ip_proto = num;
+	} else if (!strcmp(term, "ip_src")) {
+		filter.match |= CAPTURE_MATCH_IP_SRC;
+		return parse_ip(value, &filter.ip_src, &filter.ip_src_mask);
+	} else if (!strcmp(term, "ip_dst")) {
+		filter.match |= CAPTURE_MATCH_IP_DST;
+		return parse_ip(value, &filter.ip_dst, &filter.ip_dst_mask);
+	} else if (!strcmp(term, "tp_src")) {
+		filter.match |= CAPTURE_MATCH_TP_SRC;
+		filter.tp_src = num;
+	} else if (!strcmp(term, "tp_dst")) {
+		filter.match |= CAPTURE_MATCH_TP_DST;
+		filter.tp_dst = num;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+parse_arguments(int argc, char *argv[])
+{
+	int opt = 0;
+
+	while ((opt = getopt(argc, argv, "p:w:d:s:c:")) != -1) {
+		switch (opt) {
+		case 'p':
+			port_name = optarg;
+			break;
+		case 'w':
+			file_name = optarg;
+			break;
+		case 'd':
+			if (!strcmp(optarg, "in"))
+				dir = CAPTURE_DIR_IN;
+			else if (!strcmp(optarg, "out"))
+				dir = CAPTURE_DIR_OUT;
+			else if (!strcmp(optarg, "both"))
+				dir = CAPTURE_DIR_IN | CAPTURE_DIR_OUT;
+			else {
+				usage("Invalid direction '%s'\n", optarg);
+				return -1;
+			}
+			break;
+		case 's':
+			sample_rate = atoi(optarg);
+			break;
+		case 'c':
+			max_packets = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			usage("Invalid option\n");
+			return -1;
+		}
+	}
+
+	for (; optind < argc; optind++) {
+		if (parse_filter(argv[optind]) < 0) {
+			usage("Invalid filter term '%s'\n", argv[optind]);
+			return -1;
+		}
+	}
+
+	if (port_name == NULL || file_name == NULL) {
+		usage("A port and a file must be given\n");
+		return -1;
+	}
+	if (strnlen(port_name, VPORT_INFO_NAMESZ) == VPORT_INFO_NAMESZ) {
+		usage("Port name '%s' is too long\n", port_name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+capture_lookup(void)
+{
+	const struct rte_memzone *mz = NULL;
+
+	mz = rte_memzone_lookup(MZ_CAPTURE);
+	capture_ring = rte_ring_lookup(CAPTURE_RING_NAME);
+	free_ring = rte_ring_lookup(CAPTURE_FREE_RING_NAME);
+	if (mz == NULL || capture_ring == NULL || free_ring == NULL) {
+		RTE_LOG(ERR, APP, "Cannot find the packet capture memzone and rings\n");
+		return -1;
+	}
+
+	area = mz->addr;
+	if (area->magic != CAPTURE_MAGIC || area->version != CAPTURE_VERSION) {
+		RTE_LOG(ERR, APP, "Unsupported packet capture version %u\n",
+		        area->version);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Publish the configuration as a new generation and wait for the datapath
+ * to apply it. Returns the datapath's status, or -1 if it did not answer.
+ */
+static int
+capture_configure(int enabled)
+{
+	uint32_t generation = 0;
+	int i = 0;
+
+	area->heartbeat = rte_rdtsc();
+	area->enabled = enabled;
+	if (enabled) {
+		rte_snprintf(area->vport_name, sizeof(area->vport_name), "%s",
+		             port_name);
+		area->dir = dir;
+		area->sample_rate = sample_rate;
+		area->filter = filter;
+	}
+	rte_wmb();
+	generation = ++area->generation;
+
+	for (i = 0; i < CAPTURE_APPLY_TIMEOUT_MS; i++) {
+		if (area->applied == generation) {
+			rte_rmb();
+			return area->status;
+		}
+		usleep(1000);
+	}
+
+	RTE_LOG(ERR, APP, "The datapath did not apply the capture configuration\n");
+	return -1;
+}
+
+/* Sum the per-lcore counters of the datapath */
+static void
+capture_counts(uint64_t *captured, uint64_t *dropped)
+{
+	unsigned i = 0;
+
+	*captured = 0;
+	*dropped = 0;
+	for (i = 0; i < CAPTURE_MAX_LCORES; i++) {
+		*captured += area->lcores[i].captured;
+		*dropped += area->lcores[i].dropped;
+	}
+}
+
+/* Return the records on the capture ring to the free ring */
+static void
+capture_drain(void)
+{
+	void *recs[CAPTURE_BURST];
+	unsigned n = 0;
+
+	while ((n = rte_ring_sc_dequeue_burst(capture_ring, recs,
+	                                      CAPTURE_BURST)) > 0)
+		rte_ring_mp_enqueue_bulk(free_ring, recs, n);
+}
+
+static void
+write_record(FILE *file, const struct capture_record *rec,
+             const struct timeval *start_tv, uint64_t start_tsc)
+{
+	struct pcap_record_header hdr;
+	uint64_t us = 0;
+
+	if (rec->tsc > start_tsc)
+		us = (rec->tsc - start_tsc) * US_PER_S / area->tsc_hz;
+	us += start_tv->tv_usec;
+
+	hdr.ts_sec = start_tv->tv_sec + us / US_PER_S;
+	hdr.ts_usec = us % US_PER_S;
+	hdr.caplen = RTE_MIN(rec->caplen, (uint32_t)CAPTURE_SNAPLEN);
+	hdr.len = rec->len;
+
+	fwrite(&hdr, sizeof(hdr), 1, file);
+	fwrite(rec->data, hdr.caplen, 1, file);
+}
+
+static void
+handle_signal(int sig __rte_unused)
+{
+	stop = 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct pcap_file_header fhdr = {
+		.magic = PCAP_MAGIC,
+		.version_major = 2,
+		.version_minor = 4,
+		.snaplen = CAPTURE_SNAPLEN,
+		.linktype = PCAP_LINKTYPE_ETHERNET,
+	};
+	struct capture_record *recs[CAPTURE_BURST];
+	struct timeval start_tv;
+	uint64_t start_tsc = 0, written = 0;
+	uint64_t captured = 0, dropped = 0;
+	uint64_t end_captured = 0, end_dropped = 0;
+	FILE *file = NULL;
+	unsigned n = 0, i = 0;
+	int retval = 0;
+
+	/* Init EAL, parsing EAL args */
+	retval = rte_eal_init(argc, argv);
+	if (retval < 0)
+		return -1;
+
+	if (rte_eal_process_type() != RTE_PROC_SECONDARY)
+		rte_exit(EXIT_FAILURE, "Must be executed as secondary process\n");
+
+	argc -= retval;
+	argv += retval;
+
+	if (parse_arguments(argc, argv) < 0)
+		return -1;
+
+	if (capture_lookup() < 0)
+		return -1;
+
+	file = strcmp(file_name, "-") ? fopen(file_name, "w") : stdout;
+	if (file == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot open '%s'\n", file_name);
+	fwrite(&fhdr, sizeof(fhdr), 1, file);
+
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+
+	/* Records left by a previous capture are not ours */
+	capture_drain();
+
+	gettimeofday(&start_tv, NULL);
+	start_tsc = rte_rdtsc();
+	capture_counts(&captured, &dropped);
+	if (capture_configure(1) != 0) {
+		RTE_LOG(ERR, APP, "Cannot capture port '%s'\n", port_name);
+		capture_configure(0);
+		return -1;
+	}
+
+	while (!stop && (max_packets == 0 || written < max_packets)) {
+		/* Keep the datapath capturing */
+		area->heartbeat = rte_rdtsc();
+		if (area->status == CAPTURE_STATUS_EXPIRED) {
+			RTE_LOG(ERR, APP, "The datapath stopped the capture, as this "
+			        "process did not respond for %ums\n", CAPTURE_LEASE_MS);
+			break;
+		}
+
+		n = rte_ring_sc_dequeue_burst(capture_ring, (void **)recs,
+		                              CAPTURE_BURST);
+		if (n == 0) {
+			usleep(CAPTURE_IDLE_SLEEP_US);
+			continue;
+		}
+
+		for (i = 0; i < n; i++)
+			if (max_packets == 0 || written < max_packets) {
+				write_record(file, recs[i], &start_tv, start_tsc);
+				written++;
+			}
+		rte_ring_mp_enqueue_bulk(free_ring, (void **)recs, n);
+	}
+
+	capture_configure(0);
+	capture_drain();
+	fflush(file);
+	if (file != stdout)
+		fclose(file);
+
+	capture_counts(&end_captured, &end_dropped);
+	fprintf(stderr, "%"PRIu64" packets written, %"PRIu64" captured, "
+	        "%"PRIu64" dropped by the datapath\n", written,
+	        end_captured - captured, end_dropped - dropped);
+
+	return 0;
+}
@@ -0,0 +1,251 @@
+/*
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2010-2014 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <inttypes.h>
+
+#include <rte_eal.h>
+#include <rte_config.h>
+#include <rte_common.h>
+#include <rte_log.h>
+#include <rte_memzone.h>
+
+#include <ovs-vport.h>
+#include <stats-types.h>
+
+#define RTE_LOGTYPE_APP RTE_LOGTYPE_USER1
+
+#define usage(...) do {				\
+	RTE_LOG(ERR, APP, __VA_ARGS__);	\
+	print_usage();					\
+} while(0);
+
+static const char *cycles_names[STATS_EXPORT_CYCLES_TYPES] = {
+	"rx", "lookup", "action", "tx", "idle"
+};
+
+static const char *queue_names[] = {
+	[STATS_EXPORT_QUEUE_TX] = "tx",
+	[STATS_EXPORT_QUEUE_RX] = "rx",
+	[STATS_EXPORT_QUEUE_FREE] = "free",
+	[STATS_EXPORT_QUEUE_ALLOC] = "alloc",
+};
+
+/* Seconds between snapshots, or 0 to print one and exit */
+static unsigned interval = 0;
+/* Snapshots left to print when polling, or 0 for no limit */
+static unsigned count = 0;
+
+/* Current and previous snapshots, too big for the stack */
+static struct stats_export snapshots[2];
+
+static void
+print_usage(void)
+{
+	printf("\nUsage:\n"
+			"   ovs-dpdk-stats [EAL options] --proc-type=secondary --"
+			" [-i SECONDS] [-c COUNT]\n\n"
+			"Options:\n"
+			"   -i: print the statistics every SECONDS, with rates since"
+			" the previous snapshot\n"
+			"   -c: exit after printing COUNT snapshots\n\n");
+}
+
+static int
+parse_arguments(int argc, char *argv[])
+{
+	int opt = 0;
+
+	while ((opt = getopt(argc, argv, "i:c:")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 'c':
+			count = atoi(optarg);
+			break;
+		default:
+			usage("Invalid option\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Events per second of a counter between two snapshots */
+static uint64_t
+rate(uint64_t curr, uint64_t prev, const struct stats_export *c,
+     const struct stats_export *p)
+{
+	if (p == NULL || c->tsc <= p->tsc || curr < prev)
+		return 0;
+
+	return (curr - prev) * c->tsc_hz / (c->tsc - p->tsc);
+}
+
+static void
+print_vports(const struct stats_export *c, const struct stats_export *p)
+{
+	const struct stats_export_vport *v = NULL, *pv = NULL;
+	unsigned i = 0;
+
+	printf("%-16s %5s %5s %14s %14s %10s %10s %10s %10s %10s %10s\n",
+	       "Vport", "Id", "Lcore", "Rx", "Tx", "Rx/s", "Tx/s",
+	       "Rx Drop", "Tx Drop", "Errors", "Overrun");
+	for (i = 0; i < MAX_VPORTS; i++) {
+		v = &c->vports[i];
+		if (v->type == VPORT_TYPE_DISABLED)
+			continue;
+		pv = p != NULL ? &p->vports[i] : NULL;
+
+		printf("%-16s %5u %5u %14"PRIu64" %14"PRIu64" %10"PRIu64" %10"PRIu64
+		       " %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64"\n",
+		       v->name, i, v->lcore, v->rx, v->tx,
+		       pv != NULL ? rate(v->rx, pv->rx, c, p) : 0,
+		       pv != NULL ? rate(v->tx, pv->tx, c, p) : 0,
+		       v->rx_drop, v->tx_drop, v->rx_error + v->tx_error,
+		       v->overrun);
+	}
+}
+
+static void
+print_lcores(const struct stats_export *c)
+{
+	const struct stats_export_lcore *l = NULL;
+	uint64_t total = 0;
+	unsigned i = 0, j = 0;
+
+	printf("\n%-6s", "Lcore");
+	for (j = 0; j < STATS_EXPORT_CYCLES_TYPES; j++)
+		printf(" %7s%%", cycles_names[j]);
+	printf(" %14s %14s %12s %12s %10s\n",
+	       "Loops", "Busy Loops", "Hit", "Miss", "Lost");
+
+	for (i = 0; i < STATS_EXPORT_MAX_LCORES; i++) {
+		l = &c->lcores[i];
+		if (!l->enabled || !l->switching)
+			continue;
+
+		for (total = 0, j = 0; j < STATS_EXPORT_CYCLES_TYPES; j++)
+			total += l->cycles[j];
+
+		printf("%-6u", i);
+		for (j = 0; j < STATS_EXPORT_CYCLES_TYPES; j++)
+			printf(" %7.1f%%", total ? 100.0 * l->cycles[j] / total : 0.0);
+		printf(" %14"PRIu64" %14"PRIu64" %12"PRIu64" %12"PRIu64
+		       " %10"PRIu64"\n", l->loops, l->busy_loops, l->hit,
+		       l->miss, l->lost);
+	}
+}
+
+static void
+print_flow_table(const struct stats_export *c)
+{
+	const struct stats_export_flow_table *ft = &c->flow_table;
+
+	printf("\nFlow table: %"PRIu64"/%"PRIu64" flows (%"PRIu64" overflow), "
+	       "hit %"PRIu64", miss %"PRIu64", lost %"PRIu64"\n",
+	       ft->flows, ft->size, ft->overflow, ft->hit, ft->miss, ft->lost);
+}
+
+static void
+print_queues(const struct stats_export *c)
+{
+	const struct stats_export_queue *q = NULL;
+	unsigned i = 0;
+
+	printf("\n%-16s %6s %8s %8s\n", "Queue", "Type", "Count", "Size");
+	for (i = 0; i < c->num_queues && i < STATS_EXPORT_MAX_QUEUES; i++) {
+		q = &c->queues[i];
+		printf("%-16s %6s %8u %8u\n",
+		       q->vportid < MAX_VPORTS ? c->vports[q->vportid].name : "?",
+		       q->type < RTE_DIM(queue_names) ? queue_names[q->type] : "?",
+		       q->count, q->size);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct stats_export *curr = NULL, *prev = NULL;
+	unsigned printed = 0;
+	int retval = 0;
+
+	/* Init EAL, parsing EAL args */
+	retval = rte_eal_init(argc, argv);
+	if (retval < 0)
+		return -1;
+
+	if (rte_eal_process_type() != RTE_PROC_SECONDARY)
+		rte_exit(EXIT_FAILURE, "Must be executed as secondary process\n");
+
+	argc -= retval;
+	argv += retval;
+
+	if (parse_arguments(argc, argv) < 0)
+		return -1;
+
+	if (ovs_vport_lookup_stats_export() == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot find the exported statistics\n");
+
+	for (;;) {
+		curr = &snapshots[printed % 2];
+		if (ovs_vport_stats_snapshot(curr) < 0)
+			return -1;
+		/* The area always exists, but is never filled in if disabled */
+		if (curr->interval_ms == 0)
+			rte_exit(EXIT_FAILURE, "Statistics are not exported, "
+			         "--stats_export_interval is 0\n");
+
+		print_vports(curr, prev);
+		print_lcores(curr);
+		print_flow_table(curr);
+		print_queues(curr);
+
+		printed++;
+		if (interval == 0 || (count != 0 && printed >= count))
+			break;
+
+		printf("\n");
+		prev = curr;
+		sleep(interval);
+	}
+
+	return 0;
+}
@@ -367,6 +367,36 @@ ivshmem_mngr_share_vport_client(const char *metadata_name, const char *port_name
 				metadata_name);
 		return -1;
 	}
+
+	/* ALLOC queue */
+	ring = ovs_vport_client_lookup_alloc_q(port_name);
+	if (ring == NULL)
+		return -1;
+	if (rte_ivshmem_metadata_add_ring(ring, metadata_name) < 0) {
+		RTE_LOG(ERR, APP, "Failed adding alloc_q to metadata '%s'\n",
+				metadata_name);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Share the descriptor rings and buffers of MEMNIC port port_name with a
+ * given metadata name
+ */
+static int
+ivshmem_mngr_share_vport_memnic(const char *metadata_name, const char *port_name)
+{
+	const struct rte_memzone *mz = NULL;
+
+	mz = ovs_vport_memnic_lookup_memzone(port_name);
+	if (mz == NULL)
+		return -1;
+	if (rte_ivshmem_metadata_add_memzone(mz, metadata_name) < 0) {
+		RTE_LOG(ERR, APP, "Failed adding MEMNIC memzone to metadata '%s'\n",
+				metadata_name);
+		return -1;
+	}
 	return 0;
 }
 
@@ -381,6 +411,8 @@ ivshmem_mngr_share_object(const char *metadata_name, const char *port_name)
 		return ivshmem_mngr_share_vport_client(metadata_name, port_name);
 	else if (ovs_vport_is_vport_kni(port_name) == 0)
 		return ivshmem_mngr_share_vport_kni(metadata_name, port_name);
+	else if (ovs_vport_is_vport_memnic(port_name) == 0)
+		return ivshmem_mngr_share_vport_memnic(metadata_name, port_name);
 	else
 		RTE_LOG(ERR, APP, "Port name '%s' not found or invalid\n", port_name);
 
@@ -92,6 +92,11 @@ create_vport_client(struct vport_info *vport, const char *port_name)
 	client->free_q = create_ring(ring_name);
 	rte_snprintf(client->ring_names.free, sizeof(client->ring_names.free),
 			ring_name);
+
+	rte_snprintf(ring_name, sizeof(ring_name), "%sALLOC", port_name);
+	client->alloc_q = create_ring(ring_name);
+	rte_snprintf(client->ring_names.alloc, sizeof(client->ring_names.alloc),
+			ring_name);
 }
 
 static void